@@ -0,0 +1,328 @@
+/*
+ * Binder transaction latency under background load.
+ *
+ * A server process registers itself as the binder context manager and
+ * answers every transaction after spinning for a fixed amount of time.
+ * It runs at nice 10, so without priority inheritance its work competes
+ * with the background hogs on equal or worse terms than theirs.  A client
+ * process, optionally SCHED_FIFO, times synchronous transactions to it
+ * and reports the distribution of the round trip times, together with
+ * the scheduling policy and priority the server saw while handling them.
+ *
+ * The context manager slot must be free: stop servicemanager first.
+ * Build with
+ *
+ *	gcc -O2 -I drivers/staging/android -o binder-latency \
+ *		Documentation/android/binder-latency.c
+ *
+ * Usage: binder-latency [-n iterations] [-l hogs] [-w work_us] [-p rt_prio]
+ *
+ *   -n  number of transactions (default 10000)
+ *   -l  number of nice 0 busy loop processes (default 4)
+ *   -w  time the server spins per transaction in us (default 200)
+ *   -p  make the client SCHED_FIFO at this priority (default 0: normal)
+ *
+ * Compare runs with /sys/module/binder/parameters/inherit_rt at Y and N.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "binder.h"
+
+#define MAP_SIZE	(128 * 1024)
+
+struct reply {
+	int policy;
+	int prio;	/* sched_priority for RT, the nice value otherwise */
+};
+
+static int iterations = 10000;
+static int hogs = 4;
+static int work_us = 200;
+static int rt_prio;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int binder_open_map(void)
+{
+	int fd = open("/dev/binder", O_RDWR);
+
+	if (fd < 0) {
+		perror("/dev/binder");
+		exit(1);
+	}
+	if (mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0) == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	return fd;
+}
+
+static void binder_write(int fd, void *data, size_t len)
+{
+	struct binder_write_read bwr;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_size = len;
+	bwr.write_buffer = (unsigned long)data;
+	if (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0) {
+		perror("BINDER_WRITE_READ");
+		exit(1);
+	}
+}
+
+static void free_buffer(int fd, const void *buffer)
+{
+	struct {
+		uint32_t cmd;
+		const void *buffer;
+	} __attribute__((packed)) cmd = { BC_FREE_BUFFER, buffer };
+
+	binder_write(fd, &cmd, sizeof(cmd));
+}
+
+/*
+ * Reads until a BR_TRANSACTION or BR_REPLY arrives, copies it to @tr and
+ * returns the command, or BR_DEAD_REPLY / BR_FAILED_REPLY.
+ */
+static uint32_t binder_wait(int fd, struct binder_transaction_data *tr)
+{
+	uint32_t buf[64];
+	struct binder_write_read bwr;
+
+	for (;;) {
+		char *p, *end;
+
+		memset(&bwr, 0, sizeof(bwr));
+		bwr.read_size = sizeof(buf);
+		bwr.read_buffer = (unsigned long)buf;
+		if (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0) {
+			perror("BINDER_WRITE_READ");
+			exit(1);
+		}
+
+		p = (char *)buf;
+		end = p + bwr.read_consumed;
+		while (p < end) {
+			uint32_t cmd = *(uint32_t *)p;
+
+			p += sizeof(uint32_t);
+			switch (cmd) {
+			case BR_NOOP:
+			case BR_TRANSACTION_COMPLETE:
+			case BR_SPAWN_LOOPER:
+				break;
+			case BR_INCREFS:
+			case BR_ACQUIRE:
+			case BR_RELEASE:
+			case BR_DECREFS:
+				p += sizeof(struct binder_ptr_cookie);
+				break;
+			case BR_TRANSACTION:
+			case BR_REPLY:
+				memcpy(tr, p, sizeof(*tr));
+				return cmd;
+			case BR_DEAD_REPLY:
+			case BR_FAILED_REPLY:
+				return cmd;
+			default:
+				fprintf(stderr, "unexpected command %#x\n", cmd);
+				exit(1);
+			}
+		}
+	}
+}
+
+static void spin_us(int us)
+{
+	long long end = now_ns() + us * 1000LL;
+
+	while (now_ns() < end)
+		;
+}
+
+static void server(int ready)
+{
+	int fd = binder_open_map();
+	struct binder_transaction_data tr;
+	struct sched_param param;
+	struct reply r;
+	struct {
+		uint32_t cmd;
+		struct binder_transaction_data tr;
+	} __attribute__((packed)) reply;
+	uint32_t looper = BC_ENTER_LOOPER;
+
+	setpriority(PRIO_PROCESS, 0, 10);
+	if (ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) < 0) {
+		perror("BINDER_SET_CONTEXT_MGR (is servicemanager running?)");
+		exit(1);
+	}
+	binder_write(fd, &looper, sizeof(looper));
+	write(ready, "", 1);
+	close(ready);
+
+	for (;;) {
+		if (binder_wait(fd, &tr) != BR_TRANSACTION)
+			continue;
+
+		r.policy = sched_getscheduler(0);
+		sched_getparam(0, &param);
+		r.prio = param.sched_priority ? param.sched_priority :
+			 getpriority(PRIO_PROCESS, 0);
+		spin_us(work_us);
+
+		free_buffer(fd, tr.data.ptr.buffer);
+		if (tr.flags & TF_ONE_WAY)
+			continue;
+
+		memset(&reply, 0, sizeof(reply));
+		reply.cmd = BC_REPLY;
+		reply.tr.data_size = sizeof(r);
+		reply.tr.data.ptr.buffer = &r;
+		binder_write(fd, &reply, sizeof(reply));
+	}
+}
+
+static void hog(void)
+{
+	setpriority(PRIO_PROCESS, 0, 0);
+	for (;;)
+		;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+	struct binder_transaction_data tr;
+	struct {
+		uint32_t cmd;
+		struct binder_transaction_data tr;
+	} __attribute__((packed)) call;
+	pid_t server_pid, *hog_pids;
+	struct reply r = { -1, 0 };
+	long long *lat, sum = 0;
+	int pipefd[2], fd, opt, i;
+	char c;
+
+	while ((opt = getopt(argc, argv, "n:l:w:p:")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'l':
+			hogs = atoi(optarg);
+			break;
+		case 'w':
+			work_us = atoi(optarg);
+			break;
+		case 'p':
+			rt_prio = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n iterations] [-l hogs] "
+				"[-w work_us] [-p rt_prio]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (iterations <= 0)
+		return 1;
+
+	pipe(pipefd);
+	server_pid = fork();
+	if (!server_pid) {
+		close(pipefd[0]);
+		server(pipefd[1]);
+	}
+	close(pipefd[1]);
+	if (read(pipefd[0], &c, 1) != 1) {
+		fprintf(stderr, "server failed to start\n");
+		return 1;
+	}
+
+	hog_pids = calloc(hogs, sizeof(*hog_pids));
+	for (i = 0; i < hogs; i++) {
+		hog_pids[i] = fork();
+		if (!hog_pids[i])
+			hog();
+	}
+
+	if (rt_prio) {
+		struct sched_param param = { .sched_priority = rt_prio };
+
+		if (sched_setscheduler(0, SCHED_FIFO, &param) < 0)
+			perror("sched_setscheduler");
+	}
+
+	fd = binder_open_map();
+	lat = calloc(iterations, sizeof(*lat));
+
+	for (i = 0; i < iterations; i++) {
+		long long start;
+		uint32_t cmd;
+
+		memset(&call, 0, sizeof(call));
+		call.cmd = BC_TRANSACTION;
+		call.tr.target.handle = 0;
+		call.tr.code = 1;
+
+		start = now_ns();
+		binder_write(fd, &call, sizeof(call));
+		cmd = binder_wait(fd, &tr);
+		lat[i] = now_ns() - start;
+		if (cmd != BR_REPLY) {
+			fprintf(stderr, "transaction %d failed (%#x)\n", i, cmd);
+			break;
+		}
+		if (tr.data_size >= sizeof(r))
+			memcpy(&r, tr.data.ptr.buffer, sizeof(r));
+		free_buffer(fd, tr.data.ptr.buffer);
+		sum += lat[i];
+	}
+
+	for (i = 0; i < hogs; i++)
+		kill(hog_pids[i], SIGKILL);
+	kill(server_pid, SIGKILL);
+	while (wait(NULL) > 0)
+		;
+
+	if (!i)
+		return 1;
+	iterations = i;
+	qsort(lat, iterations, sizeof(*lat), cmp_ll);
+	printf("%d transactions, %d hogs, %d us work, client %s %d\n",
+	       iterations, hogs, work_us, rt_prio ? "SCHED_FIFO" : "nice",
+	       rt_prio);
+	printf("server ran as %s %d\n",
+	       r.policy == SCHED_FIFO ? "SCHED_FIFO" :
+	       r.policy == SCHED_RR ? "SCHED_RR" : "nice", r.prio);
+	printf("latency us: min %lld avg %lld p99 %lld max %lld\n",
+	       lat[0] / 1000, sum / iterations / 1000,
+	       lat[iterations * 99 / 100] / 1000, lat[iterations - 1] / 1000);
+
+	return 0;
+}
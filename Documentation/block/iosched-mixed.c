@@ -0,0 +1,200 @@
+/*
+ * iosched-mixed.c
+ *
+ * Read latency under a heavy buffered write load, for comparing io
+ * schedulers.
+ *
+ * A number of writer processes write a file each in 1MB chunks, calling
+ * fsync every 16MB, while the main process times random 4k O_DIRECT
+ * reads from a file it lays out first.  At the end the read latency
+ * percentiles and the write throughput are printed.
+ *
+ * Usage: iosched-mixed <file> [writers] [seconds]
+ *
+ * The writers use <file>.w0, <file>.w1, ..., which are removed when done.
+ *
+ * Compile with:
+ *	gcc -O2 -Wall -o iosched-mixed iosched-mixed.c
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define READ_FILE_SIZE	(64 << 20)
+#define READ_SIZE	4096
+#define WRITE_CHUNK	(1 << 20)
+#define FSYNC_EVERY	16		/* chunks */
+#define WRITE_FILE_MAX	(256 << 20)	/* then start over */
+#define MAX_SAMPLES	(1 << 20)
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void layout(const char *name)
+{
+	char *buf;
+	int fd, i;
+
+	buf = malloc(WRITE_CHUNK);
+	if (!buf)
+		die("malloc");
+	memset(buf, 0x5a, WRITE_CHUNK);
+
+	fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		die(name);
+	for (i = 0; i < READ_FILE_SIZE / WRITE_CHUNK; i++)
+		if (write(fd, buf, WRITE_CHUNK) != WRITE_CHUNK)
+			die("write");
+	if (fsync(fd))
+		die("fsync");
+	close(fd);
+	free(buf);
+}
+
+/* never returns; the parent kills it and reads the byte count */
+static void writer(const char *name, unsigned long long *written)
+{
+	char *buf;
+	off_t off = 0;
+	int fd, n = 0;
+
+	buf = malloc(WRITE_CHUNK);
+	if (!buf)
+		die("malloc");
+	memset(buf, 0xa5, WRITE_CHUNK);
+
+	fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		die(name);
+
+	for (;;) {
+		if (pwrite(fd, buf, WRITE_CHUNK, off) != WRITE_CHUNK)
+			die("pwrite");
+		__sync_fetch_and_add(written, WRITE_CHUNK);
+		off += WRITE_CHUNK;
+		if (off >= WRITE_FILE_MAX)
+			off = 0;
+		if (++n % FSYNC_EVERY == 0)
+			fsync(fd);
+	}
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name;
+	int writers = 4, seconds = 30;
+	unsigned long long *written;
+	double *lat, start, end;
+	char wname[4096];
+	pid_t *pids;
+	void *buf;
+	long n = 0;
+	int fd, i;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <file> [writers] [seconds]\n",
+			argv[0]);
+		return 1;
+	}
+	name = argv[1];
+	if (argc > 2)
+		writers = atoi(argv[2]);
+	if (argc > 3)
+		seconds = atoi(argv[3]);
+
+	layout(name);
+
+	lat = malloc(MAX_SAMPLES * sizeof(*lat));
+	pids = calloc(writers, sizeof(*pids));
+	written = mmap(NULL, sizeof(*written), PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (!lat || !pids || written == MAP_FAILED)
+		die("alloc");
+	if (posix_memalign(&buf, READ_SIZE, READ_SIZE))
+		die("posix_memalign");
+
+	fd = open(name, O_RDONLY | O_DIRECT);
+	if (fd < 0)
+		die(name);
+
+	for (i = 0; i < writers; i++) {
+		snprintf(wname, sizeof(wname), "%s.w%d", name, i);
+		pids[i] = fork();
+		if (pids[i] < 0)
+			die("fork");
+		if (!pids[i])
+			writer(wname, written);
+	}
+
+	/* let the dirty pages build up before measuring */
+	sleep(2);
+	*written = 0;
+
+	srandom(getpid());
+	start = now();
+	end = start + seconds;
+	while (n < MAX_SAMPLES) {
+		off_t off = (off_t)(random() % (READ_FILE_SIZE / READ_SIZE)) *
+			    READ_SIZE;
+		double t = now();
+
+		if (t >= end)
+			break;
+		if (pread(fd, buf, READ_SIZE, off) != READ_SIZE)
+			die("pread");
+		lat[n++] = now() - t;
+	}
+	end = now();
+
+	for (i = 0; i < writers; i++) {
+		kill(pids[i], SIGKILL);
+		waitpid(pids[i], NULL, 0);
+		snprintf(wname, sizeof(wname), "%s.w%d", name, i);
+		unlink(wname);
+	}
+	close(fd);
+
+	if (!n) {
+		fprintf(stderr, "no reads completed\n");
+		return 1;
+	}
+	qsort(lat, n, sizeof(*lat), cmp_double);
+
+	printf("reads %ld (%.0f/s)  p50 %.2fms  p99 %.2fms  max %.2fms\n",
+	       n, n / (end - start), lat[n / 2] * 1e3, lat[n * 99 / 100] * 1e3,
+	       lat[n - 1] * 1e3);
+	printf("writes %.1f MB/s by %d writers\n",
+	       *written / (end - start) / (1 << 20), writers);
+
+	return 0;
+}
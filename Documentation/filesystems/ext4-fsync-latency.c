@@ -0,0 +1,147 @@
+/*
+ * ext4-fsync-latency.c
+ *
+ * Append and fsync latency, for comparing an ext4 filesystem mounted
+ * with and without the fast_commit option.
+ *
+ * Appends <count> records of <size> bytes to <dir>/fsync-latency.0,
+ * each followed by fsync (or fdatasync with -d), and prints the rate and
+ * the median, 99th percentile and worst fsync latencies.  With <threads>
+ * greater than one, each thread appends to its own file so that the
+ * fsyncs compete for the journal.  The files are removed at the end.
+ *
+ * Usage: ext4-fsync-latency [-d] <dir> [count] [size] [threads]
+ *
+ * Compile with:
+ *	gcc -O2 -Wall -pthread -o ext4-fsync-latency ext4-fsync-latency.c
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_SIZE	(1 << 20)
+#define MAX_THREADS	64
+
+struct worker {
+	pthread_t thread;
+	char path[4096];
+	double *lat;
+};
+
+static int count = 10000, size = 4096, datasync;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void *run(void *arg)
+{
+	struct worker *w = arg;
+	char *buf;
+	double t;
+	int fd, i;
+
+	buf = malloc(size);
+	if (!buf)
+		die("malloc");
+	memset(buf, 'x', size);
+
+	fd = open(w->path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if (fd < 0)
+		die("create");
+	for (i = 0; i < count; i++) {
+		if (write(fd, buf, size) != size)
+			die("write");
+		t = now();
+		if (datasync ? fdatasync(fd) : fsync(fd))
+			die("fsync");
+		w->lat[i] = now() - t;
+	}
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct worker w[MAX_THREADS];
+	int nr_threads = 1, i, n;
+	double *lat, t;
+	const char *dir;
+
+	if (argc > 1 && !strcmp(argv[1], "-d")) {
+		datasync = 1;
+		argv++;
+		argc--;
+	}
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s [-d] <dir> [count] [size] "
+			"[threads]\n", argv[0]);
+		return 1;
+	}
+	dir = argv[1];
+	if (argc > 2)
+		count = atoi(argv[2]);
+	if (argc > 3)
+		size = atoi(argv[3]);
+	if (argc > 4)
+		nr_threads = atoi(argv[4]);
+	if (count <= 0 || size <= 0 || size > MAX_SIZE ||
+	    nr_threads <= 0 || nr_threads > MAX_THREADS) {
+		fprintf(stderr, "bad count, size or threads\n");
+		return 1;
+	}
+
+	n = count * nr_threads;
+	lat = malloc(n * sizeof(*lat));
+	if (!lat)
+		die("malloc");
+
+	sync();
+	t = now();
+	for (i = 0; i < nr_threads; i++) {
+		snprintf(w[i].path, sizeof(w[i].path), "%s/fsync-latency.%d",
+			 dir, i);
+		w[i].lat = lat + i * count;
+		if (pthread_create(&w[i].thread, NULL, run, &w[i]))
+			die("pthread_create");
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(w[i].thread, NULL);
+	t = now() - t;
+
+	qsort(lat, n, sizeof(*lat), cmp);
+	printf("%s: %d x %d bytes by %d thread(s) in %.2fs, %.0f/s\n",
+	       datasync ? "fdatasync" : "fsync", count, size, nr_threads,
+	       t, n / t);
+	printf("latency: median %.3fms, 99%% %.3fms, max %.3fms\n",
+	       lat[n / 2] * 1e3, lat[n * 99 / 100] * 1e3, lat[n - 1] * 1e3);
+
+	for (i = 0; i < nr_threads; i++)
+		unlink(w[i].path);
+	free(lat);
+	return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * ext4-smallfile.c
+ *
+ * Small file create and read throughput, for comparing an ext4
+ * filesystem made with and without the inline_data feature.
+ *
+ * Creates <count> files of <size> bytes spread over 100 subdirectories
+ * of <dir>, syncs, drops the page, dentry and inode caches (needs root)
+ * and reads them all back.  The create and cold read rates and the
+ * blocks used are printed, then everything is removed.
+ *
+ * Usage: ext4-smallfile <dir> [count] [size]
+ *
+ * Compile with:
+ *	gcc -O2 -Wall -o ext4-smallfile ext4-smallfile.c
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
+
+#define NR_DIRS		100
+#define MAX_SIZE	(64 << 10)
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long long used_kb(const char *dir)
+{
+	struct statvfs st;
+
+	if (statvfs(dir, &st))
+		die("statvfs");
+	return (unsigned long long)(st.f_blocks - st.f_bfree) *
+		st.f_frsize / 1024;
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3\n", 2) != 2)
+		fprintf(stderr, "cannot drop caches, read rate is warm\n");
+	if (fd >= 0)
+		close(fd);
+}
+
+static void name(char *buf, size_t len, const char *dir, int i)
+{
+	snprintf(buf, len, "%s/d%02d/f%07d", dir, i % NR_DIRS, i);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long before, after;
+	char path[4096], *buf;
+	int count = 10000, size = 200;
+	double t;
+	int fd, i;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <dir> [count] [size]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		count = atoi(argv[2]);
+	if (argc > 3)
+		size = atoi(argv[3]);
+	if (count <= 0 || size < 0 || size > MAX_SIZE) {
+		fprintf(stderr, "bad count or size\n");
+		return 1;
+	}
+
+	buf = malloc(MAX_SIZE);
+	if (!buf)
+		die("malloc");
+	memset(buf, 'x', MAX_SIZE);
+
+	sync();
+	before = used_kb(argv[1]);
+	for (i = 0; i < NR_DIRS; i++) {
+		snprintf(path, sizeof(path), "%s/d%02d", argv[1], i);
+		if (mkdir(path, 0755))
+			die("mkdir");
+	}
+
+	t = now();
+	for (i = 0; i < count; i++) {
+		name(path, sizeof(path), argv[1], i);
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd < 0)
+			die("create");
+		if (write(fd, buf, size) != size)
+			die("write");
+		close(fd);
+	}
+	sync();
+	t = now() - t;
+	after = used_kb(argv[1]);
+	printf("create: %d files of %d bytes in %.2fs, %.0f files/s\n",
+	       count, size, t, count / t);
+	printf("space:  %llu KB, %.0f bytes per file\n", after - before,
+	       (after - before) * 1024.0 / count);
+
+	drop_caches();
+	t = now();
+	for (i = 0; i < count; i++) {
+		name(path, sizeof(path), argv[1], i);
+		fd = open(path, O_RDONLY);
+		if (fd < 0)
+			die("open");
+		if (read(fd, buf, MAX_SIZE) != size)
+			die("read");
+		close(fd);
+	}
+	t = now() - t;
+	printf("read:   %.2fs, %.0f files/s\n", t, count / t);
+
+	for (i = 0; i < count; i++) {
+		name(path, sizeof(path), argv[1], i);
+		unlink(path);
+	}
+	for (i = 0; i < NR_DIRS; i++) {
+		snprintf(path, sizeof(path), "%s/d%02d", argv[1], i);
+		rmdir(path);
+	}
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,338 @@
+/*
+ * fuse-passthrough-bench.c
+ *
+ * FUSE read and write throughput with and without passthrough, or with
+ * the writeback cache.
+ *
+ * Mounts a minimal FUSE filesystem on <mountpoint>, served by a child
+ * process speaking the protocol on /dev/fuse directly, whose only file
+ * "data" is backed by <lowerdir>/fuse-bench.dat.  Writes <mb> megabytes
+ * to it in <bs> byte writes, then reads them back, and prints both
+ * rates.  With -p the daemon opens the file with FOPEN_PASSTHROUGH and
+ * the kernel reads and writes the lower file itself; without, every
+ * request goes through the daemon.  With -w the daemon asks for the
+ * writeback cache and for requests of up to 1MB instead, and the write
+ * rate includes the final flush of the cached pages at close.  The
+ * lower file stays in the page cache, so what is compared is the cost
+ * of the FUSE round trips.
+ *
+ * Needs root, to mount, and with -p to register the lower file.
+ *
+ * Usage: fuse-passthrough-bench [-p|-w] <lowerdir> <mountpoint> [mb] [bs]
+ *
+ * Compile against the headers of this kernel (make headers_install):
+ *	gcc -O2 -Wall -I usr/include -o fuse-passthrough-bench \
+ *		fuse-passthrough-bench.c
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <linux/fuse.h>
+
+#define DATA_INO	2
+#define MAX_WRITE	(1 << 20)
+#define BUF_SIZE	(MAX_WRITE + 4096)
+
+static int passthrough, writeback;
+static char lower[4096];
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_attr(struct fuse_attr *attr, uint64_t ino)
+{
+	struct stat st;
+
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = ino;
+	attr->nlink = 1;
+	if (ino == FUSE_ROOT_ID) {
+		attr->mode = S_IFDIR | 0755;
+		attr->nlink = 2;
+		return;
+	}
+	if (stat(lower, &st))
+		die("stat");
+	attr->mode = S_IFREG | 0644;
+	attr->size = st.st_size;
+	attr->blocks = st.st_blocks;
+	attr->mtime = st.st_mtime;
+	attr->ctime = st.st_ctime;
+	attr->blksize = 4096;
+}
+
+/* Returns -1 if the request is gone */
+static int reply(int dev, struct fuse_in_header *in, int error,
+		 const void *arg, size_t len)
+{
+	struct fuse_out_header out;
+	struct iovec iov[2];
+
+	out.len = sizeof(out) + (error ? 0 : len);
+	out.error = error;
+	out.unique = in->unique;
+	iov[0].iov_base = &out;
+	iov[0].iov_len = sizeof(out);
+	iov[1].iov_base = (void *)arg;
+	iov[1].iov_len = error ? 0 : len;
+	/* the opener may have been killed, ENOENT is fine */
+	if (writev(dev, iov, 2) < 0) {
+		if (errno != ENOENT)
+			die("reply");
+		return -1;
+	}
+	return 0;
+}
+
+/* Answers requests until the filesystem is unmounted */
+static void serve(int dev)
+{
+	static char buf[BUF_SIZE], data[MAX_WRITE];
+	struct fuse_in_header *in = (struct fuse_in_header *)buf;
+	void *arg = buf + sizeof(*in);
+	struct fuse_init_in *init_in;
+	struct fuse_init_out init_out;
+	struct fuse_entry_out entry;
+	struct fuse_attr_out attr;
+	struct fuse_open_in *open_in;
+	struct fuse_open_out open_out;
+	struct fuse_read_in *read_in;
+	struct fuse_write_in *write_in;
+	struct fuse_write_out write_out;
+	struct fuse_setattr_in *setattr_in;
+	ssize_t n;
+	int fd;
+
+	for (;;) {
+		n = read(dev, buf, sizeof(buf));
+		if (n < 0 && (errno == EINTR || errno == ENOENT))
+			continue;
+		if (n < 0 && errno == ENODEV)
+			return;
+		if (n < (ssize_t)sizeof(*in))
+			die("read /dev/fuse");
+
+		switch (in->opcode) {
+		case FUSE_INIT:
+			init_in = arg;
+			memset(&init_out, 0, sizeof(init_out));
+			init_out.major = FUSE_KERNEL_VERSION;
+			init_out.minor = FUSE_KERNEL_MINOR_VERSION;
+			init_out.max_readahead = init_in->max_readahead;
+			init_out.flags = FUSE_ASYNC_READ | FUSE_BIG_WRITES;
+			init_out.max_write = 128 << 10;
+			if (passthrough)
+				init_out.flags |= FUSE_PASSTHROUGH;
+			if (writeback) {
+				init_out.flags |= FUSE_WRITEBACK_CACHE |
+						  FUSE_MAX_PAGES;
+				init_out.max_write = MAX_WRITE;
+				init_out.max_pages = MAX_WRITE / 4096;
+			}
+			reply(dev, in, 0, &init_out, sizeof(init_out));
+			break;
+		case FUSE_LOOKUP:
+			if (in->nodeid != FUSE_ROOT_ID || strcmp(arg, "data")) {
+				reply(dev, in, -ENOENT, NULL, 0);
+				break;
+			}
+			memset(&entry, 0, sizeof(entry));
+			entry.nodeid = DATA_INO;
+			fill_attr(&entry.attr, DATA_INO);
+			reply(dev, in, 0, &entry, sizeof(entry));
+			break;
+		case FUSE_SETATTR:
+			setattr_in = arg;
+			if ((setattr_in->valid & FATTR_SIZE) &&
+			    truncate(lower, setattr_in->size))
+				die("truncate");
+			/* fall through */
+		case FUSE_GETATTR:
+			memset(&attr, 0, sizeof(attr));
+			fill_attr(&attr.attr, in->nodeid);
+			reply(dev, in, 0, &attr, sizeof(attr));
+			break;
+		case FUSE_OPEN:
+			open_in = arg;
+			fd = open(lower, open_in->flags & O_ACCMODE);
+			if (fd < 0) {
+				reply(dev, in, -errno, NULL, 0);
+				break;
+			}
+			memset(&open_out, 0, sizeof(open_out));
+			open_out.fh = fd;
+			if (passthrough) {
+				struct fuse_passthrough_out pt = { .fd = fd };
+				int id;
+
+				id = ioctl(dev, FUSE_DEV_IOC_PASSTHROUGH_OPEN,
+					   &pt);
+				if (id < 0)
+					die("FUSE_DEV_IOC_PASSTHROUGH_OPEN");
+				open_out.open_flags = FOPEN_PASSTHROUGH;
+				open_out.passthrough_fh = id;
+			}
+			if (reply(dev, in, 0, &open_out, sizeof(open_out)) &&
+			    open_out.passthrough_fh) {
+				__u32 id = open_out.passthrough_fh;
+
+				/* nobody claimed it */
+				ioctl(dev, FUSE_DEV_IOC_PASSTHROUGH_CLOSE, &id);
+			}
+			break;
+		case FUSE_READ:
+			read_in = arg;
+			n = pread(read_in->fh, data, read_in->size,
+				  read_in->offset);
+			reply(dev, in, n < 0 ? -errno : 0, data, n);
+			break;
+		case FUSE_WRITE:
+			write_in = arg;
+			n = pwrite(write_in->fh, (char *)(write_in + 1),
+				   write_in->size, write_in->offset);
+			memset(&write_out, 0, sizeof(write_out));
+			write_out.size = n;
+			reply(dev, in, n < 0 ? -errno : 0, &write_out,
+			      sizeof(write_out));
+			break;
+		case FUSE_RELEASE:
+			close(((struct fuse_release_in *)arg)->fh);
+			/* fall through */
+		case FUSE_FLUSH:
+		case FUSE_FSYNC:
+			reply(dev, in, 0, NULL, 0);
+			break;
+		case FUSE_FORGET:
+		case FUSE_BATCH_FORGET:
+			break;
+		default:
+			reply(dev, in, -ENOSYS, NULL, 0);
+			break;
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	long long mb = 256, total, done;
+	int bs = 128 << 10;
+	char path[4096], opts[256], *buf;
+	const char *mode;
+	double t;
+	pid_t pid;
+	int dev, fd, status;
+	ssize_t n;
+
+	if (argc > 1 && !strcmp(argv[1], "-p")) {
+		passthrough = 1;
+		argv++;
+		argc--;
+	} else if (argc > 1 && !strcmp(argv[1], "-w")) {
+		writeback = 1;
+		argv++;
+		argc--;
+	}
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s [-p|-w] <lowerdir> <mountpoint> "
+			"[mb] [bs]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 3)
+		mb = atoll(argv[3]);
+	if (argc > 4)
+		bs = atoi(argv[4]);
+	if (mb <= 0 || bs <= 0) {
+		fprintf(stderr, "bad mb or bs\n");
+		return 1;
+	}
+	total = mb << 20;
+	mode = passthrough ? "passthrough" : writeback ? "writeback" : "daemon";
+
+	snprintf(lower, sizeof(lower), "%s/fuse-bench.dat", argv[1]);
+	fd = open(lower, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		die("create lower file");
+	close(fd);
+
+	dev = open("/dev/fuse", O_RDWR);
+	if (dev < 0)
+		die("/dev/fuse");
+	snprintf(opts, sizeof(opts), "fd=%d,rootmode=40000,user_id=0,"
+		 "group_id=0,allow_other", dev);
+	if (mount("fuse-bench", argv[2], "fuse", MS_NOSUID | MS_NODEV, opts))
+		die("mount");
+
+	pid = fork();
+	if (pid < 0)
+		die("fork");
+	if (!pid) {
+		serve(dev);
+		_exit(0);
+	}
+	close(dev);
+
+	buf = malloc(bs);
+	if (!buf)
+		die("malloc");
+	memset(buf, 'x', bs);
+	snprintf(path, sizeof(path), "%s/data", argv[2]);
+
+	t = now();
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		die("open for write");
+	for (done = 0; done < total; done += n) {
+		n = write(fd, buf, bs);
+		if (n <= 0)
+			die("write");
+	}
+	close(fd);
+	t = now() - t;
+	printf("%s write: %lld MB in %.2fs, %.0f MB/s\n", mode, mb, t, mb / t);
+
+	/* A new open drops the fuse page cache, the lower one stays */
+	t = now();
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		die("open for read");
+	for (done = 0; (n = read(fd, buf, bs)) > 0; done += n)
+		;
+	if (n < 0)
+		die("read");
+	close(fd);
+	t = now() - t;
+	printf("%s read:  %lld MB in %.2fs, %.0f MB/s\n", mode, done >> 20, t,
+	       (done >> 20) / t);
+
+	if (umount2(argv[2], MNT_DETACH))
+		perror("umount");
+	kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+	unlink(lower);
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * squashfs-parallel-read.c
+ *
+ * Read throughput of a mounted Squashfs filesystem with parallel readers,
+ * for comparing the decompressor options, or a kernel before and after.
+ *
+ * Reads every regular file under <dir> once, with <threads> threads
+ * taking the files in turn, in <bs> byte reads, and prints the rate.  The
+ * page cache is dropped first (which needs root), so that what is
+ * measured is the reading and decompressing of the blocks; run it with
+ * one thread and then with as many as there are CPUs.
+ *
+ * Usage: squashfs-parallel-read <dir> [threads] [bs]
+ *
+ * Compile with:
+ *	gcc -O2 -Wall -pthread -o squashfs-parallel-read \
+ *		squashfs-parallel-read.c
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS	64
+
+static char **files;
+static int nr_files, max_files, next_file, bs = 128 << 10;
+static long long total;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int add_file(const char *path, const struct stat *st, int type,
+		    struct FTW *ftw)
+{
+	if (type != FTW_F || !S_ISREG(st->st_mode))
+		return 0;
+	if (nr_files == max_files) {
+		max_files = max_files ? max_files * 2 : 1024;
+		files = realloc(files, max_files * sizeof(*files));
+		if (!files)
+			die("realloc");
+	}
+	files[nr_files] = strdup(path);
+	if (!files[nr_files++])
+		die("strdup");
+	return 0;
+}
+
+static void *run(void *arg)
+{
+	long long done = 0;
+	char *buf;
+	ssize_t n;
+	int fd, i;
+
+	buf = malloc(bs);
+	if (!buf)
+		die("malloc");
+
+	for (;;) {
+		pthread_mutex_lock(&lock);
+		i = next_file++;
+		pthread_mutex_unlock(&lock);
+		if (i >= nr_files)
+			break;
+
+		fd = open(files[i], O_RDONLY);
+		if (fd < 0)
+			die(files[i]);
+		while ((n = read(fd, buf, bs)) > 0)
+			done += n;
+		if (n < 0)
+			die(files[i]);
+		close(fd);
+	}
+
+	pthread_mutex_lock(&lock);
+	total += done;
+	pthread_mutex_unlock(&lock);
+	free(buf);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t thread[MAX_THREADS];
+	int nr_threads = 1, i, fd;
+	double t;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <dir> [threads] [bs]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		nr_threads = atoi(argv[2]);
+	if (argc > 3)
+		bs = atoi(argv[3]);
+	if (nr_threads <= 0 || nr_threads > MAX_THREADS || bs <= 0) {
+		fprintf(stderr, "bad threads or bs\n");
+		return 1;
+	}
+
+	if (nftw(argv[1], add_file, 64, FTW_PHYS))
+		die("nftw");
+	if (!nr_files) {
+		fprintf(stderr, "no files under %s\n", argv[1]);
+		return 1;
+	}
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3", 1) != 1)
+		die("drop caches");
+	close(fd);
+
+	t = now();
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&thread[i], NULL, run, NULL))
+			die("pthread_create");
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(thread[i], NULL);
+	t = now() - t;
+
+	printf("%d file(s), %lld MB by %d thread(s) in %.2fs, %.0f MB/s\n",
+	       nr_files, total >> 20, nr_threads, t, (total >> 20) / t);
+
+	for (i = 0; i < nr_files; i++)
+		free(files[i]);
+	free(files);
+	return 0;
+}
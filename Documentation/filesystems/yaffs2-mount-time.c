@@ -0,0 +1,141 @@
+/*
+ * yaffs2-mount-time.c
+ *
+ * Time taken to mount a yaffs2 filesystem by scanning the flash, with and
+ * without the block summaries.
+ *
+ * Fills the yaffs2 filesystem on <mtdblock> with <mb> megabytes of 1MB
+ * files (nothing is written if mb is 0), then mounts and unmounts it
+ * <count> times with "no-checkpoint", so that every mount scans the flash
+ * as after an unclean shutdown, and as many times with "no-checkpoint,
+ * no-summary", which scans the tags of every chunk.  Prints the median
+ * mount time of each.  The files are written with summaries on, so that
+ * the blocks holding them have one.
+ *
+ * nandsim can stand in for the flash, e.g. 256MB of 2KB pages in 128KB
+ * blocks:
+ *	modprobe nandsim first_id_byte=0x20 second_id_byte=0xaa \
+ *		third_id_byte=0x00 fourth_id_byte=0x15
+ *	modprobe mtdblock
+ *	flash_erase /dev/mtd0 0 0
+ *	yaffs2-mount-time /dev/mtdblock0 /mnt 200
+ *
+ * Needs root, to mount.
+ *
+ * Usage: yaffs2-mount-time <mtdblock> <mountpoint> [mb] [count]
+ *
+ * Compile with:
+ *	gcc -O2 -Wall -o yaffs2-mount-time yaffs2-mount-time.c
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mount.h>
+
+#define MAX_COUNT	100
+
+static const char *dev, *dir;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void fill(int mb)
+{
+	char path[4096], *buf;
+	int fd, i;
+
+	buf = malloc(1 << 20);
+	if (!buf)
+		die("malloc");
+	memset(buf, 'x', 1 << 20);
+
+	if (mount(dev, dir, "yaffs2", 0, NULL))
+		die("mount");
+	for (i = 0; i < mb; i++) {
+		snprintf(path, sizeof(path), "%s/mount-time.%d", dir, i);
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			die("create");
+		if (write(fd, buf, 1 << 20) != 1 << 20)
+			die("write");
+		if (fsync(fd))
+			die("fsync");
+		close(fd);
+	}
+	if (umount(dir))
+		die("umount");
+	free(buf);
+}
+
+/* Returns the median time to mount with opts */
+static double time_mounts(const char *opts, int count)
+{
+	double t[MAX_COUNT];
+	int i;
+
+	for (i = 0; i < count; i++) {
+		t[i] = now();
+		if (mount(dev, dir, "yaffs2", 0, opts))
+			die("mount");
+		t[i] = now() - t[i];
+		if (umount(dir))
+			die("umount");
+	}
+	qsort(t, count, sizeof(*t), cmp);
+	return t[count / 2];
+}
+
+int main(int argc, char **argv)
+{
+	int mb = 0, count = 5;
+	double with, without;
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <mtdblock> <mountpoint> [mb] "
+			"[count]\n", argv[0]);
+		return 1;
+	}
+	dev = argv[1];
+	dir = argv[2];
+	if (argc > 3)
+		mb = atoi(argv[3]);
+	if (argc > 4)
+		count = atoi(argv[4]);
+	if (mb < 0 || count <= 0 || count > MAX_COUNT) {
+		fprintf(stderr, "bad mb or count\n");
+		return 1;
+	}
+
+	if (mb)
+		fill(mb);
+
+	with = time_mounts("no-checkpoint", count);
+	without = time_mounts("no-checkpoint,no-summary", count);
+
+	printf("scan with summaries:    %.3fs\n", with);
+	printf("scan without summaries: %.3fs\n", without);
+	return 0;
+}
@@ -0,0 +1,189 @@
+/*
+ * Multi-threaded page fault microbenchmark.
+ *
+ * Each worker thread repeatedly maps a private region, touches every page
+ * and unmaps it again, counting the faults it takes.  Optionally another
+ * thread keeps calling mmap/munmap on an unrelated region, which takes
+ * mmap_sem for writing and, without speculative page faults, stalls all
+ * the workers' faults behind it.
+ *
+ * Usage: fault-bench [-t threads] [-s seconds] [-m MB] [-f file] [-w]
+ *
+ *   -t  number of faulting threads (default 4)
+ *   -s  run time in seconds (default 10)
+ *   -m  size of each thread's region in MB (default 16)
+ *   -f  map this file read-only instead of anonymous memory
+ *   -w  run an extra thread doing mmap/munmap in a loop
+ *
+ * The spf_attempt/spf_abort deltas from /proc/vmstat are printed when the
+ * kernel has CONFIG_SPECULATIVE_PAGE_FAULT.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+static volatile int stop;
+static size_t region_size = 16UL << 20;
+static int file_fd = -1;
+static long page_size;
+
+struct worker {
+	pthread_t thread;
+	unsigned long faults;
+};
+
+static void *fault_thread(void *arg)
+{
+	struct worker *w = arg;
+	volatile char *p;
+	size_t off;
+	char sum = 0;
+
+	while (!stop) {
+		if (file_fd >= 0)
+			p = mmap(NULL, region_size, PROT_READ, MAP_PRIVATE,
+				 file_fd, 0);
+		else
+			p = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		for (off = 0; off < region_size && !stop; off += page_size) {
+			if (file_fd >= 0)
+				sum += p[off];
+			else
+				p[off] = 1;
+			w->faults++;
+		}
+		munmap((void *)p, region_size);
+	}
+	return (void *)(long)sum;
+}
+
+static void *mmap_thread(void *arg)
+{
+	unsigned long *ops = arg;
+	void *p;
+
+	while (!stop) {
+		p = mmap(NULL, page_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p != MAP_FAILED)
+			munmap(p, page_size);
+		(*ops)++;
+	}
+	return NULL;
+}
+
+static unsigned long vmstat(const char *name)
+{
+	char key[64];
+	unsigned long val;
+	FILE *f = fopen("/proc/vmstat", "r");
+
+	if (!f)
+		return 0;
+	while (fscanf(f, "%63s %lu", key, &val) == 2) {
+		if (!strcmp(key, name)) {
+			fclose(f);
+			return val;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int nr_threads = 4, seconds = 10, mmapper = 0;
+	unsigned long total = 0, mmap_ops = 0, attempt, abort_;
+	struct worker *workers;
+	struct timeval start, end;
+	pthread_t mthread;
+	double elapsed;
+	struct stat st;
+	int opt, i;
+
+	page_size = sysconf(_SC_PAGESIZE);
+
+	while ((opt = getopt(argc, argv, "t:s:m:f:w")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'm':
+			region_size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'f':
+			file_fd = open(optarg, O_RDONLY);
+			if (file_fd < 0 || fstat(file_fd, &st)) {
+				perror(optarg);
+				return 1;
+			}
+			if ((size_t)st.st_size < region_size)
+				region_size = st.st_size & ~(page_size - 1);
+			break;
+		case 'w':
+			mmapper = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-s seconds] "
+				"[-m MB] [-f file] [-w]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (nr_threads < 1 || !region_size) {
+		fprintf(stderr, "nothing to do\n");
+		return 1;
+	}
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		return 1;
+
+	attempt = vmstat("spf_attempt");
+	abort_ = vmstat("spf_abort");
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_create(&workers[i].thread, NULL, fault_thread,
+			       &workers[i]);
+	if (mmapper)
+		pthread_create(&mthread, NULL, mmap_thread, &mmap_ops);
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].faults;
+	}
+	if (mmapper)
+		pthread_join(mthread, NULL);
+	gettimeofday(&end, NULL);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_usec - start.tv_usec) / 1e6;
+
+	printf("threads        %d (%s)\n", nr_threads,
+	       file_fd >= 0 ? "file" : "anon");
+	printf("faults         %lu\n", total);
+	printf("faults/sec     %.0f\n", total / elapsed);
+	printf("per thread/sec %.0f\n", total / elapsed / nr_threads);
+	if (mmapper)
+		printf("mmap+munmap/s  %.0f\n", mmap_ops / elapsed);
+	printf("spf_attempt    %lu\n", vmstat("spf_attempt") - attempt);
+	printf("spf_abort      %lu\n", vmstat("spf_abort") - abort_);
+	return 0;
+}
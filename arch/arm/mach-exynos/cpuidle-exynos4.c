@@ -357,6 +357,29 @@ static int exynos4_check_operation(void)
 	return 0;
 }
 
+/*
+ * The checks above cost a dozen register reads and calls into the audio
+ * and BT drivers on every low power entry.  A busy verdict is kept for
+ * busy_hold_ms, during which AFTR is used without asking again.  An idle
+ * verdict is never reused: entering LPA with a device active is unsafe.
+ */
+static unsigned int busy_hold_ms = 20;
+module_param_named(busy_hold_ms, busy_hold_ms, uint, 0644);
+
+static unsigned long busy_seen_at = INITIAL_JIFFIES;
+
+static int exynos4_check_operation_cached(void)
+{
+	if (jiffies - busy_seen_at < msecs_to_jiffies(busy_hold_ms))
+		return 1;
+
+	if (!exynos4_check_operation())
+		return 0;
+
+	busy_seen_at = jiffies;
+	return 1;
+}
+
 static struct sleep_save exynos4_aftr_save[] = {
 	/* CMU side */
 	SAVE_ITEM(S5P_CLKSRC_AUDSS),
@@ -761,7 +784,7 @@ static int exynos4_check_entermode(void)
 	if (!mask)
 		return 0;
 
-	if ((mask & ENABLE_LPA) && !exynos4_check_operation())
+	if ((mask & ENABLE_LPA) && !exynos4_check_operation_cached())
 		ret = S5P_CHECK_LPA;
 	else if (mask & ENABLE_AFTR)
 		ret = S5P_CHECK_DIDLE;
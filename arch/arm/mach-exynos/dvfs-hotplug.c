@@ -13,6 +13,7 @@
 #include <linux/sched.h>
 #include <linux/cpufreq.h>
 #include <linux/cpu.h>
+#include <linux/moduleparam.h>
 #include <linux/err.h>
 #include <linux/notifier.h>
 #include <linux/reboot.h>
@@ -31,6 +32,10 @@ static unsigned int freq_min = -1UL;
 
 static unsigned int can_hotplug;
 
+/* park idle cores instead of unplugging them (CONFIG_CPU_PARKING) */
+static bool park_cpus;
+module_param_named(park, park_cpus, bool, 0644);
+
 static void exynos4_integrated_dvfs_hotplug(unsigned int freq_old,
 					unsigned int freq_new)
 {
@@ -39,27 +44,27 @@ static void exynos4_integrated_dvfs_hotplug(unsigned int freq_old,
 
 	if ((freq_old >= freq_in_trg) && (freq_new >= freq_in_trg)) {
 		if (soc_is_exynos4412()) {
-			if (cpu_online(3) == 0) {
+			if (cpu_usable(3) == 0) {
 				if (consecutv_highestlevel_cnt >= 5) {
-					cpu_up(3);
+					cpu_core_up(3);
 					consecutv_highestlevel_cnt = 0;
 				}
-			} else if (cpu_online(2) == 0) {
+			} else if (cpu_usable(2) == 0) {
 				if (consecutv_highestlevel_cnt >= 5) {
-					cpu_up(2);
+					cpu_core_up(2);
 					consecutv_highestlevel_cnt = 0;
 				}
-			} else if (cpu_online(1) == 0) {
+			} else if (cpu_usable(1) == 0) {
 				if (consecutv_highestlevel_cnt >= 5) {
-					cpu_up(1);
+					cpu_core_up(1);
 					consecutv_highestlevel_cnt = 0;
 				}
 			}
 			consecutv_highestlevel_cnt++;
 		} else {
-			if (cpu_online(1) == 0) {
+			if (cpu_usable(1) == 0) {
 				if (consecutv_highestlevel_cnt >= 5) {
-					cpu_up(1);
+					cpu_core_up(1);
 					consecutv_highestlevel_cnt = 0;
 				}
 			}
@@ -67,29 +72,29 @@ static void exynos4_integrated_dvfs_hotplug(unsigned int freq_old,
 		}
 	} else if ((freq_old <= freq_min) && (freq_new <= freq_min)) {
 		if (soc_is_exynos4412()) {
-			if (cpu_online(1) == 1) {
+			if (cpu_usable(1) == 1) {
 				if (consecutv_lowestlevel_cnt >= 5) {
-					cpu_down(1);
+					cpu_core_down(1, park_cpus);
 					consecutv_lowestlevel_cnt = 0;
 				} else
 					consecutv_lowestlevel_cnt++;
-			} else if (cpu_online(2) == 1) {
+			} else if (cpu_usable(2) == 1) {
 				if (consecutv_lowestlevel_cnt >= 5) {
-					cpu_down(2);
+					cpu_core_down(2, park_cpus);
 					consecutv_lowestlevel_cnt = 0;
 				} else
 					consecutv_lowestlevel_cnt++;
-			} else if (cpu_online(3) == 1) {
+			} else if (cpu_usable(3) == 1) {
 				if (consecutv_lowestlevel_cnt >= 5) {
-					cpu_down(3);
+					cpu_core_down(3, park_cpus);
 					consecutv_lowestlevel_cnt = 0;
 				} else
 					consecutv_lowestlevel_cnt++;
 			}
 		} else {
-			if (cpu_online(1) == 1) {
+			if (cpu_usable(1) == 1) {
 				if (consecutv_lowestlevel_cnt >= 5) {
-					cpu_down(1);
+					cpu_core_down(1, park_cpus);
 					consecutv_lowestlevel_cnt = 0;
 				} else
 					consecutv_lowestlevel_cnt++;
@@ -13,6 +13,7 @@
 #include <linux/sched.h>
 #include <linux/cpufreq.h>
 #include <linux/cpu.h>
+#include <linux/moduleparam.h>
 #include <linux/err.h>
 #include <linux/notifier.h>
 #include <linux/reboot.h>
@@ -36,6 +37,10 @@ static unsigned int freq_in_trg;		/* frequency hotplug in trigger */
 static unsigned int freq_out_trg;		/* frequency hotplug out trigger */
 static unsigned int can_hotplug;
 
+/* park idle cores instead of unplugging them (CONFIG_CPU_PARKING) */
+static bool park_cpus;
+module_param_named(park, park_cpus, bool, 0644);
+
 static void exynos4_integrated_dvfs_hotplug(unsigned int freq_old,
 					unsigned int freq_new)
 {
@@ -84,38 +89,38 @@ static void exynos4_integrated_dvfs_hotplug(unsigned int freq_old,
 		ctn_freq_out_trg_cnt = 0;
 
 	if (soc_is_exynos4412()) {
-		if ((cpu_online(3) == 0) && (nr_running() >= 2) &&
+		if ((cpu_usable(3) == 0) && (nr_running() >= 2) &&
 		   ((freq_old >= freq_in_trg) && (freq_new >= freq_in_trg))) {
 			if ((ctn_nr_running_over2 >= 4) &&
 			   (ctn_freq_in_trg_cnt >= 5)) {
 				/* over 400ms for nr_running(), over 500ms for frequency, tunnable */
-				cpu_up(3);
+				cpu_core_up(3);
 				ctn_freq_in_trg_cnt = 0;
 			}
-		} else if ((cpu_online(2) == 0) && (nr_running() >= 3) &&
+		} else if ((cpu_usable(2) == 0) && (nr_running() >= 3) &&
 			  ((freq_old >= freq_in_trg) && (freq_new >= freq_in_trg))) {
 			if ((ctn_nr_running_over3 >= 4) &&
 			   (ctn_freq_in_trg_cnt >= 5)) {
 				/* over 400ms for nr_running(), over 500ms for frequency, tunnable */
-				cpu_up(2);
+				cpu_core_up(2);
 				ctn_freq_in_trg_cnt = 0;
 			}
-		} else if ((cpu_online(1) == 0) && (nr_running() >= 4) &&
+		} else if ((cpu_usable(1) == 0) && (nr_running() >= 4) &&
 			  ((freq_old >= freq_in_trg) && (freq_new >= freq_in_trg))) {
 			if ((ctn_nr_running_over4 >= 8) &&
 			   (ctn_freq_in_trg_cnt >= 5)) {
 				/* over 800ms for nr_running(), over 500ms for frequency, tunnable */
-				cpu_up(1);
+				cpu_core_up(1);
 				ctn_freq_in_trg_cnt = 0;
 			}
 		}
 	} else {
-		if ((cpu_online(1) == 0) && ((freq_old >= freq_in_trg) &&
+		if ((cpu_usable(1) == 0) && ((freq_old >= freq_in_trg) &&
 		   (freq_new >= freq_in_trg))) {
 			if ((ctn_nr_running_over2 >= 8) &&
 			   (ctn_freq_in_trg_cnt >= 5)) {
 				/* over 800ms  for nr_running(), over 500ms for frequency, tunnable */
-				cpu_up(1);
+				cpu_core_up(1);
 				ctn_nr_running_over2 = 0;
 				ctn_freq_in_trg_cnt = 0;
 			}
@@ -123,38 +128,38 @@ static void exynos4_integrated_dvfs_hotplug(unsigned int freq_old,
 	}
 
 	if (soc_is_exynos4412()) {
-		if ((cpu_online(1) == 1) && (nr_running() < 4) &&
+		if ((cpu_usable(1) == 1) && (nr_running() < 4) &&
 		   ((freq_old <= freq_out_trg) && (freq_new <= freq_out_trg))) {
 			if ((ctn_nr_running_under4 >= 8) &&
 			   (ctn_freq_out_trg_cnt >= 5)) {
 				/* over 800ms for nr_running(), over 500ms for frequency, tunnable */
-				cpu_down(1);
+				cpu_core_down(1, park_cpus);
 				ctn_freq_out_trg_cnt = 0;
 			}
-		} else if ((cpu_online(2) == 1) && (nr_running() < 3) &&
+		} else if ((cpu_usable(2) == 1) && (nr_running() < 3) &&
 			  ((freq_old <= freq_out_trg) && (freq_new <= freq_out_trg))) {
 			if ((ctn_nr_running_under3 >= 8) &&
 			   (ctn_freq_out_trg_cnt >= 5)) {
 				/* over 800ms for nr_running(), over 500ms for frequency, tunnable */
-				cpu_down(2);
+				cpu_core_down(2, park_cpus);
 				ctn_freq_out_trg_cnt = 0;
 			}
-		} else if ((cpu_online(3) == 1) && (nr_running() < 2) &&
+		} else if ((cpu_usable(3) == 1) && (nr_running() < 2) &&
 			  ((freq_old <= freq_out_trg) && (freq_new <= freq_out_trg))) {
 			if ((ctn_nr_running_under2 >= 8) &&
 			   (ctn_freq_out_trg_cnt >= 5)) {
 				/* over 800ms for nr_running(), over 500ms for frequency, tunnable */
-				cpu_down(3);
+				cpu_core_down(3, park_cpus);
 				ctn_freq_out_trg_cnt = 0;
 			}
 		}
 	} else {
-		if ((cpu_online(1) == 1) &&
+		if ((cpu_usable(1) == 1) &&
 		   ((freq_old <= freq_out_trg) && (freq_new <= freq_out_trg))) {
 			if ((ctn_nr_running_under2 >= 8) &&
 			   (ctn_freq_out_trg_cnt >= 5)) {
 				/* over 800ms for nr_running(), over 500ms for frequency, tunnable */
-				cpu_down(1);
+				cpu_core_down(1, park_cpus);
 				ctn_nr_running_under2 = 0;
 				ctn_freq_out_trg_cnt = 0;
 			}
@@ -13,6 +13,7 @@
 #include <linux/sched.h>
 #include <linux/cpufreq.h>
 #include <linux/cpu.h>
+#include <linux/moduleparam.h>
 #include <linux/err.h>
 #include <linux/notifier.h>
 #include <linux/reboot.h>
@@ -32,35 +33,43 @@ static unsigned int freq_max;
 static unsigned int freq_in_trg;
 static unsigned int freq_min;
 static unsigned int can_hotplug;
+static struct nr_running_avg nr_avg;		/* runqueue depth since last transition */
+
+/* park idle cores instead of unplugging them (CONFIG_CPU_PARKING) */
+static bool park_cpus;
+module_param_named(park, park_cpus, bool, 0644);
 
 static void exynos4_integrated_dvfs_hotplug(unsigned int freq_old,
 					unsigned int freq_new)
 {
+	/* time-weighted number of runnable tasks, in units of 1/100 */
+	unsigned int nr_run = sched_get_nr_running_avg(-1, &nr_avg);
+
 	total_num_target_freq++;
 	freq_in_trg = 800000;
 
-	if (nr_running() <= 1) {
+	if (nr_run <= 100) {
 		ctn_nr_running_over2 = 0;
 		ctn_nr_running_over3 = 0;
 		ctn_nr_running_over4 = 0;
 		ctn_nr_running_under2++;
 		ctn_nr_running_under3++;
 		ctn_nr_running_under4++;
-	} else if ((nr_running() > 1) && (nr_running() <= 2)) {
+	} else if ((nr_run > 100) && (nr_run <= 200)) {
 		ctn_nr_running_over2++;
 		ctn_nr_running_over3 = 0;
 		ctn_nr_running_over4 = 0;
 		ctn_nr_running_under2 = 0;
 		ctn_nr_running_under3++;
 		ctn_nr_running_under4++;
-	} else if ((nr_running() > 2) && (nr_running() <= 3)) {
+	} else if ((nr_run > 200) && (nr_run <= 300)) {
 		ctn_nr_running_over2++;
 		ctn_nr_running_over3++;
 		ctn_nr_running_over4 = 0;
 		ctn_nr_running_under2 = 0;
 		ctn_nr_running_under3 = 0;
 		ctn_nr_running_under4++;
-	} else if (nr_running() > 3) {
+	} else if (nr_run > 300) {
 		ctn_nr_running_over2++;
 		ctn_nr_running_over3++;
 		ctn_nr_running_over4++;
@@ -70,45 +79,45 @@ static void exynos4_integrated_dvfs_hotplug(unsigned int freq_old,
 	}
 
 	if (soc_is_exynos4412()) {
-		if ((cpu_online(3) == 0) && (nr_running() >= 2)) {
+		if ((cpu_usable(3) == 0) && (nr_run >= 200)) {
 			if (ctn_nr_running_over2 >= 4) {		/* over 400ms, tunnable */
-				cpu_up(3);
+				cpu_core_up(3);
 			}
-		} else if ((cpu_online(2) == 0) && (nr_running() >= 3)) {
+		} else if ((cpu_usable(2) == 0) && (nr_run >= 300)) {
 			if (ctn_nr_running_over3 >= 4) {		/* over 400ms, tunnable */
-				cpu_up(2);
+				cpu_core_up(2);
 			}
-		} else if ((cpu_online(1) == 0) && (nr_running() >= 4)) {
+		} else if ((cpu_usable(1) == 0) && (nr_run >= 400)) {
 			if (ctn_nr_running_over4 >= 8) {		/* over 800ms, tunnable */
-				cpu_up(1);
+				cpu_core_up(1);
 			}
 		}
 	} else {
-		if (cpu_online(1) == 0) {
+		if (cpu_usable(1) == 0) {
 			if (ctn_nr_running_over2 >= 8) {		/* over 800ms, tunnable */
-				cpu_up(1);
+				cpu_core_up(1);
 				ctn_nr_running_over2 = 0;
 			}
 		}
 	} /* end of else */
 	if (soc_is_exynos4412()) {
-		if ((cpu_online(1) == 1) && (nr_running() < 4)) {
+		if ((cpu_usable(1) == 1) && (nr_run < 400)) {
 			if (ctn_nr_running_under4 >= 8) {		/* over 800ms, tunnable */
-				cpu_down(1);
+				cpu_core_down(1, park_cpus);
 			}
-		} else if ((cpu_online(2) == 1) && (nr_running() < 3)) {
+		} else if ((cpu_usable(2) == 1) && (nr_run < 300)) {
 			if (ctn_nr_running_under3 >= 8) {		/* over 800ms, tunnable */
-				cpu_down(2);
+				cpu_core_down(2, park_cpus);
 			}
-		} else if ((cpu_online(3) == 1) && (nr_running() < 2)) {
+		} else if ((cpu_usable(3) == 1) && (nr_run < 200)) {
 			if (ctn_nr_running_under2 >= 8) {		/* over 800ms, tunnable */
-				cpu_down(3);
+				cpu_core_down(3, park_cpus);
 			}
 		}
 	} else {
-		if (cpu_online(1) == 1) {
+		if (cpu_usable(1) == 1) {
 			if (ctn_nr_running_under2 >= 8) {		/* over 800ms, tunnable */
-				cpu_down(1);
+				cpu_core_down(1, park_cpus);
 				ctn_nr_running_under2 = 0;
 			}
 		}
@@ -141,6 +150,7 @@ static int hotplug_pm_transition(struct notifier_block *nb,
 		break;
 	case PM_POST_RESTORE:
 	case PM_POST_SUSPEND:
+		memset(&nr_avg, 0, sizeof(nr_avg));
 		can_hotplug = 1;
 		break;
 	}
@@ -63,6 +63,9 @@ static unsigned int trans_load_l = TRANS_LOAD_L;
 module_param_named(loadl, trans_load_l, uint, 0644);
 static unsigned int trans_load_h = TRANS_LOAD_H;
 module_param_named(loadh, trans_load_h, uint, 0644);
+/* park idle cores instead of unplugging them (CONFIG_CPU_PARKING) */
+static bool park_cpus;
+module_param_named(park, park_cpus, bool, 0644);
 
 struct cpu_time_info {
 	cputime64_t prev_cpu_idle;
@@ -108,23 +111,25 @@ static void hotplug_timer(struct work_struct *work)
 
 		tmp_info->load = 100 * (wall_time - idle_time) / wall_time;
 
-		load += tmp_info->load;
+		/* a parked cpu is idle by design, don't let it dilute */
+		if (cpu_usable(i))
+			load += tmp_info->load;
 	}
 
-	avg_load = load / num_online_cpus();
+	avg_load = load / num_usable_cpus();
 
 	cur_freq = clk_get_rate(clk_get(NULL, "armclk")) / 1000;
 
 	if (((avg_load < trans_load_l) || (cur_freq <= LOWLEVEL_FREQ)) &&
-	    (cpu_online(1) == 1)) {
+	    (cpu_usable(1) == 1)) {
 		DBG_PRINT("cpu1 turning off!\n");
-		cpu_down(1);
+		cpu_core_down(1, park_cpus);
 		DBG_PRINT("cpu1 off end!\n");
 		hotpluging_rate = CHECK_DELAY;
 	} else if (((avg_load > trans_load_h) && (cur_freq > LOWLEVEL_FREQ)) &&
-		   (cpu_online(1) == 0)) {
+		   (cpu_usable(1) == 0)) {
 		DBG_PRINT("cpu1 turning on!\n");
-		cpu_up(1);
+		cpu_core_up(1);
 		DBG_PRINT("cpu1 on end!\n");
 		hotpluging_rate = CHECK_DELAY * 4;
 	}
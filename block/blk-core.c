@@ -33,6 +33,8 @@
 #include <trace/events/block.h>
 
 #include "blk.h"
+#include "blk-mq.h"
+#include "blk-wbt.h"
 
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_bio_remap);
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_rq_remap);
@@ -55,7 +57,7 @@ struct kmem_cache *blk_requestq_cachep;
  */
 static struct workqueue_struct *kblockd_workqueue;
 
-static void drive_stat_acct(struct request *rq, int new_io)
+void drive_stat_acct(struct request *rq, int new_io)
 {
 	struct hd_struct *part;
 	int rw = rq_data_dir(rq);
@@ -286,6 +288,8 @@ void blk_sync_queue(struct request_queue *q)
 {
 	del_timer_sync(&q->timeout);
 	cancel_delayed_work_sync(&q->delay_work);
+	if (q->mq_ops)
+		blk_mq_sync_queue(q);
 }
 EXPORT_SYMBOL(blk_sync_queue);
 
@@ -1035,6 +1039,7 @@ void __blk_put_request(struct request_queue *q, struct request *req)
 		return;
 
 	elv_completed_request(q, req);
+	blk_wbt_done(q, req);
 
 	/* this is a bio leak */
 	WARN_ON(req->bio != NULL);
@@ -1210,6 +1215,7 @@ static int __make_request(struct request_queue *q, struct bio *bio)
 	struct blk_plug *plug;
 	int el_ret, rw_flags, where = ELEVATOR_INSERT_SORT;
 	struct request *req;
+	bool wb_tracked;
 
 	/*
 	 * low level driver can indicate that it wants pages above a
@@ -1258,11 +1264,24 @@ get_rq:
 	if (sync)
 		rw_flags |= REQ_SYNC;
 
+	/*
+	 * Background writeback first waits for a throttling slot, without
+	 * the queue lock.
+	 */
+	wb_tracked = blk_wbt_should_throttle(q, bio);
+	if (wb_tracked) {
+		spin_unlock_irq(q->queue_lock);
+		blk_wbt_wait(q);
+		spin_lock_irq(q->queue_lock);
+	}
+
 	/*
 	 * Grab a free request. This is might sleep but can not fail.
 	 * Returns with the queue unlocked.
 	 */
 	req = get_request_wait(q, rw_flags, bio);
+	if (wb_tracked)
+		req->cmd_flags |= REQ_WB_TRACKED;
 
 	/*
 	 * After dropping the lock and possibly sleeping here, our request
@@ -1773,8 +1792,34 @@ static void blk_account_io_completion(struct request *req, unsigned int bytes)
 	}
 }
 
-static void blk_account_io_done(struct request *req)
+/*
+ * Flushes and discards would only blur the histograms of the data
+ * requests; they are left out.
+ */
+static void blk_account_io_hist(struct request *req)
+{
+	struct blk_io_hist __percpu *hist = req->q->io_hist;
+	const int rw = rq_data_dir(req);
+	u64 usecs;
+	int lat, size;
+
+	if (!hist || !req->issue_time_ns || req->cmd_type != REQ_TYPE_FS ||
+	    (req->cmd_flags & (REQ_DISCARD | REQ_FLUSH_SEQ)))
+		return;
+
+	usecs = div_u64(ktime_to_ns(ktime_get()) - req->issue_time_ns,
+			NSEC_PER_USEC);
+	lat = min(fls64(usecs), BLK_HIST_LAT_BUCKETS - 1);
+	size = min(fls(req->issue_bytes >> 10), BLK_HIST_SIZE_BUCKETS - 1);
+
+	irqsafe_cpu_inc(hist->lat[rw][lat]);
+	irqsafe_cpu_inc(hist->size[rw][size]);
+}
+
+void blk_account_io_done(struct request *req)
 {
+	blk_account_io_hist(req);
+
 	/*
 	 * Account IO completion.  flush_rq isn't accounted as a
 	 * normal IO on queueing nor completion.  Accounting the
@@ -1945,6 +1990,7 @@ void blk_start_request(struct request *req)
 	if (unlikely(blk_bidi_rq(req)))
 		req->next_rq->resid_len = blk_rq_bytes(req->next_rq);
 
+	blk_rq_set_issue(req);
 	blk_add_timer(req);
 }
 EXPORT_SYMBOL(blk_start_request);
@@ -0,0 +1,125 @@
+/*
+ * Tag allocation for multi-queue devices
+ *
+ * Each hardware queue has a bitmap of tags, one per preallocated
+ * request.  Every cpu remembers where it last found a free tag and
+ * starts searching there, so that cpus sharing a hardware queue mostly
+ * touch different words of the map.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bitops.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+
+#include "blk-mq-tag.h"
+
+struct blk_mq_tags {
+	unsigned int		nr_tags;
+	unsigned long		*map;
+	unsigned int __percpu	*hint;		/* where to search next */
+	wait_queue_head_t	wait;
+};
+
+static unsigned int __blk_mq_find_tag(struct blk_mq_tags *tags,
+				      unsigned int start, unsigned int end)
+{
+	unsigned int tag = start;
+
+	for (;;) {
+		tag = find_next_zero_bit(tags->map, end, tag);
+		if (tag >= end)
+			return BLK_MQ_TAG_FAIL;
+		if (!test_and_set_bit(tag, tags->map))
+			return tag;
+		tag++;
+	}
+}
+
+/**
+ * blk_mq_get_tag - allocate a free tag
+ * @tags: the tag map
+ *
+ * Returns BLK_MQ_TAG_FAIL if all tags are in use; the caller can sleep
+ * in blk_mq_wait_for_tags() and retry.
+ */
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags)
+{
+	unsigned int start = this_cpu_read(*tags->hint);
+	unsigned int tag;
+
+	if (start >= tags->nr_tags)
+		start = 0;
+
+	tag = __blk_mq_find_tag(tags, start, tags->nr_tags);
+	if (tag == BLK_MQ_TAG_FAIL && start)
+		tag = __blk_mq_find_tag(tags, 0, start);
+
+	if (tag != BLK_MQ_TAG_FAIL)
+		this_cpu_write(*tags->hint, tag + 1);
+
+	return tag;
+}
+
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	BUG_ON(tag >= tags->nr_tags);
+
+	clear_bit(tag, tags->map);
+	smp_mb__after_clear_bit();
+
+	if (waitqueue_active(&tags->wait))
+		wake_up(&tags->wait);
+}
+
+/*
+ * Sleep until a tag has been freed, or return at once if one is free
+ */
+void blk_mq_wait_for_tags(struct blk_mq_tags *tags)
+{
+	DEFINE_WAIT(wait);
+
+	prepare_to_wait_exclusive(&tags->wait, &wait, TASK_UNINTERRUPTIBLE);
+	if (bitmap_full(tags->map, tags->nr_tags))
+		io_schedule();
+	finish_wait(&tags->wait, &wait);
+}
+
+ssize_t blk_mq_tag_sysfs_show(struct blk_mq_tags *tags, char *page)
+{
+	unsigned int used = bitmap_weight(tags->map, tags->nr_tags);
+
+	return sprintf(page, "nr_tags=%u, nr_free=%u\n", tags->nr_tags,
+		       tags->nr_tags - used);
+}
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node)
+{
+	struct blk_mq_tags *tags;
+
+	tags = kzalloc_node(sizeof(*tags), GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->map = kzalloc_node(BITS_TO_LONGS(nr_tags) * sizeof(long),
+				 GFP_KERNEL, node);
+	tags->hint = alloc_percpu(unsigned int);
+	if (!tags->map || !tags->hint) {
+		blk_mq_free_tags(tags);
+		return NULL;
+	}
+
+	tags->nr_tags = nr_tags;
+	init_waitqueue_head(&tags->wait);
+
+	return tags;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	free_percpu(tags->hint);
+	kfree(tags->map);
+	kfree(tags);
+}
@@ -0,0 +1,654 @@
+/*
+ * Multi-queue request path
+ *
+ * Devices that can take requests from all cpus at once, or simply do
+ * not benefit from sorting, do not need the single q->queue_lock and
+ * the elevator.  Here a bio becomes a request on the software queue of
+ * the submitting cpu, taken from the preallocated requests of the
+ * hardware queue that cpu maps to, and the hardware queue is run at
+ * once for sync io or from kblockd otherwise.  Running it collects the
+ * requests of all its software queues and hands them to the driver's
+ * ->queue_rq one at a time, without any lock held.
+ *
+ * Merging is limited to appending a bio to one of the last few
+ * requests still waiting on the software queue.  Flush and FUA are not
+ * supported: the driver must not call blk_queue_flush(), so that
+ * generic_make_request() drops those flags.  There are no request
+ * timeouts either.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/cpumask.h>
+#include <linux/init.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
+#include <linux/workqueue.h>
+
+#include <trace/events/block.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+#include "blk-mq-tag.h"
+#include "blk-wbt.h"
+
+/* requests at the tail of a software queue a bio may be merged with */
+#define BLK_MQ_MERGE_DEPTH	8
+
+static struct blk_mq_ctx *blk_mq_get_ctx(struct request_queue *q)
+{
+	return per_cpu_ptr(q->queue_ctx, get_cpu());
+}
+
+static void blk_mq_put_ctx(struct blk_mq_ctx *ctx)
+{
+	put_cpu();
+}
+
+/**
+ * blk_mq_map_queue - default cpu to hardware queue mapping
+ * @q: the queue
+ * @cpu: the cpu
+ *
+ * The cpus are spread evenly over the hardware queues, neighbouring
+ * cpus sharing a queue.
+ */
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+static void blk_mq_update_queue_map(struct request_queue *q)
+{
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu)
+		q->mq_map[cpu] = cpu * q->nr_hw_queues / nr_cpu_ids;
+}
+
+static bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
+{
+	return !bitmap_empty(hctx->ctx_map, hctx->nr_ctx) ||
+		!list_empty_careful(&hctx->dispatch);
+}
+
+static struct request *blk_mq_alloc_rq(struct blk_mq_hw_ctx *hctx,
+				       struct blk_mq_ctx *ctx,
+				       unsigned int rw_flags)
+{
+	struct request *rq;
+	unsigned int tag;
+
+	tag = blk_mq_get_tag(hctx->tags);
+	if (tag == BLK_MQ_TAG_FAIL)
+		return NULL;
+
+	rq = hctx->rqs[tag];
+	blk_rq_init(hctx->queue, rq);
+	rq->tag = tag;
+	rq->mq_ctx = ctx;
+	rq->cmd_flags = rw_flags;
+	if (blk_queue_io_stat(hctx->queue))
+		rq->cmd_flags |= REQ_IO_STAT;
+
+	return rq;
+}
+
+/**
+ * blk_mq_free_request - give a request back to its hardware queue
+ * @rq: the request
+ *
+ * Only for ->end_io handlers; blk_mq_end_io() frees requests without one.
+ */
+void blk_mq_free_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
+
+	blk_wbt_done(q, rq);
+	blk_mq_put_tag(hctx->tags, rq->tag);
+}
+EXPORT_SYMBOL(blk_mq_free_request);
+
+/**
+ * blk_mq_end_io - end all io on a request
+ * @rq: the request
+ * @error: %0 for success, < %0 for error
+ *
+ * May be called from any context.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		BUG();
+
+	blk_account_io_done(rq);
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static void blk_mq_softirq_done(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	if (q->mq_ops->complete)
+		q->mq_ops->complete(rq);
+	else
+		blk_mq_end_io(rq, rq->errors);
+}
+
+/**
+ * blk_mq_complete_request - end a request from the block softirq
+ * @rq: the request
+ *
+ * Like blk_complete_request(), completes @rq on the cpu that submitted
+ * it, through ->complete or blk_mq_end_io().
+ */
+void blk_mq_complete_request(struct request *rq)
+{
+	blk_complete_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_complete_request);
+
+static bool blk_mq_rq_merge_ok(struct request *rq, struct bio *bio)
+{
+	if (!rq_mergeable(rq))
+		return false;
+
+	if (!!(bio->bi_rw & REQ_DISCARD) != !!(rq->cmd_flags & REQ_DISCARD))
+		return false;
+
+	if (bio_data_dir(bio) != rq_data_dir(rq))
+		return false;
+
+	if (rq->rq_disk != bio->bi_bdev->bd_disk || rq->special)
+		return false;
+
+	if ((rq->cmd_flags & REQ_FAILFAST_MASK) !=
+	    (bio->bi_rw & REQ_FAILFAST_MASK))
+		return false;
+
+	if (bio_integrity(bio) != blk_integrity_rq(rq))
+		return false;
+
+	return blk_rq_pos(rq) + blk_rq_sectors(rq) == bio->bi_sector;
+}
+
+/*
+ * Append @bio to one of the requests last queued on @ctx.
+ */
+static bool blk_mq_attempt_merge(struct request_queue *q,
+				 struct blk_mq_ctx *ctx, struct bio *bio)
+{
+	struct request *rq;
+	int checked = BLK_MQ_MERGE_DEPTH;
+	bool merged = false;
+
+	spin_lock(&ctx->lock);
+	list_for_each_entry_reverse(rq, &ctx->rq_list, queuelist) {
+		if (!checked--)
+			break;
+
+		if (!blk_mq_rq_merge_ok(rq, bio))
+			continue;
+
+		if (ll_back_merge_fn(q, rq, bio)) {
+			trace_block_bio_backmerge(q, bio);
+
+			rq->biotail->bi_next = bio;
+			rq->biotail = bio;
+			rq->__data_len += bio->bi_size;
+			rq->ioprio = ioprio_best(rq->ioprio, bio_prio(bio));
+
+			drive_stat_acct(rq, 0);
+			ctx->rq_merged++;
+			merged = true;
+		}
+		break;
+	}
+	spin_unlock(&ctx->lock);
+
+	return merged;
+}
+
+static void blk_mq_start_request(struct request *rq)
+{
+	trace_block_rq_issue(rq->q, rq);
+	rq->cmd_flags |= REQ_STARTED;
+	blk_rq_set_issue(rq);
+}
+
+/*
+ * Hand everything queued for @hctx to the driver.  Requests the driver
+ * is too busy for go back on the dispatch list, ahead of the software
+ * queues, until it restarts the queue.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	unsigned int queued = 0;
+	int bit;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	hctx->run++;
+
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		clear_bit(bit, hctx->ctx_map);
+		ctx = hctx->ctxs[bit];
+
+		spin_lock(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock(&ctx->lock);
+	}
+
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	while (!list_empty(&rq_list)) {
+		int ret;
+
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		blk_mq_start_request(rq);
+
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		if (ret == BLK_MQ_RQ_QUEUE_OK) {
+			queued++;
+			continue;
+		}
+
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY) {
+			trace_block_rq_requeue(q, rq);
+			rq->cmd_flags &= ~REQ_STARTED;
+			list_add(&rq->queuelist, &rq_list);
+			break;
+		}
+
+		if (ret != BLK_MQ_RQ_QUEUE_ERROR)
+			pr_err("blk-mq: bad return on queue: %d\n", ret);
+		rq->errors = -EIO;
+		blk_mq_end_io(rq, rq->errors);
+	}
+
+	if (!queued)
+		hctx->dispatched[0]++;
+	else
+		hctx->dispatched[min_t(unsigned int, ilog2(queued) + 1,
+				       BLK_MQ_MAX_DISPATCH_ORDER - 1)]++;
+
+	if (!list_empty(&rq_list)) {
+		spin_lock(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock(&hctx->lock);
+	}
+}
+
+/**
+ * blk_mq_run_hw_queue - dispatch the requests queued for a hardware queue
+ * @hctx: the hardware queue
+ * @async: leave it to kblockd
+ *
+ * Must be called from process context unless @async.
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (!async)
+		__blk_mq_run_hw_queue(hctx);
+	else
+		kblockd_schedule_delayed_work(hctx->queue, &hctx->run_work, 0);
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!blk_mq_hctx_has_pending(hctx))
+			continue;
+
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+/**
+ * blk_mq_stop_hw_queue - stop dispatching to a hardware queue
+ * @hctx: the hardware queue
+ *
+ * For drivers that ran out of resources; requests keep being queued
+ * until blk_mq_start_stopped_hw_queues() is called.
+ */
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	cancel_delayed_work(&hctx->run_work);
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+/**
+ * blk_mq_start_stopped_hw_queues - restart stopped hardware queues
+ * @q: the queue
+ *
+ * May be called from any context; the queues are run from kblockd.
+ */
+void blk_mq_start_stopped_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+		blk_mq_run_hw_queue(hctx, true);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+static void blk_mq_run_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, run_work.work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+/*
+ * Get a request for @bio on the current cpu's software queue, with
+ * preemption disabled.  When the hardware queue is out of tags, its
+ * requests are dispatched and we wait for one to complete.
+ */
+static struct request *blk_mq_get_request(struct request_queue *q,
+					  struct bio *bio,
+					  struct blk_mq_hw_ctx **hctxp)
+{
+	unsigned int rw_flags = bio_data_dir(bio);
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+
+	if (rw_is_sync(bio->bi_rw))
+		rw_flags |= REQ_SYNC;
+
+	for (;;) {
+		ctx = blk_mq_get_ctx(q);
+		hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+		trace_block_getrq(q, bio, rw_flags & 1);
+		rq = blk_mq_alloc_rq(hctx, ctx, rw_flags);
+		if (rq)
+			break;
+
+		blk_mq_put_ctx(ctx);
+		trace_block_sleeprq(q, bio, rw_flags & 1);
+		blk_mq_run_hw_queue(hctx, false);
+		blk_mq_wait_for_tags(hctx->tags);
+	}
+
+	*hctxp = hctx;
+	return rq;
+}
+
+static int blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	const bool is_sync = rw_is_sync(bio->bi_rw);
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	bool wb_tracked;
+
+	blk_queue_bounce(q, &bio);
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	if ((hctx->flags & BLK_MQ_F_SHOULD_MERGE) && !blk_queue_nomerges(q) &&
+	    blk_mq_attempt_merge(q, ctx, bio)) {
+		blk_mq_put_ctx(ctx);
+		return 0;
+	}
+	blk_mq_put_ctx(ctx);
+
+	wb_tracked = blk_wbt_should_throttle(q, bio);
+	if (wb_tracked)
+		blk_wbt_wait(q);
+
+	rq = blk_mq_get_request(q, bio, &hctx);
+	ctx = rq->mq_ctx;
+
+	init_request_from_bio(rq, bio);
+	if (wb_tracked)
+		rq->cmd_flags |= REQ_WB_TRACKED;
+	if (test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags) ||
+	    bio_flagged(bio, BIO_CPU_AFFINE))
+		rq->cpu = blk_cpu_to_group(ctx->cpu);
+	drive_stat_acct(rq, 1);
+
+	trace_block_rq_insert(q, rq);
+
+	spin_lock(&ctx->lock);
+	list_add_tail(&rq->queuelist, &ctx->rq_list);
+	set_bit(ctx->index_hw, hctx->ctx_map);
+	spin_unlock(&ctx->lock);
+
+	atomic_long_inc(&hctx->queued);
+	blk_mq_put_ctx(ctx);
+
+	blk_mq_run_hw_queue(hctx, !is_sync);
+	return 0;
+}
+
+static void blk_mq_exit_hw_ctx(struct request_queue *q,
+			       struct blk_mq_hw_ctx *hctx)
+{
+	if (test_and_clear_bit(BLK_MQ_S_INITIALIZED, &hctx->state) &&
+	    q->mq_ops->exit_hctx)
+		q->mq_ops->exit_hctx(hctx, hctx->queue_num);
+}
+
+static void blk_mq_free_hw_ctx(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	if (hctx->rqs) {
+		for (i = 0; i < hctx->queue_depth; i++)
+			kfree(hctx->rqs[i]);
+		kfree(hctx->rqs);
+	}
+	if (hctx->tags)
+		blk_mq_free_tags(hctx->tags);
+	kfree(hctx->ctx_map);
+	kfree(hctx->ctxs);
+	free_cpumask_var(hctx->cpumask);
+	kfree(hctx);
+}
+
+static int blk_mq_init_hw_ctx(struct request_queue *q,
+			      struct blk_mq_hw_ctx *hctx,
+			      struct blk_mq_reg *reg, void *driver_data)
+{
+	size_t rq_size = sizeof(struct request) + reg->cmd_size;
+	int node = reg->numa_node;
+	unsigned int i;
+	int ret;
+
+	spin_lock_init(&hctx->lock);
+	INIT_LIST_HEAD(&hctx->dispatch);
+	hctx->queue = q;
+	hctx->flags = reg->flags;
+	hctx->queue_depth = reg->queue_depth;
+
+	hctx->ctxs = kzalloc_node(hctx->nr_ctx * sizeof(void *), GFP_KERNEL,
+				  node);
+	hctx->ctx_map = kzalloc_node(BITS_TO_LONGS(hctx->nr_ctx) *
+				     sizeof(long), GFP_KERNEL, node);
+	hctx->tags = blk_mq_init_tags(hctx->queue_depth, node);
+	hctx->rqs = kzalloc_node(hctx->queue_depth * sizeof(void *),
+				 GFP_KERNEL, node);
+	if (!hctx->ctxs || !hctx->ctx_map || !hctx->tags || !hctx->rqs)
+		return -ENOMEM;
+
+	for (i = 0; i < hctx->queue_depth; i++) {
+		hctx->rqs[i] = kzalloc_node(rq_size, GFP_KERNEL, node);
+		if (!hctx->rqs[i])
+			return -ENOMEM;
+	}
+
+	if (reg->ops->init_hctx) {
+		ret = reg->ops->init_hctx(hctx, driver_data, hctx->queue_num);
+		if (ret)
+			return ret;
+	}
+	set_bit(BLK_MQ_S_INITIALIZED, &hctx->state);
+
+	return 0;
+}
+
+/**
+ * blk_mq_init_queue - set up a multi-queue device
+ * @reg: the hardware queues and driver operations
+ * @driver_data: passed to ->init_hctx and stored in q->queuedata
+ *
+ * The queue is freed by blk_cleanup_queue() as usual, once the driver
+ * has completed all requests.  Returns an ERR_PTR on failure.
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct request_queue *q;
+	unsigned int i;
+	int ret = -ENOMEM;
+
+	if (!reg->nr_hw_queues || !reg->ops->queue_rq ||
+	    !reg->ops->map_queue || !reg->queue_depth ||
+	    reg->queue_depth > BLK_MQ_MAX_DEPTH)
+		return ERR_PTR(-EINVAL);
+
+	if (reg->nr_hw_queues > nr_cpu_ids)
+		reg->nr_hw_queues = nr_cpu_ids;
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		return ERR_PTR(-ENOMEM);
+
+	/* from here on blk_cleanup_queue() frees what has been set up */
+	q->mq_ops = reg->ops;
+	q->queuedata = driver_data;
+
+	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
+	q->queue_hw_ctx = kzalloc_node(reg->nr_hw_queues * sizeof(void *),
+				       GFP_KERNEL, reg->numa_node);
+	q->mq_map = kzalloc_node(nr_cpu_ids * sizeof(unsigned int),
+				 GFP_KERNEL, reg->numa_node);
+	if (!q->queue_ctx || !q->queue_hw_ctx || !q->mq_map)
+		goto err;
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		hctx = kzalloc_node(sizeof(*hctx), GFP_KERNEL, reg->numa_node);
+		if (!hctx || !zalloc_cpumask_var(&hctx->cpumask, GFP_KERNEL)) {
+			kfree(hctx);
+			goto err;
+		}
+		INIT_DELAYED_WORK(&hctx->run_work, blk_mq_run_work_fn);
+		hctx->queue_num = i;
+		q->queue_hw_ctx[i] = hctx;
+		q->nr_hw_queues++;
+	}
+
+	blk_mq_update_queue_map(q);
+
+	/* count the software queues of each hardware queue first */
+	for_each_possible_cpu(i) {
+		struct blk_mq_ctx *ctx = per_cpu_ptr(q->queue_ctx, i);
+
+		memset(ctx, 0, sizeof(*ctx));
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+		ctx->cpu = i;
+		ctx->queue = q;
+
+		hctx = q->mq_ops->map_queue(q, i);
+		cpumask_set_cpu(i, hctx->cpumask);
+		ctx->index_hw = hctx->nr_ctx++;
+	}
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		ret = blk_mq_init_hw_ctx(q, hctx, reg, driver_data);
+		if (ret)
+			goto err_exit;
+	}
+
+	for_each_possible_cpu(i) {
+		struct blk_mq_ctx *ctx = per_cpu_ptr(q->queue_ctx, i);
+
+		hctx = q->mq_ops->map_queue(q, i);
+		hctx->ctxs[ctx->index_hw] = ctx;
+	}
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	blk_queue_softirq_done(q, blk_mq_softirq_done);
+	q->nr_requests = reg->queue_depth;
+	q->queue_flags |= QUEUE_FLAG_MQ_DEFAULT;
+
+	return q;
+
+err_exit:
+	/* the driver may free what ->init_hctx used once we return */
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_exit_hw_ctx(q, hctx);
+err:
+	blk_cleanup_queue(q);
+	return ERR_PTR(ret);
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+void blk_mq_sync_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		cancel_delayed_work_sync(&hctx->run_work);
+}
+
+void blk_mq_free_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		blk_mq_exit_hw_ctx(q, hctx);
+		blk_mq_free_hw_ctx(hctx);
+	}
+
+	kfree(q->queue_hw_ctx);
+	kfree(q->mq_map);
+	free_percpu(q->queue_ctx);
+
+	q->queue_hw_ctx = NULL;
+	q->nr_hw_queues = 0;
+}
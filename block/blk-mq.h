@@ -0,0 +1,38 @@
+#ifndef INT_BLK_MQ_H
+#define INT_BLK_MQ_H
+
+/*
+ * The software queue of a multi-queue device, one per cpu.  Requests
+ * wait here until the hardware queue the cpu maps to is run.
+ */
+struct blk_mq_ctx {
+	struct {
+		spinlock_t		lock;
+		struct list_head	rq_list;
+	} ____cacheline_aligned_in_smp;
+
+	unsigned int		cpu;
+	unsigned int		index_hw;	/* bit in hctx->ctx_map */
+
+	unsigned long		rq_merged;
+
+	struct request_queue	*queue;
+};
+
+#ifdef CONFIG_BLK_MQ
+void blk_mq_sync_queue(struct request_queue *q);
+void blk_mq_free_queue(struct request_queue *q);
+
+/*
+ * sysfs helpers
+ */
+int blk_mq_register_disk(struct gendisk *disk);
+void blk_mq_unregister_disk(struct gendisk *disk);
+#else
+static inline void blk_mq_sync_queue(struct request_queue *q) { }
+static inline void blk_mq_free_queue(struct request_queue *q) { }
+static inline int blk_mq_register_disk(struct gendisk *disk) { return 0; }
+static inline void blk_mq_unregister_disk(struct gendisk *disk) { }
+#endif
+
+#endif
@@ -9,6 +9,8 @@
 #include <linux/blktrace_api.h>
 
 #include "blk.h"
+#include "blk-mq.h"
+#include "blk-wbt.h"
 
 struct queue_sysfs_entry {
 	struct attribute attr;
@@ -78,6 +80,8 @@ queue_requests_store(struct request_queue *q, const char *page, size_t count)
 		wake_up(&rl->wait[BLK_RW_ASYNC]);
 	}
 	spin_unlock_irq(q->queue_lock);
+
+	blk_wbt_update_limits(q);
 	return ret;
 }
 
@@ -266,6 +270,96 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+/*
+ * Sum the per-cpu histograms, bucket bounds in usecs or kbytes
+ */
+static ssize_t queue_hist_show(struct request_queue *q, char *page, bool lat)
+{
+	unsigned long sum[2][BLK_HIST_LAT_BUCKETS] = { { 0 } };
+	int nr = lat ? BLK_HIST_LAT_BUCKETS : BLK_HIST_SIZE_BUCKETS;
+	ssize_t len;
+	int cpu, rw, i;
+
+	if (!q->io_hist)
+		return -EINVAL;
+
+	for_each_possible_cpu(cpu) {
+		struct blk_io_hist *hist = per_cpu_ptr(q->io_hist, cpu);
+
+		for (rw = 0; rw < 2; rw++)
+			for (i = 0; i < nr; i++)
+				sum[rw][i] += lat ? hist->lat[rw][i] :
+						    hist->size[rw][i];
+	}
+
+	len = sprintf(page, "%10s %12s %12s\n", lat ? "usecs" : "kbytes",
+		      "reads", "writes");
+	for (i = 0; i < nr; i++) {
+		char bound[16];
+
+		if (i < nr - 1)
+			sprintf(bound, "<%lu", 1UL << i);
+		else
+			sprintf(bound, ">=%lu", 1UL << (i - 1));
+		len += sprintf(page + len, "%10s %12lu %12lu\n", bound,
+			       sum[READ][i], sum[WRITE][i]);
+	}
+
+	return len;
+}
+
+/*
+ * Writing 0 clears a histogram.  Completions racing with it may survive.
+ */
+static ssize_t
+queue_hist_store(struct request_queue *q, const char *page, size_t count,
+		 bool lat)
+{
+	unsigned long val;
+	ssize_t ret;
+	int cpu;
+
+	if (!q->io_hist)
+		return -EINVAL;
+
+	ret = queue_var_store(&val, page, count);
+	if (val)
+		return -EINVAL;
+
+	for_each_possible_cpu(cpu) {
+		struct blk_io_hist *hist = per_cpu_ptr(q->io_hist, cpu);
+
+		if (lat)
+			memset(hist->lat, 0, sizeof(hist->lat));
+		else
+			memset(hist->size, 0, sizeof(hist->size));
+	}
+
+	return ret;
+}
+
+static ssize_t queue_lat_hist_show(struct request_queue *q, char *page)
+{
+	return queue_hist_show(q, page, true);
+}
+
+static ssize_t
+queue_lat_hist_store(struct request_queue *q, const char *page, size_t count)
+{
+	return queue_hist_store(q, page, count, true);
+}
+
+static ssize_t queue_size_hist_show(struct request_queue *q, char *page)
+{
+	return queue_hist_show(q, page, false);
+}
+
+static ssize_t
+queue_size_hist_store(struct request_queue *q, const char *page, size_t count)
+{
+	return queue_hist_store(q, page, count, false);
+}
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -380,6 +474,31 @@ static struct queue_sysfs_entry queue_random_entry = {
 	.store = queue_store_random,
 };
 
+static struct queue_sysfs_entry queue_lat_hist_entry = {
+	.attr = {.name = "latency_hist", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_lat_hist_show,
+	.store = queue_lat_hist_store,
+};
+
+static struct queue_sysfs_entry queue_size_hist_entry = {
+	.attr = {.name = "size_hist", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_size_hist_show,
+	.store = queue_size_hist_store,
+};
+
+#ifdef CONFIG_BLK_WBT
+static struct queue_sysfs_entry queue_wbt_lat_entry = {
+	.attr = {.name = "wbt_lat_usec", .mode = S_IRUGO | S_IWUSR },
+	.show = blk_wbt_lat_show,
+	.store = blk_wbt_lat_store,
+};
+
+static struct queue_sysfs_entry queue_wbt_stats_entry = {
+	.attr = {.name = "wbt_stats", .mode = S_IRUGO },
+	.show = blk_wbt_stats_show,
+};
+#endif
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -402,6 +521,12 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+	&queue_lat_hist_entry.attr,
+	&queue_size_hist_entry.attr,
+#ifdef CONFIG_BLK_WBT
+	&queue_wbt_lat_entry.attr,
+	&queue_wbt_stats_entry.attr,
+#endif
 	NULL,
 };
 
@@ -477,12 +602,19 @@ static void blk_release_queue(struct kobject *kobj)
 
 	blk_throtl_exit(q);
 
+	blk_wbt_exit(q);
+
+	free_percpu(q->io_hist);
+
 	if (rl->rq_pool)
 		mempool_destroy(rl->rq_pool);
 
 	if (q->queue_tags)
 		__blk_queue_free_tags(q);
 
+	if (q->mq_ops)
+		blk_mq_free_queue(q);
+
 	blk_trace_shutdown(q);
 
 	bdi_destroy(&q->backing_dev_info);
@@ -521,6 +653,15 @@ int blk_register_queue(struct gendisk *disk)
 
 	kobject_uevent(&q->kobj, KOBJ_ADD);
 
+	if (q->mq_ops)
+		blk_mq_register_disk(disk);
+
+	if (q->request_fn || q->mq_ops) {
+		if (!q->io_hist)
+			q->io_hist = alloc_percpu(struct blk_io_hist);
+		blk_wbt_init(q);
+	}
+
 	if (!q->request_fn)
 		return 0;
 
@@ -543,6 +684,9 @@ void blk_unregister_queue(struct gendisk *disk)
 	if (WARN_ON(!q))
 		return;
 
+	if (q->mq_ops)
+		blk_mq_unregister_disk(disk);
+
 	if (q->request_fn)
 		elv_unregister_queue(q);
 
@@ -0,0 +1,437 @@
+/*
+ * Writeback throttling
+ *
+ * Buffered writeback can fill a device queue with large writes, and a
+ * read issued behind them waits for all of them.  To avoid that, every
+ * async write takes a slot before it gets a request, and the number of
+ * slots depends on what else goes on:
+ *
+ *  - reclaim (kswapd, direct reclaim) may use all of them,
+ *  - with no recent reads, writeback may use half,
+ *  - while reads are being completed, a quarter.
+ *
+ * Sync writes, reads, flushes and discards are never throttled.
+ *
+ * The completion latency of reads is sampled over a window.  When even
+ * the fastest read of a window missed the target, the write depth is
+ * halved ("scaled down"); when reads met the target and writers had to
+ * wait for a slot, it is scaled back up, and past the default up to the
+ * depth of the queue.  Windows without reads bring a scaled down depth
+ * back towards the default.
+ *
+ * The target is set per queue in /sys/block/<dev>/queue/wbt_lat_usec,
+ * 0 disabling throttling; wbt_stats shows what the throttling does.
+ */
+#include <linux/kernel.h>
+#include <linux/blkdev.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/timer.h>
+#include <linux/wait.h>
+#include <linux/ktime.h>
+
+#include "blk-wbt.h"
+
+enum {
+	RWB_DEF_DEPTH		= 16,	/* write depth at scale step 0 */
+	RWB_WINDOW_MSECS	= 100,
+	RWB_NONROT_LAT_USECS	= 2000,
+	RWB_ROT_LAT_USECS	= 75000,
+};
+
+struct rq_wb {
+	atomic_t inflight;
+	wait_queue_head_t wait;
+
+	/* slots for reclaim, without and with reads going on */
+	unsigned int limit_reclaim;
+	unsigned int limit_idle;
+	unsigned int limit_busy;
+
+	int scale_step;			/* > 0: scaled down, < 0: up */
+	unsigned int queue_depth;
+
+	u64 min_lat_nsec;		/* target, 0 if disabled */
+	unsigned long last_read;	/* jiffies */
+
+	struct timer_list window_timer;
+	unsigned long win_jiffies;
+
+	spinlock_t lock;		/* protects what follows and the limits */
+	unsigned int nr_reads;
+	u64 read_min_nsec;
+	bool throttled_in_window;
+
+	/* statistics */
+	u64 last_min_nsec;
+	unsigned long windows;
+	unsigned long exceeded;
+	unsigned long scaled_up;
+	unsigned long scaled_down;
+	unsigned long throttled;
+};
+
+static u64 rwb_default_lat(struct request_queue *q)
+{
+	if (blk_queue_nonrot(q))
+		return RWB_NONROT_LAT_USECS * NSEC_PER_USEC;
+	return RWB_ROT_LAT_USECS * NSEC_PER_USEC;
+}
+
+static unsigned int rwb_depth(struct rq_wb *rwb, int step)
+{
+	unsigned int depth;
+
+	if (step > 0)
+		depth = 1 + ((RWB_DEF_DEPTH - 1) >> step);
+	else
+		depth = RWB_DEF_DEPTH << -step;
+
+	return max(1U, min(depth, rwb->queue_depth));
+}
+
+/*
+ * rwb->lock must be held
+ */
+static void rwb_calc_limits(struct rq_wb *rwb)
+{
+	unsigned int depth = rwb_depth(rwb, rwb->scale_step);
+
+	rwb->limit_reclaim = depth;
+	rwb->limit_idle = (depth + 1) / 2;
+	rwb->limit_busy = (depth + 3) / 4;
+}
+
+static bool rwb_can_scale_up(struct rq_wb *rwb)
+{
+	return rwb_depth(rwb, rwb->scale_step) < rwb->queue_depth;
+}
+
+static bool rwb_can_scale_down(struct rq_wb *rwb)
+{
+	return rwb->limit_reclaim > 1;
+}
+
+static void rwb_arm_timer(struct rq_wb *rwb)
+{
+	if (!timer_pending(&rwb->window_timer))
+		mod_timer(&rwb->window_timer, jiffies + rwb->win_jiffies);
+}
+
+static void rwb_window_timer_fn(unsigned long data)
+{
+	struct rq_wb *rwb = (struct rq_wb *)data;
+	unsigned int nr_reads;
+	bool throttled;
+	unsigned long flags;
+	int step;
+
+	spin_lock_irqsave(&rwb->lock, flags);
+
+	nr_reads = rwb->nr_reads;
+	throttled = rwb->throttled_in_window;
+	step = rwb->scale_step;
+	rwb->windows++;
+
+	if (!rwb->min_lat_nsec) {
+		step = 0;
+	} else if (nr_reads) {
+		rwb->last_min_nsec = rwb->read_min_nsec;
+		if (rwb->read_min_nsec > rwb->min_lat_nsec) {
+			rwb->exceeded++;
+			if (rwb_can_scale_down(rwb)) {
+				step++;
+				rwb->scaled_down++;
+			}
+		} else if (throttled && rwb_can_scale_up(rwb)) {
+			step--;
+			rwb->scaled_up++;
+		}
+	} else if (step > 0) {
+		step--;
+		rwb->scaled_up++;
+	}
+
+	rwb->nr_reads = 0;
+	rwb->read_min_nsec = ULLONG_MAX;
+	rwb->throttled_in_window = false;
+
+	if (step != rwb->scale_step) {
+		rwb->scale_step = step;
+		rwb_calc_limits(rwb);
+	}
+
+	spin_unlock_irqrestore(&rwb->lock, flags);
+
+	wake_up_all(&rwb->wait);
+
+	if (nr_reads || throttled || step > 0 || atomic_read(&rwb->inflight))
+		rwb_arm_timer(rwb);
+}
+
+static unsigned int rwb_limit(struct rq_wb *rwb)
+{
+	if (!rwb->min_lat_nsec)
+		return UINT_MAX;
+
+	if (current->flags & PF_MEMALLOC)
+		return rwb->limit_reclaim;
+
+	if (time_before(jiffies, rwb->last_read + rwb->win_jiffies))
+		return rwb->limit_busy;
+
+	return rwb->limit_idle;
+}
+
+static bool rwb_get_slot(struct rq_wb *rwb)
+{
+	unsigned int limit = rwb_limit(rwb);
+	int cur = atomic_read(&rwb->inflight);
+
+	for (;;) {
+		int old;
+
+		if (cur >= limit)
+			return false;
+
+		old = atomic_cmpxchg(&rwb->inflight, cur, cur + 1);
+		if (old == cur)
+			return true;
+		cur = old;
+	}
+}
+
+/**
+ * blk_wbt_should_throttle - does @bio need a writeback throttling slot
+ * @q: the queue @bio goes to
+ * @bio: the bio
+ *
+ * If so, blk_wbt_wait() must be called before allocating its request,
+ * and the request marked with REQ_WB_TRACKED.
+ */
+bool blk_wbt_should_throttle(struct request_queue *q, struct bio *bio)
+{
+	const unsigned long mask = REQ_WRITE | REQ_SYNC | REQ_DISCARD |
+				   REQ_FLUSH | REQ_FUA;
+
+	if (!q->rq_wb || !q->rq_wb->min_lat_nsec)
+		return false;
+
+	return (bio->bi_rw & mask) == REQ_WRITE;
+}
+
+/**
+ * blk_wbt_wait - take a writeback throttling slot
+ * @q: the queue
+ *
+ * Sleeps until one is free.  Must not be called with the queue lock held.
+ */
+void blk_wbt_wait(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	DEFINE_WAIT(wait);
+
+	if (rwb_get_slot(rwb))
+		return;
+
+	rwb->throttled++;
+	rwb->throttled_in_window = true;
+	rwb_arm_timer(rwb);
+
+	for (;;) {
+		prepare_to_wait_exclusive(&rwb->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		if (rwb_get_slot(rwb))
+			break;
+		io_schedule();
+	}
+	finish_wait(&rwb->wait, &wait);
+}
+
+/**
+ * blk_wbt_done - a request is going away
+ * @q: its queue
+ * @rq: the request
+ *
+ * Gives back the slot of a tracked write and samples the latency of a
+ * read.  May be called from any context.
+ */
+void blk_wbt_done(struct request_queue *q, struct request *rq)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	unsigned long flags;
+	u64 lat;
+
+	if (!rwb)
+		return;
+
+	if (rq->cmd_flags & REQ_WB_TRACKED) {
+		rq->cmd_flags &= ~REQ_WB_TRACKED;
+		atomic_dec(&rwb->inflight);
+		smp_mb__after_atomic_dec();
+		if (waitqueue_active(&rwb->wait))
+			wake_up(&rwb->wait);
+		return;
+	}
+
+	if (rq->cmd_type != REQ_TYPE_FS || rq_data_dir(rq) != READ ||
+	    !rq->issue_time_ns || !rwb->min_lat_nsec)
+		return;
+
+	lat = ktime_to_ns(ktime_get()) - rq->issue_time_ns;
+	rwb->last_read = jiffies;
+
+	spin_lock_irqsave(&rwb->lock, flags);
+	rwb->nr_reads++;
+	if (lat < rwb->read_min_nsec)
+		rwb->read_min_nsec = lat;
+	spin_unlock_irqrestore(&rwb->lock, flags);
+
+	rwb_arm_timer(rwb);
+}
+
+/**
+ * blk_wbt_update_limits - the depth of the queue has changed
+ * @q: the queue
+ */
+void blk_wbt_update_limits(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	unsigned long flags;
+
+	if (!rwb)
+		return;
+
+	spin_lock_irqsave(&rwb->lock, flags);
+	rwb->queue_depth = q->nr_requests;
+	while (rwb->scale_step < 0 &&
+	       rwb_depth(rwb, rwb->scale_step + 1) >= rwb->queue_depth)
+		rwb->scale_step++;
+	rwb_calc_limits(rwb);
+	spin_unlock_irqrestore(&rwb->lock, flags);
+
+	wake_up_all(&rwb->wait);
+}
+
+ssize_t blk_wbt_lat_show(struct request_queue *q, char *page)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return sprintf(page, "0\n");
+
+	return sprintf(page, "%llu\n",
+		       (unsigned long long)div_u64(rwb->min_lat_nsec,
+						   NSEC_PER_USEC));
+}
+
+/*
+ * Writing 0 disables throttling, -1 restores the default target.
+ */
+ssize_t blk_wbt_lat_store(struct request_queue *q, const char *page,
+			  size_t count)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	unsigned long flags;
+	long long val;
+	int ret;
+
+	if (!rwb)
+		return -EINVAL;
+
+	ret = kstrtoll(page, 10, &val);
+	if (ret)
+		return ret;
+	if (val < -1)
+		return -EINVAL;
+
+	spin_lock_irqsave(&rwb->lock, flags);
+	if (val == -1)
+		rwb->min_lat_nsec = rwb_default_lat(q);
+	else
+		rwb->min_lat_nsec = val * NSEC_PER_USEC;
+	rwb->scale_step = 0;
+	rwb_calc_limits(rwb);
+	spin_unlock_irqrestore(&rwb->lock, flags);
+
+	wake_up_all(&rwb->wait);
+	return count;
+}
+
+ssize_t blk_wbt_stats_show(struct request_queue *q, char *page)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	unsigned long flags;
+	ssize_t len;
+
+	if (!rwb)
+		return -EINVAL;
+
+	spin_lock_irqsave(&rwb->lock, flags);
+	len = sprintf(page,
+		      "inflight %d\n"
+		      "limits %u %u %u\n"
+		      "scale_step %d\n"
+		      "windows %lu\n"
+		      "exceeded %lu\n"
+		      "scaled_up %lu\n"
+		      "scaled_down %lu\n"
+		      "throttled %lu\n"
+		      "read_min_lat_usec %llu\n",
+		      atomic_read(&rwb->inflight),
+		      rwb->limit_busy, rwb->limit_idle, rwb->limit_reclaim,
+		      rwb->scale_step, rwb->windows, rwb->exceeded,
+		      rwb->scaled_up, rwb->scaled_down, rwb->throttled,
+		      (unsigned long long)div_u64(rwb->last_min_nsec,
+						  NSEC_PER_USEC));
+	spin_unlock_irqrestore(&rwb->lock, flags);
+
+	return len;
+}
+
+/**
+ * blk_wbt_init - set up writeback throttling for a queue
+ * @q: the queue, with a request_fn or multi-queue request path
+ *
+ * Called when the queue is registered, once the driver has set the
+ * queue up.  Without memory, the queue just goes unthrottled.
+ */
+void blk_wbt_init(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+
+	if (q->rq_wb)
+		return;
+
+	rwb = kzalloc_node(sizeof(*rwb), GFP_KERNEL, q->node);
+	if (!rwb)
+		return;
+
+	atomic_set(&rwb->inflight, 0);
+	init_waitqueue_head(&rwb->wait);
+	spin_lock_init(&rwb->lock);
+	setup_timer(&rwb->window_timer, rwb_window_timer_fn,
+		    (unsigned long)rwb);
+	rwb->win_jiffies = msecs_to_jiffies(RWB_WINDOW_MSECS);
+	rwb->last_read = jiffies - rwb->win_jiffies;
+	rwb->read_min_nsec = ULLONG_MAX;
+	rwb->min_lat_nsec = rwb_default_lat(q);
+	rwb->queue_depth = q->nr_requests;
+	rwb_calc_limits(rwb);
+
+	/* requests may already be completing */
+	smp_wmb();
+	q->rq_wb = rwb;
+}
+
+void blk_wbt_exit(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return;
+
+	del_timer_sync(&rwb->window_timer);
+	q->rq_wb = NULL;
+	kfree(rwb);
+}
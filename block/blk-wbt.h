@@ -0,0 +1,36 @@
+#ifndef BLK_WBT_H
+#define BLK_WBT_H
+
+#include <linux/blkdev.h>
+
+#ifdef CONFIG_BLK_WBT
+
+void blk_wbt_init(struct request_queue *q);
+void blk_wbt_exit(struct request_queue *q);
+void blk_wbt_update_limits(struct request_queue *q);
+bool blk_wbt_should_throttle(struct request_queue *q, struct bio *bio);
+void blk_wbt_wait(struct request_queue *q);
+void blk_wbt_done(struct request_queue *q, struct request *rq);
+
+ssize_t blk_wbt_lat_show(struct request_queue *q, char *page);
+ssize_t blk_wbt_lat_store(struct request_queue *q, const char *page,
+			  size_t count);
+ssize_t blk_wbt_stats_show(struct request_queue *q, char *page);
+
+#else
+
+static inline void blk_wbt_init(struct request_queue *q) { }
+static inline void blk_wbt_exit(struct request_queue *q) { }
+static inline void blk_wbt_update_limits(struct request_queue *q) { }
+static inline bool blk_wbt_should_throttle(struct request_queue *q,
+					   struct bio *bio)
+{
+	return false;
+}
+static inline void blk_wbt_wait(struct request_queue *q) { }
+static inline void blk_wbt_done(struct request_queue *q,
+				struct request *rq) { }
+
+#endif /* CONFIG_BLK_WBT */
+
+#endif
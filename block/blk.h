@@ -11,6 +11,8 @@ extern struct kmem_cache *blk_requestq_cachep;
 extern struct kobj_type blk_queue_ktype;
 
 void init_request_from_bio(struct request *req, struct bio *bio);
+void drive_stat_acct(struct request *rq, int new_io);
+void blk_account_io_done(struct request *req);
 void blk_rq_bio_prep(struct request_queue *q, struct request *rq,
 			struct bio *bio);
 int blk_rq_append_bio(struct request_queue *q, struct request *rq,
@@ -137,6 +139,28 @@ void elv_quiesce_start(struct request_queue *q);
 void elv_quiesce_end(struct request_queue *q);
 
 
+/*
+ * Completion latency and size histograms of a queue, per cpu and data
+ * direction, shown in /sys/block/<dev>/queue/{latency,size}_hist.  The
+ * latency is counted from blk_rq_set_issue().
+ */
+#define BLK_HIST_LAT_BUCKETS	24	/* < 1us, < 2us, < 4us, ..., >= 4.2s */
+#define BLK_HIST_SIZE_BUCKETS	12	/* < 1K, < 2K, < 4K, ..., >= 1M */
+
+struct blk_io_hist {
+	unsigned long lat[2][BLK_HIST_LAT_BUCKETS];
+	unsigned long size[2][BLK_HIST_SIZE_BUCKETS];
+};
+
+/*
+ * The request is handed to the driver
+ */
+static inline void blk_rq_set_issue(struct request *rq)
+{
+	rq->issue_time_ns = ktime_to_ns(ktime_get());
+	rq->issue_bytes = blk_rq_bytes(rq);
+}
+
 /*
  * Return the threshold (number of used requests) at which the queue is
  * considered to be congested.  It include a little hysteresis to keep the
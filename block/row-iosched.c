@@ -0,0 +1,529 @@
+/*
+ *  ROW (read over write) i/o scheduler.
+ *
+ *  A deadline descendant for flash storage: no seek ordering and no
+ *  idling, but one fifo per ioprio class and request type, dispatched
+ *  in priority order with bounded starvation of writes and of the
+ *  lower classes.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+#include <linux/ioprio.h>
+#include <linux/iocontext.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+
+/*
+ * See Documentation/block/row-iosched.txt
+ */
+static const int read_expire = HZ / 4;	/* max time before a read is submitted. */
+static const int write_expire = 5 * HZ;	/* ditto for writes, these limits are SOFT! */
+static const int idle_expire = 2 * HZ;	/* ditto for the idle class */
+static const int writes_starved = 4;	/* max times reads can starve a write */
+
+enum row_class {
+	ROW_RT,
+	ROW_BE,
+	ROW_IDLE,
+	ROW_CLASSES
+};
+
+enum row_type {
+	ROW_READ,
+	ROW_SYNC_WRITE,
+	ROW_ASYNC_WRITE,
+	ROW_TYPES
+};
+
+#define ROW_QUEUES	(ROW_CLASSES * ROW_TYPES)
+
+static const char *row_class_name[ROW_CLASSES] = { "rt", "be", "idle" };
+
+struct row_stats {
+	unsigned long dispatched[2];	/* reads, writes */
+	unsigned long expired;		/* dispatched after their deadline */
+	u64 wait_us[2];			/* total time spent queued */
+	unsigned long max_wait_us[2];
+};
+
+struct row_data {
+	/*
+	 * run time data
+	 */
+
+	/*
+	 * requests are on one fifo, indexed class * ROW_TYPES + type, and
+	 * on the sort_list of their direction, which is only used to find
+	 * merge candidates
+	 */
+	struct list_head fifo_list[ROW_QUEUES];
+	struct rb_root sort_list[2];
+	unsigned int queued[ROW_CLASSES];
+	unsigned int starved;		/* times reads have starved writes */
+
+	struct row_stats stats[ROW_CLASSES];
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int fifo_expire[2];
+	int idle_expire;
+	int writes_starved;
+	int front_merges;
+};
+
+/*
+ * elevator_private[0] holds the fifo index, [1] the time the request
+ * was queued in microseconds, for the wait statistics
+ */
+static inline int row_rq_queue(struct request *rq)
+{
+	return (unsigned long)rq->elevator_private[0];
+}
+
+static inline int row_rq_class(struct request *rq)
+{
+	return row_rq_queue(rq) / ROW_TYPES;
+}
+
+static inline unsigned long row_now_us(void)
+{
+	return (unsigned long)ktime_to_us(ktime_get());
+}
+
+/*
+ * The class comes from the request, the io context or the cpu
+ * scheduling policy of the submitter, as in cfq.  Writeback is queued
+ * by the flusher threads and lands in the best effort class.
+ */
+static int row_classify(struct request *rq)
+{
+	int ioprio = req_get_ioprio(rq);
+	int class;
+
+	if (!ioprio_valid(ioprio) && current->io_context)
+		ioprio = current->io_context->ioprio;
+
+	if (ioprio_valid(ioprio))
+		class = IOPRIO_PRIO_CLASS(ioprio);
+	else
+		class = task_nice_ioclass(current);
+
+	switch (class) {
+	case IOPRIO_CLASS_RT:
+		return ROW_RT;
+	case IOPRIO_CLASS_IDLE:
+		return ROW_IDLE;
+	default:
+		return ROW_BE;
+	}
+}
+
+static int row_type(struct request *rq)
+{
+	if (rq_data_dir(rq) == READ)
+		return ROW_READ;
+
+	return rq_is_sync(rq) ? ROW_SYNC_WRITE : ROW_ASYNC_WRITE;
+}
+
+static void row_move_to_dispatch(struct row_data *, struct request *);
+
+static void
+row_add_rq_rb(struct row_data *rd, struct request *rq)
+{
+	struct rb_root *root = &rd->sort_list[rq_data_dir(rq)];
+	struct request *__alias;
+
+	while (unlikely(__alias = elv_rb_add(root, rq)))
+		row_move_to_dispatch(rd, __alias);
+}
+
+static inline void
+row_del_rq_rb(struct row_data *rd, struct request *rq)
+{
+	elv_rb_del(&rd->sort_list[rq_data_dir(rq)], rq);
+}
+
+/*
+ * add rq to its fifo and the rbtree
+ */
+static void
+row_add_request(struct request_queue *q, struct request *rq)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+	const int class = row_classify(rq);
+	const int type = row_type(rq);
+	int expire;
+
+	row_add_rq_rb(rd, rq);
+
+	if (class == ROW_IDLE)
+		expire = rd->idle_expire;
+	else
+		expire = rd->fifo_expire[rq_data_dir(rq)];
+
+	rq->elevator_private[0] = (void *)(unsigned long)
+					(class * ROW_TYPES + type);
+	rq->elevator_private[1] = (void *)row_now_us();
+	rq_set_fifo_time(rq, jiffies + expire);
+	list_add_tail(&rq->queuelist, &rd->fifo_list[row_rq_queue(rq)]);
+	rd->queued[class]++;
+}
+
+/*
+ * remove rq from its fifo and the rbtree
+ */
+static void row_remove_request(struct request_queue *q, struct request *rq)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+
+	rd->queued[row_rq_class(rq)]--;
+	rq_fifo_clear(rq);
+	row_del_rq_rb(rd, rq);
+}
+
+static int
+row_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+	struct request *__rq;
+
+	/*
+	 * check for front merge
+	 */
+	if (rd->front_merges) {
+		sector_t sector = bio->bi_sector + bio_sectors(bio);
+
+		__rq = elv_rb_find(&rd->sort_list[bio_data_dir(bio)], sector);
+		if (__rq && elv_rq_merge_ok(__rq, bio)) {
+			*req = __rq;
+			return ELEVATOR_FRONT_MERGE;
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void row_merged_request(struct request_queue *q,
+			       struct request *req, int type)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		row_del_rq_rb(rd, req);
+		row_add_rq_rb(rd, req);
+	}
+}
+
+static void
+row_merged_requests(struct request_queue *q, struct request *req,
+		    struct request *next)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+
+	/*
+	 * if next is in a more urgent fifo, or expires first in the same
+	 * one, move rq into its position (next will be deleted)
+	 */
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+		int queue = row_rq_queue(req), next_queue = row_rq_queue(next);
+
+		if (next_queue < queue ||
+		    (next_queue == queue &&
+		     time_before(rq_fifo_time(next), rq_fifo_time(req)))) {
+			list_move(&req->queuelist, &next->queuelist);
+			if (time_before(rq_fifo_time(next), rq_fifo_time(req)))
+				rq_set_fifo_time(req, rq_fifo_time(next));
+			rd->queued[row_rq_class(req)]--;
+			req->elevator_private[0] = next->elevator_private[0];
+			rd->queued[row_rq_class(req)]++;
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	row_remove_request(q, next);
+}
+
+/*
+ * account for and move rq to the dispatch queue
+ */
+static void
+row_move_to_dispatch(struct row_data *rd, struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct row_stats *stats = &rd->stats[row_rq_class(rq)];
+	const int data_dir = rq_data_dir(rq);
+	unsigned long wait;
+
+	wait = row_now_us() - (unsigned long)rq->elevator_private[1];
+	stats->dispatched[data_dir]++;
+	stats->wait_us[data_dir] += wait;
+	if (wait > stats->max_wait_us[data_dir])
+		stats->max_wait_us[data_dir] = wait;
+	if (time_after(jiffies, rq_fifo_time(rq)))
+		stats->expired++;
+
+	row_remove_request(q, rq);
+	elv_dispatch_add_tail(q, rq);
+}
+
+/*
+ * the first request past its deadline, in priority order
+ */
+static struct request *row_expired_request(struct row_data *rd)
+{
+	struct request *rq;
+	int i;
+
+	for (i = 0; i < ROW_QUEUES; i++) {
+		if (list_empty(&rd->fifo_list[i]))
+			continue;
+
+		rq = rq_entry_fifo(rd->fifo_list[i].next);
+		if (time_after(jiffies, rq_fifo_time(rq)))
+			return rq;
+	}
+
+	return NULL;
+}
+
+/*
+ * reads first, then sync writes, then async writes, except that a
+ * write goes after writes_starved reads have passed it
+ */
+static struct request *row_class_request(struct row_data *rd, int class)
+{
+	struct list_head *fifo = &rd->fifo_list[class * ROW_TYPES];
+	const int reads = !list_empty(&fifo[ROW_READ]);
+	const int writes = !list_empty(&fifo[ROW_SYNC_WRITE]) ||
+			   !list_empty(&fifo[ROW_ASYNC_WRITE]);
+
+	if (reads && (!writes || rd->starved < rd->writes_starved)) {
+		if (writes)
+			rd->starved++;
+		return rq_entry_fifo(fifo[ROW_READ].next);
+	}
+
+	rd->starved = 0;
+
+	if (!list_empty(&fifo[ROW_SYNC_WRITE]))
+		return rq_entry_fifo(fifo[ROW_SYNC_WRITE].next);
+
+	return rq_entry_fifo(fifo[ROW_ASYNC_WRITE].next);
+}
+
+/*
+ * row_dispatch_requests selects the best request according to
+ * class, direction and expiry
+ */
+static int row_dispatch_requests(struct request_queue *q, int force)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+	struct request *rq;
+	int class;
+
+	rq = row_expired_request(rd);
+	if (!rq) {
+		for (class = 0; class < ROW_CLASSES; class++)
+			if (rd->queued[class])
+				break;
+
+		if (class == ROW_CLASSES)
+			return 0;
+
+		rq = row_class_request(rd, class);
+	}
+
+	row_move_to_dispatch(rd, rq);
+
+	return 1;
+}
+
+static void row_exit_queue(struct elevator_queue *e)
+{
+	struct row_data *rd = e->elevator_data;
+	int i;
+
+	for (i = 0; i < ROW_QUEUES; i++)
+		BUG_ON(!list_empty(&rd->fifo_list[i]));
+
+	kfree(rd);
+}
+
+/*
+ * initialize elevator private data (row_data).
+ */
+static void *row_init_queue(struct request_queue *q)
+{
+	struct row_data *rd;
+	int i;
+
+	rd = kmalloc_node(sizeof(*rd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!rd)
+		return NULL;
+
+	for (i = 0; i < ROW_QUEUES; i++)
+		INIT_LIST_HEAD(&rd->fifo_list[i]);
+	rd->sort_list[READ] = RB_ROOT;
+	rd->sort_list[WRITE] = RB_ROOT;
+	rd->fifo_expire[READ] = read_expire;
+	rd->fifo_expire[WRITE] = write_expire;
+	rd->idle_expire = idle_expire;
+	rd->writes_starved = writes_starved;
+	rd->front_merges = 1;
+	return rd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+row_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+row_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct row_data *rd = e->elevator_data;				\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return row_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(row_read_expire_show, rd->fifo_expire[READ], 1);
+SHOW_FUNCTION(row_write_expire_show, rd->fifo_expire[WRITE], 1);
+SHOW_FUNCTION(row_idle_expire_show, rd->idle_expire, 1);
+SHOW_FUNCTION(row_writes_starved_show, rd->writes_starved, 0);
+SHOW_FUNCTION(row_front_merges_show, rd->front_merges, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct row_data *rd = e->elevator_data;				\
+	int __data;							\
+	int ret = row_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(row_read_expire_store, &rd->fifo_expire[READ], 0, INT_MAX, 1);
+STORE_FUNCTION(row_write_expire_store, &rd->fifo_expire[WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(row_idle_expire_store, &rd->idle_expire, 0, INT_MAX, 1);
+STORE_FUNCTION(row_writes_starved_store, &rd->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(row_front_merges_store, &rd->front_merges, 0, 1, 0);
+#undef STORE_FUNCTION
+
+/*
+ * per class: requests dispatched, average and maximum wait in the
+ * scheduler in microseconds, for reads and writes, and the number
+ * dispatched past their deadline
+ */
+static ssize_t row_stats_show(struct elevator_queue *e, char *page)
+{
+	struct row_data *rd = e->elevator_data;
+	ssize_t len = 0;
+	int class, dir;
+
+	for (class = 0; class < ROW_CLASSES; class++) {
+		struct row_stats *stats = &rd->stats[class];
+
+		len += sprintf(page + len, "%-4s", row_class_name[class]);
+		for (dir = READ; dir <= WRITE; dir++) {
+			u64 avg = stats->wait_us[dir];
+
+			if (stats->dispatched[dir])
+				do_div(avg, stats->dispatched[dir]);
+			len += sprintf(page + len, " %c %lu %llu %lu",
+				       dir == READ ? 'r' : 'w',
+				       stats->dispatched[dir],
+				       (unsigned long long)avg,
+				       stats->max_wait_us[dir]);
+		}
+		len += sprintf(page + len, " expired %lu\n", stats->expired);
+	}
+
+	return len;
+}
+
+#define ROW_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, row_##name##_show, \
+				      row_##name##_store)
+
+static struct elv_fs_entry row_attrs[] = {
+	ROW_ATTR(read_expire),
+	ROW_ATTR(write_expire),
+	ROW_ATTR(idle_expire),
+	ROW_ATTR(writes_starved),
+	ROW_ATTR(front_merges),
+	__ATTR(stats, S_IRUGO, row_stats_show, NULL),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_row = {
+	.ops = {
+		.elevator_merge_fn = 		row_merge,
+		.elevator_merged_fn =		row_merged_request,
+		.elevator_merge_req_fn =	row_merged_requests,
+		.elevator_dispatch_fn =		row_dispatch_requests,
+		.elevator_add_req_fn =		row_add_request,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_init_fn =		row_init_queue,
+		.elevator_exit_fn =		row_exit_queue,
+	},
+
+	.elevator_attrs = row_attrs,
+	.elevator_name = "row",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init row_init(void)
+{
+	elv_register(&iosched_row);
+
+	return 0;
+}
+
+static void __exit row_exit(void)
+{
+	elv_unregister(&iosched_row);
+}
+
+module_init(row_init);
+module_exit(row_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("ROW (read over write) IO scheduler");
@@ -62,9 +62,70 @@ static ssize_t __ref store_online(struct sys_device *dev, struct sysdev_attribut
 }
 static SYSDEV_ATTR(online, 0644, show_online, store_online);
 
+#ifdef CONFIG_CPU_PARKING
+static ssize_t show_parked(struct sys_device *dev, struct sysdev_attribute *attr,
+			   char *buf)
+{
+	struct cpu *cpu = container_of(dev, struct cpu, sysdev);
+
+	return sprintf(buf, "%u\n", !!cpu_parked(cpu->sysdev.id));
+}
+
+static ssize_t store_parked(struct sys_device *dev, struct sysdev_attribute *attr,
+			    const char *buf, size_t count)
+{
+	struct cpu *cpu = container_of(dev, struct cpu, sysdev);
+	ssize_t ret;
+
+	switch (buf[0]) {
+	case '0':
+		ret = cpu_parked(cpu->sysdev.id) ? cpu_unpark(cpu->sysdev.id) : 0;
+		break;
+	case '1':
+		ret = cpu_park(cpu->sysdev.id);
+		break;
+	default:
+		ret = -EINVAL;
+	}
+
+	if (ret >= 0)
+		ret = count;
+	return ret;
+}
+static SYSDEV_ATTR(parked, 0644, show_parked, store_parked);
+
+static const char *const cpu_park_stat_names[NR_CPU_PARK_STATS] = {
+	"park", "unpark", "down", "up",
+};
+
+static ssize_t print_cpus_park_stats(struct sysdev_class *class,
+				     struct sysdev_class_attribute *attr,
+				     char *buf)
+{
+	struct cpu_park_stat stat;
+	int i, n;
+
+	n = sprintf(buf, "%-8s %8s %10s %10s\n",
+		    "", "count", "avg_us", "max_us");
+	for (i = 0; i < NR_CPU_PARK_STATS; i++) {
+		cpu_park_get_stat(i, &stat);
+		n += sprintf(buf + n, "%-8s %8lu %10llu %10llu\n",
+			     cpu_park_stat_names[i], stat.count,
+			     stat.count ? div_u64(div_u64(stat.total_ns,
+					NSEC_PER_USEC), stat.count) : 0,
+			     div_u64(stat.max_ns, NSEC_PER_USEC));
+	}
+	return n;
+}
+static SYSDEV_CLASS_ATTR(park_stats, 0444, print_cpus_park_stats, NULL);
+#endif /* CONFIG_CPU_PARKING */
+
 static void __cpuinit register_cpu_control(struct cpu *cpu)
 {
 	sysdev_create_file(&cpu->sysdev, &attr_online);
+#ifdef CONFIG_CPU_PARKING
+	sysdev_create_file(&cpu->sysdev, &attr_parked);
+#endif
 }
 void unregister_cpu(struct cpu *cpu)
 {
@@ -73,6 +134,9 @@ void unregister_cpu(struct cpu *cpu)
 	unregister_cpu_under_node(logical_cpu, cpu_to_node(logical_cpu));
 
 	sysdev_remove_file(&cpu->sysdev, &attr_online);
+#ifdef CONFIG_CPU_PARKING
+	sysdev_remove_file(&cpu->sysdev, &attr_parked);
+#endif
 
 	sysdev_unregister(&cpu->sysdev);
 	per_cpu(cpu_sys_devices, logical_cpu) = NULL;
@@ -161,6 +225,9 @@ static struct cpu_attr cpu_attrs[] = {
 	_CPU_ATTR(online, &cpu_online_mask),
 	_CPU_ATTR(possible, &cpu_possible_mask),
 	_CPU_ATTR(present, &cpu_present_mask),
+#ifdef CONFIG_CPU_PARKING
+	_CPU_ATTR(parked, &cpu_parked_mask),
+#endif
 };
 
 /*
@@ -270,5 +337,9 @@ static struct sysdev_class_attribute *cpu_sysdev_class_attrs[] = {
 	&cpu_attrs[2].attr,
 	&attr_kernel_max,
 	&attr_offline,
+#ifdef CONFIG_CPU_PARKING
+	&cpu_attrs[3].attr,
+	&attr_park_stats,
+#endif
 	NULL
 };
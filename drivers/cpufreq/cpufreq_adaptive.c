@@ -58,7 +58,7 @@ static unsigned int min_sampling_rate;
 #define TRANSITION_LATENCY_LIMIT		(10 * 1000 * 1000)
 
 static void (*pm_idle_old)(void);
-static void do_dbs_timer(struct work_struct *work);
+static void do_dbs_timer(struct cpufreq_sampler *sampler, unsigned int cpu);
 static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 				unsigned int event);
 
@@ -81,7 +81,7 @@ struct cpu_dbs_info_s {
 	cputime64_t prev_cpu_wall;
 	cputime64_t prev_cpu_nice;
 	struct cpufreq_policy *cur_policy;
-	struct delayed_work work;
+	struct cpufreq_sampler sampler;
 	struct cpufreq_frequency_table *freq_table;
 	unsigned int freq_hi_jiffies;
 	int cpu;
@@ -409,7 +409,6 @@ do_nothing:
 					&per_cpu(idle_exit_wall, j));
 	}
 	mod_timer(&cpu_timer, jiffies + 2);
-	schedule_delayed_work_on(0, &this_dbs_info->work, 10);
 
 	if (mutex_is_locked(&short_timer_mutex))
 		mutex_unlock(&short_timer_mutex);
@@ -569,43 +568,34 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 	}
 }
 
-static void do_dbs_timer(struct work_struct *work)
+static void do_dbs_timer(struct cpufreq_sampler *sampler, unsigned int cpu)
 {
 	struct cpu_dbs_info_s *dbs_info =
-		container_of(work, struct cpu_dbs_info_s, work.work);
-	unsigned int cpu = dbs_info->cpu;
-
-	int delay;
+		container_of(sampler, struct cpu_dbs_info_s, sampler);
 
 	mutex_lock(&dbs_info->timer_mutex);
 
 	/* Common NORMAL_SAMPLE setup */
 	dbs_info->sample_type = DBS_NORMAL_SAMPLE;
 	dbs_check_cpu(dbs_info);
-
-	/* We want all CPUs to do sampling nearly on
-	 * same jiffy
-	 */
-	delay = usecs_to_jiffies(dbs_tuners_ins.sampling_rate);
-
-		schedule_delayed_work_on(cpu, &dbs_info->work, delay);
+	sampler->period_us = dbs_tuners_ins.sampling_rate;
 
 	mutex_unlock(&dbs_info->timer_mutex);
 }
 
-static inline void dbs_timer_init(struct cpu_dbs_info_s *dbs_info)
+static inline int dbs_timer_init(struct cpu_dbs_info_s *dbs_info)
 {
-	/* We want all CPUs to do sampling nearly on same jiffy */
-	int delay = usecs_to_jiffies(dbs_tuners_ins.sampling_rate);
-
 	dbs_info->sample_type = DBS_NORMAL_SAMPLE;
-	INIT_DELAYED_WORK_DEFERRABLE(&dbs_info->work, do_dbs_timer);
-	schedule_delayed_work_on(dbs_info->cpu, &dbs_info->work, delay);
+	dbs_info->sampler.name = "adaptive";
+	dbs_info->sampler.period_us = dbs_tuners_ins.sampling_rate;
+	dbs_info->sampler.sample = do_dbs_timer;
+	return cpufreq_sampler_start(&dbs_info->sampler,
+				     dbs_info->cur_policy->cpus, 0);
 }
 
 static inline void dbs_timer_exit(struct cpu_dbs_info_s *dbs_info)
 {
-	cancel_delayed_work_sync(&dbs_info->work);
+	cpufreq_sampler_stop(&dbs_info->sampler);
 }
 
 /*
@@ -655,7 +645,6 @@ static void cpufreq_adaptive_idle(void)
 			}
 
 			mod_timer(&cpu_timer, jiffies + 2);
-			cancel_delayed_work(&dbs_info->work);
 		}
 	} else {
 		if (timer_pending(&cpu_timer))
@@ -732,7 +721,18 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 		mutex_unlock(&dbs_mutex);
 
 		mutex_init(&this_dbs_info->timer_mutex);
-		dbs_timer_init(this_dbs_info);
+		rc = dbs_timer_init(this_dbs_info);
+		if (rc) {
+			mutex_lock(&dbs_mutex);
+			sysfs_remove_group(&policy->kobj, &dbs_attr_group);
+			mutex_destroy(&this_dbs_info->timer_mutex);
+			dbs_enable--;
+			mutex_unlock(&dbs_mutex);
+			if (!dbs_enable)
+				sysfs_remove_group(cpufreq_global_kobject,
+						   &dbs_attr_group);
+			return rc;
+		}
 
 		pm_idle_old = pm_idle;
 		pm_idle = cpufreq_adaptive_idle;
@@ -803,7 +803,6 @@ static int cpufreq_adaptive_up_task(void *data)
 	unsigned long flags;
 	struct cpu_dbs_info_s *this_dbs_info;
 	struct cpufreq_policy *policy;
-	int delay = usecs_to_jiffies(dbs_tuners_ins.sampling_rate);
 
 	this_dbs_info = &per_cpu(od_cpu_dbs_info, 0);
 	policy = this_dbs_info->cur_policy;
@@ -830,13 +829,8 @@ static int cpufreq_adaptive_up_task(void *data)
 		__cpufreq_driver_target(this_dbs_info->cur_policy,
 					target_freq,
 					CPUFREQ_RELATION_H);
-		if (policy->cur != policy->max) {
-			mutex_lock(&this_dbs_info->timer_mutex);
-
-			schedule_delayed_work_on(0, &this_dbs_info->work, delay);
-			mutex_unlock(&this_dbs_info->timer_mutex);
+		if (policy->cur != policy->max)
 			cpufreq_adaptive_update_time();
-		}
 		if (mutex_is_locked(&short_timer_mutex))
 			mutex_unlock(&short_timer_mutex);
 	}
@@ -849,7 +843,6 @@ static void cpufreq_adaptive_freq_down(struct work_struct *work)
 	unsigned long flags;
 	struct cpu_dbs_info_s *this_dbs_info;
 	struct cpufreq_policy *policy;
-	int delay = usecs_to_jiffies(dbs_tuners_ins.sampling_rate);
 
 	spin_lock_irqsave(&down_cpumask_lock, flags);
 	cpumask_clear(&down_cpumask);
@@ -862,13 +855,8 @@ static void cpufreq_adaptive_freq_down(struct work_struct *work)
 				target_freq,
 				CPUFREQ_RELATION_H);
 
-	if (policy->cur != policy->min) {
-		mutex_lock(&this_dbs_info->timer_mutex);
-
-		schedule_delayed_work_on(0, &this_dbs_info->work, delay);
-		mutex_unlock(&this_dbs_info->timer_mutex);
+	if (policy->cur != policy->min)
 		cpufreq_adaptive_update_time();
-	}
 
 	if (mutex_is_locked(&short_timer_mutex))
 		mutex_unlock(&short_timer_mutex);
@@ -904,7 +892,11 @@ static int __init cpufreq_gov_dbs_init(void)
 			MIN_SAMPLING_RATE_RATIO * jiffies_to_usecs(10);
 	}
 
-	init_timer(&cpu_timer);
+	/*
+	 * Armed on the way out of idle to sample the short-term load; a
+	 * cpu that has gone back to idle by then is not woken up for it.
+	 */
+	init_timer_deferrable(&cpu_timer);
 	cpu_timer.function = cpufreq_adaptive_timer;
 
 	up_task = kthread_create(cpufreq_adaptive_up_task, NULL,
@@ -0,0 +1,121 @@
+/*
+ *  drivers/cpufreq/cpufreq_input.c
+ *
+ *  Touch input notification for cpufreq governors.
+ *
+ *  A single input handler binds to every touchscreen and calls the
+ *  governors registered with cpufreq_register_input_notifier() at the
+ *  end of each input frame (SYN_REPORT), so that they can raise the
+ *  frequency before the work triggered by the touch shows up as load.
+ *  What a governor does with it, and for how long, is up to the
+ *  governor's own tunables.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/input.h>
+#include <linux/notifier.h>
+#include <linux/slab.h>
+
+static ATOMIC_NOTIFIER_HEAD(cpufreq_input_chain);
+
+int cpufreq_register_input_notifier(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_register(&cpufreq_input_chain, nb);
+}
+EXPORT_SYMBOL_GPL(cpufreq_register_input_notifier);
+
+int cpufreq_unregister_input_notifier(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_unregister(&cpufreq_input_chain, nb);
+}
+EXPORT_SYMBOL_GPL(cpufreq_unregister_input_notifier);
+
+static void cpufreq_input_event(struct input_handle *handle,
+				unsigned int type, unsigned int code, int value)
+{
+	if (type == EV_SYN && code == SYN_REPORT)
+		atomic_notifier_call_chain(&cpufreq_input_chain, 0, NULL);
+}
+
+static int cpufreq_input_connect(struct input_handler *handler,
+				 struct input_dev *dev,
+				 const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int ret;
+
+	handle = kzalloc(sizeof(*handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_input";
+
+	ret = input_register_handle(handle);
+	if (ret) {
+		pr_err("%s: cannot register handle for %s (%d)\n",
+		       __func__, dev->name, ret);
+		goto err_reg;
+	}
+
+	ret = input_open_device(handle);
+	if (ret) {
+		pr_err("%s: cannot open %s (%d)\n", __func__, dev->name, ret);
+		goto err_open;
+	}
+
+	return 0;
+
+err_open:
+	input_unregister_handle(handle);
+err_reg:
+	kfree(handle);
+	return ret;
+}
+
+static void cpufreq_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+static const struct input_device_id cpufreq_input_ids[] = {
+	/* multi-touch touchscreens */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
+			    BIT_MASK(ABS_MT_POSITION_X) },
+	},
+	/* single-touch touchscreens and touchpads */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_KEYBIT,
+		.evbit = { BIT_MASK(EV_KEY) },
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+	},
+	{ },
+};
+
+static struct input_handler cpufreq_input_handler = {
+	.event		= cpufreq_input_event,
+	.connect	= cpufreq_input_connect,
+	.disconnect	= cpufreq_input_disconnect,
+	.name		= "cpufreq_input",
+	.id_table	= cpufreq_input_ids,
+};
+
+static int __init cpufreq_input_init(void)
+{
+	return input_register_handler(&cpufreq_input_handler);
+}
+late_initcall(cpufreq_input_init);
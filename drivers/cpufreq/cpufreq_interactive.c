@@ -32,7 +32,8 @@
 static atomic_t active_count = ATOMIC_INIT(0);
 
 struct cpufreq_interactive_cpuinfo {
-	struct timer_list cpu_timer;
+	struct cpufreq_sampler sampler;
+	int timer_pending;	/* a sample is wanted at the next slot */
 	int timer_idlecancel;
 	u64 time_in_idle;
 	u64 idle_exit_time;
@@ -77,6 +78,15 @@ static unsigned long min_sample_time;
 #define DEFAULT_TIMER_RATE 20 * USEC_PER_MSEC
 static unsigned long timer_rate;
 
+/*
+ * Frequency floor held for input_boost_duration usecs after touch input,
+ * 0 meaning hispeed_freq.  A zero duration turns the input boost off.
+ */
+static unsigned int input_boost_freq;
+static unsigned long input_boost_duration;
+static unsigned long input_boost_end = INITIAL_JIFFIES; /* read unlocked */
+static unsigned long input_boosts;
+
 static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		unsigned int event);
 
@@ -90,7 +100,22 @@ struct cpufreq_governor cpufreq_gov_interactive = {
 	.owner = THIS_MODULE,
 };
 
-static void cpufreq_interactive_timer(unsigned long data)
+static unsigned int input_boost_floor(struct cpufreq_policy *policy)
+{
+	if (!time_before(jiffies, ACCESS_ONCE(input_boost_end)))
+		return 0;
+
+	return min_t(unsigned int, input_boost_freq ? : hispeed_freq,
+		     policy->max);
+}
+
+/*
+ * Runs from the shared sampling slot of the cpu every timer_rate, and
+ * does nothing unless a sample was asked for, which is where the timer
+ * of this governor used to be armed.
+ */
+static void cpufreq_interactive_timer(struct cpufreq_sampler *sampler,
+				      unsigned int data)
 {
 	unsigned int delta_idle;
 	unsigned int delta_time;
@@ -99,16 +124,32 @@ static void cpufreq_interactive_timer(unsigned long data)
 	u64 time_in_idle;
 	u64 idle_exit_time;
 	struct cpufreq_interactive_cpuinfo *pcpu =
-		&per_cpu(cpuinfo, data);
+		container_of(sampler, struct cpufreq_interactive_cpuinfo,
+			     sampler);
+	unsigned long min_window;
 	u64 now_idle;
 	unsigned int new_freq;
+	unsigned int boost_freq;
 	unsigned int index;
 	unsigned long flags;
 
 	smp_rmb();
 
-	if (!pcpu->governor_enabled)
+	if (!pcpu->governor_enabled || !pcpu->timer_pending)
+		goto exit;
+
+	/*
+	 * Slots are aligned, so the first one after idle exit started the
+	 * sample can come a jiffy later.  Leave the sample pending for the
+	 * next slot until it covers timer_rate, give or take the jiffy.
+	 */
+	min_window = timer_rate -
+		min_t(unsigned long, timer_rate, jiffies_to_usecs(1));
+	idle_exit_time = pcpu->idle_exit_time;
+	if (idle_exit_time &&
+	    ktime_to_us(ktime_get()) - idle_exit_time < min_window)
 		goto exit;
+	pcpu->timer_pending = 0;
 
 	/*
 	 * Once pcpu->timer_run_time is updated to >= pcpu->idle_exit_time,
@@ -171,6 +212,10 @@ static void cpufreq_interactive_timer(unsigned long data)
 		new_freq = pcpu->policy->cur * cpu_load / 100;
 	}
 
+	boost_freq = input_boost_floor(pcpu->policy);
+	if (new_freq < boost_freq)
+		new_freq = boost_freq;
+
 	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
 					   new_freq, CPUFREQ_RELATION_H,
 					   &index)) {
@@ -217,7 +262,7 @@ rearm_if_notmax:
 		goto exit;
 
 rearm:
-	if (!timer_pending(&pcpu->cpu_timer)) {
+	if (!pcpu->timer_pending) {
 		/*
 		 * If already at min: if that CPU is idle, don't set timer.
 		 * Else cancel the timer if that CPU goes idle.  We don't
@@ -234,8 +279,7 @@ rearm:
 
 		pcpu->time_in_idle = get_cpu_idle_time_us(
 			data, &pcpu->idle_exit_time);
-		mod_timer(&pcpu->cpu_timer,
-			  jiffies + usecs_to_jiffies(timer_rate));
+		pcpu->timer_pending = 1;
 	}
 
 exit:
@@ -253,25 +297,25 @@ static void cpufreq_interactive_idle_start(void)
 
 	pcpu->idling = 1;
 	smp_wmb();
-	pending = timer_pending(&pcpu->cpu_timer);
+	pending = pcpu->timer_pending;
 
 	if (pcpu->target_freq != pcpu->policy->min) {
 #ifdef CONFIG_SMP
 		/*
 		 * Entering idle while not at lowest speed.  On some
 		 * platforms this can hold the other CPU(s) at that speed
-		 * even though the CPU is idle. Set a timer to re-evaluate
-		 * speed so this idle CPU doesn't hold the other CPUs above
-		 * min indefinitely.  This should probably be a quirk of
-		 * the CPUFreq driver.
+		 * even though the CPU is idle. Have it woken up to
+		 * re-evaluate speed so this idle CPU doesn't hold the other
+		 * CPUs above min indefinitely.  This should probably be a
+		 * quirk of the CPUFreq driver.
 		 */
 		if (!pending) {
 			pcpu->time_in_idle = get_cpu_idle_time_us(
 				smp_processor_id(), &pcpu->idle_exit_time);
 			pcpu->timer_idlecancel = 0;
-			mod_timer(&pcpu->cpu_timer,
-				  jiffies + usecs_to_jiffies(timer_rate));
+			pcpu->timer_pending = 1;
 		}
+		cpufreq_sampler_wakeup(&pcpu->sampler);
 #endif
 	} else {
 		/*
@@ -281,7 +325,7 @@ static void cpufreq_interactive_idle_start(void)
 		 * CPU didn't go busy; we'll recheck things upon idle exit.
 		 */
 		if (pending && pcpu->timer_idlecancel) {
-			del_timer(&pcpu->cpu_timer);
+			pcpu->timer_pending = 0;
 			/*
 			 * Ensure last timer run time is after current idle
 			 * sample start time, so next idle exit will always
@@ -313,15 +357,14 @@ static void cpufreq_interactive_idle_end(void)
 	 * give the timer function enough time to make a decision on this
 	 * run.)
 	 */
-	if (timer_pending(&pcpu->cpu_timer) == 0 &&
+	if (!pcpu->timer_pending &&
 	    pcpu->timer_run_time >= pcpu->idle_exit_time &&
 	    pcpu->governor_enabled) {
 		pcpu->time_in_idle =
 			get_cpu_idle_time_us(smp_processor_id(),
 					     &pcpu->idle_exit_time);
 		pcpu->timer_idlecancel = 0;
-		mod_timer(&pcpu->cpu_timer,
-			  jiffies + usecs_to_jiffies(timer_rate));
+		pcpu->timer_pending = 1;
 	}
 
 }
@@ -440,6 +483,66 @@ static void cpufreq_interactive_freq_down(struct work_struct *work)
 	}
 }
 
+/*
+ * Called from the input event path with interrupts disabled: start or
+ * extend the boost window and, when it starts, raise the target of the
+ * busy cpus through the up task.  Idle cpus are left alone, as their
+ * timer may be cancelled and nothing would bring them back down; they
+ * pick up the floor from their own timer after the next idle exit.
+ */
+static int cpufreq_interactive_input_notifier(struct notifier_block *nb,
+					      unsigned long val, void *data)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu;
+	unsigned int cpu, boost_freq, index;
+	unsigned long flags;
+	unsigned long now = jiffies;
+	int kick = 0;
+
+	if (!input_boost_duration || !atomic_read(&active_count))
+		return NOTIFY_DONE;
+
+	if (time_before(now, input_boost_end)) {
+		input_boost_end = now + usecs_to_jiffies(input_boost_duration);
+		return NOTIFY_OK;
+	}
+	input_boost_end = now + usecs_to_jiffies(input_boost_duration);
+	input_boosts++;
+
+	for_each_online_cpu(cpu) {
+		pcpu = &per_cpu(cpuinfo, cpu);
+		smp_rmb();
+
+		if (!pcpu->governor_enabled || pcpu->idling)
+			continue;
+
+		boost_freq = input_boost_floor(pcpu->policy);
+		if (cpufreq_frequency_table_target(pcpu->policy,
+						   pcpu->freq_table,
+						   boost_freq,
+						   CPUFREQ_RELATION_H, &index))
+			continue;
+		boost_freq = pcpu->freq_table[index].frequency;
+		if (pcpu->target_freq >= boost_freq)
+			continue;
+
+		pcpu->target_freq = boost_freq;
+		spin_lock_irqsave(&up_cpumask_lock, flags);
+		cpumask_set_cpu(cpu, &up_cpumask);
+		spin_unlock_irqrestore(&up_cpumask_lock, flags);
+		kick = 1;
+	}
+
+	if (kick)
+		wake_up_process(up_task);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block cpufreq_interactive_input_nb = {
+	.notifier_call = cpufreq_interactive_input_notifier,
+};
+
 static ssize_t show_hispeed_freq(struct kobject *kobj,
 				 struct attribute *attr, char *buf)
 {
@@ -519,22 +622,82 @@ static ssize_t store_timer_rate(struct kobject *kobj,
 {
 	int ret;
 	unsigned long val;
+	unsigned int cpu;
 
 	ret = strict_strtoul(buf, 0, &val);
 	if (ret < 0)
 		return ret;
 	timer_rate = val;
+	for_each_possible_cpu(cpu)
+		per_cpu(cpuinfo, cpu).sampler.period_us = timer_rate;
 	return count;
 }
 
 static struct global_attr timer_rate_attr = __ATTR(timer_rate, 0644,
 		show_timer_rate, store_timer_rate);
 
+static ssize_t show_input_boost_freq(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", input_boost_freq);
+}
+
+static ssize_t store_input_boost_freq(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	input_boost_freq = val;
+	return count;
+}
+
+static struct global_attr input_boost_freq_attr = __ATTR(input_boost_freq,
+		0644, show_input_boost_freq, store_input_boost_freq);
+
+static ssize_t show_input_boost_duration(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", input_boost_duration);
+}
+
+static ssize_t store_input_boost_duration(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	input_boost_duration = val;
+	return count;
+}
+
+static struct global_attr input_boost_duration_attr =
+	__ATTR(input_boost_duration, 0644, show_input_boost_duration,
+	       store_input_boost_duration);
+
+static ssize_t show_input_boosts(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", input_boosts);
+}
+
+static struct global_attr input_boosts_attr = __ATTR(input_boosts, 0444,
+		show_input_boosts, NULL);
+
 static struct attribute *interactive_attributes[] = {
 	&hispeed_freq_attr.attr,
 	&go_hispeed_load_attr.attr,
 	&min_sample_time_attr.attr,
 	&timer_rate_attr.attr,
+	&input_boost_freq_attr.attr,
+	&input_boost_duration_attr.attr,
+	&input_boosts_attr.attr,
 	NULL,
 };
 
@@ -567,8 +730,15 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			pcpu->freq_change_time_in_idle =
 				get_cpu_idle_time_us(j,
 					     &pcpu->freq_change_time);
+			pcpu->sampler.period_us = timer_rate;
 			pcpu->governor_enabled = 1;
 			smp_wmb();
+			rc = cpufreq_sampler_start(&pcpu->sampler,
+						   cpumask_of(j), 0);
+			if (rc) {
+				pcpu->governor_enabled = 0;
+				goto err_stop;
+			}
 		}
 
 		if (!hispeed_freq)
@@ -593,7 +763,8 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			pcpu = &per_cpu(cpuinfo, j);
 			pcpu->governor_enabled = 0;
 			smp_wmb();
-			del_timer_sync(&pcpu->cpu_timer);
+			cpufreq_sampler_stop(&pcpu->sampler);
+			pcpu->timer_pending = 0;
 
 			/*
 			 * Reset idle exit time since we may cancel the timer
@@ -623,6 +794,18 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		break;
 	}
 	return 0;
+
+err_stop:
+	/* the samplers started so far are those of the cpus before j */
+	for_each_cpu(j, policy->cpus) {
+		pcpu = &per_cpu(cpuinfo, j);
+		if (!pcpu->governor_enabled)
+			break;
+		pcpu->governor_enabled = 0;
+		smp_wmb();
+		cpufreq_sampler_stop(&pcpu->sampler);
+	}
+	return rc;
 }
 
 static int cpufreq_interactive_idle_notifier(struct notifier_block *nb,
@@ -655,12 +838,11 @@ static int __init cpufreq_interactive_init(void)
 	min_sample_time = DEFAULT_MIN_SAMPLE_TIME;
 	timer_rate = DEFAULT_TIMER_RATE;
 
-	/* Initalize per-cpu timers */
+	/* Initalize per-cpu samplers */
 	for_each_possible_cpu(i) {
 		pcpu = &per_cpu(cpuinfo, i);
-		init_timer(&pcpu->cpu_timer);
-		pcpu->cpu_timer.function = cpufreq_interactive_timer;
-		pcpu->cpu_timer.data = i;
+		pcpu->sampler.name = "interactive";
+		pcpu->sampler.sample = cpufreq_interactive_timer;
 	}
 
 	up_task = kthread_create(cpufreq_interactive_up_task, NULL,
@@ -686,6 +868,7 @@ static int __init cpufreq_interactive_init(void)
 	mutex_init(&set_speed_lock);
 
 	idle_notifier_register(&cpufreq_interactive_idle_nb);
+	cpufreq_register_input_notifier(&cpufreq_interactive_input_nb);
 
 	return cpufreq_register_governor(&cpufreq_gov_interactive);
 
@@ -702,6 +885,7 @@ module_init(cpufreq_interactive_init);
 
 static void __exit cpufreq_interactive_exit(void)
 {
+	cpufreq_unregister_input_notifier(&cpufreq_interactive_input_nb);
 	cpufreq_unregister_governor(&cpufreq_gov_interactive);
 	kthread_stop(up_task);
 	put_task_struct(up_task);
@@ -37,107 +37,21 @@
 #define EARLYSUSPEND_HOTPLUGLOCK 1
 
 /*
- * runqueue average
+ * runqueue average, maintained by the scheduler on enqueue/dequeue
  */
 
-#define RQ_AVG_TIMER_RATE	10
+static struct nr_running_avg rq_avg;
 
-struct runqueue_data {
-	unsigned int nr_run_avg;
-	unsigned int update_rate;
-	int64_t last_time;
-	int64_t total_time;
-	struct delayed_work work;
-	struct workqueue_struct *nr_run_wq;
-	spinlock_t lock;
-};
-
-static struct runqueue_data *rq_data;
-static void rq_work_fn(struct work_struct *work);
-
-static void start_rq_work(void)
+static void reset_rq_avg(void)
 {
-	rq_data->nr_run_avg = 0;
-	rq_data->last_time = 0;
-	rq_data->total_time = 0;
-	if (rq_data->nr_run_wq == NULL)
-		rq_data->nr_run_wq =
-			create_singlethread_workqueue("nr_run_avg");
-
-	queue_delayed_work(rq_data->nr_run_wq, &rq_data->work,
-			   msecs_to_jiffies(rq_data->update_rate));
-	return;
-}
-
-static void stop_rq_work(void)
-{
-	if (rq_data->nr_run_wq)
-		cancel_delayed_work(&rq_data->work);
-	return;
-}
-
-static int __init init_rq_avg(void)
-{
-	rq_data = kzalloc(sizeof(struct runqueue_data), GFP_KERNEL);
-	if (rq_data == NULL) {
-		pr_err("%s cannot allocate memory\n", __func__);
-		return -ENOMEM;
-	}
-	spin_lock_init(&rq_data->lock);
-	rq_data->update_rate = RQ_AVG_TIMER_RATE;
-	INIT_DELAYED_WORK_DEFERRABLE(&rq_data->work, rq_work_fn);
-
-	return 0;
-}
-
-static void rq_work_fn(struct work_struct *work)
-{
-	int64_t time_diff = 0;
-	int64_t nr_run = 0;
-	unsigned long flags = 0;
-	int64_t cur_time = ktime_to_ns(ktime_get());
-
-	spin_lock_irqsave(&rq_data->lock, flags);
-
-	if (rq_data->last_time == 0)
-		rq_data->last_time = cur_time;
-	if (rq_data->nr_run_avg == 0)
-		rq_data->total_time = 0;
-
-	nr_run = nr_running() * 100;
-	time_diff = cur_time - rq_data->last_time;
-	do_div(time_diff, 1000 * 1000);
-
-	if (time_diff != 0 && rq_data->total_time != 0) {
-		nr_run = (nr_run * time_diff) +
-			(rq_data->nr_run_avg * rq_data->total_time);
-		do_div(nr_run, rq_data->total_time + time_diff);
-	}
-	rq_data->nr_run_avg = nr_run;
-	rq_data->total_time += time_diff;
-	rq_data->last_time = cur_time;
-
-	if (rq_data->update_rate != 0)
-		queue_delayed_work(rq_data->nr_run_wq, &rq_data->work,
-				   msecs_to_jiffies(rq_data->update_rate));
-
-	spin_unlock_irqrestore(&rq_data->lock, flags);
+	memset(&rq_avg, 0, sizeof(rq_avg));
 }
 
 static unsigned int get_nr_run_avg(void)
 {
-	unsigned int nr_run_avg;
-	unsigned long flags = 0;
-
-	spin_lock_irqsave(&rq_data->lock, flags);
-	nr_run_avg = rq_data->nr_run_avg;
-	rq_data->nr_run_avg = 0;
-	spin_unlock_irqrestore(&rq_data->lock, flags);
-
-	return nr_run_avg;
+	return sched_get_nr_running_avg(-1, &rq_avg);
 }
 
-
 /*
  * dbs is used in this file as a shortform for demandbased switching
  * It helps to keep variable names smaller, simpler
@@ -163,6 +77,7 @@ static unsigned int get_nr_run_avg(void)
 #define DEF_CPU_DOWN_RATE			(20)
 #define DEF_FREQ_STEP				(37)
 #define DEF_START_DELAY				(0)
+#define DEF_INPUT_BOOST_FREQ			(800000)
 
 #define UP_THRESHOLD_AT_MIN_FREQ		(40)
 #define FREQ_FOR_RESPONSIVENESS			(400000)
@@ -183,7 +98,7 @@ static int hotplug_freq[4][2] = {
 
 static unsigned int min_sampling_rate;
 
-static void do_dbs_timer(struct work_struct *work);
+static void do_dbs_timer(struct cpufreq_sampler *sampler, unsigned int cpu);
 static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 				unsigned int event);
 
@@ -205,9 +120,10 @@ struct cpu_dbs_info_s {
 	cputime64_t prev_cpu_wall;
 	cputime64_t prev_cpu_nice;
 	struct cpufreq_policy *cur_policy;
-	struct delayed_work work;
+	struct cpufreq_sampler sampler;
 	struct work_struct up_work;
 	struct work_struct down_work;
+	struct work_struct boost_work;
 	struct cpufreq_frequency_table *freq_table;
 	unsigned int rate_mult;
 	int cpu;
@@ -247,6 +163,10 @@ static struct dbs_tuners {
 	unsigned int min_cpu_lock;
 	atomic_t hotplug_lock;
 	unsigned int dvfs_debug;
+	unsigned int park_cpus;
+	unsigned int input_boost_freq;
+	unsigned int input_boost_duration;
+	unsigned int input_boost_cpus;
 	unsigned int max_freq;
 	unsigned int min_freq;
 #ifdef CONFIG_HAS_EARLYSUSPEND
@@ -267,6 +187,7 @@ static struct dbs_tuners {
 	.min_cpu_lock = DEF_MIN_CPU_LOCK,
 	.hotplug_lock = ATOMIC_INIT(0),
 	.dvfs_debug = 0,
+	.input_boost_freq = DEF_INPUT_BOOST_FREQ,
 #ifdef CONFIG_HAS_EARLYSUSPEND
 	.early_suspend = -1,
 #endif
@@ -288,7 +209,7 @@ static void apply_hotplug_lock(void)
 
 	/* do turn_on/off cpus */
 	dbs_info = &per_cpu(od_cpu_dbs_info, 0); /* from CPU0 */
-	online = num_online_cpus();
+	online = num_usable_cpus();
 	possible = num_possible_cpus();
 	lock = atomic_read(&g_hotplug_lock);
 	flag = lock - online;
@@ -348,7 +269,7 @@ void cpufreq_pegasusq_min_cpu_lock(unsigned int num_core)
 	dbs_tuners_ins.min_cpu_lock = min(num_core, num_possible_cpus());
 
 	dbs_info = &per_cpu(od_cpu_dbs_info, 0); /* from CPU0 */
-	online = num_online_cpus();
+	online = num_usable_cpus();
 	flag = (int)num_core - online;
 	if (flag <= 0)
 		return;
@@ -363,7 +284,7 @@ void cpufreq_pegasusq_min_cpu_unlock(void)
 	dbs_tuners_ins.min_cpu_lock = 0;
 
 	dbs_info = &per_cpu(od_cpu_dbs_info, 0); /* from CPU0 */
-	online = num_online_cpus();
+	online = num_usable_cpus();
 	lock = atomic_read(&g_hotplug_lock);
 	if (lock == 0)
 		return;
@@ -373,6 +294,28 @@ void cpufreq_pegasusq_min_cpu_unlock(void)
 	queue_work_on(dbs_info->cpu, dvfs_workqueue, &dbs_info->down_work);
 }
 
+/*
+ * Touch input boost: for input_boost_duration usecs after touch events
+ * the frequency is kept at or above input_boost_freq and at least
+ * input_boost_cpus cores are kept usable.
+ */
+static unsigned long input_boost_end = INITIAL_JIFFIES; /* read unlocked */
+static unsigned long nr_input_boosts;
+
+static bool input_boost_active(void)
+{
+	return dbs_tuners_ins.input_boost_duration &&
+		time_before(jiffies, ACCESS_ONCE(input_boost_end));
+}
+
+static unsigned int input_boost_floor(struct cpufreq_policy *policy)
+{
+	if (!input_boost_active())
+		return 0;
+
+	return min(dbs_tuners_ins.input_boost_freq, policy->max);
+}
+
 /*
  * History of CPU usage
  */
@@ -445,6 +388,14 @@ static ssize_t show_sampling_rate_min(struct kobject *kobj,
 
 define_one_global_ro(sampling_rate_min);
 
+static ssize_t show_input_boosts(struct kobject *kobj,
+				 struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", nr_input_boosts);
+}
+
+define_one_global_ro(input_boosts);
+
 /* cpufreq_pegasusq Governor Tunables */
 #define show_one(file_name, object)					\
 static ssize_t show_##file_name						\
@@ -467,6 +418,10 @@ show_one(up_nr_cpus, up_nr_cpus);
 show_one(max_cpu_lock, max_cpu_lock);
 show_one(min_cpu_lock, min_cpu_lock);
 show_one(dvfs_debug, dvfs_debug);
+show_one(park_cpus, park_cpus);
+show_one(input_boost_freq, input_boost_freq);
+show_one(input_boost_duration, input_boost_duration);
+show_one(input_boost_cpus, input_boost_cpus);
 static ssize_t show_hotplug_lock(struct kobject *kobj,
 				struct attribute *attr, char *buf)
 {
@@ -786,6 +741,59 @@ static ssize_t store_dvfs_debug(struct kobject *a, struct attribute *b,
 	return count;
 }
 
+static ssize_t store_park_cpus(struct kobject *a, struct attribute *b,
+			       const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+	if (ret != 1)
+		return -EINVAL;
+#ifndef CONFIG_CPU_PARKING
+	if (input)
+		return -EINVAL;
+#endif
+	dbs_tuners_ins.park_cpus = input > 0;
+	return count;
+}
+
+static ssize_t store_input_boost_freq(struct kobject *a, struct attribute *b,
+				      const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+	if (ret != 1)
+		return -EINVAL;
+	dbs_tuners_ins.input_boost_freq = input;
+	return count;
+}
+
+static ssize_t store_input_boost_duration(struct kobject *a,
+					  struct attribute *b,
+					  const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+	if (ret != 1)
+		return -EINVAL;
+	dbs_tuners_ins.input_boost_duration = input;
+	return count;
+}
+
+static ssize_t store_input_boost_cpus(struct kobject *a, struct attribute *b,
+				      const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+	if (ret != 1)
+		return -EINVAL;
+	dbs_tuners_ins.input_boost_cpus = min(input, num_possible_cpus());
+	return count;
+}
+
 define_one_global_rw(sampling_rate);
 define_one_global_rw(io_is_busy);
 define_one_global_rw(up_threshold);
@@ -802,6 +810,10 @@ define_one_global_rw(max_cpu_lock);
 define_one_global_rw(min_cpu_lock);
 define_one_global_rw(hotplug_lock);
 define_one_global_rw(dvfs_debug);
+define_one_global_rw(park_cpus);
+define_one_global_rw(input_boost_freq);
+define_one_global_rw(input_boost_duration);
+define_one_global_rw(input_boost_cpus);
 
 static struct attribute *dbs_attributes[] = {
 	&sampling_rate_min.attr,
@@ -823,6 +835,13 @@ static struct attribute *dbs_attributes[] = {
 	&min_cpu_lock.attr,
 	&hotplug_lock.attr,
 	&dvfs_debug.attr,
+	/* park idle cores instead of unplugging them */
+	&park_cpus.attr,
+	/* floor and cores held after touch input, see input_boost_floor */
+	&input_boost_freq.attr,
+	&input_boost_duration.attr,
+	&input_boost_cpus.attr,
+	&input_boosts.attr,
 	&hotplug_freq_1_1.attr,
 	&hotplug_freq_2_0.attr,
 	&hotplug_freq_2_1.attr,
@@ -848,7 +867,7 @@ static struct attribute_group dbs_attr_group = {
 static void cpu_up_work(struct work_struct *work)
 {
 	int cpu;
-	int online = num_online_cpus();
+	int online = num_usable_cpus();
 	int nr_up = dbs_tuners_ins.up_nr_cpus;
 	int min_cpu_lock = dbs_tuners_ins.min_cpu_lock;
 	int hotplug_lock = atomic_read(&g_hotplug_lock);
@@ -866,39 +885,43 @@ static void cpu_up_work(struct work_struct *work)
 	if (num_possible_cpus() == 4) {
 		if (online == 1) {
 			pr_debug("CPU_UP 3\n");
-				cpu_up(num_possible_cpus() - 1);
+				cpu_core_up(num_possible_cpus() - 1);
 			nr_up -= 1;
 		}
 
-		for_each_cpu_not(cpu, cpu_online_mask) {
+		for_each_possible_cpu(cpu) {
+			if (cpu_usable(cpu))
+				continue;
 			if (nr_up-- == 0)
 				break;
 			if (cpu == 0)
 				continue;
 			pr_debug("CPU_UP %d\n", cpu);
-			cpu_up(cpu);
+			cpu_core_up(cpu);
 		}
 	} else {
 		pr_info("CPU_UP 1\n");
-		cpu_up(1);
+		cpu_core_up(1);
 	}
 }
 
 static void cpu_down_work(struct work_struct *work)
 {
 	int cpu;
-	int online = num_online_cpus();
+	int online = num_usable_cpus();
 	int nr_down = 1;
 	int hotplug_lock = atomic_read(&g_hotplug_lock);
 
 	if (hotplug_lock)
 		nr_down = online - hotplug_lock;
+	if (nr_down <= 0)
+		return;
 
 	for_each_online_cpu(cpu) {
-		if (cpu == 0)
+		if (cpu == 0 || cpu_parked(cpu))
 			continue;
 		pr_debug("CPU_DOWN %d\n", cpu);
-		cpu_down(cpu);
+		cpu_core_down(cpu, dbs_tuners_ins.park_cpus);
 		if (--nr_down == 0)
 			break;
 	}
@@ -914,6 +937,69 @@ static void dbs_freq_increase(struct cpufreq_policy *p, unsigned int freq)
 	__cpufreq_driver_target(p, freq, CPUFREQ_RELATION_L);
 }
 
+static void input_boost_work(struct work_struct *work)
+{
+	struct cpu_dbs_info_s *dbs_info =
+		container_of(work, struct cpu_dbs_info_s, boost_work);
+	struct cpufreq_policy *policy = dbs_info->cur_policy;
+	unsigned int boost_freq;
+	int cpu, nr_up;
+
+	mutex_lock(&dbs_info->timer_mutex);
+	boost_freq = input_boost_floor(policy);
+	if (policy->cur < boost_freq)
+		dbs_freq_increase(policy, boost_freq);
+	mutex_unlock(&dbs_info->timer_mutex);
+
+	/* hotplug_lock, including the early suspend one, wins over boost */
+	if (atomic_read(&g_hotplug_lock))
+		return;
+
+	nr_up = dbs_tuners_ins.input_boost_cpus;
+	if (dbs_tuners_ins.max_cpu_lock)
+		nr_up = min_t(int, nr_up, dbs_tuners_ins.max_cpu_lock);
+	nr_up -= num_usable_cpus();
+
+	for_each_possible_cpu(cpu) {
+		if (nr_up <= 0)
+			break;
+		if (cpu_usable(cpu))
+			continue;
+		pr_debug("CPU_UP %d (input boost)\n", cpu);
+		if (!cpu_core_up(cpu))
+			nr_up--;
+	}
+}
+
+/*
+ * Called from the input event path with interrupts disabled.  Every
+ * frame extends the boost window; only its start queues the boost work.
+ */
+static int dbs_input_notifier_call(struct notifier_block *nb,
+				   unsigned long val, void *data)
+{
+	struct cpu_dbs_info_s *dbs_info = &per_cpu(od_cpu_dbs_info, 0);
+	unsigned long now = jiffies;
+	bool start;
+
+	if (!dbs_tuners_ins.input_boost_duration || !dbs_enable)
+		return NOTIFY_DONE;
+
+	start = !time_before(now, input_boost_end);
+	input_boost_end = now +
+		usecs_to_jiffies(dbs_tuners_ins.input_boost_duration);
+	if (!start)
+		return NOTIFY_OK;
+
+	nr_input_boosts++;
+	queue_work_on(dbs_info->cpu, dvfs_workqueue, &dbs_info->boost_work);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block dbs_input_notifier = {
+	.notifier_call = dbs_input_notifier_call,
+};
+
 /*
  * print hotplug debugging info.
  * which 1 : UP, 0 : DOWN
@@ -946,7 +1032,7 @@ static int check_up(void)
 	if (hotplug_lock > 0)
 		return 0;
 
-	online = num_online_cpus();
+	online = num_usable_cpus();
 	up_freq = hotplug_freq[online - 1][HOTPLUG_UP_INDEX];
 	up_rq = hotplug_rq[online - 1][HOTPLUG_UP_INDEX];
 
@@ -1001,13 +1087,16 @@ static int check_down(void)
 	if (hotplug_lock > 0)
 		return 0;
 
-	online = num_online_cpus();
+	online = num_usable_cpus();
 	down_freq = hotplug_freq[online - 1][HOTPLUG_DOWN_INDEX];
 	down_rq = hotplug_rq[online - 1][HOTPLUG_DOWN_INDEX];
 
 	if (online == 1)
 		return 0;
 
+	if (online <= dbs_tuners_ins.input_boost_cpus && input_boost_active())
+		return 0;
+
 	if (dbs_tuners_ins.max_cpu_lock != 0
 		&& online > dbs_tuners_ins.max_cpu_lock)
 		return 1;
@@ -1052,6 +1141,7 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 	int max_hotplug_rate = max(dbs_tuners_ins.cpu_up_rate,
 				   dbs_tuners_ins.cpu_down_rate);
 	int up_threshold = dbs_tuners_ins.up_threshold;
+	unsigned int boost_freq;
 
 	policy = this_dbs_info->cur_policy;
 
@@ -1136,6 +1226,8 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 	if (hotplug_history->num_hist  == max_hotplug_rate)
 		hotplug_history->num_hist = 0;
 
+	boost_freq = input_boost_floor(policy);
+
 	/* Check for frequency increase */
 	if (policy->cur < FREQ_FOR_RESPONSIVENESS) {
 		up_threshold = UP_THRESHOLD_AT_MIN_FREQ;
@@ -1145,6 +1237,8 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 		/* Maximum increase of 300MHZ one-step */
 		int inc = min((policy->max * dbs_tuners_ins.freq_step) / 100, 300000U);
 		int target = min(policy->max, policy->cur + inc);
+
+		target = max_t(int, target, boost_freq);
 		/* If switching to max speed, apply sampling_down_factor */
 		if (policy->cur < policy->max && target == policy->max)
 			this_dbs_info->rate_mult =
@@ -1153,6 +1247,11 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 		return;
 	}
 
+	if (policy->cur < boost_freq) {
+		dbs_freq_increase(policy, boost_freq);
+		return;
+	}
+
 	/* Check for frequency decrease */
 #ifndef CONFIG_ARCH_EXYNOS4
 	/* if we cannot reduce the frequency anymore, break out early */
@@ -1190,6 +1289,9 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 			&& (max_load_freq / freq_next) > down_thres)
 			freq_next = FREQ_FOR_RESPONSIVENESS;
 
+		if (freq_next < boost_freq)
+			freq_next = boost_freq;
+
 		if (policy->cur == freq_next)
 			return;
 
@@ -1198,50 +1300,45 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 	}
 }
 
-static void do_dbs_timer(struct work_struct *work)
+/*
+ * Runs from the shared sampling slot on whichever cpu of the policy is
+ * busy at the time; all cpus are sampled from here.
+ */
+static void do_dbs_timer(struct cpufreq_sampler *sampler, unsigned int cpu)
 {
 	struct cpu_dbs_info_s *dbs_info =
-		container_of(work, struct cpu_dbs_info_s, work.work);
-	unsigned int cpu = dbs_info->cpu;
-	int delay;
+		container_of(sampler, struct cpu_dbs_info_s, sampler);
 
 	mutex_lock(&dbs_info->timer_mutex);
 
 	dbs_check_cpu(dbs_info);
-	/* We want all CPUs to do sampling nearly on
-	 * same jiffy
-	 */
-	delay = usecs_to_jiffies(dbs_tuners_ins.sampling_rate
-				 * dbs_info->rate_mult);
-
-	if (num_online_cpus() > 1)
-		delay -= jiffies % delay;
+	sampler->period_us = dbs_tuners_ins.sampling_rate * dbs_info->rate_mult;
 
-	queue_delayed_work_on(cpu, dvfs_workqueue, &dbs_info->work, delay);
 	mutex_unlock(&dbs_info->timer_mutex);
 }
 
-static inline void dbs_timer_init(struct cpu_dbs_info_s *dbs_info)
+static inline int dbs_timer_init(struct cpu_dbs_info_s *dbs_info)
 {
-	/* We want all CPUs to do sampling nearly on same jiffy */
-	int delay = usecs_to_jiffies(DEF_START_DELAY * 1000 * 1000
-				     + dbs_tuners_ins.sampling_rate);
-	if (num_online_cpus() > 1)
-		delay -= jiffies % delay;
+	unsigned long delay = usecs_to_jiffies(DEF_START_DELAY * 1000 * 1000);
 
-	INIT_DELAYED_WORK_DEFERRABLE(&dbs_info->work, do_dbs_timer);
+	dbs_info->sampler.name = "pegasusq";
+	dbs_info->sampler.period_us = dbs_tuners_ins.sampling_rate;
+	dbs_info->sampler.sample = do_dbs_timer;
 	INIT_WORK(&dbs_info->up_work, cpu_up_work);
 	INIT_WORK(&dbs_info->down_work, cpu_down_work);
+	INIT_WORK(&dbs_info->boost_work, input_boost_work);
 
-	queue_delayed_work_on(dbs_info->cpu, dvfs_workqueue,
-			      &dbs_info->work, delay + 2 * HZ);
+	return cpufreq_sampler_start(&dbs_info->sampler,
+				     dbs_info->cur_policy->cpus,
+				     delay + 2 * HZ);
 }
 
 static inline void dbs_timer_exit(struct cpu_dbs_info_s *dbs_info)
 {
-	cancel_delayed_work_sync(&dbs_info->work);
+	cpufreq_sampler_stop(&dbs_info->sampler);
 	cancel_work_sync(&dbs_info->up_work);
 	cancel_work_sync(&dbs_info->down_work);
+	cancel_work_sync(&dbs_info->boost_work);
 }
 
 #if !EARLYSUSPEND_HOTPLUGLOCK
@@ -1302,7 +1399,6 @@ static void cpufreq_pegasusq_early_suspend(struct early_suspend *h)
 	atomic_set(&g_hotplug_lock,
 	    (dbs_tuners_ins.min_cpu_lock) ? dbs_tuners_ins.min_cpu_lock : 1);
 	apply_hotplug_lock();
-	stop_rq_work();
 #endif
 }
 static void cpufreq_pegasusq_late_resume(struct early_suspend *h)
@@ -1315,7 +1411,7 @@ static void cpufreq_pegasusq_late_resume(struct early_suspend *h)
 	dbs_tuners_ins.sampling_rate = prev_sampling_rate;
 #if EARLYSUSPEND_HOTPLUGLOCK
 	apply_hotplug_lock();
-	start_rq_work();
+	reset_rq_avg();
 #endif
 }
 #endif
@@ -1338,7 +1434,7 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 		dbs_tuners_ins.max_freq = policy->max;
 		dbs_tuners_ins.min_freq = policy->min;
 		hotplug_history->num_hist = 0;
-		start_rq_work();
+		reset_rq_avg();
 
 		mutex_lock(&dbs_mutex);
 
@@ -1378,7 +1474,24 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 		register_reboot_notifier(&reboot_notifier);
 
 		mutex_init(&this_dbs_info->timer_mutex);
-		dbs_timer_init(this_dbs_info);
+		rc = dbs_timer_init(this_dbs_info);
+		if (rc) {
+			mutex_lock(&dbs_mutex);
+			mutex_destroy(&this_dbs_info->timer_mutex);
+			unregister_reboot_notifier(&reboot_notifier);
+			dbs_enable--;
+			mutex_unlock(&dbs_mutex);
+			if (!dbs_enable)
+				sysfs_remove_group(cpufreq_global_kobject,
+						   &dbs_attr_group);
+			return rc;
+		}
+
+		/* one notifier for all the policies, from the first on */
+		mutex_lock(&dbs_mutex);
+		if (dbs_enable == 1)
+			cpufreq_register_input_notifier(&dbs_input_notifier);
+		mutex_unlock(&dbs_mutex);
 
 #if !EARLYSUSPEND_HOTPLUGLOCK
 		register_pm_notifier(&pm_notifier);
@@ -1396,6 +1509,11 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 		unregister_pm_notifier(&pm_notifier);
 #endif
 
+		/* before the boost work is cancelled, it cannot come back */
+		mutex_lock(&dbs_mutex);
+		if (dbs_enable == 1)
+			cpufreq_unregister_input_notifier(&dbs_input_notifier);
+		mutex_unlock(&dbs_mutex);
 		dbs_timer_exit(this_dbs_info);
 
 		mutex_lock(&dbs_mutex);
@@ -1406,8 +1524,6 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 		dbs_enable--;
 		mutex_unlock(&dbs_mutex);
 
-		stop_rq_work();
-
 		if (!dbs_enable)
 			sysfs_remove_group(cpufreq_global_kobject,
 					   &dbs_attr_group);
@@ -1436,15 +1552,10 @@ static int __init cpufreq_gov_dbs_init(void)
 {
 	int ret;
 
-	ret = init_rq_avg();
-	if (ret)
-		return ret;
-
 	hotplug_history = kzalloc(sizeof(struct cpu_usage_history), GFP_KERNEL);
 	if (!hotplug_history) {
 		pr_err("%s cannot create hotplug history array\n", __func__);
-		ret = -ENOMEM;
-		goto err_hist;
+		return -ENOMEM;
 	}
 
 	dvfs_workqueue = create_workqueue("kpegasusq");
@@ -1470,8 +1581,6 @@ err_reg:
 	destroy_workqueue(dvfs_workqueue);
 err_queue:
 	kfree(hotplug_history);
-err_hist:
-	kfree(rq_data);
 	return ret;
 }
 
@@ -1480,7 +1589,6 @@ static void __exit cpufreq_gov_dbs_exit(void)
 	cpufreq_unregister_governor(&cpufreq_gov_pegasusq);
 	destroy_workqueue(dvfs_workqueue);
 	kfree(hotplug_history);
-	kfree(rq_data);
 }
 
 MODULE_AUTHOR("ByungChang Cha <bc.cha@samsung.com>");
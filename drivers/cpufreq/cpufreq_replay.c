@@ -0,0 +1,796 @@
+/*
+ *  drivers/cpufreq/cpufreq_replay.c
+ *
+ *  Record per-cpu load traces on a device and replay them against any
+ *  cpufreq governor, typically on top of the simulated fake-cpufreq
+ *  driver, to compare governors and their tunables offline.
+ *
+ *  A trace is a list of samples "t_ms cpu busy% nr_running*100 freq",
+ *  one per online cpu and sampling period.  On replay the recorded work
+ *  of each sample (busy time at the recorded frequency) is regenerated
+ *  by spinning kthreads bound to that cpu, stretched or shrunk by the
+ *  ratio of the recorded to the current frequency, with as many
+ *  spinning threads as the recorded runqueue depth.  The governor under
+ *  test therefore sees the same idle time and runqueue signals it would
+ *  have seen on the device, and its decisions feed back into the load.
+ *
+ *  debugfs files in cpufreq_replay/:
+ *    control  "record [period_ms]", "replay" or "stop"
+ *    trace    read the recorded trace, or write one to be replayed
+ *    report   time at each frequency, transitions, response to load
+ *             steps and work that could not be delivered in time
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/cpu.h>
+#include <linux/cpumask.h>
+#include <linux/debugfs.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/tick.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+#define REPLAY_MAX_SAMPLES	(1 << 16)
+#define REPLAY_MAX_TRACE	(REPLAY_MAX_SAMPLES * 32)
+#define REPLAY_DEF_PERIOD_MS	10
+#define REPLAY_SLOTS		4	/* spinning threads per cpu */
+#define REPLAY_MAX_FREQS	64
+
+struct replay_sample {
+	u32 t_ms;
+	u16 nr_run;		/* runqueue depth * 100 */
+	u8 cpu;
+	u8 busy;		/* percent */
+	u32 freq;		/* kHz */
+};
+
+enum replay_state {
+	REPLAY_IDLE,
+	REPLAY_RECORDING,
+	REPLAY_REPLAYING,
+};
+
+/*
+ * state only changes under replay_mutex.  A recording that fills the trace
+ * and a replay that runs to completion just flag it, and the next control
+ * or trace access moves state back to idle.
+ */
+static DEFINE_MUTEX(replay_mutex);
+static enum replay_state state;
+
+static struct replay_sample *samples;
+static unsigned int nr_samples;
+static unsigned int period_ms = REPLAY_DEF_PERIOD_MS;
+
+/* recording */
+static struct delayed_work record_work;
+static unsigned long record_start;
+static bool record_full;
+static struct {
+	u64 idle;
+	u64 wall;
+	struct nr_running_avg nr_avg;
+} record_prev[NR_CPUS];
+
+/* replay: per-cpu demand of the current interval */
+struct replay_cpu {
+	wait_queue_head_t wait;
+	unsigned long gen;
+	ktime_t busy_until;
+	unsigned int nr_active;
+	struct task_struct *slot[REPLAY_SLOTS];
+};
+
+static struct replay_cpu replay_cpu[NR_CPUS];
+static struct task_struct *replay_task;
+static bool replay_nb_registered;
+
+/* replay report */
+static DEFINE_SPINLOCK(report_lock);
+static struct {
+	ktime_t start;
+	ktime_t stop;
+	bool done;
+	ktime_t last_change;
+	unsigned int cur_freq;
+	unsigned int transitions;
+	unsigned int nr_freqs;
+	unsigned int freq[REPLAY_MAX_FREQS];
+	u64 time_ns[REPLAY_MAX_FREQS];
+
+	/* load steps waiting for the frequency to catch up */
+	unsigned int max_freq;
+	unsigned int last_demand;
+	bool step_pending;
+	ktime_t step_time;
+	unsigned int step_target;
+	unsigned int steps;
+	unsigned int steps_met;
+	u64 step_latency_ns;
+	u64 step_latency_max_ns;
+
+	u64 demand_ns;		/* busy time asked for */
+	u64 deficit_ns;		/* part that did not fit in its period */
+} report;
+
+static unsigned int step_khz = 300000;
+module_param(step_khz, uint, 0644);
+MODULE_PARM_DESC(step_khz, "Demand increase counted as a load step, in kHz");
+
+/************************** recording ******************************/
+
+static void record_sample(struct work_struct *work)
+{
+	unsigned int t_ms = jiffies_to_msecs(jiffies - record_start);
+	unsigned int cpu;
+
+	for_each_online_cpu(cpu) {
+		struct replay_sample *s;
+		u64 idle, wall, d_idle, d_wall;
+		unsigned int nr_run;
+
+		idle = get_cpu_idle_time_us(cpu, &wall);
+		idle += get_cpu_iowait_time_us(cpu, NULL);
+		nr_run = sched_get_nr_running_avg(cpu,
+						  &record_prev[cpu].nr_avg);
+
+		d_idle = idle - record_prev[cpu].idle;
+		d_wall = wall - record_prev[cpu].wall;
+		record_prev[cpu].idle = idle;
+		record_prev[cpu].wall = wall;
+
+		/* first sample of a cpu only establishes the baseline */
+		if (!t_ms || !d_wall || d_idle > d_wall)
+			continue;
+		if (nr_samples >= REPLAY_MAX_SAMPLES) {
+			record_full = true;
+			pr_info("cpufreq_replay: trace full, recording stopped\n");
+			return;
+		}
+
+		s = &samples[nr_samples++];
+		s->t_ms = t_ms;
+		s->cpu = cpu;
+		s->busy = div64_u64((d_wall - d_idle) * 100, d_wall);
+		s->nr_run = min(nr_run, 65535U);
+		s->freq = cpufreq_quick_get(cpu);
+	}
+
+	schedule_delayed_work(&record_work, msecs_to_jiffies(period_ms));
+}
+
+static int record_start_locked(unsigned int period)
+{
+	u64 wall;
+	int cpu;
+
+	if (get_cpu_idle_time_us(0, &wall) == -1ULL)
+		return -ENODEV;
+
+	period_ms = period ? period : REPLAY_DEF_PERIOD_MS;
+	nr_samples = 0;
+	record_full = false;
+	memset(record_prev, 0, sizeof(record_prev));
+	for_each_online_cpu(cpu)
+		record_prev[cpu].idle = get_cpu_idle_time_us(cpu,
+						&record_prev[cpu].wall) +
+					get_cpu_iowait_time_us(cpu, NULL);
+
+	record_start = jiffies;
+	state = REPLAY_RECORDING;
+	schedule_delayed_work(&record_work, msecs_to_jiffies(period_ms));
+	return 0;
+}
+
+/************************** replay *********************************/
+
+static int replay_freq_index(unsigned int freq)
+{
+	unsigned int i;
+
+	for (i = 0; i < report.nr_freqs; i++)
+		if (report.freq[i] == freq)
+			return i;
+	if (report.nr_freqs == REPLAY_MAX_FREQS)
+		return -1;
+	report.freq[report.nr_freqs] = freq;
+	return report.nr_freqs++;
+}
+
+/* Called with report_lock held. */
+static void replay_check_step(ktime_t now, unsigned int freq)
+{
+	u64 lat;
+
+	if (!report.step_pending || freq < report.step_target)
+		return;
+
+	lat = ktime_to_ns(ktime_sub(now, report.step_time));
+	report.step_pending = false;
+	report.steps_met++;
+	report.step_latency_ns += lat;
+	report.step_latency_max_ns = max(report.step_latency_max_ns, lat);
+}
+
+/* Called with report_lock held. */
+static void replay_account_freq(ktime_t now, unsigned int new_freq)
+{
+	int i = replay_freq_index(report.cur_freq);
+
+	if (i >= 0)
+		report.time_ns[i] += ktime_to_ns(ktime_sub(now,
+						report.last_change));
+	report.last_change = now;
+	report.cur_freq = new_freq;
+	replay_check_step(now, new_freq);
+}
+
+static int replay_transition(struct notifier_block *nb, unsigned long val,
+			     void *data)
+{
+	struct cpufreq_freqs *freqs = data;
+	unsigned long flags;
+
+	/* a shared policy notifies every cpu; count each change once */
+	if (val != CPUFREQ_POSTCHANGE || freqs->cpu != cpumask_first(
+							cpu_online_mask))
+		return 0;
+
+	spin_lock_irqsave(&report_lock, flags);
+	if (state == REPLAY_REPLAYING && !report.done) {
+		report.transitions++;
+		replay_account_freq(ktime_get(), freqs->new);
+	}
+	spin_unlock_irqrestore(&report_lock, flags);
+	return 0;
+}
+
+static struct notifier_block replay_transition_nb = {
+	.notifier_call = replay_transition,
+};
+
+static int replay_slot_thread(void *data)
+{
+	unsigned long arg = (unsigned long)data;
+	unsigned int cpu = arg / REPLAY_SLOTS, slot = arg % REPLAY_SLOTS;
+	struct replay_cpu *rc = &replay_cpu[cpu];
+	unsigned long gen = 0;
+	bool bound = false;
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(rc->wait, rc->gen != gen ||
+					 kthread_should_stop());
+		gen = rc->gen;
+		if (slot >= rc->nr_active)
+			continue;
+
+		/* the load of an offline cpu lands wherever it can run */
+		if (cpu_online(cpu) != bound) {
+			bound = cpu_online(cpu);
+			set_cpus_allowed_ptr(current, bound ?
+					     cpumask_of(cpu) : cpu_online_mask);
+		}
+
+		while (ktime_to_ns(ktime_sub(rc->busy_until, ktime_get())) > 0 &&
+		       !kthread_should_stop()) {
+			cpu_relax();
+			cond_resched();
+		}
+	}
+	return 0;
+}
+
+static void replay_interval(struct replay_sample *s, unsigned int n,
+			    ktime_t start)
+{
+	u64 period_ns = (u64)period_ms * NSEC_PER_MSEC;
+	unsigned int cur = cpufreq_quick_get(cpumask_first(cpu_online_mask));
+	unsigned int demand = 0, i;
+	unsigned long flags;
+
+	for (i = 0; i < n; i++) {
+		struct replay_cpu *rc = &replay_cpu[s[i].cpu];
+		u64 busy_ns = period_ns * s[i].busy / 100;
+		unsigned int f = s[i].freq ? s[i].freq : cur;
+
+		/* the same work takes longer at a lower frequency */
+		if (cur && f != cur)
+			busy_ns = div_u64(busy_ns * f, cur);
+
+		spin_lock_irqsave(&report_lock, flags);
+		report.demand_ns += busy_ns;
+		if (busy_ns > period_ns) {
+			report.deficit_ns += busy_ns - period_ns;
+			busy_ns = period_ns;
+		}
+		spin_unlock_irqrestore(&report_lock, flags);
+
+		demand = max(demand, f * s[i].busy / 100);
+		rc->nr_active = busy_ns ? clamp_t(unsigned int,
+				DIV_ROUND_CLOSEST(s[i].nr_run, 100),
+				1, REPLAY_SLOTS) : 0;
+		rc->busy_until = ktime_add_ns(start, busy_ns);
+		rc->gen++;
+		wake_up_all(&rc->wait);
+	}
+
+	/*
+	 * A load step is a rise in demanded frequency of at least step_khz
+	 * beyond the current one; it is met once the frequency reaches it.
+	 */
+	demand = min(demand, report.max_freq);
+	spin_lock_irqsave(&report_lock, flags);
+	if (!report.step_pending) {
+		if (demand >= report.last_demand + step_khz && demand > cur) {
+			report.step_pending = true;
+			report.step_time = start;
+			report.step_target = demand;
+			report.steps++;
+		}
+	} else if (demand > report.step_target) {
+		report.step_target = demand;
+	}
+	report.last_demand = demand;
+	replay_check_step(start, cur);
+	spin_unlock_irqrestore(&report_lock, flags);
+}
+
+static int replay_thread(void *data)
+{
+	unsigned int i = 0, j;
+	ktime_t t0 = ktime_get(), next;
+	unsigned long flags;
+
+	while (i < nr_samples && !kthread_should_stop()) {
+		unsigned int t_ms = samples[i].t_ms;
+
+		for (j = i; j < nr_samples && samples[j].t_ms == t_ms; j++)
+			;
+		next = ktime_add_ns(t0, (u64)t_ms * NSEC_PER_MSEC);
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_hrtimeout(&next, HRTIMER_MODE_ABS);
+
+		replay_interval(&samples[i], j - i, ktime_get());
+		i = j;
+	}
+
+	/* let the last interval run out */
+	next = ktime_add_ns(ktime_get(), (u64)period_ms * NSEC_PER_MSEC);
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	schedule_hrtimeout(&next, HRTIMER_MODE_ABS);
+
+	/* threads are reaped by replay_update_state_locked() */
+	spin_lock_irqsave(&report_lock, flags);
+	report.stop = ktime_get();
+	replay_account_freq(report.stop, report.cur_freq);
+	report.done = true;
+	spin_unlock_irqrestore(&report_lock, flags);
+
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static void replay_stop_threads(void)
+{
+	unsigned int cpu, slot;
+
+	if (replay_task) {
+		kthread_stop(replay_task);
+		replay_task = NULL;
+	}
+	for_each_possible_cpu(cpu) {
+		for (slot = 0; slot < REPLAY_SLOTS; slot++) {
+			if (!replay_cpu[cpu].slot[slot])
+				continue;
+			kthread_stop(replay_cpu[cpu].slot[slot]);
+			replay_cpu[cpu].slot[slot] = NULL;
+		}
+	}
+	if (replay_nb_registered) {
+		cpufreq_unregister_notifier(&replay_transition_nb,
+					    CPUFREQ_TRANSITION_NOTIFIER);
+		replay_nb_registered = false;
+	}
+}
+
+static int replay_start_locked(void)
+{
+	unsigned int cpu, slot;
+	struct cpufreq_policy *policy;
+	struct task_struct *t;
+	int ret;
+
+	if (!nr_samples)
+		return -ENODATA;
+
+	memset(&report, 0, sizeof(report));
+	policy = cpufreq_cpu_get(cpumask_first(cpu_online_mask));
+	if (!policy)
+		return -ENODEV;
+	report.max_freq = policy->cpuinfo.max_freq;
+	report.cur_freq = policy->cur;
+	cpufreq_cpu_put(policy);
+	report.start = report.last_change = ktime_get();
+
+	for_each_possible_cpu(cpu) {
+		struct replay_cpu *rc = &replay_cpu[cpu];
+
+		init_waitqueue_head(&rc->wait);
+		rc->gen = 0;
+		rc->nr_active = 0;
+		for (slot = 0; slot < REPLAY_SLOTS; slot++) {
+			t = kthread_create(replay_slot_thread,
+					   (void *)(unsigned long)
+					   (cpu * REPLAY_SLOTS + slot),
+					   "kreplay/%u:%u", cpu, slot);
+			if (IS_ERR(t)) {
+				ret = PTR_ERR(t);
+				goto err;
+			}
+			rc->slot[slot] = t;
+			wake_up_process(t);
+		}
+	}
+
+	ret = cpufreq_register_notifier(&replay_transition_nb,
+					CPUFREQ_TRANSITION_NOTIFIER);
+	if (ret)
+		goto err;
+	replay_nb_registered = true;
+
+	t = kthread_run(replay_thread, NULL, "kcpufreq_replay");
+	if (IS_ERR(t)) {
+		ret = PTR_ERR(t);
+		goto err;
+	}
+	replay_task = t;
+	state = REPLAY_REPLAYING;
+	return 0;
+
+err:
+	replay_stop_threads();
+	return ret;
+}
+
+/* Go back to idle after a full trace or a completed replay. */
+static void replay_update_state_locked(void)
+{
+	unsigned long flags;
+	bool done;
+
+	if (state == REPLAY_RECORDING && ACCESS_ONCE(record_full)) {
+		state = REPLAY_IDLE;
+	} else if (state == REPLAY_REPLAYING) {
+		spin_lock_irqsave(&report_lock, flags);
+		done = report.done;
+		spin_unlock_irqrestore(&report_lock, flags);
+		if (done) {
+			replay_stop_threads();
+			state = REPLAY_IDLE;
+		}
+	}
+}
+
+/************************** debugfs interface **********************/
+
+static ssize_t replay_control_write(struct file *file,
+				    const char __user *ubuf,
+				    size_t count, loff_t *ppos)
+{
+	char buf[32];
+	unsigned int period = 0;
+	int ret = 0;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	mutex_lock(&replay_mutex);
+	replay_update_state_locked();
+
+	if (!strncmp(buf, "record", 6)) {
+		if (state != REPLAY_IDLE)
+			ret = -EBUSY;
+		else if (sscanf(buf + 6, "%u", &period) < 0 || period > 1000)
+			ret = -EINVAL;
+		else
+			ret = record_start_locked(period);
+	} else if (!strncmp(buf, "replay", 6)) {
+		if (state != REPLAY_IDLE)
+			ret = -EBUSY;
+		else
+			ret = replay_start_locked();
+	} else if (!strncmp(buf, "stop", 4)) {
+		if (state == REPLAY_RECORDING) {
+			state = REPLAY_IDLE;
+			cancel_delayed_work_sync(&record_work);
+		} else if (state == REPLAY_REPLAYING) {
+			replay_stop_threads();
+			state = REPLAY_IDLE;
+		}
+	} else {
+		ret = -EINVAL;
+	}
+	mutex_unlock(&replay_mutex);
+
+	return ret ? ret : count;
+}
+
+static int replay_control_show(struct seq_file *m, void *v)
+{
+	static const char * const names[] = {
+		"idle", "recording", "replaying",
+	};
+
+	mutex_lock(&replay_mutex);
+	replay_update_state_locked();
+	seq_printf(m, "%s\n", names[state]);
+	mutex_unlock(&replay_mutex);
+	return 0;
+}
+
+static int replay_control_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, replay_control_show, NULL);
+}
+
+static const struct file_operations replay_control_fops = {
+	.open		= replay_control_open,
+	.read		= seq_read,
+	.write		= replay_control_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void *replay_trace_start(struct seq_file *m, loff_t *pos)
+{
+	if (*pos == 0)
+		return SEQ_START_TOKEN;
+	return *pos <= nr_samples ? &samples[*pos - 1] : NULL;
+}
+
+static void *replay_trace_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	return *pos <= nr_samples ? &samples[*pos - 1] : NULL;
+}
+
+static void replay_trace_stop(struct seq_file *m, void *v)
+{
+}
+
+static int replay_trace_show(struct seq_file *m, void *v)
+{
+	struct replay_sample *s = v;
+
+	if (v == SEQ_START_TOKEN)
+		seq_printf(m, "# period_ms=%u\n", period_ms);
+	else
+		seq_printf(m, "%u %u %u %u %u\n", s->t_ms, s->cpu, s->busy,
+			   s->nr_run, s->freq);
+	return 0;
+}
+
+static const struct seq_operations replay_trace_seq_ops = {
+	.start	= replay_trace_start,
+	.next	= replay_trace_next,
+	.stop	= replay_trace_stop,
+	.show	= replay_trace_show,
+};
+
+struct replay_trace_buf {
+	char *data;
+	size_t len;
+};
+
+static int replay_trace_open(struct inode *inode, struct file *file)
+{
+	struct replay_trace_buf *tb;
+
+	if ((file->f_flags & O_ACCMODE) == O_RDONLY)
+		return seq_open(file, &replay_trace_seq_ops);
+	if ((file->f_flags & O_ACCMODE) != O_WRONLY)
+		return -EINVAL;
+
+	mutex_lock(&replay_mutex);
+	replay_update_state_locked();
+	if (state != REPLAY_IDLE) {
+		mutex_unlock(&replay_mutex);
+		return -EBUSY;
+	}
+	mutex_unlock(&replay_mutex);
+
+	tb = kzalloc(sizeof(*tb), GFP_KERNEL);
+	if (!tb)
+		return -ENOMEM;
+	tb->data = vmalloc(REPLAY_MAX_TRACE + 1);
+	if (!tb->data) {
+		kfree(tb);
+		return -ENOMEM;
+	}
+	file->private_data = tb;
+	return 0;
+}
+
+static ssize_t replay_trace_write(struct file *file, const char __user *ubuf,
+				  size_t count, loff_t *ppos)
+{
+	struct replay_trace_buf *tb = file->private_data;
+
+	if (tb->len + count > REPLAY_MAX_TRACE)
+		return -EFBIG;
+	if (copy_from_user(tb->data + tb->len, ubuf, count))
+		return -EFAULT;
+	tb->len += count;
+	return count;
+}
+
+/* Parse the written trace into samples[], sorted by time as recorded. */
+static int replay_trace_parse(struct replay_trace_buf *tb)
+{
+	char *p = tb->data, *line;
+	unsigned int t, cpu, busy, nr, freq, last_t = 0;
+	unsigned int n = 0, period = REPLAY_DEF_PERIOD_MS;
+
+	tb->data[tb->len] = '\0';
+	while ((line = strsep(&p, "\n")) != NULL) {
+		if (line[0] == '#') {
+			char *s = strstr(line, "period_ms=");
+
+			if (s && sscanf(s, "period_ms=%u", &period) != 1)
+				return -EINVAL;
+			continue;
+		}
+		if (!line[0])
+			continue;
+		if (sscanf(line, "%u %u %u %u %u", &t, &cpu, &busy, &nr,
+			   &freq) != 5)
+			return -EINVAL;
+		if (cpu >= nr_cpu_ids || busy > 100 || t < last_t)
+			return -EINVAL;
+		if (n >= REPLAY_MAX_SAMPLES)
+			return -EFBIG;
+
+		samples[n].t_ms = t;
+		samples[n].cpu = cpu;
+		samples[n].busy = busy;
+		samples[n].nr_run = min(nr, 65535U);
+		samples[n].freq = freq;
+		last_t = t;
+		n++;
+	}
+
+	if (!period || period > 1000)
+		return -EINVAL;
+	period_ms = period;
+	nr_samples = n;
+	return 0;
+}
+
+static int replay_trace_release(struct inode *inode, struct file *file)
+{
+	struct replay_trace_buf *tb;
+	int ret;
+
+	if ((file->f_flags & O_ACCMODE) == O_RDONLY)
+		return seq_release(inode, file);
+
+	tb = file->private_data;
+	mutex_lock(&replay_mutex);
+	replay_update_state_locked();
+	if (state != REPLAY_IDLE) {
+		ret = -EBUSY;
+	} else {
+		ret = replay_trace_parse(tb);
+		if (ret)
+			nr_samples = 0;
+	}
+	mutex_unlock(&replay_mutex);
+
+	vfree(tb->data);
+	kfree(tb);
+	return ret;
+}
+
+static const struct file_operations replay_trace_fops = {
+	.open		= replay_trace_open,
+	.read		= seq_read,
+	.write		= replay_trace_write,
+	.llseek		= seq_lseek,
+	.release	= replay_trace_release,
+};
+
+static int replay_report_show(struct seq_file *m, void *v)
+{
+	u64 total_ns, lat_avg = 0;
+	unsigned long flags;
+	unsigned int i;
+	bool running;
+
+	spin_lock_irqsave(&report_lock, flags);
+	running = state == REPLAY_REPLAYING && !report.done;
+	if (running)
+		replay_account_freq(ktime_get(), report.cur_freq);
+
+	total_ns = ktime_to_ns(ktime_sub(running ?
+			report.last_change : report.stop, report.start));
+	if (report.steps_met)
+		lat_avg = div_u64(report.step_latency_ns, report.steps_met);
+
+	seq_printf(m, "samples:               %u\n", nr_samples);
+	seq_printf(m, "period_ms:             %u\n", period_ms);
+	seq_printf(m, "duration_ms:           %llu\n",
+		   div_u64(total_ns, NSEC_PER_MSEC));
+	seq_printf(m, "transitions:           %u\n", report.transitions);
+	seq_printf(m, "load_steps:            %u\n", report.steps);
+	seq_printf(m, "load_steps_met:        %u\n", report.steps_met);
+	seq_printf(m, "step_latency_avg_us:   %llu\n",
+		   div_u64(lat_avg, NSEC_PER_USEC));
+	seq_printf(m, "step_latency_max_us:   %llu\n",
+		   div_u64(report.step_latency_max_ns, NSEC_PER_USEC));
+	seq_printf(m, "work_deficit_permille: %llu\n", report.demand_ns ?
+		   div64_u64(report.deficit_ns * 1000, report.demand_ns) : 0);
+	seq_printf(m, "\n%10s %12s %8s\n", "freq", "time_ms", "permille");
+	for (i = 0; i < report.nr_freqs; i++)
+		seq_printf(m, "%10u %12llu %8llu\n", report.freq[i],
+			   div_u64(report.time_ns[i], NSEC_PER_MSEC),
+			   total_ns ? div64_u64(report.time_ns[i] * 1000,
+						total_ns) : 0);
+	spin_unlock_irqrestore(&report_lock, flags);
+
+	return 0;
+}
+
+static int replay_report_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, replay_report_show, NULL);
+}
+
+static const struct file_operations replay_report_fops = {
+	.open		= replay_report_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init cpufreq_replay_init(void)
+{
+	struct dentry *dir;
+
+	samples = vmalloc(REPLAY_MAX_SAMPLES * sizeof(*samples));
+	if (!samples)
+		return -ENOMEM;
+	INIT_DELAYED_WORK(&record_work, record_sample);
+
+	dir = debugfs_create_dir("cpufreq_replay", NULL);
+	if (!dir) {
+		vfree(samples);
+		return -ENOMEM;
+	}
+	debugfs_create_file("control", 0644, dir, NULL, &replay_control_fops);
+	debugfs_create_file("trace", 0644, dir, NULL, &replay_trace_fops);
+	debugfs_create_file("report", 0444, dir, NULL, &replay_report_fops);
+
+	return 0;
+}
+late_initcall(cpufreq_replay_init);
@@ -0,0 +1,360 @@
+/*
+ *  drivers/cpufreq/cpufreq_sampling.c
+ *
+ *  Shared, idle-aware sampling for cpufreq governors.
+ *
+ *  Governors that evaluate the load every sampling period used to keep
+ *  a timer each, per cpu or on the policy cpu, and a busy timer of one
+ *  governor on an otherwise idle core kept it out of the deep idle
+ *  states.  Here every cpu has a single deferrable timer, armed for the
+ *  earliest due sampler of that cpu.  Due times are multiples of the
+ *  sampler's period in jiffies, so samplers with related periods, and
+ *  the timers of all cpus, expire on the same jiffy.
+ *
+ *  A sampler covering several cpus is run once per period by the first
+ *  of them that is busy when the slot expires.  A deferrable timer that
+ *  expires on an idle cpu, because something else woke it, samples
+ *  nothing there.  Governors that must look at an idle cpu, e.g. to
+ *  bring down a frequency it would otherwise hold, ask for it with
+ *  cpufreq_sampler_wakeup(); those wakeups are counted per sampler in
+ *  /sys/devices/system/cpu/cpufreq/sampling/stats.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/cpu.h>
+#include <linux/cpufreq.h>
+#include <linux/jiffies.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
+#include <linux/workqueue.h>
+
+struct sampling_slot {
+	unsigned int		cpu;
+	int			active;		/* timers may be armed */
+	int			idle;		/* a timer found the cpu idle */
+	int			woken;		/* the wake timer woke it up */
+	spinlock_t		lock;		/* timers and active */
+	struct timer_list	timer;		/* deferrable */
+	struct timer_list	wake_timer;
+	struct work_struct	work;
+};
+
+static DEFINE_PER_CPU(struct sampling_slot, sampling_slots);
+
+/* sampling_mutex protects the list and is held while samplers run */
+static LIST_HEAD(samplers);
+static DEFINE_MUTEX(sampling_mutex);
+static struct workqueue_struct *sampling_wq;
+
+/* the first multiple of the sampler's period after @now */
+static unsigned long sampling_align(struct cpufreq_sampler *s,
+				    unsigned long now)
+{
+	unsigned long period = usecs_to_jiffies(s->period_us);
+
+	if (!period)
+		period = 1;
+
+	return now - now % period + period;
+}
+
+static void sampling_set_timer(struct sampling_slot *slot,
+			       struct timer_list *timer, int armed,
+			       unsigned long expires)
+{
+	if (armed && timer_pending(timer) && timer->expires == expires)
+		return;
+
+	del_timer(timer);
+	if (armed) {
+		timer->expires = expires;
+		add_timer_on(timer, slot->cpu);
+	}
+}
+
+/* called with sampling_mutex held */
+static void sampling_arm(struct sampling_slot *slot)
+{
+	struct cpufreq_sampler *s;
+	unsigned long now = jiffies, next = 0, wake = 0;
+	int armed = 0, wake_armed = 0;
+	unsigned long flags;
+
+	list_for_each_entry(s, &samplers, list) {
+		unsigned long due;
+
+		if (!cpumask_test_cpu(slot->cpu, &s->cpus))
+			continue;
+
+		/* left to another cpu while this one was idle: next slot */
+		due = time_after(s->next, now) ? s->next :
+						 sampling_align(s, now);
+
+		if (!armed || time_before(due, next)) {
+			next = due;
+			armed = 1;
+		}
+
+		if (cpumask_test_cpu(slot->cpu, &s->wake) &&
+		    (!wake_armed || time_before(due, wake))) {
+			wake = due;
+			wake_armed = 1;
+		}
+	}
+
+	spin_lock_irqsave(&slot->lock, flags);
+	if (!slot->active)
+		armed = wake_armed = 0;
+	sampling_set_timer(slot, &slot->timer, armed, next);
+	sampling_set_timer(slot, &slot->wake_timer, wake_armed, wake);
+	spin_unlock_irqrestore(&slot->lock, flags);
+}
+
+static void sampling_timer(unsigned long data)
+{
+	struct sampling_slot *slot = &per_cpu(sampling_slots, data);
+
+	/* in softirq context: the idle task is current if it was idle */
+	slot->idle = idle_cpu(data);
+	queue_work_on(data, sampling_wq, &slot->work);
+}
+
+static void sampling_wake_timer(unsigned long data)
+{
+	struct sampling_slot *slot = &per_cpu(sampling_slots, data);
+
+	slot->idle = slot->woken = idle_cpu(data);
+	queue_work_on(data, sampling_wq, &slot->work);
+}
+
+static void sampling_work(struct work_struct *work)
+{
+	struct sampling_slot *slot =
+		container_of(work, struct sampling_slot, work);
+	unsigned int cpu = slot->cpu;
+	struct cpufreq_sampler *s;
+	unsigned long now;
+	int idle, woken;
+
+	mutex_lock(&sampling_mutex);
+	idle = xchg(&slot->idle, 0);
+	woken = xchg(&slot->woken, 0);
+	now = jiffies;
+
+	list_for_each_entry(s, &samplers, list) {
+		int wake;
+
+		if (!cpumask_test_cpu(cpu, &s->cpus) ||
+		    time_before(now, s->next))
+			continue;
+
+		/* only our bit, other cpus may be setting theirs */
+		wake = cpumask_test_and_clear_cpu(cpu, &s->wake);
+		if (idle && !wake) {
+			s->idle_skips++;
+			continue;
+		}
+
+		if (woken && wake)
+			s->wakeups++;
+
+		s->sample(s, cpu);
+		s->samples++;
+		s->next = sampling_align(s, jiffies);
+	}
+
+	sampling_arm(slot);
+	mutex_unlock(&sampling_mutex);
+}
+
+/**
+ * cpufreq_sampler_start - start calling a sampler every period
+ * @s: the sampler, with name, period_us and sample set
+ * @cpus: the cpus whose activity it samples
+ * @delay: jiffies before the first sample
+ */
+int cpufreq_sampler_start(struct cpufreq_sampler *s,
+			  const struct cpumask *cpus, unsigned long delay)
+{
+	unsigned int cpu;
+
+	if (!s->sample || !sampling_wq)
+		return -EINVAL;
+
+	mutex_lock(&sampling_mutex);
+	cpumask_copy(&s->cpus, cpus);
+	cpumask_clear(&s->wake);
+	s->samples = 0;
+	s->idle_skips = 0;
+	s->wakeups = 0;
+	s->next = sampling_align(s, jiffies + delay);
+	list_add_tail(&s->list, &samplers);
+
+	for_each_cpu(cpu, &s->cpus)
+		sampling_arm(&per_cpu(sampling_slots, cpu));
+	mutex_unlock(&sampling_mutex);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(cpufreq_sampler_start);
+
+/**
+ * cpufreq_sampler_stop - stop calling a sampler
+ * @s: the sampler
+ *
+ * The sampler is not running, and will not run again, on return.  Must
+ * not be called with a lock held that ->sample takes.
+ */
+void cpufreq_sampler_stop(struct cpufreq_sampler *s)
+{
+	cpumask_t cpus;
+	unsigned int cpu;
+
+	mutex_lock(&sampling_mutex);
+	list_del(&s->list);
+	cpumask_copy(&cpus, &s->cpus);
+	cpumask_clear(&s->cpus);
+
+	for_each_cpu(cpu, &cpus)
+		sampling_arm(&per_cpu(sampling_slots, cpu));
+	mutex_unlock(&sampling_mutex);
+}
+EXPORT_SYMBOL_GPL(cpufreq_sampler_stop);
+
+/**
+ * cpufreq_sampler_wakeup - sample even if this cpu stays idle
+ * @s: the sampler
+ *
+ * Called from the idle path, before the cpu goes to sleep, by governors
+ * that have to reevaluate an idle cpu.  The next due sample of @s will
+ * wake this cpu if nothing else does; the request is dropped once the
+ * sampler has run.
+ */
+void cpufreq_sampler_wakeup(struct cpufreq_sampler *s)
+{
+	unsigned int cpu = smp_processor_id();
+	struct sampling_slot *slot = &per_cpu(sampling_slots, cpu);
+	unsigned long flags, due, now = jiffies;
+
+	if (!cpumask_test_cpu(cpu, &s->cpus))
+		return;
+
+	spin_lock_irqsave(&slot->lock, flags);
+	if (slot->active && !cpumask_test_and_set_cpu(cpu, &s->wake)) {
+		due = time_after(s->next, now) ? s->next :
+						 sampling_align(s, now);
+		if (!timer_pending(&slot->wake_timer) ||
+		    time_before(due, slot->wake_timer.expires))
+			mod_timer(&slot->wake_timer, due);
+	}
+	spin_unlock_irqrestore(&slot->lock, flags);
+}
+EXPORT_SYMBOL_GPL(cpufreq_sampler_wakeup);
+
+static int __cpuinit sampling_cpu_callback(struct notifier_block *nfb,
+					   unsigned long action, void *hcpu)
+{
+	unsigned int cpu = (unsigned long)hcpu;
+	struct sampling_slot *slot = &per_cpu(sampling_slots, cpu);
+
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_ONLINE:
+	case CPU_DOWN_FAILED:
+		mutex_lock(&sampling_mutex);
+		spin_lock_irq(&slot->lock);
+		slot->active = 1;
+		spin_unlock_irq(&slot->lock);
+		sampling_arm(slot);
+		mutex_unlock(&sampling_mutex);
+		break;
+
+	case CPU_DOWN_PREPARE:
+		spin_lock_irq(&slot->lock);
+		slot->active = 0;
+		spin_unlock_irq(&slot->lock);
+		del_timer_sync(&slot->timer);
+		del_timer_sync(&slot->wake_timer);
+		cancel_work_sync(&slot->work);
+		break;
+	}
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block __refdata sampling_cpu_notifier = {
+	.notifier_call = sampling_cpu_callback,
+};
+
+static ssize_t show_stats(struct kobject *kobj,
+			  struct attribute *attr, char *buf)
+{
+	struct cpufreq_sampler *s;
+	ssize_t len = 0;
+
+	mutex_lock(&sampling_mutex);
+	list_for_each_entry(s, &samplers, list) {
+		if (len >= PAGE_SIZE - 80)
+			break;
+		len += sprintf(buf + len, "%-12s cpus ", s->name);
+		len += cpulist_scnprintf(buf + len, PAGE_SIZE - len, &s->cpus);
+		len += sprintf(buf + len, " period %u samples %lu "
+			       "idle_skips %lu wakeups %lu\n", s->period_us,
+			       s->samples, s->idle_skips, s->wakeups);
+	}
+	mutex_unlock(&sampling_mutex);
+
+	return len;
+}
+
+static struct global_attr stats_attr = __ATTR(stats, 0444, show_stats, NULL);
+
+static struct attribute *sampling_attributes[] = {
+	&stats_attr.attr,
+	NULL,
+};
+
+static struct attribute_group sampling_attr_group = {
+	.attrs = sampling_attributes,
+	.name = "sampling",
+};
+
+static int __init cpufreq_sampling_init(void)
+{
+	unsigned int cpu;
+
+	sampling_wq = alloc_workqueue("cpufreq_sampling", WQ_HIGHPRI, 0);
+	if (!sampling_wq)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct sampling_slot *slot = &per_cpu(sampling_slots, cpu);
+
+		slot->cpu = cpu;
+		spin_lock_init(&slot->lock);
+		init_timer_deferrable(&slot->timer);
+		slot->timer.function = sampling_timer;
+		slot->timer.data = cpu;
+		init_timer(&slot->wake_timer);
+		slot->wake_timer.function = sampling_wake_timer;
+		slot->wake_timer.data = cpu;
+		INIT_WORK(&slot->work, sampling_work);
+	}
+
+	get_online_cpus();
+	for_each_online_cpu(cpu)
+		per_cpu(sampling_slots, cpu).active = 1;
+	register_hotcpu_notifier(&sampling_cpu_notifier);
+	put_online_cpus();
+
+	return sysfs_create_group(cpufreq_global_kobject,
+				  &sampling_attr_group);
+}
+core_initcall(cpufreq_sampling_init);
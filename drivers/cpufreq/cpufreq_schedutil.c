@@ -0,0 +1,389 @@
+/*
+ *  drivers/cpufreq/cpufreq_schedutil.c
+ *
+ *  Scheduler-driven cpufreq governor.
+ *
+ *  Instead of sampling idle time from a timer, the scheduler reports the
+ *  runnable average of every runqueue whenever it changes (enqueue,
+ *  dequeue and tick) and the frequency is chosen directly from the
+ *  busiest cpu of the policy:
+ *
+ *	next_freq = 1.25 * cur_freq * util / max
+ *
+ *  which settles at the frequency that keeps the busiest cpu about 80%
+ *  busy.  Requests are rate limited and carried out from a SCHED_FIFO
+ *  kthread, since the update hook runs with the runqueue lock held.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/cpu.h>
+#include <linux/cpumask.h>
+#include <linux/irq_work.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#define DEF_RATE_LIMIT_US		(10000)
+
+struct sugov_policy {
+	struct cpufreq_policy *policy;
+	struct cpufreq_frequency_table *freq_table;
+
+	/* protects the fields below, taken from the scheduler hook */
+	raw_spinlock_t update_lock;
+	u64 last_freq_update_time;
+	unsigned int next_freq;
+	bool work_in_progress;
+
+	struct irq_work irq_work;
+	struct kthread_work work;
+	struct mutex work_lock;
+};
+
+struct sugov_cpu {
+	struct update_util_data update_util;
+	struct sugov_policy *sg_policy;
+
+	unsigned long util;
+	unsigned long max;
+	u64 last_update;
+};
+
+static DEFINE_PER_CPU(struct sugov_cpu, sugov_cpu);
+
+static struct kthread_worker sugov_worker;
+static struct task_struct *sugov_thread;
+static atomic_t active_count = ATOMIC_INIT(0);
+
+/* tunables */
+static unsigned int rate_limit_us = DEF_RATE_LIMIT_US;
+
+/* statistics, updated under the policies' update_lock */
+static unsigned long util_updates;
+static unsigned long freq_requests;
+
+static bool sugov_should_update_freq(struct sugov_policy *sg_policy, u64 time)
+{
+	s64 delta_ns;
+
+	/* the previous request has not been carried out yet */
+	if (sg_policy->work_in_progress)
+		return false;
+
+	delta_ns = time - sg_policy->last_freq_update_time;
+	return delta_ns >= (s64)rate_limit_us * NSEC_PER_USEC;
+}
+
+static unsigned int sugov_next_freq(struct sugov_policy *sg_policy, u64 time)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+	unsigned long util = 0, max = 1;
+	unsigned int freq, j;
+
+	for_each_cpu(j, policy->cpus) {
+		struct sugov_cpu *j_sg_cpu = &per_cpu(sugov_cpu, j);
+		s64 delta_ns = time - j_sg_cpu->last_update;
+
+		/*
+		 * A cpu that has not reported for more than a tick is idle
+		 * with its tick stopped; its last utilization is stale.
+		 */
+		if (delta_ns > TICK_NSEC || !j_sg_cpu->max)
+			continue;
+
+		if (j_sg_cpu->util * max > util * j_sg_cpu->max) {
+			util = j_sg_cpu->util;
+			max = j_sg_cpu->max;
+		}
+	}
+
+	freq = policy->cur + (policy->cur >> 2);
+	return div_u64((u64)freq * util, max);
+}
+
+static void sugov_update_commit(struct sugov_policy *sg_policy, u64 time,
+				unsigned int next_freq)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+	unsigned int index;
+
+	sg_policy->last_freq_update_time = time;
+
+	next_freq = clamp(next_freq, policy->min, policy->max);
+	if (sg_policy->freq_table &&
+	    !cpufreq_frequency_table_target(policy, sg_policy->freq_table,
+					    next_freq, CPUFREQ_RELATION_L,
+					    &index))
+		next_freq = sg_policy->freq_table[index].frequency;
+
+	if (next_freq == policy->cur)
+		return;
+
+	sg_policy->next_freq = next_freq;
+	sg_policy->work_in_progress = true;
+	freq_requests++;
+	irq_work_queue(&sg_policy->irq_work);
+}
+
+/* Called by the scheduler with the rq lock held and interrupts off. */
+static void sugov_update(struct update_util_data *hook, u64 time,
+			 unsigned long util, unsigned long max)
+{
+	struct sugov_cpu *sg_cpu = container_of(hook, struct sugov_cpu,
+						update_util);
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+
+	raw_spin_lock(&sg_policy->update_lock);
+
+	sg_cpu->util = util;
+	sg_cpu->max = max;
+	sg_cpu->last_update = time;
+	util_updates++;
+
+	if (sugov_should_update_freq(sg_policy, time))
+		sugov_update_commit(sg_policy, time,
+				    sugov_next_freq(sg_policy, time));
+
+	raw_spin_unlock(&sg_policy->update_lock);
+}
+
+static void sugov_work(struct kthread_work *work)
+{
+	struct sugov_policy *sg_policy = container_of(work,
+					struct sugov_policy, work);
+
+	mutex_lock(&sg_policy->work_lock);
+	__cpufreq_driver_target(sg_policy->policy, sg_policy->next_freq,
+				CPUFREQ_RELATION_L);
+	mutex_unlock(&sg_policy->work_lock);
+
+	sg_policy->work_in_progress = false;
+}
+
+static void sugov_irq_work(struct irq_work *irq_work)
+{
+	struct sugov_policy *sg_policy = container_of(irq_work,
+					struct sugov_policy, irq_work);
+
+	queue_kthread_work(&sugov_worker, &sg_policy->work);
+}
+
+/************************** sysfs interface ************************/
+
+static ssize_t show_rate_limit_us(struct kobject *kobj,
+				  struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", rate_limit_us);
+}
+
+static ssize_t store_rate_limit_us(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	unsigned long val;
+	int ret;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	rate_limit_us = val;
+	return count;
+}
+
+static struct global_attr rate_limit_us_attr = __ATTR(rate_limit_us, 0644,
+		show_rate_limit_us, store_rate_limit_us);
+
+static ssize_t show_util_updates(struct kobject *kobj,
+				 struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", util_updates);
+}
+
+static struct global_attr util_updates_attr = __ATTR(util_updates, 0444,
+		show_util_updates, NULL);
+
+static ssize_t show_freq_requests(struct kobject *kobj,
+				  struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", freq_requests);
+}
+
+static struct global_attr freq_requests_attr = __ATTR(freq_requests, 0444,
+		show_freq_requests, NULL);
+
+static struct attribute *schedutil_attributes[] = {
+	&rate_limit_us_attr.attr,
+	&util_updates_attr.attr,
+	&freq_requests_attr.attr,
+	NULL,
+};
+
+static struct attribute_group schedutil_attr_group = {
+	.attrs = schedutil_attributes,
+	.name = "schedutil",
+};
+
+/************************** governor callbacks *********************/
+
+static int sugov_start(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy;
+	unsigned int j;
+	int rc;
+
+	sg_policy = kzalloc(sizeof(*sg_policy), GFP_KERNEL);
+	if (!sg_policy)
+		return -ENOMEM;
+
+	sg_policy->policy = policy;
+	sg_policy->freq_table = cpufreq_frequency_get_table(policy->cpu);
+	raw_spin_lock_init(&sg_policy->update_lock);
+	init_irq_work(&sg_policy->irq_work, sugov_irq_work);
+	init_kthread_work(&sg_policy->work, sugov_work);
+	mutex_init(&sg_policy->work_lock);
+
+	if (atomic_inc_return(&active_count) == 1) {
+		rc = sysfs_create_group(cpufreq_global_kobject,
+					&schedutil_attr_group);
+		if (rc) {
+			atomic_dec(&active_count);
+			kfree(sg_policy);
+			return rc;
+		}
+	}
+
+	/*
+	 * Hook all cpus the policy may ever cover, so that cpus coming
+	 * online later report too; offline ones go stale and are skipped.
+	 */
+	for_each_cpu(j, policy->related_cpus) {
+		struct sugov_cpu *sg_cpu = &per_cpu(sugov_cpu, j);
+
+		memset(sg_cpu, 0, sizeof(*sg_cpu));
+		sg_cpu->sg_policy = sg_policy;
+		sg_cpu->update_util.func = sugov_update;
+		cpufreq_set_update_util_data(j, &sg_cpu->update_util);
+	}
+
+	return 0;
+}
+
+static void sugov_stop(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = NULL;
+	unsigned int j;
+
+	for_each_possible_cpu(j) {
+		struct sugov_cpu *sg_cpu = &per_cpu(sugov_cpu, j);
+
+		if (!sg_cpu->sg_policy ||
+		    sg_cpu->sg_policy->policy != policy)
+			continue;
+		sg_policy = sg_cpu->sg_policy;
+		cpufreq_set_update_util_data(j, NULL);
+	}
+	if (!sg_policy)
+		return;
+
+	/* wait for hooks still running, then for the work they queued */
+	synchronize_sched();
+	irq_work_sync(&sg_policy->irq_work);
+	flush_kthread_work(&sg_policy->work);
+
+	for_each_possible_cpu(j) {
+		struct sugov_cpu *sg_cpu = &per_cpu(sugov_cpu, j);
+
+		if (sg_cpu->sg_policy == sg_policy)
+			sg_cpu->sg_policy = NULL;
+	}
+	kfree(sg_policy);
+
+	if (atomic_dec_return(&active_count) == 0)
+		sysfs_remove_group(cpufreq_global_kobject,
+				   &schedutil_attr_group);
+}
+
+static void sugov_limits(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy;
+
+	sg_policy = per_cpu(sugov_cpu, policy->cpu).sg_policy;
+	if (sg_policy)
+		mutex_lock(&sg_policy->work_lock);
+
+	if (policy->max < policy->cur)
+		__cpufreq_driver_target(policy, policy->max,
+					CPUFREQ_RELATION_H);
+	else if (policy->min > policy->cur)
+		__cpufreq_driver_target(policy, policy->min,
+					CPUFREQ_RELATION_L);
+
+	if (sg_policy)
+		mutex_unlock(&sg_policy->work_lock);
+}
+
+static int cpufreq_governor_schedutil(struct cpufreq_policy *policy,
+				      unsigned int event)
+{
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		if (!cpu_online(policy->cpu))
+			return -EINVAL;
+		return sugov_start(policy);
+
+	case CPUFREQ_GOV_STOP:
+		sugov_stop(policy);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		sugov_limits(policy);
+		break;
+	}
+	return 0;
+}
+
+#ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHEDUTIL
+static
+#endif
+struct cpufreq_governor cpufreq_gov_schedutil = {
+	.name			= "schedutil",
+	.governor		= cpufreq_governor_schedutil,
+	.owner			= THIS_MODULE,
+};
+
+static int __init cpufreq_schedutil_init(void)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO - 1 };
+	int ret;
+
+	init_kthread_worker(&sugov_worker);
+	sugov_thread = kthread_run(kthread_worker_fn, &sugov_worker,
+				   "kschedutil");
+	if (IS_ERR(sugov_thread))
+		return PTR_ERR(sugov_thread);
+
+	sched_setscheduler_nocheck(sugov_thread, SCHED_FIFO, &param);
+
+	ret = cpufreq_register_governor(&cpufreq_gov_schedutil);
+	if (ret)
+		kthread_stop(sugov_thread);
+
+	return ret;
+}
+
+#ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHEDUTIL
+fs_initcall(cpufreq_schedutil_init);
+#else
+module_init(cpufreq_schedutil_init);
+#endif
+
+MODULE_DESCRIPTION("'cpufreq_schedutil' - A scheduler-driven cpufreq governor");
+MODULE_LICENSE("GPL");
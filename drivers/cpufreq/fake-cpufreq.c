@@ -0,0 +1,166 @@
+/*
+ *  drivers/cpufreq/fake-cpufreq.c
+ *
+ *  Simulated cpufreq driver.
+ *
+ *  Exposes a frequency table without touching any hardware, so that
+ *  governors can be exercised and measured on emulators and boards
+ *  without DVFS support.  All cpus share a single policy, as on exynos.
+ *  Transitions go through the normal notifier chain, so cpufreq_stats
+ *  and the cpufreq trace events account for them as usual.
+ *
+ *  Module parameters:
+ *	freqs=		comma separated table in kHz (default 200-1400MHz)
+ *	latency_us=	time each transition sleeps, to simulate PLL relock
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/cpumask.h>
+#include <linux/delay.h>
+#include <linux/slab.h>
+
+#define FAKE_MAX_FREQS		32
+
+static unsigned int freqs[FAKE_MAX_FREQS] = {
+	200000, 300000, 400000, 500000, 600000, 700000, 800000,
+	900000, 1000000, 1100000, 1200000, 1300000, 1400000,
+};
+static unsigned int nr_freqs = 13;
+module_param_array(freqs, uint, &nr_freqs, 0444);
+MODULE_PARM_DESC(freqs, "Available frequencies in kHz");
+
+static unsigned int latency_us = 100;
+module_param(latency_us, uint, 0644);
+MODULE_PARM_DESC(latency_us, "Simulated transition latency in us");
+
+static struct cpufreq_frequency_table *freq_table;
+static unsigned int cur_freq;
+
+static struct freq_attr *fake_cpufreq_attr[] = {
+	&cpufreq_freq_attr_scaling_available_freqs,
+	NULL,
+};
+
+static int fake_cpufreq_verify(struct cpufreq_policy *policy)
+{
+	return cpufreq_frequency_table_verify(policy, freq_table);
+}
+
+static unsigned int fake_cpufreq_get(unsigned int cpu)
+{
+	return cur_freq;
+}
+
+static int fake_cpufreq_target(struct cpufreq_policy *policy,
+			       unsigned int target_freq,
+			       unsigned int relation)
+{
+	struct cpufreq_freqs freqs;
+	unsigned int index;
+
+	if (cpufreq_frequency_table_target(policy, freq_table, target_freq,
+					   relation, &index))
+		return -EINVAL;
+
+	freqs.old = cur_freq;
+	freqs.new = freq_table[index].frequency;
+	if (freqs.old == freqs.new)
+		return 0;
+
+	for_each_cpu(freqs.cpu, policy->cpus)
+		cpufreq_notify_transition(&freqs, CPUFREQ_PRECHANGE);
+
+	if (latency_us)
+		usleep_range(latency_us, latency_us + latency_us / 4 + 1);
+	cur_freq = freqs.new;
+
+	for_each_cpu(freqs.cpu, policy->cpus)
+		cpufreq_notify_transition(&freqs, CPUFREQ_POSTCHANGE);
+
+	return 0;
+}
+
+static int fake_cpufreq_init(struct cpufreq_policy *policy)
+{
+	int ret;
+
+	ret = cpufreq_frequency_table_cpuinfo(policy, freq_table);
+	if (ret)
+		return ret;
+	cpufreq_frequency_table_get_attr(freq_table, policy->cpu);
+
+	if (!cur_freq)
+		cur_freq = policy->cpuinfo.max_freq;
+	policy->cur = cur_freq;
+	policy->cpuinfo.transition_latency = latency_us * NSEC_PER_USEC;
+
+	policy->shared_type = CPUFREQ_SHARED_TYPE_ALL;
+	cpumask_copy(policy->related_cpus, cpu_possible_mask);
+	cpumask_copy(policy->cpus, cpu_online_mask);
+
+	return 0;
+}
+
+static int fake_cpufreq_exit(struct cpufreq_policy *policy)
+{
+	cpufreq_frequency_table_put_attr(policy->cpu);
+	return 0;
+}
+
+static struct cpufreq_driver fake_cpufreq_driver = {
+	.flags		= CPUFREQ_STICKY,
+	.verify		= fake_cpufreq_verify,
+	.target		= fake_cpufreq_target,
+	.get		= fake_cpufreq_get,
+	.init		= fake_cpufreq_init,
+	.exit		= fake_cpufreq_exit,
+	.name		= "fake",
+	.owner		= THIS_MODULE,
+	.attr		= fake_cpufreq_attr,
+};
+
+static int __init fake_cpufreq_module_init(void)
+{
+	unsigned int i;
+	int ret;
+
+	if (!nr_freqs || nr_freqs > FAKE_MAX_FREQS)
+		return -EINVAL;
+
+	freq_table = kcalloc(nr_freqs + 1, sizeof(*freq_table), GFP_KERNEL);
+	if (!freq_table)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_freqs; i++) {
+		freq_table[i].index = i;
+		freq_table[i].frequency = freqs[i];
+	}
+	freq_table[i].index = i;
+	freq_table[i].frequency = CPUFREQ_TABLE_END;
+
+	ret = cpufreq_register_driver(&fake_cpufreq_driver);
+	if (ret) {
+		pr_err("%s: cannot register driver (%d)\n", __func__, ret);
+		kfree(freq_table);
+	}
+	return ret;
+}
+
+static void __exit fake_cpufreq_module_exit(void)
+{
+	cpufreq_unregister_driver(&fake_cpufreq_driver);
+	kfree(freq_table);
+}
+
+module_init(fake_cpufreq_module_init);
+module_exit(fake_cpufreq_module_exit);
+
+MODULE_DESCRIPTION("Simulated cpufreq driver for governor testing");
+MODULE_LICENSE("GPL");
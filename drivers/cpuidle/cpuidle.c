@@ -42,6 +42,35 @@ static void cpuidle_kick_cpus(void) {}
 
 static int __cpuidle_register_device(struct cpuidle_device *dev);
 
+/*
+ * Judge the state that was actually entered against the residency that
+ * followed: "above" if it was deeper than the idle period justified,
+ * "below" if a deeper state would have paid off.  Latency constraints
+ * are not taken into account.
+ */
+static void cpuidle_account_residency(struct cpuidle_device *dev,
+				      struct cpuidle_state *state)
+{
+	int i, idx = state - dev->states;
+
+	if (!(state->flags & CPUIDLE_FLAG_TIME_VALID))
+		return;
+
+	if (idx > 0 && dev->last_residency < state->target_residency) {
+		state->above++;
+		return;
+	}
+
+	for (i = idx + 1; i < dev->state_count; i++) {
+		if (dev->states[i].flags & CPUIDLE_FLAG_IGNORE)
+			continue;
+		if (dev->last_residency >= dev->states[i].target_residency) {
+			state->below++;
+			break;
+		}
+	}
+}
+
 /**
  * cpuidle_idle_call - the main idle loop
  *
@@ -110,6 +139,7 @@ static void cpuidle_idle_call(void)
 
 	target_state->time += (unsigned long long)dev->last_residency;
 	target_state->usage++;
+	cpuidle_account_residency(dev, target_state);
 
 	/* give the governor an opportunity to reflect on the outcome */
 	if (cpuidle_curr_governor->reflect)
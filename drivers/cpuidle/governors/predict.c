@@ -0,0 +1,297 @@
+/*
+ * predict.c - the predict idle governor
+ *
+ * Predicts the length of an idle period from the next timer event and
+ * from the wakeup history of the individual interrupt sources.
+ *
+ * This code is licenced under the GPL version 2 as described
+ * in the COPYING file that acompanies the Linux Kernel.
+ */
+
+#include <linux/kernel.h>
+#include <linux/cpuidle.h>
+#include <linux/pm_qos.h>
+#include <linux/time.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/tick.h>
+#include <linux/sched.h>
+#include <linux/percpu.h>
+
+#define SOURCES		8	/* interrupt sources tracked per cpu */
+#define MIN_SAMPLES	3	/* wakeups before a source is trusted */
+#define MAX_INTERVAL	(2 * USEC_PER_SEC)
+#define TIMER_SLACK	50	/* us; wakeups this close are the timer's */
+
+/*
+ * Concepts behind the predict governor
+ *
+ * The next timer event bounds the idle period from above; what ends it
+ * earlier is a device interrupt.  Many of those are periodic from the
+ * point of view of an idle cpu: the display refresh, audio buffers, a
+ * polling touch controller or modem.  menu folds them all into one
+ * correction factor per order of magnitude of the timer distance; here
+ * each interrupt that woke the cpu is tracked on its own instead.
+ *
+ * The irq core notes the first interrupt handled after the cpu went idle
+ * (cpuidle_note_wakeup_irq).  For every source the interval between its
+ * wakeups is kept as a running average with a running mean deviation,
+ * the way TCP estimates round trip times.  A source whose deviation is
+ * below half its average is regular and predicts its next wakeup at
+ *
+ *	last wakeup + average - deviation
+ *
+ * The idle period is predicted to end at the earliest of the next timer
+ * and the predicted wakeups of the regular sources; a source already
+ * late by more than three deviations is ignored until it shows up again.
+ * Wakeups within TIMER_SLACK of the next timer event are attributed to
+ * the timer and teach nothing.
+ *
+ * How well this works can be read from the above/below counters of each
+ * state in sysfs.
+ */
+
+struct predict_source {
+	int		irq;
+	unsigned int	samples;
+	u64		last_us;	/* time of the last wakeup */
+	u32		avg_us;		/* average wakeup interval */
+	u32		dev_us;		/* mean deviation of the interval */
+	unsigned long	stamp;		/* for replacement, larger is newer */
+};
+
+struct predict_device {
+	int		last_state_idx;
+	int		needs_update;
+	int		wakeup_irq;
+
+	u64		entry_us;
+	unsigned int	expected_us;
+	unsigned int	predicted_us;
+	unsigned int	exit_us;
+
+	unsigned long	stamp;
+	struct predict_source sources[SOURCES];
+};
+
+static DEFINE_PER_CPU(struct predict_device, predict_devices);
+
+DEFINE_PER_CPU(int, cpuidle_wakeup_irq) = CPUIDLE_WAKEUP_NONE;
+
+static struct predict_source *predict_find_source(struct predict_device *data,
+						  int irq)
+{
+	struct predict_source *src, *victim = &data->sources[0];
+	int i;
+
+	for (i = 0; i < SOURCES; i++) {
+		src = &data->sources[i];
+		if (src->samples && src->irq == irq)
+			return src;
+		if (!src->samples)
+			victim = src;
+		else if (victim->samples && src->stamp < victim->stamp)
+			victim = src;
+	}
+
+	memset(victim, 0, sizeof(*victim));
+	victim->irq = irq;
+	return victim;
+}
+
+static void predict_learn(struct predict_device *data, int irq, u64 now_us)
+{
+	struct predict_source *src = predict_find_source(data, irq);
+	u32 interval;
+	s32 err;
+
+	src->stamp = ++data->stamp;
+
+	if (!src->samples || now_us - src->last_us > MAX_INTERVAL) {
+		src->samples = 1;
+		src->avg_us = 0;
+		src->dev_us = 0;
+		src->last_us = now_us;
+		return;
+	}
+
+	interval = now_us - src->last_us;
+	src->last_us = now_us;
+
+	if (src->samples++ == 1) {
+		src->avg_us = interval;
+		src->dev_us = interval / 2;
+		return;
+	}
+
+	/* avg += err / 8, dev += (|err| - dev) / 4 */
+	err = interval - src->avg_us;
+	src->avg_us += err / 8;
+	src->dev_us += ((s32)abs(err) - (s32)src->dev_us) / 4;
+}
+
+static unsigned int predict_sources(struct predict_device *data, u64 now_us,
+				    unsigned int predicted_us)
+{
+	int i;
+
+	for (i = 0; i < SOURCES; i++) {
+		struct predict_source *src = &data->sources[i];
+		s64 remaining;
+
+		if (src->samples < MIN_SAMPLES || 2 * src->dev_us > src->avg_us)
+			continue;
+
+		remaining = (s64)(src->last_us + src->avg_us - src->dev_us) -
+			    (s64)now_us;
+		if (remaining < -3 * (s64)src->dev_us)
+			continue;
+		if (remaining < 0)
+			remaining = 0;
+		if (remaining < predicted_us)
+			predicted_us = remaining;
+	}
+
+	return predicted_us;
+}
+
+/**
+ * predict_update - learns from the idle period that just ended
+ * @dev: the CPU
+ */
+static void predict_update(struct cpuidle_device *dev)
+{
+	struct predict_device *data = &__get_cpu_var(predict_devices);
+	struct cpuidle_state *target = &dev->states[data->last_state_idx];
+	unsigned int measured_us = cpuidle_get_last_residency(dev);
+
+	if (unlikely(!(target->flags & CPUIDLE_FLAG_TIME_VALID)))
+		return;
+
+	/* the next timer event ended it, or no interrupt was noted */
+	if (measured_us + TIMER_SLACK >= data->expected_us ||
+	    data->wakeup_irq < 0)
+		return;
+
+	predict_learn(data, data->wakeup_irq, data->entry_us + measured_us);
+}
+
+/**
+ * predict_select - selects the next idle state to enter
+ * @dev: the CPU
+ */
+static int predict_select(struct cpuidle_device *dev)
+{
+	struct predict_device *data = &__get_cpu_var(predict_devices);
+	int latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+	unsigned int power_usage = -1;
+	int multiplier;
+	struct timespec t;
+	int i;
+
+	if (data->needs_update) {
+		predict_update(dev);
+		data->needs_update = 0;
+	}
+
+	data->last_state_idx = 0;
+	data->exit_us = 0;
+	data->expected_us = 0;
+
+	/* Special case when user has set very strict latency requirement */
+	if (unlikely(latency_req == 0))
+		return 0;
+
+	data->entry_us = ktime_to_us(ktime_get());
+	t = ktime_to_timespec(tick_nohz_get_sleep_length());
+	data->expected_us =
+		t.tv_sec * USEC_PER_SEC + t.tv_nsec / NSEC_PER_USEC;
+	data->predicted_us = predict_sources(data, data->entry_us,
+					     data->expected_us);
+
+	/* as in menu: the more tasks wait for IO here, the more reluctant */
+	multiplier = 1 + 10 * nr_iowait_cpu(smp_processor_id());
+
+	if (data->expected_us > 5)
+		data->last_state_idx = CPUIDLE_DRIVER_STATE_START;
+
+	for (i = CPUIDLE_DRIVER_STATE_START; i < dev->state_count; i++) {
+		struct cpuidle_state *s = &dev->states[i];
+
+		if (s->flags & CPUIDLE_FLAG_IGNORE)
+			continue;
+		if (s->target_residency > data->predicted_us)
+			continue;
+		if (s->exit_latency > latency_req)
+			continue;
+		if (s->exit_latency * multiplier > data->predicted_us)
+			continue;
+
+		if (s->power_usage < power_usage) {
+			power_usage = s->power_usage;
+			data->last_state_idx = i;
+			data->exit_us = s->exit_latency;
+		}
+	}
+
+	__this_cpu_write(cpuidle_wakeup_irq, CPUIDLE_WAKEUP_ARMED);
+
+	return data->last_state_idx;
+}
+
+/**
+ * predict_reflect - picks up the wakeup source, defers the rest
+ * @dev: the CPU
+ */
+static void predict_reflect(struct cpuidle_device *dev)
+{
+	struct predict_device *data = &__get_cpu_var(predict_devices);
+
+	data->wakeup_irq = __this_cpu_read(cpuidle_wakeup_irq);
+	__this_cpu_write(cpuidle_wakeup_irq, CPUIDLE_WAKEUP_NONE);
+	data->needs_update = 1;
+}
+
+/**
+ * predict_enable_device - scans a CPU's states and does setup
+ * @dev: the CPU
+ */
+static int predict_enable_device(struct cpuidle_device *dev)
+{
+	struct predict_device *data = &per_cpu(predict_devices, dev->cpu);
+
+	memset(data, 0, sizeof(struct predict_device));
+	data->wakeup_irq = CPUIDLE_WAKEUP_NONE;
+
+	return 0;
+}
+
+/**
+ * predict_disable_device - stops noting wakeup interrupts
+ * @dev: the CPU
+ */
+static void predict_disable_device(struct cpuidle_device *dev)
+{
+	per_cpu(cpuidle_wakeup_irq, dev->cpu) = CPUIDLE_WAKEUP_NONE;
+}
+
+static struct cpuidle_governor predict_governor = {
+	.name =		"predict",
+	.rating =	30,
+	.enable =	predict_enable_device,
+	.disable =	predict_disable_device,
+	.select =	predict_select,
+	.reflect =	predict_reflect,
+	.owner =	THIS_MODULE,
+};
+
+/**
+ * init_predict - initializes the governor
+ */
+static int __init init_predict(void)
+{
+	return cpuidle_register_governor(&predict_governor);
+}
+
+MODULE_LICENSE("GPL");
+module_init(init_predict);
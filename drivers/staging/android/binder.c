@@ -16,6 +16,7 @@
  */
 
 #include <asm/cacheflush.h>
+#include <linux/cgroup.h>
 #include <linux/fdtable.h>
 #include <linux/file.h>
 #include <linux/fs.h>
@@ -25,6 +26,7 @@
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/nsproxy.h>
+#include <linux/pid_namespace.h>
 #include <linux/poll.h>
 #include <linux/debugfs.h>
 #include <linux/rbtree.h>
@@ -106,6 +108,15 @@ module_param_named(debug_mask, binder_debug_mask, uint, S_IWUSR | S_IRUGO);
 static int binder_debug_no_lock;
 module_param_named(proc_no_lock, binder_debug_no_lock, bool, S_IWUSR | S_IRUGO);
 
+static int binder_inherit_rt = 1;
+module_param_named(inherit_rt, binder_inherit_rt, bool, S_IWUSR | S_IRUGO);
+
+#ifdef CONFIG_CGROUP_SCHED
+static int binder_inherit_cgroup;
+module_param_named(inherit_cgroup, binder_inherit_cgroup, bool,
+		   S_IWUSR | S_IRUGO);
+#endif
+
 static DECLARE_WAIT_QUEUE_HEAD(binder_user_error_wait);
 static int binder_stop_on_user_error;
 
@@ -274,6 +285,19 @@ struct binder_buffer {
 	uint8_t data[0];
 };
 
+/*
+ * Scheduling class and priority of a thread.  prio is a kernel priority
+ * (0..MAX_RT_PRIO-1 for the realtime policies, NICE_TO_PRIO(nice)
+ * otherwise), lower is more important.
+ */
+struct binder_priority {
+	unsigned int sched_policy;
+	int prio;
+};
+
+#define BINDER_NICE_TO_PRIO(nice)	(MAX_RT_PRIO + (nice) + 20)
+#define BINDER_PRIO_TO_NICE(prio)	((prio) - MAX_RT_PRIO - 20)
+
 enum binder_deferred_state {
 	BINDER_DEFERRED_PUT_FILES    = 0x01,
 	BINDER_DEFERRED_FLUSH        = 0x02,
@@ -353,8 +377,11 @@ struct binder_transaction {
 	struct binder_buffer *buffer;
 	unsigned int	code;
 	unsigned int	flags;
-	long	priority;
-	long	saved_priority;
+	struct binder_priority	priority;
+	struct binder_priority	saved_priority;
+#ifdef CONFIG_CGROUP_SCHED
+	struct cgroup_subsys_state *saved_css;
+#endif
 	uid_t	sender_euid;
 };
 
@@ -516,6 +543,144 @@ static void binder_set_nice(long nice)
 	binder_user_error("binder: %d RLIMIT_NICE not set\n", current->pid);
 }
 
+static bool binder_is_rt_policy(unsigned int policy)
+{
+	return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+static struct binder_priority binder_get_priority(struct task_struct *task)
+{
+	struct binder_priority p;
+
+	p.sched_policy = task->policy;
+	p.prio = task->normal_prio;
+	return p;
+}
+
+/*
+ * Priority a transaction sent by current carries to the thread that
+ * handles it.  Without inherit_rt a realtime caller lends only its nice
+ * value, as binder always did.
+ */
+static struct binder_priority binder_caller_priority(void)
+{
+	struct binder_priority p = binder_get_priority(current);
+
+	if (binder_is_rt_policy(p.sched_policy) && !binder_inherit_rt) {
+		p.sched_policy = SCHED_NORMAL;
+		p.prio = current->static_prio;
+	}
+	return p;
+}
+
+static void binder_set_priority(struct binder_priority desired)
+{
+	struct sched_param params;
+	unsigned int policy = desired.sched_policy;
+
+	if (current->policy == policy && current->normal_prio == desired.prio)
+		return;
+
+	if (binder_is_rt_policy(policy)) {
+		/*
+		 * The caller lends its own priority, so the rlimits of the
+		 * handling thread do not apply.  The realtime group of the
+		 * handler may have no runtime, fall back to the best nice
+		 * value then.
+		 */
+		params.sched_priority = MAX_RT_PRIO - 1 - desired.prio;
+		if (!sched_setscheduler_nocheck(current, policy, &params))
+			return;
+		binder_debug(BINDER_DEBUG_PRIORITY_CAP,
+			     "binder: %d: rt priority %d not allowed use "
+			     "nice -20 instead\n", current->pid,
+			     params.sched_priority);
+		policy = SCHED_NORMAL;
+		desired.prio = BINDER_NICE_TO_PRIO(-20);
+	}
+
+	if (policy != current->policy) {
+		params.sched_priority = 0;
+		sched_setscheduler_nocheck(current, policy, &params);
+	}
+	binder_set_nice(BINDER_PRIO_TO_NICE(desired.prio));
+}
+
+#ifdef CONFIG_CGROUP_SCHED
+/*
+ * Moves current into the cpu cgroup of the thread that sent @t, so that
+ * a foreground caller is not served with the share of a background
+ * group.  The group current came from is kept in @t until the reply.
+ */
+static void binder_inherit_cpu_cgroup(struct binder_transaction *t)
+{
+	struct task_struct *from;
+	struct cgroup_subsys_state *css;
+	int ret;
+
+	t->saved_css = NULL;
+	if (!binder_inherit_cgroup || !t->from)
+		return;
+
+	rcu_read_lock();
+	from = find_task_by_pid_ns(t->from->pid, &init_pid_ns);
+	if (from)
+		get_task_struct(from);
+	rcu_read_unlock();
+	if (!from)
+		return;
+
+	cgroup_lock();
+	css = task_subsys_state(current, cpu_cgroup_subsys_id);
+	if (css != task_subsys_state(from, cpu_cgroup_subsys_id)) {
+		ret = cgroup_attach_task(task_cgroup(from, cpu_cgroup_subsys_id),
+					 current);
+		if (!ret) {
+			css_get(css);
+			t->saved_css = css;
+		} else
+			binder_debug(BINDER_DEBUG_PRIORITY_CAP,
+				     "binder: %d: cannot join cpu cgroup of "
+				     "%d, %d\n", current->pid, from->pid, ret);
+	}
+	cgroup_unlock();
+	put_task_struct(from);
+}
+
+static void binder_restore_cpu_cgroup(struct binder_transaction *t)
+{
+	struct cgroup_subsys_state *css = t->saved_css;
+
+	if (!css)
+		return;
+	t->saved_css = NULL;
+	cgroup_lock();
+	cgroup_attach_task(css->cgroup, current);
+	cgroup_unlock();
+	css_put(css);
+}
+
+static void binder_drop_cpu_cgroup(struct binder_transaction *t)
+{
+	if (t->saved_css) {
+		css_put(t->saved_css);
+		t->saved_css = NULL;
+	}
+}
+#else
+static inline void binder_inherit_cpu_cgroup(struct binder_transaction *t)
+{
+}
+
+static inline void binder_restore_cpu_cgroup(struct binder_transaction *t)
+{
+}
+
+static inline void binder_drop_cpu_cgroup(struct binder_transaction *t)
+{
+}
+#endif
+
 static size_t binder_buffer_size(struct binder_proc *proc,
 				 struct binder_buffer *buffer)
 {
@@ -1414,7 +1579,8 @@ static void binder_transaction(struct binder_proc *proc,
 			return_error = BR_FAILED_REPLY;
 			goto err_empty_call_stack;
 		}
-		binder_set_nice(in_reply_to->saved_priority);
+		binder_set_priority(in_reply_to->saved_priority);
+		binder_restore_cpu_cgroup(in_reply_to);
 		if (in_reply_to->to_thread != thread) {
 			binder_user_error("binder: %d:%d got reply transaction "
 				"with bad transaction stack,"
@@ -1548,7 +1714,7 @@ static void binder_transaction(struct binder_proc *proc,
 	t->to_thread = target_thread;
 	t->code = tr->code;
 	t->flags = tr->flags;
-	t->priority = task_nice(current);
+	t->priority = binder_caller_priority();
 	t->buffer = binder_alloc_buf(target_proc, tr->data_size,
 		tr->offsets_size, !reply && (t->flags & TF_ONE_WAY));
 	if (t->buffer == NULL) {
@@ -2410,15 +2576,23 @@ retry:
 		BUG_ON(t->buffer == NULL);
 		if (t->buffer->target_node) {
 			struct binder_node *target_node = t->buffer->target_node;
+			struct binder_priority node_prio = {
+				.sched_policy = SCHED_NORMAL,
+				.prio = BINDER_NICE_TO_PRIO(
+						target_node->min_priority),
+			};
+
 			tr.target.ptr = target_node->ptr;
 			tr.cookie =  target_node->cookie;
-			t->saved_priority = task_nice(current);
-			if (t->priority < target_node->min_priority &&
-			    !(t->flags & TF_ONE_WAY))
-				binder_set_nice(t->priority);
-			else if (!(t->flags & TF_ONE_WAY) ||
-				 t->saved_priority > target_node->min_priority)
-				binder_set_nice(target_node->min_priority);
+			t->saved_priority = binder_get_priority(current);
+			if (!(t->flags & TF_ONE_WAY)) {
+				binder_inherit_cpu_cgroup(t);
+				if (t->priority.prio < node_prio.prio)
+					binder_set_priority(t->priority);
+				else
+					binder_set_priority(node_prio);
+			} else if (t->saved_priority.prio > node_prio.prio)
+				binder_set_priority(node_prio);
 			cmd = BR_TRANSACTION;
 		} else {
 			tr.target.ptr = NULL;
@@ -2576,6 +2750,7 @@ static int binder_free_thread(struct binder_proc *proc,
 			     (t->to_thread == thread) ? "in" : "out");
 
 		if (t->to_thread == thread) {
+			binder_drop_cpu_cgroup(t);
 			t->to_proc = NULL;
 			t->to_thread = NULL;
 			if (t->buffer) {
@@ -3142,13 +3317,14 @@ static void print_binder_transaction(struct seq_file *m, const char *prefix,
 				     struct binder_transaction *t)
 {
 	seq_printf(m,
-		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %ld r%d",
+		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %d:%d r%d",
 		   prefix, t->debug_id, t,
 		   t->from ? t->from->proc->pid : 0,
 		   t->from ? t->from->pid : 0,
 		   t->to_proc ? t->to_proc->pid : 0,
 		   t->to_thread ? t->to_thread->pid : 0,
-		   t->code, t->flags, t->priority, t->need_reply);
+		   t->code, t->flags, t->priority.sched_policy,
+		   t->priority.prio, t->need_reply);
 	if (t->buffer == NULL) {
 		seq_puts(m, " buffer free\n");
 		return;
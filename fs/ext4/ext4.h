@@ -351,9 +351,10 @@ struct flex_groups {
 #define EXT4_EXTENTS_FL			0x00080000 /* Inode uses extents */
 #define EXT4_EA_INODE_FL	        0x00200000 /* Inode used for large EA */
 #define EXT4_EOFBLOCKS_FL		0x00400000 /* Blocks allocated beyond EOF */
+#define EXT4_INLINE_DATA_FL		0x10000000 /* Inode has inline data. */
 #define EXT4_RESERVED_FL		0x80000000 /* reserved for ext4 lib */
 
-#define EXT4_FL_USER_VISIBLE		0x004BDFFF /* User visible flags */
+#define EXT4_FL_USER_VISIBLE		0x104BDFFF /* User visible flags */
 #define EXT4_FL_USER_MODIFIABLE		0x004B80FF /* User modifiable flags */
 
 /* Flags that should be inherited by new inodes from their parent. */
@@ -407,6 +408,7 @@ enum {
 	EXT4_INODE_EXTENTS	= 19,	/* Inode uses extents */
 	EXT4_INODE_EA_INODE	= 21,	/* Inode used for large EA */
 	EXT4_INODE_EOFBLOCKS	= 22,	/* Blocks allocated beyond EOF */
+	EXT4_INODE_INLINE_DATA	= 28,	/* Data in inode. */
 	EXT4_INODE_RESERVED	= 31,	/* reserved for ext4 lib */
 };
 
@@ -453,6 +455,7 @@ static inline void ext4_check_flag_values(void)
 	CHECK_FLAG_VALUE(EXTENTS);
 	CHECK_FLAG_VALUE(EA_INODE);
 	CHECK_FLAG_VALUE(EOFBLOCKS);
+	CHECK_FLAG_VALUE(INLINE_DATA);
 	CHECK_FLAG_VALUE(RESERVED);
 }
 
@@ -755,6 +758,9 @@ struct ext4_ext_cache {
 	__u32		ec_len; /* must be 32bit to return holes */
 };
 
+#include "extents_status.h"
+#include "fast_commit.h"
+
 /*
  * fourth extended file system inode data in memory
  */
@@ -822,6 +828,11 @@ struct ext4_inode_info {
 	struct jbd2_inode *jinode;
 
 	struct ext4_ext_cache i_cached_extent;
+
+	/* extent status tree, see extents_status.c */
+	struct ext4_es_tree i_es_tree;
+	rwlock_t i_es_lock;
+	struct list_head i_es_lru;	/* on s_es_lru while it has entries */
 	/*
 	 * File creation time. Its function is same as that of
 	 * struct timespec i_{a,c,m}time in the generic inode.
@@ -866,6 +877,16 @@ struct ext4_inode_info {
 	 */
 	tid_t i_sync_tid;
 	tid_t i_datasync_tid;
+
+	/*
+	 * Fast commit: on s_fc_q while it has changes that are not in the
+	 * journal, which logical blocks they touched, and the last
+	 * transaction they belong to.  [s_fc_lock]
+	 */
+	struct list_head i_fc_list;
+	ext4_lblk_t i_fc_lblk_start;
+	ext4_lblk_t i_fc_lblk_len;
+	tid_t i_fc_tid;
 };
 
 /*
@@ -917,6 +938,10 @@ struct ext4_inode_info {
 #define EXT4_MOUNT_DISCARD		0x40000000 /* Issue DISCARD requests */
 #define EXT4_MOUNT_INIT_INODE_TABLE	0x80000000 /* Initialize uninitialized itables */
 
+#define EXT4_MOUNT2_IDLE_DISCARD	0x00000001 /* Discard freed blocks when
+						      the disk is idle */
+#define EXT4_MOUNT2_JOURNAL_FAST_COMMIT	0x00000002 /* Fast commits on fsync */
+
 #define clear_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt &= \
 						~EXT4_MOUNT_##opt
 #define set_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt |= \
@@ -1156,6 +1181,23 @@ struct ext4_sb_info {
 	unsigned long extent_cache_hits;
 	unsigned long extent_cache_misses;
 
+	/* extent status trees */
+	struct shrinker s_es_shrinker;
+	struct list_head s_es_lru;	/* inodes with cached extents */
+	spinlock_t s_es_lru_lock;
+	struct percpu_counter s_es_cnt;	/* cached extents, all inodes */
+	unsigned long s_es_hits;
+	unsigned long s_es_misses;
+
+	/* fast commits, see fast_commit.c */
+	struct list_head s_fc_q;	/* inodes with changes to log */
+	spinlock_t s_fc_lock;
+	wait_queue_head_t s_fc_wait;
+	tid_t s_fc_ineligible_tid;	/* transaction needing a full commit */
+	unsigned long s_fc_commits;
+	unsigned long s_fc_fallbacks;
+	unsigned long s_fc_blocks;
+
 	/* for buddy allocator */
 	struct ext4_group_info ***s_group_info;
 	struct inode *s_buddy_cache;
@@ -1215,6 +1257,19 @@ struct ext4_sb_info {
 
 	/* Kernel thread for multiple mount protection */
 	struct task_struct *s_mmp_tsk;
+
+	/* Freed extents waiting for an idle disk to be discarded */
+	struct task_struct *s_discard_tsk;
+	spinlock_t s_discard_lock;
+	struct rb_root s_discard_root;
+	unsigned int s_discard_extents;
+	unsigned long s_discard_pending;	/* in blocks */
+	unsigned long s_discard_done;		/* in blocks */
+	unsigned long s_discard_dropped;	/* in blocks */
+	unsigned long s_discard_sectors;	/* we issued, in sectors */
+	unsigned long s_discard_reads;		/* bitmaps read for it */
+	unsigned int s_discard_interval_ms;
+	unsigned int s_discard_rate_kb;		/* per second */
 };
 
 static inline struct ext4_sb_info *EXT4_SB(struct super_block *sb)
@@ -1254,6 +1309,9 @@ enum {
 	EXT4_STATE_DIO_UNWRITTEN,	/* need convert on dio done*/
 	EXT4_STATE_NEWENTRY,		/* File just added to dir */
 	EXT4_STATE_DELALLOC_RESERVED,	/* blks already reserved for delalloc */
+	EXT4_STATE_MAY_INLINE_DATA,	/* may have in-inode data */
+	EXT4_STATE_FC_COMMITTING,	/* fast commit is logging inode */
+	EXT4_STATE_FC_REMAPPED,		/* mapped meanwhile, rewrite data */
 };
 
 #define EXT4_INODE_BIT_FNS(name, field, offset)				\
@@ -1286,6 +1344,11 @@ static inline void ext4_clear_state_flags(struct ext4_inode_info *ei)
 	/* We depend on the fact that callers will set i_flags */
 }
 #endif
+
+static inline int ext4_has_inline_data(struct inode *inode)
+{
+	return ext4_test_inode_flag(inode, EXT4_INODE_INLINE_DATA);
+}
 #else
 /* Assume that user mode programs are passing in an ext4fs superblock, not
  * a kernel struct super_block.  This will allow us to call the feature-test
@@ -1365,6 +1428,7 @@ static inline void ext4_clear_state_flags(struct ext4_inode_info *ei)
 #define EXT4_FEATURE_INCOMPAT_FLEX_BG		0x0200
 #define EXT4_FEATURE_INCOMPAT_EA_INODE		0x0400 /* EA in inode */
 #define EXT4_FEATURE_INCOMPAT_DIRDATA		0x1000 /* data in dirent */
+#define EXT4_FEATURE_INCOMPAT_INLINE_DATA	0x8000 /* data in inode */
 
 #define EXT2_FEATURE_COMPAT_SUPP	EXT4_FEATURE_COMPAT_EXT_ATTR
 #define EXT2_FEATURE_INCOMPAT_SUPP	(EXT4_FEATURE_INCOMPAT_FILETYPE| \
@@ -1381,6 +1445,12 @@ static inline void ext4_clear_state_flags(struct ext4_inode_info *ei)
 					 EXT4_FEATURE_RO_COMPAT_LARGE_FILE| \
 					 EXT4_FEATURE_RO_COMPAT_BTREE_DIR)
 
+#ifdef CONFIG_EXT4_FS_XATTR
+#define EXT4_FEATURE_INCOMPAT_INLINE_SUPP	EXT4_FEATURE_INCOMPAT_INLINE_DATA
+#else
+#define EXT4_FEATURE_INCOMPAT_INLINE_SUPP	0
+#endif
+
 #define EXT4_FEATURE_COMPAT_SUPP	EXT2_FEATURE_COMPAT_EXT_ATTR
 #define EXT4_FEATURE_INCOMPAT_SUPP	(EXT4_FEATURE_INCOMPAT_FILETYPE| \
 					 EXT4_FEATURE_INCOMPAT_RECOVER| \
@@ -1388,7 +1458,8 @@ static inline void ext4_clear_state_flags(struct ext4_inode_info *ei)
 					 EXT4_FEATURE_INCOMPAT_EXTENTS| \
 					 EXT4_FEATURE_INCOMPAT_64BIT| \
 					 EXT4_FEATURE_INCOMPAT_FLEX_BG| \
-					 EXT4_FEATURE_INCOMPAT_MMP)
+					 EXT4_FEATURE_INCOMPAT_MMP| \
+					 EXT4_FEATURE_INCOMPAT_INLINE_SUPP)
 #define EXT4_FEATURE_RO_COMPAT_SUPP	(EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER| \
 					 EXT4_FEATURE_RO_COMPAT_LARGE_FILE| \
 					 EXT4_FEATURE_RO_COMPAT_GDT_CSUM| \
@@ -1746,6 +1817,7 @@ extern unsigned ext4_init_block_bitmap(struct super_block *sb,
 		ext4_init_block_bitmap(sb, NULL, group, desc)
 
 /* dir.c */
+extern unsigned char get_dtype(struct super_block *sb, int filetype);
 extern int __ext4_check_dir_entry(const char *, unsigned int, struct inode *,
 				  struct file *,
 				  struct ext4_dir_entry_2 *,
@@ -1797,6 +1869,10 @@ extern int ext4_mb_add_groupinfo(struct super_block *sb,
 extern void ext4_add_groupblocks(handle_t *handle, struct super_block *sb,
 				ext4_fsblk_t block, unsigned long count);
 extern int ext4_trim_fs(struct super_block *, struct fstrim_range *);
+extern int ext4_mb_mark_bb(handle_t *handle, struct super_block *sb,
+			   ext4_fsblk_t block, ext4_lblk_t len);
+extern void ext4_mb_start_idle_discard(struct super_block *);
+extern void ext4_mb_stop_idle_discard(struct super_block *);
 
 /* inode.c */
 struct buffer_head *ext4_getblk(handle_t *, struct inode *,
@@ -1847,6 +1923,20 @@ extern int ext4_orphan_add(handle_t *, struct inode *);
 extern int ext4_orphan_del(handle_t *, struct inode *);
 extern int ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
 				__u32 start_minor_hash, __u32 *next_hash);
+extern int ext4_search_dir(struct buffer_head *bh, char *search_buf,
+			   int buf_size, struct inode *dir,
+			   const struct qstr *d_name, unsigned int offset,
+			   struct ext4_dir_entry_2 **res_dir);
+extern int ext4_find_dest_de(struct inode *dir, struct buffer_head *bh,
+			     void *buf, int buf_size, const char *name,
+			     int namelen, struct ext4_dir_entry_2 **dest_de);
+extern void ext4_insert_dentry(struct inode *dir, struct inode *inode,
+			       struct ext4_dir_entry_2 *de, int buf_size,
+			       const char *name, int namelen);
+extern int ext4_generic_delete_entry(struct inode *dir,
+				     struct ext4_dir_entry_2 *de_del,
+				     struct buffer_head *bh, void *entry_buf,
+				     int buf_size);
 
 /* resize.c */
 extern int ext4_group_add(struct super_block *sb,
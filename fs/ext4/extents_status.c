@@ -0,0 +1,542 @@
+/*
+ *  fs/ext4/extents_status.c
+ *
+ * Per-inode tree of extent status entries: ranges of logical blocks known
+ * to be written, unwritten, delayed or holes.  ext4_map_blocks() answers
+ * from here before walking the extent tree or the indirect blocks, and
+ * FIEMAP finds delayed extents here instead of scanning the page cache.
+ *
+ * Apart from delayed extents, which are recorded nowhere else, the tree
+ * is only a cache of the block map and entries may be dropped at any
+ * time, by the shrinker among others.  Entries are added from the block
+ * map with i_data_sem held, and whoever changes the block map drops the
+ * range it changed before releasing i_data_sem, so that a lookup never
+ * returns a stale mapping.
+ */
+
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include "ext4.h"
+#include "ext4_extents.h"
+#include "extents_status.h"
+
+static struct kmem_cache *ext4_es_cachep;
+
+int __init ext4_init_es(void)
+{
+	ext4_es_cachep = KMEM_CACHE(extent_status, SLAB_RECLAIM_ACCOUNT);
+	if (ext4_es_cachep == NULL)
+		return -ENOMEM;
+	return 0;
+}
+
+void ext4_exit_es(void)
+{
+	kmem_cache_destroy(ext4_es_cachep);
+}
+
+void ext4_es_init_tree(struct ext4_es_tree *tree)
+{
+	tree->root = RB_ROOT;
+	tree->cache_es = NULL;
+}
+
+static inline ext4_lblk_t ext4_es_end(struct extent_status *es)
+{
+	BUG_ON(es->es_lblk + es->es_len < es->es_lblk);
+	return es->es_lblk + es->es_len - 1;
+}
+
+static inline int ext4_es_is_mapped(struct extent_status *es)
+{
+	return ext4_es_is_written(es) || ext4_es_is_unwritten(es);
+}
+
+/*
+ * Returns the extent containing lblk, or else the first extent after it,
+ * or NULL.
+ */
+static struct extent_status *__es_tree_search(struct rb_root *root,
+					      ext4_lblk_t lblk)
+{
+	struct rb_node *node = root->rb_node;
+	struct extent_status *es = NULL;
+
+	while (node) {
+		es = rb_entry(node, struct extent_status, rb_node);
+		if (lblk < es->es_lblk)
+			node = node->rb_left;
+		else if (lblk > ext4_es_end(es))
+			node = node->rb_right;
+		else
+			return es;
+	}
+
+	if (es && lblk < es->es_lblk)
+		return es;
+
+	if (es && lblk > ext4_es_end(es)) {
+		node = rb_next(&es->rb_node);
+		return node ? rb_entry(node, struct extent_status, rb_node) :
+			      NULL;
+	}
+
+	return NULL;
+}
+
+static struct extent_status *
+ext4_es_alloc_extent(struct inode *inode, ext4_lblk_t lblk, ext4_lblk_t len,
+		     ext4_fsblk_t pblk)
+{
+	struct extent_status *es;
+
+	/* called with i_es_lock held */
+	es = kmem_cache_alloc(ext4_es_cachep, GFP_ATOMIC);
+	if (es == NULL)
+		return NULL;
+	es->es_lblk = lblk;
+	es->es_len = len;
+	es->es_pblk = pblk;
+	percpu_counter_inc(&EXT4_SB(inode->i_sb)->s_es_cnt);
+	return es;
+}
+
+static void ext4_es_free_extent(struct inode *inode, struct extent_status *es)
+{
+	percpu_counter_dec(&EXT4_SB(inode->i_sb)->s_es_cnt);
+	kmem_cache_free(ext4_es_cachep, es);
+}
+
+/* Whether es2 directly follows es1 with the same status and mapping */
+static int ext4_es_can_be_merged(struct extent_status *es1,
+				 struct extent_status *es2)
+{
+	if (ext4_es_status(es1) != ext4_es_status(es2))
+		return 0;
+	if ((__u64)es1->es_len + es2->es_len > EXT_MAX_BLOCKS)
+		return 0;
+	if (es1->es_lblk + es1->es_len != es2->es_lblk)
+		return 0;
+	if (ext4_es_is_mapped(es1) &&
+	    ext4_es_pblock(es1) + es1->es_len != ext4_es_pblock(es2))
+		return 0;
+	return 1;
+}
+
+static struct extent_status *
+ext4_es_try_to_merge_left(struct inode *inode, struct extent_status *es)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct extent_status *es1;
+	struct rb_node *node;
+
+	node = rb_prev(&es->rb_node);
+	if (!node)
+		return es;
+
+	es1 = rb_entry(node, struct extent_status, rb_node);
+	if (ext4_es_can_be_merged(es1, es)) {
+		es1->es_len += es->es_len;
+		rb_erase(&es->rb_node, &tree->root);
+		ext4_es_free_extent(inode, es);
+		es = es1;
+	}
+	return es;
+}
+
+static struct extent_status *
+ext4_es_try_to_merge_right(struct inode *inode, struct extent_status *es)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct extent_status *es1;
+	struct rb_node *node;
+
+	node = rb_next(&es->rb_node);
+	if (!node)
+		return es;
+
+	es1 = rb_entry(node, struct extent_status, rb_node);
+	if (ext4_es_can_be_merged(es, es1)) {
+		es->es_len += es1->es_len;
+		rb_erase(node, &tree->root);
+		ext4_es_free_extent(inode, es1);
+	}
+	return es;
+}
+
+/* Insert newes, which must not overlap any extent in the tree */
+static int __es_insert_extent(struct inode *inode, struct extent_status *newes)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct rb_node **p = &tree->root.rb_node;
+	struct rb_node *parent = NULL;
+	struct extent_status *es;
+
+	while (*p) {
+		parent = *p;
+		es = rb_entry(parent, struct extent_status, rb_node);
+
+		if (newes->es_lblk < es->es_lblk) {
+			if (ext4_es_can_be_merged(newes, es)) {
+				/* newes ends right where es begins */
+				es->es_lblk = newes->es_lblk;
+				es->es_len += newes->es_len;
+				if (ext4_es_is_mapped(es))
+					ext4_es_store_pblock(es,
+						ext4_es_pblock(newes));
+				es = ext4_es_try_to_merge_left(inode, es);
+				goto out;
+			}
+			p = &(*p)->rb_left;
+		} else if (newes->es_lblk > ext4_es_end(es)) {
+			if (ext4_es_can_be_merged(es, newes)) {
+				es->es_len += newes->es_len;
+				es = ext4_es_try_to_merge_right(inode, es);
+				goto out;
+			}
+			p = &(*p)->rb_right;
+		} else {
+			BUG();
+			return -EINVAL;
+		}
+	}
+
+	es = ext4_es_alloc_extent(inode, newes->es_lblk, newes->es_len,
+				  newes->es_pblk);
+	if (!es)
+		return -ENOMEM;
+	rb_link_node(&es->rb_node, parent, p);
+	rb_insert_color(&es->rb_node, &tree->root);
+
+out:
+	tree->cache_es = es;
+	return 0;
+}
+
+/*
+ * Drop [lblk, end] from the tree.  An extent straddling the whole range is
+ * split in two; if there is no memory for that, its tail is dropped too.
+ */
+static void __es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
+			       ext4_lblk_t end)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct extent_status *es, orig_es, newes;
+	struct rb_node *node;
+	ext4_lblk_t len1, len2;
+
+	es = __es_tree_search(&tree->root, lblk);
+	if (!es || es->es_lblk > end)
+		return;
+
+	tree->cache_es = NULL;
+
+	orig_es = *es;
+	len1 = lblk > es->es_lblk ? lblk - es->es_lblk : 0;
+	len2 = ext4_es_end(es) > end ? ext4_es_end(es) - end : 0;
+	if (len1 > 0)
+		es->es_len = len1;
+	if (len2 > 0) {
+		if (len1 > 0) {
+			newes.es_lblk = end + 1;
+			newes.es_len = len2;
+			newes.es_pblk = orig_es.es_pblk;
+			if (ext4_es_is_mapped(&orig_es))
+				ext4_es_store_pblock(&newes,
+					ext4_es_pblock(&orig_es) +
+					orig_es.es_len - len2);
+			__es_insert_extent(inode, &newes);
+		} else {
+			es->es_lblk = end + 1;
+			es->es_len = len2;
+			if (ext4_es_is_mapped(es))
+				ext4_es_store_pblock(es,
+					ext4_es_pblock(&orig_es) +
+					orig_es.es_len - len2);
+		}
+		return;
+	}
+
+	if (len1 > 0) {
+		node = rb_next(&es->rb_node);
+		es = node ? rb_entry(node, struct extent_status, rb_node) :
+			    NULL;
+	}
+
+	while (es && ext4_es_end(es) <= end) {
+		node = rb_next(&es->rb_node);
+		rb_erase(&es->rb_node, &tree->root);
+		ext4_es_free_extent(inode, es);
+		es = node ? rb_entry(node, struct extent_status, rb_node) :
+			    NULL;
+	}
+
+	if (es && es->es_lblk <= end) {
+		len1 = ext4_es_end(es) - end;
+		if (ext4_es_is_mapped(es))
+			ext4_es_store_pblock(es, ext4_es_pblock(es) +
+					     es->es_len - len1);
+		es->es_lblk = end + 1;
+		es->es_len = len1;
+	}
+}
+
+/* Called with i_es_lock held, which the shrinker only ever trylocks */
+static void ext4_es_lru_add(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	if (!list_empty(&ei->i_es_lru))
+		return;
+	spin_lock(&sbi->s_es_lru_lock);
+	list_add_tail(&ei->i_es_lru, &sbi->s_es_lru);
+	spin_unlock(&sbi->s_es_lru_lock);
+}
+
+void ext4_es_lru_del(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	spin_lock(&sbi->s_es_lru_lock);
+	list_del_init(&ei->i_es_lru);
+	spin_unlock(&sbi->s_es_lru_lock);
+}
+
+static ext4_lblk_t ext4_es_clamp_len(ext4_lblk_t lblk, ext4_lblk_t len)
+{
+	if (lblk >= EXT_MAX_BLOCKS)
+		return 0;
+	return min_t(ext4_lblk_t, len, EXT_MAX_BLOCKS - lblk);
+}
+
+/*
+ * Record [lblk, lblk + len) as having the given status, replacing whatever
+ * was known about the range.  Used for delayed extents, which must be
+ * recorded; the caller holds i_data_sem or the pages of the range locked.
+ */
+void ext4_es_insert_extent(struct inode *inode, ext4_lblk_t lblk,
+			   ext4_lblk_t len, ext4_fsblk_t pblk,
+			   unsigned long long status)
+{
+	struct extent_status newes;
+
+	len = ext4_es_clamp_len(lblk, len);
+	if (!len)
+		return;
+
+	newes.es_lblk = lblk;
+	newes.es_len = len;
+	newes.es_pblk = (pblk & ~EXTENT_STATUS_FLAGS) |
+			(status & EXTENT_STATUS_FLAGS);
+
+	write_lock(&EXT4_I(inode)->i_es_lock);
+	__es_remove_extent(inode, lblk, lblk + len - 1);
+	if (!__es_insert_extent(inode, &newes))
+		ext4_es_lru_add(inode);
+	write_unlock(&EXT4_I(inode)->i_es_lock);
+}
+
+/*
+ * Cache what the block map says about [lblk, lblk + len), in the parts of
+ * the range the tree knows nothing about yet: in particular, a hole found
+ * in the block map never hides a delayed extent.
+ */
+void ext4_es_cache_extent(struct inode *inode, ext4_lblk_t lblk,
+			  ext4_lblk_t len, ext4_fsblk_t pblk,
+			  unsigned long long status)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct extent_status newes, *es;
+	ext4_lblk_t end, skip;
+
+	len = ext4_es_clamp_len(lblk, len);
+	if (!len)
+		return;
+	end = lblk + len - 1;
+	if (!(status & (EXTENT_STATUS_WRITTEN | EXTENT_STATUS_UNWRITTEN)))
+		pblk = 0;
+
+	write_lock(&EXT4_I(inode)->i_es_lock);
+	for (;;) {
+		es = __es_tree_search(&tree->root, lblk);
+		if (es && es->es_lblk <= lblk) {
+			/* already known */
+			skip = ext4_es_end(es) - lblk + 1;
+		} else {
+			newes.es_lblk = lblk;
+			if (es && es->es_lblk <= end)
+				newes.es_len = es->es_lblk - lblk;
+			else
+				newes.es_len = end - lblk + 1;
+			newes.es_pblk = (pblk & ~EXTENT_STATUS_FLAGS) |
+					(status & EXTENT_STATUS_FLAGS);
+			if (__es_insert_extent(inode, &newes))
+				break;
+			ext4_es_lru_add(inode);
+			skip = newes.es_len;
+		}
+		if (skip > end - lblk)
+			break;
+		lblk += skip;
+		if (pblk)
+			pblk += skip;
+	}
+	write_unlock(&EXT4_I(inode)->i_es_lock);
+}
+
+/* Forget everything about [lblk, lblk + len) */
+void ext4_es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
+			   ext4_lblk_t len)
+{
+	len = ext4_es_clamp_len(lblk, len);
+	if (!len)
+		return;
+
+	write_lock(&EXT4_I(inode)->i_es_lock);
+	__es_remove_extent(inode, lblk, lblk + len - 1);
+	write_unlock(&EXT4_I(inode)->i_es_lock);
+}
+
+/*
+ * Look up the extent containing lblk.  Returns 1 and a copy of it in *es
+ * if the tree has one, 0 otherwise.
+ */
+int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
+			  struct extent_status *es)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct extent_status *es1;
+	struct rb_node *node;
+	int found = 0;
+
+	read_lock(&EXT4_I(inode)->i_es_lock);
+	es1 = tree->cache_es;
+	if (es1 && in_range(lblk, es1->es_lblk, es1->es_len)) {
+		found = 1;
+	} else {
+		node = tree->root.rb_node;
+		while (node) {
+			es1 = rb_entry(node, struct extent_status, rb_node);
+			if (lblk < es1->es_lblk)
+				node = node->rb_left;
+			else if (lblk > ext4_es_end(es1))
+				node = node->rb_right;
+			else {
+				found = 1;
+				break;
+			}
+		}
+	}
+
+	if (found) {
+		es->es_lblk = es1->es_lblk;
+		es->es_len = es1->es_len;
+		es->es_pblk = es1->es_pblk;
+		sbi->s_es_hits++;
+	} else
+		sbi->s_es_misses++;
+	read_unlock(&EXT4_I(inode)->i_es_lock);
+
+	return found;
+}
+
+/*
+ * Find the first delayed extent containing or following lblk.  es_len is
+ * 0 in *es if there is none.
+ */
+void ext4_es_find_delayed_extent(struct inode *inode, ext4_lblk_t lblk,
+				 struct extent_status *es)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct extent_status *es1;
+	struct rb_node *node;
+
+	es->es_lblk = es->es_len = 0;
+	es->es_pblk = 0;
+
+	read_lock(&EXT4_I(inode)->i_es_lock);
+	es1 = __es_tree_search(&tree->root, lblk);
+	while (es1 && !ext4_es_is_delayed(es1)) {
+		node = rb_next(&es1->rb_node);
+		es1 = node ? rb_entry(node, struct extent_status, rb_node) :
+			     NULL;
+	}
+	if (es1) {
+		es->es_lblk = es1->es_lblk;
+		es->es_len = es1->es_len;
+		es->es_pblk = es1->es_pblk;
+	}
+	read_unlock(&EXT4_I(inode)->i_es_lock);
+}
+
+/* Free up to nr_to_scan extents of ei other than delayed ones */
+static int ext4_es_reclaim_extents(struct ext4_inode_info *ei, int nr_to_scan)
+{
+	struct ext4_es_tree *tree = &ei->i_es_tree;
+	struct extent_status *es;
+	struct rb_node *node;
+	int nr_shrunk = 0;
+
+	tree->cache_es = NULL;
+	node = rb_first(&tree->root);
+	while (node && nr_shrunk < nr_to_scan) {
+		es = rb_entry(node, struct extent_status, rb_node);
+		node = rb_next(node);
+		if (!ext4_es_is_delayed(es)) {
+			rb_erase(&es->rb_node, &tree->root);
+			ext4_es_free_extent(&ei->vfs_inode, es);
+			nr_shrunk++;
+		}
+	}
+	return nr_shrunk;
+}
+
+static int ext4_es_shrink(struct shrinker *shrink, struct shrink_control *sc)
+{
+	struct ext4_sb_info *sbi = container_of(shrink, struct ext4_sb_info,
+						s_es_shrinker);
+	struct ext4_inode_info *ei, *tmp;
+	int nr_to_scan = sc->nr_to_scan;
+	LIST_HEAD(scanned);
+
+	if (!nr_to_scan)
+		goto out;
+
+	/* oldest inodes first; those scanned go to the tail */
+	spin_lock(&sbi->s_es_lru_lock);
+	list_for_each_entry_safe(ei, tmp, &sbi->s_es_lru, i_es_lru) {
+		if (nr_to_scan <= 0)
+			break;
+		if (!write_trylock(&ei->i_es_lock))
+			continue;
+		nr_to_scan -= ext4_es_reclaim_extents(ei, nr_to_scan);
+		if (RB_EMPTY_ROOT(&ei->i_es_tree.root))
+			list_del_init(&ei->i_es_lru);
+		else
+			list_move_tail(&ei->i_es_lru, &scanned);
+		write_unlock(&ei->i_es_lock);
+	}
+	list_splice_tail(&scanned, &sbi->s_es_lru);
+	spin_unlock(&sbi->s_es_lru_lock);
+out:
+	return percpu_counter_read_positive(&sbi->s_es_cnt);
+}
+
+void ext4_es_register_shrinker(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	INIT_LIST_HEAD(&sbi->s_es_lru);
+	spin_lock_init(&sbi->s_es_lru_lock);
+	sbi->s_es_shrinker.shrink = ext4_es_shrink;
+	sbi->s_es_shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&sbi->s_es_shrinker);
+}
+
+void ext4_es_unregister_shrinker(struct super_block *sb)
+{
+	unregister_shrinker(&EXT4_SB(sb)->s_es_shrinker);
+}
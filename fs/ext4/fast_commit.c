@@ -0,0 +1,1160 @@
+/*
+ *  fs/ext4/fast_commit.c
+ *
+ * Fast commits: on fsync, instead of committing the running transaction,
+ * log what changed in the inodes touched since the last commit to the
+ * fast commit area at the end of the journal.  For each inode that is the
+ * range of logical blocks that were mapped or unmapped, the extents now
+ * mapping that range, and the on-disk inode.  Their data is written out
+ * first, so a fast commit costs the data plus a block or two, where a full
+ * commit writes every metadata block the transaction dirtied.
+ *
+ * Changes that cannot be described this way - directory entries, xattrs,
+ * inode flags, data journalling, quota - make the running transaction
+ * ineligible, and fsync commits it in full as before.  So does running out
+ * of room in the area, which is reused after every full commit.
+ *
+ * After jbd2 recovery, the fast commits of the transaction that did not
+ * make it to the log are replayed on top of it when the filesystem is
+ * mounted.
+ */
+
+#include <linux/crc32.h>
+#include <linux/quotaops.h>
+#include <linux/slab.h>
+#include <linux/writeback.h>
+#include "ext4.h"
+#include "ext4_jbd2.h"
+#include "ext4_extents.h"
+
+static inline int ext4_fc_enabled(struct super_block *sb)
+{
+	return test_opt2(sb, JOURNAL_FAST_COMMIT) &&
+	       jbd2_has_fast_commit(EXT4_SB(sb)->s_journal);
+}
+
+void ext4_fc_init_inode(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+
+	INIT_LIST_HEAD(&ei->i_fc_list);
+	ei->i_fc_lblk_start = 0;
+	ei->i_fc_lblk_len = 0;
+	ei->i_fc_tid = 0;
+}
+
+/* Queue the inode for the next fast commit, s_fc_lock held */
+static void ext4_fc_queue(handle_t *handle, struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+
+	ei->i_fc_tid = handle->h_transaction->t_tid;
+	if (list_empty(&ei->i_fc_list))
+		list_add_tail(&ei->i_fc_list, &EXT4_SB(inode->i_sb)->s_fc_q);
+}
+
+/*
+ * The running transaction has changes fast commits cannot describe, fsync
+ * has to commit it in full.
+ */
+void ext4_fc_mark_ineligible(handle_t *handle, struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	if (!ext4_fc_enabled(sb) || !ext4_handle_valid(handle))
+		return;
+	spin_lock(&sbi->s_fc_lock);
+	sbi->s_fc_ineligible_tid = handle->h_transaction->t_tid;
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/* The on-disk inode changed, called from ext4_mark_inode_dirty() */
+void ext4_fc_track_inode(handle_t *handle, struct inode *inode)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	if (!ext4_fc_enabled(inode->i_sb) || !ext4_handle_valid(handle))
+		return;
+	if (!S_ISREG(inode->i_mode) || ext4_should_journal_data(inode) ||
+	    ext4_has_inline_data(inode)) {
+		ext4_fc_mark_ineligible(handle, inode->i_sb);
+		return;
+	}
+	spin_lock(&sbi->s_fc_lock);
+	ext4_fc_queue(handle, inode);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/* Logical blocks start to end, inclusive, were mapped or unmapped */
+void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+			 ext4_lblk_t start, ext4_lblk_t end)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	ext4_lblk_t old_end;
+
+	if (!ext4_fc_enabled(inode->i_sb) || !ext4_handle_valid(handle))
+		return;
+	if (!S_ISREG(inode->i_mode) ||
+	    !ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) ||
+	    ext4_should_journal_data(inode) || ext4_has_inline_data(inode)) {
+		ext4_fc_mark_ineligible(handle, inode->i_sb);
+		return;
+	}
+
+	spin_lock(&sbi->s_fc_lock);
+	if (ext4_test_inode_state(inode, EXT4_STATE_FC_COMMITTING))
+		ext4_set_inode_state(inode, EXT4_STATE_FC_REMAPPED);
+	if (ei->i_fc_lblk_len) {
+		old_end = ei->i_fc_lblk_start + ei->i_fc_lblk_len - 1;
+		ei->i_fc_lblk_start = min(ei->i_fc_lblk_start, start);
+		end = max(old_end, end);
+	} else
+		ei->i_fc_lblk_start = start;
+	ei->i_fc_lblk_len = end - ei->i_fc_lblk_start + 1;
+	ext4_fc_queue(handle, inode);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/* The inode is being evicted, wait for a fast commit still logging it */
+void ext4_fc_del(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	DEFINE_WAIT(wait);
+
+	if (list_empty(&ei->i_fc_list))
+		return;
+
+	spin_lock(&sbi->s_fc_lock);
+	while (ext4_test_inode_state(inode, EXT4_STATE_FC_COMMITTING)) {
+		prepare_to_wait(&sbi->s_fc_wait, &wait, TASK_UNINTERRUPTIBLE);
+		spin_unlock(&sbi->s_fc_lock);
+		schedule();
+		finish_wait(&sbi->s_fc_wait, &wait);
+		spin_lock(&sbi->s_fc_lock);
+	}
+	list_del_init(&ei->i_fc_list);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/* A full commit of tid made the changes queued up to it durable */
+static void ext4_fc_cleanup(journal_t *journal, tid_t tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(journal->j_private);
+	struct ext4_inode_info *ei, *tmp;
+
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry_safe(ei, tmp, &sbi->s_fc_q, i_fc_list) {
+		if (!tid_geq(tid, ei->i_fc_tid))
+			continue;
+		list_del_init(&ei->i_fc_list);
+		ei->i_fc_lblk_len = 0;
+	}
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/*
+ * Writing fast commits
+ */
+
+struct ext4_fc_ctx {
+	journal_t *journal;
+	struct buffer_head **bhs;	/* blocks filled so far */
+	int nr_bhs;
+	int max_bhs;
+	int off;			/* end of the tags in the last one */
+	u32 crc;
+};
+
+static void ext4_fc_crc(struct ext4_fc_ctx *ctx, struct ext4_fc_tl *tl)
+{
+	ctx->crc = crc32_be(ctx->crc, (u8 *)tl,
+			    sizeof(*tl) + le16_to_cpu(tl->fc_len));
+}
+
+/* Pad out the last block and get a new one */
+static int ext4_fc_next_block(struct ext4_fc_ctx *ctx)
+{
+	int bsize = ctx->journal->j_blocksize;
+	struct buffer_head *bh;
+	struct ext4_fc_tl *tl;
+	int ret;
+
+	if (ctx->nr_bhs && ctx->off < bsize) {
+		bh = ctx->bhs[ctx->nr_bhs - 1];
+		tl = (struct ext4_fc_tl *)(bh->b_data + ctx->off);
+		tl->fc_tag = cpu_to_le16(EXT4_FC_TAG_PAD);
+		tl->fc_len = cpu_to_le16(bsize - ctx->off - sizeof(*tl));
+		ext4_fc_crc(ctx, tl);
+	}
+	if (ctx->nr_bhs == ctx->max_bhs)
+		return -ENOSPC;
+
+	ret = jbd2_fc_get_buf(ctx->journal, &bh);
+	if (ret)
+		return ret;
+	ctx->bhs[ctx->nr_bhs++] = bh;
+	ctx->off = 0;
+	return 0;
+}
+
+/* Room for a tag with a len byte value, which the caller fills in */
+static struct ext4_fc_tl *ext4_fc_reserve(struct ext4_fc_ctx *ctx, int tag,
+					  int len)
+{
+	int size = sizeof(struct ext4_fc_tl) + len;
+	struct ext4_fc_tl *tl;
+	int ret;
+
+	if (size > ctx->journal->j_blocksize)
+		return ERR_PTR(-EINVAL);
+	if (!ctx->nr_bhs || ctx->off + size > ctx->journal->j_blocksize) {
+		ret = ext4_fc_next_block(ctx);
+		if (ret)
+			return ERR_PTR(ret);
+	}
+
+	tl = (struct ext4_fc_tl *)(ctx->bhs[ctx->nr_bhs - 1]->b_data +
+				   ctx->off);
+	tl->fc_tag = cpu_to_le16(tag);
+	tl->fc_len = cpu_to_le16(len);
+	ctx->off += size;
+	return tl;
+}
+
+static int ext4_fc_add_tag(struct ext4_fc_ctx *ctx, int tag, int len,
+			   const void *val)
+{
+	struct ext4_fc_tl *tl;
+
+	tl = ext4_fc_reserve(ctx, tag, len);
+	if (IS_ERR(tl))
+		return PTR_ERR(tl);
+	memcpy(tl + 1, val, len);
+	ext4_fc_crc(ctx, tl);
+	return 0;
+}
+
+static int ext4_fc_add_tail(struct ext4_fc_ctx *ctx, tid_t tid)
+{
+	struct ext4_fc_tail *tail;
+	struct ext4_fc_tl *tl;
+
+	tl = ext4_fc_reserve(ctx, EXT4_FC_TAG_TAIL, sizeof(*tail));
+	if (IS_ERR(tl))
+		return PTR_ERR(tl);
+	tail = (struct ext4_fc_tail *)(tl + 1);
+	tail->fc_tid = cpu_to_le32(tid);
+	ctx->crc = crc32_be(ctx->crc, (u8 *)tl, sizeof(*tl) +
+			    offsetof(struct ext4_fc_tail, fc_crc));
+	tail->fc_crc = cpu_to_le32(ctx->crc);
+	return 0;
+}
+
+/* The part of a walked extent that lies in [start, end) */
+static void ext4_fc_clip(struct ext4_ext_cache *cex, ext4_lblk_t start,
+			 u64 end, ext4_lblk_t *lblk, ext4_lblk_t *len,
+			 ext4_fsblk_t *pblk)
+{
+	*lblk = max(cex->ec_block, start);
+	*len = min_t(u64, (u64)cex->ec_block + cex->ec_len, end) - *lblk;
+	*pblk = cex->ec_start + *lblk - cex->ec_block;
+}
+
+struct ext4_fc_walk {
+	struct ext4_fc_ctx *ctx;
+	ext4_lblk_t start;
+	u64 end;
+};
+
+static int ext4_fc_add_range_cb(struct inode *inode, ext4_lblk_t next,
+				struct ext4_ext_cache *cex,
+				struct ext4_extent *ex, void *data)
+{
+	struct ext4_fc_walk *w = data;
+	struct ext4_fc_add_range add;
+	struct ext4_extent *fex = (struct ext4_extent *)add.fc_ex;
+	ext4_lblk_t lblk, len;
+	ext4_fsblk_t pblk;
+
+	if (!cex->ec_start)
+		return EXT_CONTINUE;
+
+	ext4_fc_clip(cex, w->start, w->end, &lblk, &len, &pblk);
+	add.fc_ino = cpu_to_le32(inode->i_ino);
+	fex->ee_block = cpu_to_le32(lblk);
+	fex->ee_len = cpu_to_le16(len);
+	ext4_ext_store_pblock(fex, pblk);
+	if (ext4_ext_is_uninitialized(ex))
+		ext4_ext_mark_uninitialized(fex);
+	return ext4_fc_add_tag(w->ctx, EXT4_FC_TAG_ADD_RANGE, sizeof(add),
+			       &add);
+}
+
+static int ext4_fc_add_inode(struct ext4_fc_ctx *ctx, struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_fc_del_range del;
+	struct ext4_fc_inode *fi;
+	struct ext4_fc_walk w;
+	struct ext4_fc_tl *tl;
+	struct ext4_iloc iloc;
+	int inode_len, ret;
+
+	if (ei->i_fc_lblk_len) {
+		del.fc_ino = cpu_to_le32(inode->i_ino);
+		del.fc_lblk = cpu_to_le32(ei->i_fc_lblk_start);
+		del.fc_len = cpu_to_le32(ei->i_fc_lblk_len);
+		ret = ext4_fc_add_tag(ctx, EXT4_FC_TAG_DEL_RANGE, sizeof(del),
+				      &del);
+		if (ret)
+			return ret;
+
+		w.ctx = ctx;
+		w.start = ei->i_fc_lblk_start;
+		w.end = (u64)w.start + ei->i_fc_lblk_len;
+		ret = ext4_ext_walk_space(inode, w.start, ei->i_fc_lblk_len,
+					  ext4_fc_add_range_cb, &w);
+		if (ret)
+			return ret;
+	}
+
+	inode_len = EXT4_GOOD_OLD_INODE_SIZE;
+	if (EXT4_INODE_SIZE(inode->i_sb) > EXT4_GOOD_OLD_INODE_SIZE)
+		inode_len += ei->i_extra_isize;
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		return ret;
+	tl = ext4_fc_reserve(ctx, EXT4_FC_TAG_INODE, sizeof(*fi) + inode_len);
+	if (IS_ERR(tl)) {
+		brelse(iloc.bh);
+		return PTR_ERR(tl);
+	}
+	fi = (struct ext4_fc_inode *)(tl + 1);
+	fi->fc_ino = cpu_to_le32(inode->i_ino);
+	memcpy(fi->fc_raw_inode, ext4_raw_inode(&iloc), inode_len);
+	ext4_fc_crc(ctx, tl);
+	brelse(iloc.bh);
+	return 0;
+}
+
+static int ext4_fc_wait_bhs(struct buffer_head **bhs, int nr)
+{
+	int i, ret = 0;
+
+	for (i = 0; i < nr; i++) {
+		wait_on_buffer(bhs[i]);
+		if (!buffer_uptodate(bhs[i]))
+			ret = -EIO;
+	}
+	return ret;
+}
+
+static void ext4_fc_submit_bh(struct buffer_head *bh, int rw)
+{
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	get_bh(bh);
+	submit_bh(rw, bh);
+}
+
+/*
+ * Write the blocks, the last one, holding the tail, only once the others
+ * and the data are on disk.
+ */
+static int ext4_fc_submit(struct ext4_fc_ctx *ctx)
+{
+	journal_t *journal = ctx->journal;
+	int barrier = journal->j_flags & JBD2_BARRIER;
+	int i, last = ctx->nr_bhs - 1;
+	int ret;
+
+	for (i = 0; i < last; i++)
+		ext4_fc_submit_bh(ctx->bhs[i], WRITE_SYNC);
+	ret = ext4_fc_wait_bhs(ctx->bhs, last);
+	if (ret)
+		return ret;
+
+	if (barrier && journal->j_fs_dev != journal->j_dev)
+		blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+	ext4_fc_submit_bh(ctx->bhs[last],
+			  barrier ? WRITE_SYNC | WRITE_FLUSH_FUA : WRITE_SYNC);
+	return ext4_fc_wait_bhs(ctx->bhs + last, 1);
+}
+
+/*
+ * Write the data of blocks the inode already has, so the extents logged
+ * never point at stale blocks.  ext4_writepage() starts no handle for
+ * these, and leaves delayed and unwritten buffers alone: fsync wrote the
+ * file's own, and other inodes log no extent for them yet.
+ */
+static int ext4_fc_write_data(struct inode *inode)
+{
+	struct writeback_control wbc = {
+		.sync_mode = WB_SYNC_ALL,
+		.nr_to_write = LONG_MAX,
+		.range_start = 0,
+		.range_end = LLONG_MAX,
+	};
+
+	if (!S_ISREG(inode->i_mode) || !inode->i_mapping->nrpages)
+		return 0;
+	return generic_writepages(inode->i_mapping, &wbc);
+}
+
+/* Write and wait on the data of the queued inodes, or of the remapped ones */
+static int ext4_fc_write_data_q(struct list_head *q, int remapped)
+{
+	struct ext4_inode_info *ei;
+	struct inode *inode;
+	int ret;
+
+	list_for_each_entry(ei, q, i_fc_list) {
+		inode = &ei->vfs_inode;
+		if (remapped &&
+		    !ext4_test_inode_state(inode, EXT4_STATE_FC_REMAPPED))
+			continue;
+		ret = ext4_fc_write_data(inode);
+		if (ret)
+			return ret;
+	}
+	list_for_each_entry(ei, q, i_fc_list) {
+		inode = &ei->vfs_inode;
+		if (remapped &&
+		    !ext4_test_inode_state(inode, EXT4_STATE_FC_REMAPPED))
+			continue;
+		ret = filemap_fdatawait(inode->i_mapping);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/* Done with the queued inodes, whether they got logged or not */
+static void ext4_fc_dequeue(struct ext4_sb_info *sbi, struct list_head *q)
+{
+	struct ext4_inode_info *ei, *tmp;
+
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry_safe(ei, tmp, q, i_fc_list) {
+		list_del_init(&ei->i_fc_list);
+		ei->i_fc_lblk_len = 0;
+		ext4_clear_inode_state(&ei->vfs_inode,
+				       EXT4_STATE_FC_COMMITTING);
+		ext4_clear_inode_state(&ei->vfs_inode, EXT4_STATE_FC_REMAPPED);
+	}
+	spin_unlock(&sbi->s_fc_lock);
+	wake_up_all(&sbi->s_fc_wait);
+}
+
+/*
+ * Fill in the tags for the queued inodes.  No handle may run meanwhile,
+ * so what is logged is the state of the inodes at one point in time, and
+ * the tracking is reset at that same point.
+ */
+static int ext4_fc_fill(struct ext4_fc_ctx *ctx, struct list_head *q,
+			tid_t tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ctx->journal->j_private);
+	struct ext4_inode_info *ei;
+	struct ext4_fc_head head;
+	int ret = 0;
+
+	jbd2_journal_lock_updates(ctx->journal);
+
+	/* Blocks mapped since the data was written hold no data on disk yet */
+	ret = ext4_fc_write_data_q(q, 1);
+	if (!ret && ctx->journal->j_fc_off == 0) {
+		head.fc_features = 0;
+		head.fc_tid = cpu_to_le32(tid);
+		ret = ext4_fc_add_tag(ctx, EXT4_FC_TAG_HEAD, sizeof(head),
+				      &head);
+	}
+	list_for_each_entry(ei, q, i_fc_list) {
+		if (ret)
+			break;
+		ret = ext4_fc_add_inode(ctx, &ei->vfs_inode);
+	}
+	if (!ret)
+		ret = ext4_fc_add_tail(ctx, tid);
+
+	ext4_fc_dequeue(sbi, q);
+	jbd2_journal_unlock_updates(ctx->journal);
+	return ret;
+}
+
+static int ext4_fc_perform_commit(journal_t *journal, tid_t tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_inode_info *ei, *tmp;
+	struct ext4_fc_ctx ctx;
+	LIST_HEAD(commit_q);
+	int ret = 0;
+
+	spin_lock(&sbi->s_fc_lock);
+	if (sbi->s_fc_ineligible_tid == tid) {
+		spin_unlock(&sbi->s_fc_lock);
+		return -EINVAL;
+	}
+	/* Inodes being evicted are clean, and ext4_fc_del() waits for us */
+	list_for_each_entry_safe(ei, tmp, &sbi->s_fc_q, i_fc_list) {
+		struct inode *inode = &ei->vfs_inode;
+
+		spin_lock(&inode->i_lock);
+		if (!(inode->i_state & (I_FREEING | I_WILL_FREE))) {
+			ext4_set_inode_state(inode, EXT4_STATE_FC_COMMITTING);
+			list_move_tail(&ei->i_fc_list, &commit_q);
+		}
+		spin_unlock(&inode->i_lock);
+	}
+	spin_unlock(&sbi->s_fc_lock);
+
+	if (list_empty(&commit_q)) {
+		/* Nothing to log since the last one, fsync wrote data though */
+		if (journal->j_flags & JBD2_BARRIER)
+			blkdev_issue_flush(sb->s_bdev, GFP_NOFS, NULL);
+		return 0;
+	}
+
+	ctx.journal = journal;
+	ctx.nr_bhs = 0;
+	ctx.off = 0;
+	ctx.crc = ~0;
+	ctx.max_bhs = journal->j_fc_last - journal->j_fc_first -
+		      journal->j_fc_off;
+	ctx.bhs = NULL;
+	if (ctx.max_bhs <= 0)
+		ret = -ENOSPC;
+	else
+		ctx.bhs = kmalloc(ctx.max_bhs * sizeof(*ctx.bhs), GFP_NOFS);
+	if (!ret && !ctx.bhs)
+		ret = -ENOMEM;
+
+	/*
+	 * Handles keep running while the data is written, inodes they remap
+	 * meanwhile get theirs written again by ext4_fc_fill().
+	 */
+	if (!ret)
+		ret = ext4_fc_write_data_q(&commit_q, 0);
+	if (!ret)
+		ret = ext4_fc_fill(&ctx, &commit_q, tid);
+	else
+		ext4_fc_dequeue(sbi, &commit_q);
+	if (!ret)
+		ret = ext4_fc_submit(&ctx);
+	if (!ret)
+		sbi->s_fc_blocks += ctx.nr_bhs;
+	while (ctx.nr_bhs)
+		brelse(ctx.bhs[--ctx.nr_bhs]);
+	kfree(ctx.bhs);
+
+	/* Later fast commits would be hidden behind a failed one */
+	if (ret) {
+		spin_lock(&sbi->s_fc_lock);
+		sbi->s_fc_ineligible_tid = tid;
+		spin_unlock(&sbi->s_fc_lock);
+	}
+	return ret;
+}
+
+/*
+ * Make transaction commit_tid durable for fsync with a fast commit.
+ * Returns 1 if the caller has to commit it in full instead, because it is
+ * committing already, or because it cannot be fast committed.  Quota
+ * changes are not logged, so fast commits are off while quota is on.
+ */
+int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int ret;
+
+	if (!ext4_fc_enabled(sb))
+		return 1;
+
+	do {
+		ret = jbd2_fc_begin_commit(journal, commit_tid);
+	} while (ret == -EAGAIN);
+	if (ret)
+		return 1;
+
+	if (sb_any_quota_loaded(sb))
+		ret = -EINVAL;
+	else
+		ret = ext4_fc_perform_commit(journal, commit_tid);
+	if (ret)
+		sbi->s_fc_fallbacks++;
+	else
+		sbi->s_fc_commits++;
+	jbd2_fc_end_commit(journal);
+	return ret ? 1 : 0;
+}
+
+/*
+ * Set up the fast commit area of the journal, or give it back to the log
+ * if the fast_commit option is not set.
+ */
+int ext4_fc_init(struct super_block *sb)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	int ret;
+
+	if (!test_opt2(sb, JOURNAL_FAST_COMMIT))
+		return jbd2_fc_release(journal);
+
+	ret = jbd2_fc_init(journal, EXT4_NUM_FC_BLKS);
+	if (ret)
+		return ret;
+	journal->j_fc_cleanup_callback = ext4_fc_cleanup;
+	return 0;
+}
+
+/*
+ * Replay
+ */
+
+struct ext4_fc_ext {
+	ext4_lblk_t lblk;
+	ext4_lblk_t len;
+	ext4_fsblk_t pblk;
+	int unwritten;
+};
+
+struct ext4_fc_exts {
+	struct ext4_fc_ext *ext;
+	int nr;
+	int max;
+};
+
+struct ext4_fc_replay_state {
+	tid_t tid;
+
+	/* checking the area */
+	u32 crc;
+	int seen_head;
+	unsigned long valid_blocks;
+
+	/* the inode being replayed */
+	unsigned long ino;
+	ext4_lblk_t lblk;
+	ext4_lblk_t len;
+	struct ext4_fc_exts add;	/* how [lblk, lblk + len) is mapped */
+	struct ext4_fc_exts old;	/* and how it was */
+};
+
+static int ext4_fc_exts_add(struct ext4_fc_exts *exts, ext4_lblk_t lblk,
+			    ext4_lblk_t len, ext4_fsblk_t pblk, int unwritten)
+{
+	struct ext4_fc_ext *ext;
+
+	if (exts->nr == exts->max) {
+		int max = exts->max ? exts->max * 2 : 16;
+
+		ext = krealloc(exts->ext, max * sizeof(*ext), GFP_NOFS);
+		if (!ext)
+			return -ENOMEM;
+		exts->ext = ext;
+		exts->max = max;
+	}
+	ext = &exts->ext[exts->nr++];
+	ext->lblk = lblk;
+	ext->len = len;
+	ext->pblk = pblk;
+	ext->unwritten = unwritten;
+	return 0;
+}
+
+/*
+ * Returns how many blocks from lblk on are mapped by exts to pblk onwards,
+ * looking at most len blocks ahead, or minus how many are not.  exts is
+ * sorted and the extents do not overlap.
+ */
+static s64 ext4_fc_same(struct ext4_fc_exts *exts, ext4_lblk_t lblk,
+			ext4_lblk_t len, ext4_fsblk_t pblk,
+			struct ext4_fc_ext **match)
+{
+	struct ext4_fc_ext *e;
+	u64 n;
+	int i;
+
+	for (i = 0; i < exts->nr; i++) {
+		e = &exts->ext[i];
+		if ((u64)e->lblk + e->len <= lblk)
+			continue;
+		if (e->lblk > lblk)
+			return -(s64)min_t(u64, len, e->lblk - lblk);
+		n = min_t(u64, len, (u64)e->lblk + e->len - lblk);
+		if (e->pblk + (lblk - e->lblk) != pblk)
+			return -(s64)n;
+		if (match)
+			*match = e;
+		return n;
+	}
+	return -(s64)len;
+}
+
+static int ext4_fc_collect_cb(struct inode *inode, ext4_lblk_t next,
+			      struct ext4_ext_cache *cex,
+			      struct ext4_extent *ex, void *data)
+{
+	struct ext4_fc_replay_state *st = data;
+	ext4_lblk_t lblk, len;
+	ext4_fsblk_t pblk;
+
+	if (!cex->ec_start)
+		return EXT_CONTINUE;
+
+	ext4_fc_clip(cex, st->lblk, (u64)st->lblk + st->len,
+		     &lblk, &len, &pblk);
+	return ext4_fc_exts_add(&st->old, lblk, len, pblk,
+				ext4_ext_is_uninitialized(ex));
+}
+
+static int ext4_fc_replay_punch(struct inode *inode, ext4_lblk_t lblk,
+				ext4_lblk_t len)
+{
+	struct ext4_map_blocks map;
+	handle_t *handle;
+	int ret;
+
+	while (len) {
+		handle = ext4_journal_start(inode,
+					    ext4_writepage_trans_blocks(inode));
+		if (IS_ERR(handle))
+			return PTR_ERR(handle);
+
+		down_write(&EXT4_I(inode)->i_data_sem);
+		ext4_ext_invalidate_cache(inode);
+		ext4_es_remove_extent(inode, lblk, len);
+		map.m_lblk = lblk;
+		map.m_len = len;
+		map.m_flags = 0;
+		ret = ext4_ext_map_blocks(handle, inode, &map,
+					  EXT4_GET_BLOCKS_PUNCH_OUT_EXT);
+		up_write(&EXT4_I(inode)->i_data_sem);
+
+		ext4_mark_inode_dirty(handle, inode);
+		ext4_journal_stop(handle);
+		if (ret <= 0)
+			return ret ? ret : -EIO;
+		lblk += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static int ext4_fc_replay_insert(struct inode *inode, ext4_lblk_t lblk,
+				 ext4_lblk_t len, ext4_fsblk_t pblk,
+				 int unwritten)
+{
+	ext4_lblk_t n, max = unwritten ? EXT_UNINIT_MAX_LEN : EXT_INIT_MAX_LEN;
+	struct ext4_ext_path *path;
+	struct ext4_extent newex;
+	handle_t *handle;
+	int ret, ret2;
+
+	for (; len; lblk += n, pblk += n, len -= n) {
+		n = min(len, max);
+		handle = ext4_journal_start(inode,
+					    ext4_chunk_trans_blocks(inode, n));
+		if (IS_ERR(handle))
+			return PTR_ERR(handle);
+
+		ret = ext4_mb_mark_bb(handle, inode->i_sb, pblk, n);
+		if (ret)
+			goto stop;
+
+		down_write(&EXT4_I(inode)->i_data_sem);
+		path = ext4_ext_find_extent(inode, lblk, NULL);
+		if (IS_ERR(path)) {
+			ret = PTR_ERR(path);
+		} else {
+			newex.ee_block = cpu_to_le32(lblk);
+			ext4_ext_store_pblock(&newex, pblk);
+			newex.ee_len = cpu_to_le16(n);
+			if (unwritten)
+				ext4_ext_mark_uninitialized(&newex);
+			ret = ext4_ext_insert_extent(handle, inode, path,
+						     &newex, 0);
+			ext4_ext_drop_refs(path);
+			kfree(path);
+		}
+		ext4_ext_invalidate_cache(inode);
+		ext4_es_remove_extent(inode, lblk, n);
+		up_write(&EXT4_I(inode)->i_data_sem);
+
+		if (!ret) {
+			dquot_alloc_block_nofail(inode, n);
+			ret = ext4_mark_inode_dirty(handle, inode);
+		}
+stop:
+		ret2 = ext4_journal_stop(handle);
+		if (!ret)
+			ret = ret2;
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/* Make the logged range of the inode map what the fast commit says */
+static int ext4_fc_replay_range(struct inode *inode,
+				struct ext4_fc_replay_state *st)
+{
+	unsigned int blkbits = inode->i_blkbits;
+	struct ext4_fc_ext *e, *match;
+	ext4_lblk_t cur, end, n;
+	int i, punched = 0, ret;
+	s64 same;
+
+	st->old.nr = 0;
+	ret = ext4_ext_walk_space(inode, st->lblk, st->len,
+				  ext4_fc_collect_cb, st);
+	if (ret)
+		return ret;
+
+	/* Free what is mapped differently, convert what got written */
+	for (i = 0; i < st->old.nr; i++) {
+		e = &st->old.ext[i];
+		end = e->lblk + e->len;
+		for (cur = e->lblk; cur < end; cur += n) {
+			match = NULL;
+			same = ext4_fc_same(&st->add, cur, end - cur,
+					    e->pblk + cur - e->lblk, &match);
+			if (same < 0) {
+				n = -same;
+				ret = ext4_fc_replay_punch(inode, cur, n);
+				punched = 1;
+			} else {
+				n = same;
+				if (e->unwritten && !match->unwritten)
+					ret = ext4_convert_unwritten_extents(
+						inode, (loff_t)cur << blkbits,
+						(ssize_t)n << blkbits);
+			}
+			if (ret)
+				return ret;
+		}
+	}
+
+	/*
+	 * Punched extent tree blocks only become free in the buddy once
+	 * committed, ext4_mb_mark_bb() refuses them until then.  Punched
+	 * data blocks are free right away, even those another inode's
+	 * ADD_RANGE has, which ext4_fc_replay() marks in use again at the
+	 * end.
+	 */
+	if (punched) {
+		ret = ext4_force_commit(inode->i_sb);
+		if (ret)
+			return ret;
+	}
+
+	/* Map what is missing */
+	for (i = 0; i < st->add.nr; i++) {
+		e = &st->add.ext[i];
+		end = e->lblk + e->len;
+		for (cur = e->lblk; cur < end; cur += n) {
+			same = ext4_fc_same(&st->old, cur, end - cur,
+					    e->pblk + cur - e->lblk, NULL);
+			if (same > 0) {
+				n = same;
+				continue;
+			}
+			n = -same;
+			ret = ext4_fc_replay_insert(inode, cur, n,
+						    e->pblk + cur - e->lblk,
+						    e->unwritten);
+			if (ret)
+				return ret;
+		}
+	}
+	return 0;
+}
+
+static int ext4_fc_replay_attrs(struct inode *inode, struct ext4_inode *raw)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	handle_t *handle;
+	int ret, ret2;
+
+	handle = ext4_journal_start(inode, EXT4_DATA_TRANS_BLOCKS(inode->i_sb));
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	inode->i_mode = le16_to_cpu(raw->i_mode);
+	inode->i_uid = (uid_t)le16_to_cpu(raw->i_uid_low);
+	inode->i_gid = (gid_t)le16_to_cpu(raw->i_gid_low);
+	if (!(test_opt(inode->i_sb, NO_UID32))) {
+		inode->i_uid |= le16_to_cpu(raw->i_uid_high) << 16;
+		inode->i_gid |= le16_to_cpu(raw->i_gid_high) << 16;
+	}
+	i_size_write(inode, ext4_isize(raw));
+	ei->i_disksize = inode->i_size;
+	EXT4_INODE_GET_XTIME(i_ctime, inode, raw);
+	EXT4_INODE_GET_XTIME(i_mtime, inode, raw);
+	EXT4_INODE_GET_XTIME(i_atime, inode, raw);
+	ei->i_flags = le32_to_cpu(raw->i_flags);
+	ext4_set_inode_flags(inode);
+
+	ret = ext4_mark_inode_dirty(handle, inode);
+	ret2 = ext4_journal_stop(handle);
+	return ret ? ret : ret2;
+}
+
+static int ext4_fc_replay_inode(struct super_block *sb,
+				struct ext4_fc_replay_state *st,
+				unsigned long ino, void *raw_inode, int len)
+{
+	struct ext4_inode *raw;
+	struct inode *inode;
+	int ret = -ENOMEM;
+
+	inode = ext4_iget(sb, ino);
+	if (IS_ERR(inode))
+		return PTR_ERR(inode);
+
+	/* Fields past what was logged read as zero */
+	raw = kzalloc(EXT4_INODE_SIZE(sb), GFP_NOFS);
+	if (!raw)
+		goto out;
+	memcpy(raw, raw_inode, min_t(int, len, EXT4_INODE_SIZE(sb)));
+
+	ret = 0;
+	if (st->len && st->ino == ino)
+		ret = ext4_fc_replay_range(inode, st);
+	if (!ret)
+		ret = ext4_fc_replay_attrs(inode, raw);
+	kfree(raw);
+out:
+	iput(inode);
+	return ret;
+}
+
+typedef int (*ext4_fc_tag_fn)(struct super_block *,
+			      struct ext4_fc_replay_state *,
+			      unsigned long, struct ext4_fc_tl *);
+
+/*
+ * Calls fn on every tag in the first nr_blocks blocks of the area, until
+ * it returns non-zero: negative for an error, positive to stop.
+ */
+static int ext4_fc_for_each_tag(struct super_block *sb, unsigned long nr_blocks,
+				ext4_fc_tag_fn fn,
+				struct ext4_fc_replay_state *st)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	struct buffer_head *bh;
+	struct ext4_fc_tl *tl;
+	unsigned long blk;
+	int off, size, tag, ret = 0;
+
+	for (blk = 0; blk < nr_blocks && !ret; blk++) {
+		ret = jbd2_fc_read_buf(journal, blk, &bh);
+		if (ret)
+			break;
+		for (off = 0; off + sizeof(*tl) <= sb->s_blocksize;
+		     off += size) {
+			tl = (struct ext4_fc_tl *)(bh->b_data + off);
+			tag = le16_to_cpu(tl->fc_tag);
+			size = sizeof(*tl) + le16_to_cpu(tl->fc_len);
+			if (off + size > sb->s_blocksize) {
+				ret = 1;
+				break;
+			}
+			ret = fn(sb, st, blk, tl);
+			/* every fast commit starts on a new block */
+			if (ret || tag == EXT4_FC_TAG_PAD ||
+			    tag == EXT4_FC_TAG_TAIL)
+				break;
+		}
+		brelse(bh);
+	}
+	return ret < 0 ? ret : 0;
+}
+
+/* Find the fast commits of st->tid that made it to disk whole */
+static int ext4_fc_scan_tag(struct super_block *sb,
+			    struct ext4_fc_replay_state *st,
+			    unsigned long blk, struct ext4_fc_tl *tl)
+{
+	int len = le16_to_cpu(tl->fc_len);
+	struct ext4_fc_head *head;
+	struct ext4_fc_tail *tail;
+
+	switch (le16_to_cpu(tl->fc_tag)) {
+	case EXT4_FC_TAG_HEAD:
+		head = (struct ext4_fc_head *)(tl + 1);
+		if (st->seen_head || len != sizeof(*head) ||
+		    le32_to_cpu(head->fc_tid) != st->tid)
+			return 1;
+		st->seen_head = 1;
+		break;
+	case EXT4_FC_TAG_TAIL:
+		tail = (struct ext4_fc_tail *)(tl + 1);
+		if (!st->seen_head || len != sizeof(*tail) ||
+		    le32_to_cpu(tail->fc_tid) != st->tid)
+			return 1;
+		st->crc = crc32_be(st->crc, (u8 *)tl, sizeof(*tl) +
+				   offsetof(struct ext4_fc_tail, fc_crc));
+		if (le32_to_cpu(tail->fc_crc) != st->crc)
+			return 1;
+		st->valid_blocks = blk + 1;
+		st->crc = ~0;
+		return 0;
+	case EXT4_FC_TAG_DEL_RANGE:
+		if (!st->seen_head || len != sizeof(struct ext4_fc_del_range))
+			return 1;
+		break;
+	case EXT4_FC_TAG_ADD_RANGE:
+		if (!st->seen_head || len != sizeof(struct ext4_fc_add_range))
+			return 1;
+		break;
+	case EXT4_FC_TAG_INODE:
+		if (!st->seen_head ||
+		    len < sizeof(struct ext4_fc_inode) +
+			  EXT4_GOOD_OLD_INODE_SIZE)
+			return 1;
+		break;
+	case EXT4_FC_TAG_PAD:
+		if (!st->seen_head)
+			return 1;
+		break;
+	default:
+		return 1;
+	}
+	st->crc = crc32_be(st->crc, (u8 *)tl, sizeof(*tl) + len);
+	return 0;
+}
+
+/*
+ * Mark all the blocks the fast commits map in use: first, so that the
+ * extent tree blocks allocated while replaying do not land on them, and
+ * again last, as punching the old mapping of one inode frees the blocks
+ * logged for another.
+ */
+static int ext4_fc_mark_tag(struct super_block *sb,
+			    struct ext4_fc_replay_state *st,
+			    unsigned long blk, struct ext4_fc_tl *tl)
+{
+	struct ext4_fc_add_range *add;
+	struct ext4_extent *ex;
+	ext4_lblk_t len;
+	handle_t *handle;
+	int ret, ret2;
+
+	if (le16_to_cpu(tl->fc_tag) != EXT4_FC_TAG_ADD_RANGE)
+		return 0;
+	add = (struct ext4_fc_add_range *)(tl + 1);
+	ex = (struct ext4_extent *)add->fc_ex;
+	len = ext4_ext_get_actual_len(ex);
+
+	/* a bitmap and a group descriptor per group the extent spans */
+	handle = ext4_journal_start_sb(sb,
+			2 * (len / EXT4_BLOCKS_PER_GROUP(sb) + 2));
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+	ret = ext4_mb_mark_bb(handle, sb, ext4_ext_pblock(ex), len);
+	ret2 = ext4_journal_stop(handle);
+	return ret ? ret : ret2;
+}
+
+static int ext4_fc_replay_tag(struct super_block *sb,
+			      struct ext4_fc_replay_state *st,
+			      unsigned long blk, struct ext4_fc_tl *tl)
+{
+	struct ext4_fc_del_range *del;
+	struct ext4_fc_add_range *add;
+	struct ext4_fc_inode *fi;
+	struct ext4_extent *ex;
+	unsigned long ino;
+	int ret;
+
+	switch (le16_to_cpu(tl->fc_tag)) {
+	case EXT4_FC_TAG_DEL_RANGE:
+		del = (struct ext4_fc_del_range *)(tl + 1);
+		st->ino = le32_to_cpu(del->fc_ino);
+		st->lblk = le32_to_cpu(del->fc_lblk);
+		st->len = le32_to_cpu(del->fc_len);
+		st->add.nr = 0;
+		break;
+	case EXT4_FC_TAG_ADD_RANGE:
+		add = (struct ext4_fc_add_range *)(tl + 1);
+		ex = (struct ext4_extent *)add->fc_ex;
+		if (!st->len || le32_to_cpu(add->fc_ino) != st->ino)
+			return -EIO;
+		return ext4_fc_exts_add(&st->add, le32_to_cpu(ex->ee_block),
+					ext4_ext_get_actual_len(ex),
+					ext4_ext_pblock(ex),
+					ext4_ext_is_uninitialized(ex));
+	case EXT4_FC_TAG_INODE:
+		fi = (struct ext4_fc_inode *)(tl + 1);
+		ino = le32_to_cpu(fi->fc_ino);
+		if (st->len && st->ino != ino)
+			return -EIO;
+		ret = ext4_fc_replay_inode(sb, st, ino, fi->fc_raw_inode,
+					   le16_to_cpu(tl->fc_len) -
+					   sizeof(*fi));
+		st->len = 0;
+		return ret;
+	}
+	return 0;
+}
+
+/*
+ * Replay the fast commits jbd2 recovery left, on top of the transactions
+ * it replayed.  Called at mount, before orphan cleanup.
+ */
+int ext4_fc_replay(struct super_block *sb)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	unsigned int s_flags = sb->s_flags;
+	struct ext4_fc_replay_state st;
+	int ret;
+
+	memset(&st, 0, sizeof(st));
+	if (!jbd2_fc_replay_tid(journal, &st.tid))
+		return 0;
+
+	if (bdev_read_only(sb->s_bdev)) {
+		ext4_msg(sb, KERN_ERR, "write access "
+			 "unavailable, skipping fast commit replay");
+		return 0;
+	}
+	sb->s_flags &= ~MS_RDONLY;
+
+	st.crc = ~0;
+	ret = ext4_fc_for_each_tag(sb, journal->j_fc_last - journal->j_fc_first,
+				   ext4_fc_scan_tag, &st);
+	if (!ret && st.valid_blocks) {
+		ext4_msg(sb, KERN_INFO, "replaying fast commits of "
+			 "transaction %u", st.tid);
+		ret = ext4_fc_for_each_tag(sb, st.valid_blocks,
+					   ext4_fc_mark_tag, &st);
+		if (!ret)
+			ret = ext4_fc_for_each_tag(sb, st.valid_blocks,
+						   ext4_fc_replay_tag, &st);
+		/* let the punched extent tree blocks reach the buddy */
+		if (!ret)
+			ret = ext4_force_commit(sb);
+		if (!ret)
+			ret = ext4_fc_for_each_tag(sb, st.valid_blocks,
+						   ext4_fc_mark_tag, &st);
+		if (!ret)
+			ret = ext4_force_commit(sb);
+	}
+	kfree(st.add.ext);
+	kfree(st.old.ext);
+
+	/*
+	 * Even if replay failed: the fast commits are stale once anything
+	 * else is committed on top of what was recovered.
+	 */
+	jbd2_fc_replay_done(journal);
+	sb->s_flags = s_flags;
+	return ret;
+}
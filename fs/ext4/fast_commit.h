@@ -0,0 +1,76 @@
+/*
+ *  fs/ext4/fast_commit.h
+ *
+ * On-disk format of the fast commits ext4 writes to the fast commit area
+ * of the journal on fsync, see fast_commit.c.
+ */
+
+#ifndef _EXT4_FAST_COMMIT_H
+#define _EXT4_FAST_COMMIT_H
+
+/* Journal blocks set aside for fast commits */
+#define EXT4_NUM_FC_BLKS		256
+
+/*
+ * A fast commit is a run of tags, each a struct ext4_fc_tl followed by
+ * fc_len bytes of value.  Tags never straddle blocks, and each fast
+ * commit starts on a new block.
+ */
+#define EXT4_FC_TAG_HEAD		0x0001
+#define EXT4_FC_TAG_DEL_RANGE		0x0002
+#define EXT4_FC_TAG_ADD_RANGE		0x0003
+#define EXT4_FC_TAG_INODE		0x0004
+#define EXT4_FC_TAG_PAD			0x0005
+#define EXT4_FC_TAG_TAIL		0x0006
+
+struct ext4_fc_tl {
+	__le16 fc_tag;
+	__le16 fc_len;
+};
+
+/* First tag of the area: the transaction the fast commits belong to */
+struct ext4_fc_head {
+	__le32 fc_features;
+	__le32 fc_tid;
+};
+
+/*
+ * Blocks [fc_lblk, fc_lblk + fc_len) of the inode may have been remapped.
+ * Whatever is not mapped in that range the way the following ADD_RANGE
+ * tags say is freed on replay.
+ */
+struct ext4_fc_del_range {
+	__le32 fc_ino;
+	__le32 fc_lblk;
+	__le32 fc_len;
+};
+
+/* An extent of the inode, struct ext4_extent layout */
+struct ext4_fc_add_range {
+	__le32 fc_ino;
+	__u8 fc_ex[12];
+};
+
+/* The on-disk inode follows, replay takes its attributes from it */
+struct ext4_fc_inode {
+	__le32 fc_ino;
+	__u8 fc_raw_inode[0];
+};
+
+/* Last tag of a fast commit; fc_crc covers everything from its start */
+struct ext4_fc_tail {
+	__le32 fc_tid;
+	__le32 fc_crc;
+};
+
+extern void ext4_fc_init_inode(struct inode *inode);
+extern void ext4_fc_track_inode(handle_t *handle, struct inode *inode);
+extern void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+				ext4_lblk_t start, ext4_lblk_t end);
+extern void ext4_fc_mark_ineligible(handle_t *handle, struct super_block *sb);
+extern void ext4_fc_del(struct inode *inode);
+extern int ext4_fc_commit(journal_t *journal, tid_t commit_tid);
+extern int ext4_fc_replay(struct super_block *sb);
+extern int ext4_fc_init(struct super_block *sb);
+
+#endif /* _EXT4_FAST_COMMIT_H */
@@ -0,0 +1,1134 @@
+/*
+ * linux/fs/ext4/inline.c
+ *
+ * Inline data: the contents of small files and directories are kept in
+ * the inode itself, in i_block and then in the value of the "system.data"
+ * extended attribute of the inode body, as laid out by the e2fsprogs
+ * inline_data feature.  Reading or creating such a file costs no data
+ * block and no extra I/O beyond the inode table block.
+ *
+ * The raw inode is authoritative for an inline inode: ext4_do_update_inode()
+ * leaves i_block alone and all updates go through the inode buffer under
+ * xattr_sem.  Anything that does not fit converts the inode to a block
+ * mapped one.
+ */
+
+#include <linux/fs.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/fiemap.h>
+#include "ext4_jbd2.h"
+#include "ext4.h"
+#include "xattr.h"
+
+/*
+ * Inline updates hold xattr_sem for write; keep ext4_mark_inode_dirty()
+ * from expanding the inode, which takes xattr_sem as well.
+ */
+static void ext4_inline_lock(struct inode *inode, int *no_expand)
+{
+	down_write(&EXT4_I(inode)->xattr_sem);
+	*no_expand = ext4_test_inode_state(inode, EXT4_STATE_NO_EXPAND);
+	ext4_set_inode_state(inode, EXT4_STATE_NO_EXPAND);
+}
+
+static void ext4_inline_unlock(struct inode *inode, int no_expand)
+{
+	if (!no_expand)
+		ext4_clear_inode_state(inode, EXT4_STATE_NO_EXPAND);
+	up_write(&EXT4_I(inode)->xattr_sem);
+}
+
+/* Locate the system.data entry of the inode body, or NULL */
+static struct ext4_xattr_entry *ext4_inline_entry(struct inode *inode,
+						  struct ext4_iloc *iloc)
+{
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+	};
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+		.iloc = *iloc,
+	};
+
+	if (!EXT4_I(inode)->i_extra_isize ||
+	    !ext4_test_inode_state(inode, EXT4_STATE_XATTR))
+		return NULL;
+	if (ext4_xattr_ibody_find(inode, &i, &is) || is.s.not_found)
+		return NULL;
+	return is.s.here;
+}
+
+static void *ext4_inline_value(struct inode *inode, struct ext4_iloc *iloc,
+			       struct ext4_xattr_entry *entry)
+{
+	struct ext4_xattr_ibody_header *header;
+
+	header = IHDR(inode, ext4_raw_inode(iloc));
+	return (void *)IFIRST(header) + le16_to_cpu(entry->e_value_offs);
+}
+
+static int ext4_inline_xattr_size(struct inode *inode, struct ext4_iloc *iloc)
+{
+	struct ext4_xattr_entry *entry = ext4_inline_entry(inode, iloc);
+
+	return entry ? le32_to_cpu(entry->e_value_size) : 0;
+}
+
+/* Bytes of data held inline, i_block included */
+static int ext4_inline_size(struct inode *inode, struct ext4_iloc *iloc)
+{
+	return EXT4_MIN_INLINE_DATA_SIZE + ext4_inline_xattr_size(inode, iloc);
+}
+
+/*
+ * The largest system.data value the inode body has room for, counting the
+ * space of the current value and leaving the other attributes alone.
+ */
+static int ext4_max_inline_xattr_size(struct inode *inode,
+				      struct ext4_iloc *iloc)
+{
+	struct ext4_xattr_ibody_header *header;
+	struct ext4_xattr_entry *entry, *data = NULL;
+	size_t min_offs, used, free;
+
+	if (!EXT4_I(inode)->i_extra_isize)
+		return 0;
+
+	min_offs = EXT4_SB(inode->i_sb)->s_inode_size -
+		   EXT4_GOOD_OLD_INODE_SIZE - EXT4_I(inode)->i_extra_isize -
+		   sizeof(struct ext4_xattr_ibody_header);
+	header = IHDR(inode, ext4_raw_inode(iloc));
+	entry = IFIRST(header);
+	if (ext4_test_inode_state(inode, EXT4_STATE_XATTR)) {
+		data = ext4_inline_entry(inode, iloc);
+		for (; !IS_LAST_ENTRY(entry); entry = EXT4_XATTR_NEXT(entry)) {
+			if (!entry->e_value_block && entry->e_value_size) {
+				size_t offs = le16_to_cpu(entry->e_value_offs);
+				if (offs < min_offs)
+					min_offs = offs;
+			}
+		}
+	}
+
+	/* the entry table ends with four zero bytes */
+	used = (void *)entry - (void *)IFIRST(header) + sizeof(__u32);
+	if (!data)
+		used += EXT4_XATTR_LEN(strlen(EXT4_XATTR_SYSTEM_DATA));
+	if (used >= min_offs)
+		return 0;
+	free = min_offs - used;
+	if (data)
+		free += EXT4_XATTR_SIZE(le32_to_cpu(data->e_value_size));
+	return free & ~EXT4_XATTR_ROUND;
+}
+
+static int ext4_max_inline_size(struct inode *inode)
+{
+	struct ext4_iloc iloc;
+	int ret;
+
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		return ret;
+	ret = EXT4_MIN_INLINE_DATA_SIZE +
+		ext4_max_inline_xattr_size(inode, &iloc);
+	brelse(iloc.bh);
+	return ret;
+}
+
+/* Copy up to len bytes of inline data into buffer */
+static int ext4_read_inline_data(struct inode *inode, void *buffer,
+				 unsigned int len, struct ext4_iloc *iloc)
+{
+	struct ext4_xattr_entry *entry;
+	unsigned int cp_len;
+
+	cp_len = min_t(unsigned int, len, EXT4_MIN_INLINE_DATA_SIZE);
+	memcpy(buffer, ext4_raw_inode(iloc)->i_block, cp_len);
+	len -= cp_len;
+	if (!len)
+		return cp_len;
+
+	entry = ext4_inline_entry(inode, iloc);
+	if (!entry)
+		return cp_len;
+	len = min_t(unsigned int, len, le32_to_cpu(entry->e_value_size));
+	memcpy(buffer + cp_len, ext4_inline_value(inode, iloc, entry), len);
+	return cp_len + len;
+}
+
+/*
+ * Copy len bytes to offset pos of the inline data.  The system.data value
+ * must already be large enough.
+ */
+static void ext4_write_inline_data(struct inode *inode, struct ext4_iloc *iloc,
+				   void *buffer, loff_t pos, unsigned int len)
+{
+	struct ext4_xattr_entry *entry;
+	unsigned int cp_len;
+
+	if (pos < EXT4_MIN_INLINE_DATA_SIZE) {
+		cp_len = min_t(unsigned int, len,
+			       EXT4_MIN_INLINE_DATA_SIZE - pos);
+		memcpy((void *)ext4_raw_inode(iloc)->i_block + pos, buffer,
+		       cp_len);
+		buffer += cp_len;
+		pos += cp_len;
+		len -= cp_len;
+	}
+	if (!len)
+		return;
+
+	pos -= EXT4_MIN_INLINE_DATA_SIZE;
+	entry = ext4_inline_entry(inode, iloc);
+	BUG_ON(!entry || pos + len > le32_to_cpu(entry->e_value_size));
+	memcpy(ext4_inline_value(inode, iloc, entry) + pos, buffer, len);
+}
+
+/*
+ * Resize the system.data value to size bytes, keeping its contents and
+ * zeroing any new tail.  The caller has write access to iloc->bh.
+ */
+static int ext4_resize_inline_xattr(handle_t *handle, struct inode *inode,
+				    struct ext4_iloc *iloc, unsigned int size)
+{
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+	};
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+		.iloc = *iloc,
+	};
+	unsigned int old_size = 0;
+	void *value;
+	int error;
+
+	error = ext4_xattr_ibody_find(inode, &i, &is);
+	if (error)
+		return error;
+	if (!is.s.not_found) {
+		old_size = le32_to_cpu(is.s.here->e_value_size);
+		if (old_size == size)
+			return 0;
+	}
+
+	value = kzalloc(size, GFP_NOFS);
+	if (!value)
+		return -ENOMEM;
+	if (old_size)
+		memcpy(value, ext4_inline_value(inode, iloc, is.s.here),
+		       min(old_size, size));
+	i.value = value;
+	i.value_len = size;
+	error = ext4_xattr_ibody_set(handle, inode, &i, &is);
+	kfree(value);
+	return error;
+}
+
+/*
+ * Turn an empty inode into an inline one holding up to len bytes.  Returns
+ * -ENOSPC, and stops trying for this inode, if the inode body has no room.
+ */
+static int ext4_create_inline_data(handle_t *handle, struct inode *inode,
+				   unsigned int len)
+{
+	struct ext4_iloc iloc;
+	int error;
+
+	error = ext4_get_inode_loc(inode, &iloc);
+	if (error)
+		return error;
+	error = ext4_journal_get_write_access(handle, iloc.bh);
+	if (error)
+		goto out;
+
+	if (ext4_test_inode_state(inode, EXT4_STATE_NEW)) {
+		memset(ext4_raw_inode(&iloc), 0,
+		       EXT4_SB(inode->i_sb)->s_inode_size);
+		ext4_clear_inode_state(inode, EXT4_STATE_NEW);
+	}
+
+	len = len > EXT4_MIN_INLINE_DATA_SIZE ?
+		len - EXT4_MIN_INLINE_DATA_SIZE : 0;
+	error = ext4_resize_inline_xattr(handle, inode, &iloc, len);
+	if (error) {
+		if (error == -ENOSPC)
+			ext4_clear_inode_state(inode,
+					       EXT4_STATE_MAY_INLINE_DATA);
+		goto out;
+	}
+
+	memset(ext4_raw_inode(&iloc)->i_block, 0, EXT4_MIN_INLINE_DATA_SIZE);
+	ext4_clear_inode_flag(inode, EXT4_INODE_EXTENTS);
+	ext4_set_inode_flag(inode, EXT4_INODE_INLINE_DATA);
+	return ext4_mark_iloc_dirty(handle, inode, &iloc);
+out:
+	brelse(iloc.bh);
+	return error;
+}
+
+/*
+ * Drop the inline data and hand the inode back to the block mapping code,
+ * with an empty extent tree when the filesystem has extents.
+ */
+static int ext4_destroy_inline_data(handle_t *handle, struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+		.value = NULL,
+		.value_len = 0,
+	};
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	int error;
+
+	error = ext4_get_inode_loc(inode, &is.iloc);
+	if (error)
+		return error;
+	error = ext4_journal_get_write_access(handle, is.iloc.bh);
+	if (error)
+		goto out;
+	error = ext4_xattr_ibody_find(inode, &i, &is);
+	if (error)
+		goto out;
+	if (!is.s.not_found) {
+		error = ext4_xattr_ibody_set(handle, inode, &i, &is);
+		if (error)
+			goto out;
+	}
+
+	memset(ext4_raw_inode(&is.iloc)->i_block, 0,
+	       EXT4_MIN_INLINE_DATA_SIZE);
+	memset(ei->i_data, 0, sizeof(ei->i_data));
+	ext4_clear_inode_flag(inode, EXT4_INODE_INLINE_DATA);
+	ext4_clear_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+	if (EXT4_HAS_INCOMPAT_FEATURE(inode->i_sb,
+				      EXT4_FEATURE_INCOMPAT_EXTENTS)) {
+		ext4_set_inode_flag(inode, EXT4_INODE_EXTENTS);
+		ext4_ext_tree_init(handle, inode);
+	}
+	return ext4_mark_iloc_dirty(handle, inode, &is.iloc);
+out:
+	brelse(is.iloc.bh);
+	return error;
+}
+
+/* Put size bytes at buf back inline after a failed conversion */
+static int ext4_restore_inline_data(handle_t *handle, struct inode *inode,
+				    void *buf, unsigned int size)
+{
+	struct ext4_iloc iloc;
+	int ret, no_expand;
+
+	ext4_inline_lock(inode, &no_expand);
+	ret = ext4_create_inline_data(handle, inode, size);
+	if (ret)
+		goto out;
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		goto out;
+	ret = ext4_journal_get_write_access(handle, iloc.bh);
+	if (ret) {
+		brelse(iloc.bh);
+		goto out;
+	}
+	ext4_write_inline_data(inode, &iloc, buf, 0, size);
+	ret = ext4_mark_iloc_dirty(handle, inode, &iloc);
+	ext4_set_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+out:
+	ext4_inline_unlock(inode, no_expand);
+	if (ret)
+		EXT4_ERROR_INODE(inode, "lost inline data: %d", ret);
+	return ret;
+}
+
+/* Fill page 0 from the inline data; xattr_sem is held */
+static int ext4_read_inline_page(struct inode *inode, struct page *page)
+{
+	struct ext4_iloc iloc;
+	size_t len;
+	void *kaddr;
+	int ret;
+
+	BUG_ON(page->index);
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		return ret;
+
+	len = min_t(size_t, ext4_inline_size(inode, &iloc),
+		    i_size_read(inode));
+	kaddr = kmap_atomic(page, KM_USER0);
+	ret = ext4_read_inline_data(inode, kaddr, len, &iloc);
+	flush_dcache_page(page);
+	kunmap_atomic(kaddr, KM_USER0);
+	zero_user_segment(page, ret, PAGE_CACHE_SIZE);
+	SetPageUptodate(page);
+	brelse(iloc.bh);
+	return 0;
+}
+
+/*
+ * ->readpage() for an inline file.  Returns -EAGAIN if the inode was
+ * converted meanwhile and the page must be read from its blocks.
+ */
+int ext4_readpage_inline(struct inode *inode, struct page *page)
+{
+	int ret = 0;
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		up_read(&EXT4_I(inode)->xattr_sem);
+		return -EAGAIN;
+	}
+
+	/* only page 0 carries data; the rest is a hole */
+	if (!page->index)
+		ret = ext4_read_inline_page(inode, page);
+	else if (!PageUptodate(page)) {
+		zero_user_segment(page, 0, PAGE_CACHE_SIZE);
+		SetPageUptodate(page);
+	}
+	up_read(&EXT4_I(inode)->xattr_sem);
+
+	unlock_page(page);
+	return ret;
+}
+
+/*
+ * Move the inline data of a regular file into a block and clear
+ * EXT4_STATE_MAY_INLINE_DATA, so that it takes the block path from now on.
+ */
+int ext4_convert_inline_data(struct inode *inode)
+{
+	struct address_space *mapping = inode->i_mapping;
+	int ret, needed_blocks, no_expand, retries = 0;
+	handle_t *handle;
+	struct page *page;
+	unsigned int size;
+	void *kaddr;
+
+	ext4_clear_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+	if (!ext4_has_inline_data(inode))
+		return 0;
+
+	needed_blocks = ext4_writepage_trans_blocks(inode);
+retry:
+	handle = ext4_journal_start(inode, needed_blocks);
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	page = grab_cache_page_write_begin(mapping, 0, AOP_FLAG_NOFS);
+	if (!page) {
+		ret = -ENOMEM;
+		goto out_stop;
+	}
+
+	ext4_inline_lock(inode, &no_expand);
+	ret = 0;
+	if (!ext4_has_inline_data(inode)) {
+		ext4_inline_unlock(inode, no_expand);
+		goto out_page;
+	}
+	if (!PageUptodate(page)) {
+		ret = ext4_read_inline_page(inode, page);
+		if (ret) {
+			ext4_inline_unlock(inode, no_expand);
+			goto out_page;
+		}
+	}
+	size = i_size_read(inode);
+	ret = ext4_destroy_inline_data(handle, inode);
+	ext4_inline_unlock(inode, no_expand);
+	if (ret || !size)
+		goto out_page;
+
+	/* blocks are allocated without xattr_sem, see ext4_inline_lock() */
+	ret = __block_write_begin(page, 0, size, ext4_get_block);
+	if (!ret && ext4_should_order_data(inode))
+		ret = ext4_jbd2_file_inode(handle, inode);
+	if (!ret) {
+		block_commit_write(page, 0, size);
+	} else {
+		kaddr = kmap(page);
+		ext4_restore_inline_data(handle, inode, kaddr, size);
+		kunmap(page);
+	}
+out_page:
+	unlock_page(page);
+	page_cache_release(page);
+out_stop:
+	ext4_journal_stop(handle);
+	if (ret == -ENOSPC && ext4_should_retry_alloc(inode->i_sb, &retries))
+		goto retry;
+	return ret;
+}
+
+/*
+ * ->write_begin() for an inode that may keep its data inline.  Returns 1
+ * with the page locked and a handle running if the write stays inline, 0
+ * if the caller should go the block way (after converting the inode if it
+ * had inline data), or a negative error.
+ */
+int ext4_try_to_write_inline_data(struct address_space *mapping,
+				  struct inode *inode, loff_t pos,
+				  unsigned len, unsigned flags,
+				  struct page **pagep)
+{
+	handle_t *handle;
+	struct page *page;
+	int ret, no_expand;
+
+	if (ext4_should_journal_data(inode))
+		return ext4_convert_inline_data(inode);
+
+	/* a file that already has blocks or a size never turns inline */
+	if (!ext4_has_inline_data(inode) &&
+	    (inode->i_size || inode->i_blocks)) {
+		ext4_clear_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+		return 0;
+	}
+
+	/*
+	 * The inode, and the superblock for the ext4_orphan_add() that
+	 * ->write_end() does after a short copy.
+	 */
+	handle = ext4_journal_start(inode, 2);
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	ext4_inline_lock(inode, &no_expand);
+	ret = ext4_max_inline_size(inode);
+	if (ret < 0)
+		goto out_unlock;
+	if (pos + len > ret) {
+		ext4_inline_unlock(inode, no_expand);
+		ext4_journal_stop(handle);
+		return ext4_convert_inline_data(inode);
+	}
+	ret = 0;
+	if (!ext4_has_inline_data(inode)) {
+		ret = ext4_create_inline_data(handle, inode, pos + len);
+		if (ret == -ENOSPC)
+			ret = 0;
+		if (!ext4_has_inline_data(inode))
+			goto out_unlock;
+	}
+	ext4_inline_unlock(inode, no_expand);
+
+	flags |= AOP_FLAG_NOFS;
+	page = grab_cache_page_write_begin(mapping, 0, flags);
+	if (!page) {
+		ret = -ENOMEM;
+		goto out_stop;
+	}
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		/* converted by page_mkwrite meanwhile */
+		ret = 0;
+		goto out_release;
+	}
+	if (!PageUptodate(page)) {
+		ret = ext4_read_inline_page(inode, page);
+		if (ret < 0)
+			goto out_release;
+	}
+	up_read(&EXT4_I(inode)->xattr_sem);
+	*pagep = page;
+	return 1;
+
+out_release:
+	up_read(&EXT4_I(inode)->xattr_sem);
+	unlock_page(page);
+	page_cache_release(page);
+	goto out_stop;
+out_unlock:
+	ext4_inline_unlock(inode, no_expand);
+out_stop:
+	ext4_journal_stop(handle);
+	return ret;
+}
+
+/*
+ * Copy what ->write_begin() let through from the page to the inline data.
+ * The caller updates i_size and unlocks the page.
+ */
+int ext4_write_inline_data_end(struct inode *inode, loff_t pos, unsigned len,
+			       unsigned copied, struct page *page)
+{
+	handle_t *handle = ext4_journal_current_handle();
+	struct ext4_iloc iloc;
+	unsigned int size;
+	int ret, no_expand;
+	void *kaddr;
+
+	if (unlikely(copied < len) && !PageUptodate(page))
+		return 0;
+
+	ext4_inline_lock(inode, &no_expand);
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		goto out;
+	ret = ext4_journal_get_write_access(handle, iloc.bh);
+	if (ret) {
+		brelse(iloc.bh);
+		goto out;
+	}
+
+	size = max_t(loff_t, inode->i_size, pos + copied);
+	if (size > ext4_inline_size(inode, &iloc)) {
+		ret = ext4_resize_inline_xattr(handle, inode, &iloc,
+				size - EXT4_MIN_INLINE_DATA_SIZE);
+		if (ret) {
+			brelse(iloc.bh);
+			goto out;
+		}
+	}
+
+	kaddr = kmap_atomic(page, KM_USER0);
+	ext4_write_inline_data(inode, &iloc, kaddr + pos, pos, copied);
+	kunmap_atomic(kaddr, KM_USER0);
+	SetPageUptodate(page);
+
+	ext4_update_inode_fsync_trans(handle, inode, 1);
+	ret = ext4_mark_iloc_dirty(handle, inode, &iloc);
+out:
+	ext4_inline_unlock(inode, no_expand);
+	return ret ? ret : copied;
+}
+
+/* Cut the inline data down to i_size */
+void ext4_inline_data_truncate(struct inode *inode)
+{
+	struct ext4_iloc iloc;
+	handle_t *handle;
+	unsigned int size;
+	int err, no_expand;
+
+	handle = ext4_journal_start(inode, 3);
+	if (IS_ERR(handle))
+		return;
+
+	ext4_inline_lock(inode, &no_expand);
+	if (!ext4_has_inline_data(inode))
+		goto out_unlock;
+	err = ext4_get_inode_loc(inode, &iloc);
+	if (err)
+		goto out_unlock;
+	err = ext4_journal_get_write_access(handle, iloc.bh);
+	if (err) {
+		brelse(iloc.bh);
+		goto out_unlock;
+	}
+
+	size = inode->i_size;
+	if (size < EXT4_MIN_INLINE_DATA_SIZE) {
+		memset((void *)ext4_raw_inode(&iloc)->i_block + size, 0,
+		       EXT4_MIN_INLINE_DATA_SIZE - size);
+		size = EXT4_MIN_INLINE_DATA_SIZE;
+	}
+	if (size < ext4_inline_size(inode, &iloc))
+		ext4_resize_inline_xattr(handle, inode, &iloc,
+					 size - EXT4_MIN_INLINE_DATA_SIZE);
+	ext4_mark_iloc_dirty(handle, inode, &iloc);
+out_unlock:
+	ext4_inline_unlock(inode, no_expand);
+
+	if (IS_SYNC(inode))
+		ext4_handle_sync(handle);
+	if (inode->i_nlink)
+		ext4_orphan_del(handle, inode);
+	ext4_journal_stop(handle);
+}
+
+/* Report the inline data as one extent at its byte address on disk */
+int ext4_inline_data_fiemap(struct inode *inode,
+			    struct fiemap_extent_info *fieinfo)
+{
+	__u64 physical;
+	struct ext4_iloc iloc;
+	int error;
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	error = ext4_get_inode_loc(inode, &iloc);
+	if (error)
+		goto out;
+	physical = (__u64)iloc.bh->b_blocknr << inode->i_sb->s_blocksize_bits;
+	physical += (char *)ext4_raw_inode(&iloc) - iloc.bh->b_data;
+	physical += offsetof(struct ext4_inode, i_block);
+	brelse(iloc.bh);
+
+	if (i_size_read(inode))
+		error = fiemap_fill_next_extent(fieinfo, 0, physical,
+						i_size_read(inode),
+						FIEMAP_EXTENT_DATA_INLINE |
+						FIEMAP_EXTENT_NOT_ALIGNED |
+						FIEMAP_EXTENT_LAST);
+	if (error > 0)
+		error = 0;
+out:
+	up_read(&EXT4_I(inode)->xattr_sem);
+	return error;
+}
+
+/*
+ * Inline directories.  i_block holds the parent's inode number followed
+ * by a run of directory entries; the system.data value, when present, is
+ * a second run.  "." and ".." are implied.
+ */
+
+static int ext4_check_inline_dirent(struct inode *dir,
+				    struct ext4_dir_entry_2 *de,
+				    void *buf, int size)
+{
+	const int rlen = ext4_rec_len_from_disk(de->rec_len,
+						dir->i_sb->s_blocksize);
+
+	if (likely(rlen >= EXT4_DIR_REC_LEN(1) && !(rlen % 4) &&
+		   rlen >= EXT4_DIR_REC_LEN(de->name_len) &&
+		   (void *)de - buf + rlen <= size &&
+		   le32_to_cpu(de->inode) <=
+		   le32_to_cpu(EXT4_SB(dir->i_sb)->s_es->s_inodes_count)))
+		return 0;
+
+	EXT4_ERROR_INODE(dir, "bad inline directory entry: offset=%u, "
+			 "inode=%u, rec_len=%d, name_len=%d",
+			 (unsigned)((void *)de - buf), le32_to_cpu(de->inode),
+			 rlen, de->name_len);
+	return 1;
+}
+
+/* The two runs of entries of an inline directory */
+static void *ext4_inline_dirents(struct inode *dir, struct ext4_iloc *iloc,
+				 int n, int *size)
+{
+	struct ext4_xattr_entry *entry;
+
+	if (n == 0) {
+		*size = EXT4_MIN_INLINE_DATA_SIZE - EXT4_INLINE_DOTDOT_SIZE;
+		return (void *)ext4_raw_inode(iloc)->i_block +
+			EXT4_INLINE_DOTDOT_SIZE;
+	}
+	entry = ext4_inline_entry(dir, iloc);
+	*size = entry ? le32_to_cpu(entry->e_value_size) : 0;
+	return *size ? ext4_inline_value(dir, iloc, entry) : NULL;
+}
+
+int ext4_try_create_inline_dir(handle_t *handle, struct inode *parent,
+			       struct inode *inode)
+{
+	struct ext4_dir_entry_2 *de;
+	struct ext4_iloc iloc;
+	int ret, no_expand;
+
+	ext4_inline_lock(inode, &no_expand);
+	ret = ext4_create_inline_data(handle, inode,
+				      EXT4_MIN_INLINE_DATA_SIZE);
+	if (ret)
+		goto out;
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		goto out;
+	ret = ext4_journal_get_write_access(handle, iloc.bh);
+	if (ret) {
+		brelse(iloc.bh);
+		goto out;
+	}
+
+	ext4_raw_inode(&iloc)->i_block[0] = cpu_to_le32(parent->i_ino);
+	de = (struct ext4_dir_entry_2 *)((void *)ext4_raw_inode(&iloc)->i_block +
+					 EXT4_INLINE_DOTDOT_SIZE);
+	de->inode = 0;
+	de->rec_len = ext4_rec_len_to_disk(EXT4_MIN_INLINE_DATA_SIZE -
+					   EXT4_INLINE_DOTDOT_SIZE,
+					   inode->i_sb->s_blocksize);
+	inode->i_size = EXT4_I(inode)->i_disksize = EXT4_MIN_INLINE_DATA_SIZE;
+	ret = ext4_mark_iloc_dirty(handle, inode, &iloc);
+out:
+	ext4_inline_unlock(inode, no_expand);
+	return ret;
+}
+
+int ext4_read_inline_dir(struct file *filp, void *dirent, filldir_t filldir)
+{
+	struct inode *inode = filp->f_path.dentry->d_inode;
+	struct super_block *sb = inode->i_sb;
+	struct ext4_dir_entry_2 *de;
+	struct ext4_iloc iloc;
+	int inline_size, extra_offset, extra_size, i, ret;
+	void *dir_buf;
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret) {
+		up_read(&EXT4_I(inode)->xattr_sem);
+		return ret;
+	}
+	inline_size = ext4_inline_size(inode, &iloc);
+	dir_buf = kmalloc(inline_size, GFP_NOFS);
+	if (dir_buf)
+		ext4_read_inline_data(inode, dir_buf, inline_size, &iloc);
+	brelse(iloc.bh);
+	up_read(&EXT4_I(inode)->xattr_sem);
+	if (!dir_buf)
+		return -ENOMEM;
+
+	/*
+	 * Entries are presented at their offset in the inline data plus
+	 * extra_offset, which leaves room for "." at 0 and ".." right after.
+	 */
+	extra_offset = EXT4_DIR_REC_LEN(1) + EXT4_DIR_REC_LEN(2) -
+		       EXT4_INLINE_DOTDOT_SIZE;
+	extra_size = extra_offset + inline_size;
+
+	/*
+	 * If the directory has changed since the last call to readdir(2),
+	 * f_pos may point into the middle of an entry.  Rescan from the
+	 * start to find the entry boundary at or before it.
+	 */
+	if (filp->f_version != inode->i_version) {
+		for (i = 0; i < extra_size && i < filp->f_pos;) {
+			if (i < EXT4_DIR_REC_LEN(1)) {
+				i = EXT4_DIR_REC_LEN(1);
+				continue;
+			}
+			if (i < extra_offset + EXT4_INLINE_DOTDOT_SIZE) {
+				i = extra_offset + EXT4_INLINE_DOTDOT_SIZE;
+				continue;
+			}
+			de = dir_buf + i - extra_offset;
+			if (ext4_rec_len_from_disk(de->rec_len,
+				sb->s_blocksize) < EXT4_DIR_REC_LEN(1))
+				break;
+			i += ext4_rec_len_from_disk(de->rec_len,
+						    sb->s_blocksize);
+		}
+		filp->f_pos = i;
+		filp->f_version = inode->i_version;
+	}
+
+	while (filp->f_pos < extra_size) {
+		if (filp->f_pos == 0) {
+			if (filldir(dirent, ".", 1, 0, inode->i_ino, DT_DIR))
+				break;
+			filp->f_pos = EXT4_DIR_REC_LEN(1);
+			continue;
+		}
+		if (filp->f_pos == EXT4_DIR_REC_LEN(1)) {
+			if (filldir(dirent, "..", 2, filp->f_pos,
+				    le32_to_cpu(((__le32 *)dir_buf)[0]),
+				    DT_DIR))
+				break;
+			filp->f_pos = extra_offset + EXT4_INLINE_DOTDOT_SIZE;
+			continue;
+		}
+
+		de = dir_buf + filp->f_pos - extra_offset;
+		if (ext4_check_inline_dirent(inode, de, dir_buf, inline_size)) {
+			filp->f_pos = extra_size;
+			break;
+		}
+		if (le32_to_cpu(de->inode) &&
+		    filldir(dirent, de->name, de->name_len, filp->f_pos,
+			    le32_to_cpu(de->inode),
+			    get_dtype(sb, de->file_type)))
+			break;
+		filp->f_pos += ext4_rec_len_from_disk(de->rec_len,
+						      sb->s_blocksize);
+	}
+
+	kfree(dir_buf);
+	return 0;
+}
+
+/*
+ * Like ext4_find_entry(): returns the inode buffer, with its count
+ * elevated, and the entry in it.
+ */
+struct buffer_head *ext4_find_inline_entry(struct inode *dir,
+					   const struct qstr *d_name,
+					   struct ext4_dir_entry_2 **res_dir)
+{
+	struct ext4_iloc iloc;
+	void *buf;
+	int n, size, ret;
+
+	down_read(&EXT4_I(dir)->xattr_sem);
+	if (ext4_get_inode_loc(dir, &iloc)) {
+		up_read(&EXT4_I(dir)->xattr_sem);
+		return NULL;
+	}
+	for (n = 0; n < 2; n++) {
+		buf = ext4_inline_dirents(dir, &iloc, n, &size);
+		if (!buf)
+			break;
+		ret = ext4_search_dir(iloc.bh, buf, size, dir, d_name, 0,
+				      res_dir);
+		if (ret == 1) {
+			up_read(&EXT4_I(dir)->xattr_sem);
+			return iloc.bh;
+		}
+		if (ret < 0)
+			break;
+	}
+	up_read(&EXT4_I(dir)->xattr_sem);
+	brelse(iloc.bh);
+	return NULL;
+}
+
+/*
+ * Add an entry to an inline directory, growing system.data for it if the
+ * existing entries are full.  Returns -ENOSPC if the inode body has no
+ * more room; the caller then moves the directory to a block.
+ */
+int ext4_try_add_inline_entry(handle_t *handle, struct dentry *dentry,
+			      struct inode *inode)
+{
+	struct inode *dir = dentry->d_parent->d_inode;
+	const char *name = dentry->d_name.name;
+	int namelen = dentry->d_name.len;
+	int reclen = EXT4_DIR_REC_LEN(namelen);
+	struct ext4_dir_entry_2 *de;
+	struct ext4_iloc iloc;
+	int n, size, ret, no_expand;
+	void *buf;
+
+	ext4_inline_lock(dir, &no_expand);
+	ret = ext4_get_inode_loc(dir, &iloc);
+	if (ret)
+		goto out;
+	ret = ext4_journal_get_write_access(handle, iloc.bh);
+	if (ret) {
+		brelse(iloc.bh);
+		goto out;
+	}
+
+	for (n = 0; n < 2; n++) {
+		buf = ext4_inline_dirents(dir, &iloc, n, &size);
+		if (!buf)
+			break;
+		ret = ext4_find_dest_de(dir, iloc.bh, buf, size, name,
+					namelen, &de);
+		if (!ret)
+			goto insert;
+		if (ret != -ENOSPC)
+			goto out_brelse;
+	}
+
+	/* append a fresh run of reclen bytes to system.data */
+	size = ext4_inline_xattr_size(dir, &iloc);
+	ret = -ENOSPC;
+	if (size + reclen > ext4_max_inline_xattr_size(dir, &iloc))
+		goto out_brelse;
+	ret = ext4_resize_inline_xattr(handle, dir, &iloc, size + reclen);
+	if (ret)
+		goto out_brelse;
+	buf = ext4_inline_dirents(dir, &iloc, 1, &n);
+	de = buf + size;
+	de->inode = 0;
+	de->rec_len = ext4_rec_len_to_disk(reclen, dir->i_sb->s_blocksize);
+	size += reclen;
+	dir->i_size = EXT4_I(dir)->i_disksize =
+		EXT4_MIN_INLINE_DATA_SIZE + size;
+insert:
+	ext4_insert_dentry(dir, inode, de, size, name, namelen);
+	dir->i_mtime = dir->i_ctime = ext4_current_time(dir);
+	dir->i_version++;
+out_brelse:
+	/* the inode buffer may have changed even on failure */
+	n = ext4_mark_iloc_dirty(handle, dir, &iloc);
+	if (!ret)
+		ret = n;
+out:
+	ext4_inline_unlock(dir, no_expand);
+	return ret;
+}
+
+/*
+ * Move the entries of a full inline directory to a newly allocated block
+ * 0, headed by real "." and ".." entries.
+ */
+int ext4_convert_inline_dir(handle_t *handle, struct inode *dir)
+{
+	struct super_block *sb = dir->i_sb;
+	unsigned int blocksize = sb->s_blocksize;
+	struct ext4_dir_entry_2 *de, *last;
+	struct buffer_head *bh;
+	struct ext4_iloc iloc;
+	int ret, size, offset, no_expand;
+	void *buf;
+
+	ext4_inline_lock(dir, &no_expand);
+	ret = ext4_get_inode_loc(dir, &iloc);
+	if (ret) {
+		ext4_inline_unlock(dir, no_expand);
+		return ret;
+	}
+	size = ext4_inline_size(dir, &iloc);
+	buf = kmalloc(size, GFP_NOFS);
+	if (buf)
+		ext4_read_inline_data(dir, buf, size, &iloc);
+	brelse(iloc.bh);
+	ret = buf ? ext4_destroy_inline_data(handle, dir) : -ENOMEM;
+	ext4_inline_unlock(dir, no_expand);
+	if (ret)
+		goto out;
+
+	dir->i_size = EXT4_I(dir)->i_disksize = 0;
+	bh = ext4_bread(handle, dir, 0, 1, &ret);
+	if (!bh)
+		goto out_restore;
+	ret = ext4_journal_get_write_access(handle, bh);
+	if (ret) {
+		brelse(bh);
+		goto out_restore;
+	}
+
+	de = (struct ext4_dir_entry_2 *)bh->b_data;
+	de->inode = cpu_to_le32(dir->i_ino);
+	de->name_len = 1;
+	de->rec_len = ext4_rec_len_to_disk(EXT4_DIR_REC_LEN(1), blocksize);
+	strcpy(de->name, ".");
+	de->file_type = 0;
+	if (EXT4_HAS_INCOMPAT_FEATURE(sb, EXT4_FEATURE_INCOMPAT_FILETYPE))
+		de->file_type = EXT4_FT_DIR;
+	de = (struct ext4_dir_entry_2 *)(bh->b_data + EXT4_DIR_REC_LEN(1));
+	de->inode = *(__le32 *)buf;
+	de->name_len = 2;
+	de->rec_len = ext4_rec_len_to_disk(EXT4_DIR_REC_LEN(2), blocksize);
+	strcpy(de->name, "..");
+	de->file_type = 0;
+	if (EXT4_HAS_INCOMPAT_FEATURE(sb, EXT4_FEATURE_INCOMPAT_FILETYPE))
+		de->file_type = EXT4_FT_DIR;
+
+	/* both runs end exactly at their boundary, so they chain up */
+	offset = EXT4_DIR_REC_LEN(1) + EXT4_DIR_REC_LEN(2);
+	memcpy(bh->b_data + offset, buf + EXT4_INLINE_DOTDOT_SIZE,
+	       size - EXT4_INLINE_DOTDOT_SIZE);
+	last = NULL;
+	while (offset < EXT4_DIR_REC_LEN(1) + EXT4_DIR_REC_LEN(2) +
+	       size - EXT4_INLINE_DOTDOT_SIZE) {
+		last = (struct ext4_dir_entry_2 *)(bh->b_data + offset);
+		if (ext4_check_dir_entry(dir, NULL, last, bh, offset)) {
+			ret = -EIO;
+			break;
+		}
+		offset += ext4_rec_len_from_disk(last->rec_len, blocksize);
+	}
+	if (!ret)
+		last->rec_len = ext4_rec_len_to_disk(blocksize -
+					((char *)last - bh->b_data),
+					blocksize);
+	if (!ret)
+		ret = ext4_handle_dirty_metadata(handle, dir, bh);
+	brelse(bh);
+	dir->i_size = EXT4_I(dir)->i_disksize = blocksize;
+	if (!ret)
+		ret = ext4_mark_inode_dirty(handle, dir);
+	goto out;
+
+out_restore:
+	if (!ext4_restore_inline_data(handle, dir, buf, size))
+		dir->i_size = EXT4_I(dir)->i_disksize = size;
+out:
+	kfree(buf);
+	return ret;
+}
+
+/*
+ * Remove de_del, found by ext4_find_inline_entry() in the inode buffer
+ * bh, from an inline directory.
+ */
+int ext4_delete_inline_entry(handle_t *handle, struct inode *dir,
+			     struct ext4_dir_entry_2 *de_del,
+			     struct buffer_head *bh)
+{
+	struct ext4_iloc iloc;
+	int n, size, ret, no_expand;
+	void *buf = NULL;
+
+	ext4_inline_lock(dir, &no_expand);
+	ret = ext4_get_inode_loc(dir, &iloc);
+	if (ret)
+		goto out;
+	for (n = 0; n < 2; n++) {
+		buf = ext4_inline_dirents(dir, &iloc, n, &size);
+		if (buf && (void *)de_del >= buf &&
+		    (void *)de_del < buf + size)
+			break;
+	}
+	ret = -ENOENT;
+	if (n == 2 || iloc.bh != bh)
+		goto out_brelse;
+
+	ret = ext4_journal_get_write_access(handle, iloc.bh);
+	if (ret)
+		goto out_brelse;
+	ret = ext4_generic_delete_entry(dir, de_del, iloc.bh, buf, size);
+	if (ret)
+		goto out_brelse;
+	ret = ext4_mark_iloc_dirty(handle, dir, &iloc);
+	goto out;
+out_brelse:
+	brelse(iloc.bh);
+out:
+	ext4_inline_unlock(dir, no_expand);
+	return ret;
+}
+
+/* Whether an inline directory has no entries besides "." and ".." */
+int empty_inline_dir(struct inode *dir)
+{
+	struct ext4_dir_entry_2 *de;
+	struct ext4_iloc iloc;
+	int n, size, offset, empty = 1;
+	void *buf;
+
+	down_read(&EXT4_I(dir)->xattr_sem);
+	if (ext4_get_inode_loc(dir, &iloc)) {
+		up_read(&EXT4_I(dir)->xattr_sem);
+		return 1;
+	}
+	for (n = 0; n < 2 && empty; n++) {
+		buf = ext4_inline_dirents(dir, &iloc, n, &size);
+		if (!buf)
+			break;
+		for (offset = 0; offset < size;) {
+			de = buf + offset;
+			if (ext4_check_inline_dirent(dir, de, buf, size))
+				break;
+			if (le32_to_cpu(de->inode)) {
+				empty = 0;
+				break;
+			}
+			offset += ext4_rec_len_from_disk(de->rec_len,
+							 dir->i_sb->s_blocksize);
+		}
+	}
+	brelse(iloc.bh);
+	up_read(&EXT4_I(dir)->xattr_sem);
+	return empty;
+}
+
+/*
+ * Returns the inode buffer of an inline directory, with *parent_ino
+ * pointing at the stored parent inode number, for ".." lookups and
+ * updates.
+ */
+struct buffer_head *ext4_get_inline_parent(struct inode *dir,
+					   __le32 **parent_ino)
+{
+	struct ext4_iloc iloc;
+
+	if (ext4_get_inode_loc(dir, &iloc))
+		return NULL;
+	*parent_ino = &ext4_raw_inode(&iloc)->i_block[0];
+	return iloc.bh;
+}
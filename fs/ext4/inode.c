@@ -1279,12 +1279,36 @@ static pgoff_t ext4_num_dirty_pages(struct inode *inode, pgoff_t idx,
 int ext4_map_blocks(handle_t *handle, struct inode *inode,
 		    struct ext4_map_blocks *map, int flags)
 {
+	struct extent_status es;
+	ext4_lblk_t orig_lblk, orig_len;
 	int retval;
 
 	map->m_flags = 0;
 	ext_debug("ext4_map_blocks(): inode %lu, flag %d, max_blocks %u,"
 		  "logical block %lu\n", inode->i_ino, flags, map->m_len,
 		  (unsigned long) map->m_lblk);
+
+	/* Look up the extent status tree first, without i_data_sem */
+	if (ext4_es_lookup_extent(inode, map->m_lblk, &es)) {
+		if (ext4_es_is_written(&es) || ext4_es_is_unwritten(&es)) {
+			ext4_lblk_t left = es.es_lblk + es.es_len - map->m_lblk;
+
+			map->m_pblk = ext4_es_pblock(&es) +
+					map->m_lblk - es.es_lblk;
+			map->m_flags |= ext4_es_is_written(&es) ?
+				EXT4_MAP_MAPPED : EXT4_MAP_UNWRITTEN;
+			if (map->m_len > left)
+				map->m_len = left;
+			retval = map->m_len;
+		} else
+			retval = 0;
+		/* Written blocks need nothing more, even for a create */
+		if (!(flags & EXT4_GET_BLOCKS_CREATE) ||
+		    ext4_es_is_written(&es))
+			return retval;
+		goto create;
+	}
+
 	/*
 	 * Try to see if we can get the block without requesting a new
 	 * file system block.
@@ -1295,6 +1319,12 @@ int ext4_map_blocks(handle_t *handle, struct inode *inode,
 	} else {
 		retval = ext4_ind_map_blocks(handle, inode, map, 0);
 	}
+	if (retval > 0 && map->m_flags & EXT4_MAP_MAPPED)
+		ext4_es_cache_extent(inode, map->m_lblk, retval,
+				     map->m_pblk, EXTENT_STATUS_WRITTEN);
+	else if (retval > 0 && map->m_flags & EXT4_MAP_UNWRITTEN)
+		ext4_es_cache_extent(inode, map->m_lblk, retval,
+				     map->m_pblk, EXTENT_STATUS_UNWRITTEN);
 	up_read((&EXT4_I(inode)->i_data_sem));
 
 	if (retval > 0 && map->m_flags & EXT4_MAP_MAPPED) {
@@ -1317,6 +1347,7 @@ int ext4_map_blocks(handle_t *handle, struct inode *inode,
 	if (retval > 0 && map->m_flags & EXT4_MAP_MAPPED)
 		return retval;
 
+create:
 	/*
 	 * When we call get_blocks without the create flag, the
 	 * BH_Unwritten flag could have gotten set if the blocks
@@ -1336,6 +1367,8 @@ int ext4_map_blocks(handle_t *handle, struct inode *inode,
 	 * with create == 1 flag.
 	 */
 	down_write((&EXT4_I(inode)->i_data_sem));
+	orig_lblk = map->m_lblk;
+	orig_len = map->m_len;
 
 	/*
 	 * if the caller is from delayed allocation writeout path
@@ -1376,6 +1409,17 @@ int ext4_map_blocks(handle_t *handle, struct inode *inode,
 	if (flags & EXT4_GET_BLOCKS_DELALLOC_RESERVE)
 		ext4_clear_inode_state(inode, EXT4_STATE_DELALLOC_RESERVED);
 
+	/*
+	 * The create pass may have allocated, converted or zeroed out
+	 * blocks anywhere in the requested range; drop what we knew
+	 * about it and let the next lookup cache the new state.
+	 */
+	if (retval > 0) {
+		ext4_es_remove_extent(inode, map->m_lblk, retval);
+		ext4_fc_track_range(handle, inode, map->m_lblk,
+				    map->m_lblk + retval - 1);
+	} else
+		ext4_es_remove_extent(inode, orig_lblk, orig_len);
 	up_write((&EXT4_I(inode)->i_data_sem));
 	if (retval > 0 && map->m_flags & EXT4_MAP_MAPPED) {
 		int ret = check_block_validity(inode, map);
@@ -1617,6 +1661,16 @@ static int ext4_write_begin(struct file *file, struct address_space *mapping,
 	unsigned from, to;
 
 	trace_ext4_write_begin(inode, pos, len, flags);
+
+	if (ext4_test_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA)) {
+		ret = ext4_try_to_write_inline_data(mapping, inode, pos, len,
+						    flags, pagep);
+		if (ret < 0)
+			goto out;
+		if (ret == 1)
+			return 0;
+	}
+
 	/*
 	 * Reserve one block more for addition to orphan list in case
 	 * we allocate blocks but write fails for some reason
@@ -1707,7 +1761,18 @@ static int ext4_generic_write_end(struct file *file,
 	struct inode *inode = mapping->host;
 	handle_t *handle = ext4_journal_current_handle();
 
-	copied = block_write_end(file, mapping, pos, len, copied, page, fsdata);
+	if (ext4_has_inline_data(inode)) {
+		int ret = ext4_write_inline_data_end(inode, pos, len, copied,
+						     page);
+		if (ret < 0) {
+			unlock_page(page);
+			page_cache_release(page);
+			return ret;
+		}
+		copied = ret;
+	} else
+		copied = block_write_end(file, mapping, pos, len, copied,
+					 page, fsdata);
 
 	/*
 	 * No need to use i_size_read() here, the i_size
@@ -2002,8 +2067,10 @@ static void ext4_da_page_release_reservation(struct page *page,
 					     unsigned long offset)
 {
 	int to_release = 0;
+	struct inode *inode = page->mapping->host;
 	struct buffer_head *head, *bh;
 	unsigned int curr_off = 0;
+	ext4_lblk_t lblk;
 
 	head = page_buffers(page);
 	bh = head;
@@ -2016,7 +2083,16 @@ static void ext4_da_page_release_reservation(struct page *page,
 		}
 		curr_off = next_off;
 	} while ((bh = bh->b_this_page) != head);
-	ext4_da_release_space(page->mapping->host, to_release);
+
+	if (to_release) {
+		lblk = page->index << (PAGE_CACHE_SHIFT - inode->i_blkbits);
+		lblk += (offset + (1 << inode->i_blkbits) - 1) >>
+			inode->i_blkbits;
+		ext4_es_remove_extent(inode, lblk,
+			((page->index + 1) << (PAGE_CACHE_SHIFT -
+					       inode->i_blkbits)) - lblk);
+	}
+	ext4_da_release_space(inode, to_release);
 }
 
 /*
@@ -2187,9 +2263,15 @@ static void ext4_da_block_invalidatepages(struct mpage_da_data *mpd)
 	struct pagevec pvec;
 	struct inode *inode = mpd->inode;
 	struct address_space *mapping = inode->i_mapping;
+	ext4_lblk_t start, last;
 
 	index = mpd->first_page;
 	end   = mpd->next_page - 1;
+
+	start = index << (PAGE_CACHE_SHIFT - inode->i_blkbits);
+	last = ((end + 1) << (PAGE_CACHE_SHIFT - inode->i_blkbits)) - 1;
+	ext4_es_remove_extent(inode, start, last - start + 1);
+
 	while (index <= end) {
 		nr_pages = pagevec_lookup(&pvec, mapping, index, PAGEVEC_SIZE);
 		if (nr_pages == 0)
@@ -2498,6 +2580,8 @@ static int ext4_da_get_block_prep(struct inode *inode, sector_t iblock,
 			/* not enough space to reserve */
 			return ret;
 
+		ext4_es_insert_extent(inode, iblock, 1, ~0,
+				      EXTENT_STATUS_DELAYED);
 		map_bh(bh, inode->i_sb, invalid_block);
 		set_buffer_new(bh);
 		set_buffer_delay(bh);
@@ -3136,6 +3220,15 @@ static int ext4_da_write_begin(struct file *file, struct address_space *mapping,
 	}
 	*fsdata = (void *)0;
 	trace_ext4_da_write_begin(inode, pos, len, flags);
+
+	if (ext4_test_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA)) {
+		ret = ext4_try_to_write_inline_data(mapping, inode, pos, len,
+						    flags, pagep);
+		if (ret < 0)
+			goto out;
+		if (ret == 1)
+			return 0;
+	}
 retry:
 	/*
 	 * With delayed allocation, we don't log the i_disksize update
@@ -3229,6 +3322,11 @@ static int ext4_da_write_end(struct file *file,
 	}
 
 	trace_ext4_da_write_end(inode, pos, len, copied);
+	if (ext4_has_inline_data(inode)) {
+		ret2 = ext4_generic_write_end(file, mapping, pos, len, copied,
+					      page, fsdata);
+		goto out;
+	}
 	start = pos & (PAGE_CACHE_SIZE - 1);
 	end = start + copied - 1;
 
@@ -3263,6 +3361,7 @@ static int ext4_da_write_end(struct file *file,
 	}
 	ret2 = generic_write_end(file, mapping, pos, len, copied,
 							page, fsdata);
+out:
 	copied = ret2;
 	if (ret2 < 0)
 		ret = ret2;
@@ -3355,6 +3454,10 @@ static sector_t ext4_bmap(struct address_space *mapping, sector_t block)
 	journal_t *journal;
 	int err;
 
+	/* Inline data has no block to map */
+	if (ext4_has_inline_data(inode))
+		return 0;
+
 	if (mapping_tagged(mapping, PAGECACHE_TAG_DIRTY) &&
 			test_opt(inode->i_sb, DELALLOC)) {
 		/*
@@ -3400,7 +3503,15 @@ static sector_t ext4_bmap(struct address_space *mapping, sector_t block)
 
 static int ext4_readpage(struct file *file, struct page *page)
 {
+	struct inode *inode = page->mapping->host;
+
 	trace_ext4_readpage(page);
+	if (ext4_has_inline_data(inode)) {
+		int ret = ext4_readpage_inline(inode, page);
+
+		if (ret != -EAGAIN)
+			return ret;
+	}
 	return mpage_readpage(page, ext4_get_block);
 }
 
@@ -3408,6 +3519,9 @@ static int
 ext4_readpages(struct file *file, struct address_space *mapping,
 		struct list_head *pages, unsigned nr_pages)
 {
+	/* Leave inline data to ->readpage() */
+	if (ext4_has_inline_data(mapping->host))
+		return 0;
 	return mpage_readpages(mapping, pages, nr_pages, ext4_get_block);
 }
 
@@ -3832,6 +3946,10 @@ static ssize_t ext4_direct_IO(int rw, struct kiocb *iocb,
 	struct inode *inode = file->f_mapping->host;
 	ssize_t ret;
 
+	/* Fall back to buffered I/O for inline data */
+	if (ext4_has_inline_data(inode))
+		return 0;
+
 	trace_ext4_direct_IO_enter(inode, offset, iov_length(iov, nr_segs), rw);
 	if (ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS))
 		ret = ext4_ext_direct_IO(rw, iocb, iov, offset, nr_segs);
@@ -4533,6 +4651,12 @@ void ext4_truncate(struct inode *inode)
 	if (inode->i_size == 0 && !test_opt(inode->i_sb, NO_AUTO_DA_ALLOC))
 		ext4_set_inode_state(inode, EXT4_STATE_DA_ALLOC_CLOSE);
 
+	if (ext4_has_inline_data(inode)) {
+		ext4_inline_data_truncate(inode);
+		trace_ext4_truncate_exit(inode);
+		return;
+	}
+
 	if (ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) {
 		ext4_ext_truncate(inode);
 		trace_ext4_truncate_exit(inode);
@@ -4542,6 +4666,8 @@ void ext4_truncate(struct inode *inode)
 	handle = start_transaction(inode);
 	if (IS_ERR(handle))
 		return;		/* AKPM: return what? */
+	/* fast commits only log extent mapped files */
+	ext4_fc_mark_ineligible(handle, inode->i_sb);
 
 	last_block = (inode->i_size + blocksize-1)
 					>> EXT4_BLOCK_SIZE_BITS(inode->i_sb);
@@ -4577,6 +4703,7 @@ void ext4_truncate(struct inode *inode)
 	down_write(&ei->i_data_sem);
 
 	ext4_discard_preallocations(inode);
+	ext4_es_remove_extent(inode, last_block, EXT_MAX_BLOCKS - last_block);
 
 	/*
 	 * The orphan list entry will now protect us from any crash which
@@ -5036,6 +5163,15 @@ struct inode *ext4_iget(struct super_block *sb, unsigned long ino)
 				 ei->i_file_acl);
 		ret = -EIO;
 		goto bad_inode;
+	} else if (ext4_has_inline_data(inode)) {
+		/* The data lives in i_block and the in-inode system.data */
+		if (!EXT4_HAS_INCOMPAT_FEATURE(sb,
+				EXT4_FEATURE_INCOMPAT_INLINE_DATA) ||
+		    !ext4_test_inode_state(inode, EXT4_STATE_XATTR)) {
+			EXT4_ERROR_INODE(inode, "bad inline data");
+			ret = -EIO;
+		} else
+			ext4_set_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
 	} else if (ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) {
 		if (S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode) ||
 		    (S_ISLNK(inode->i_mode) &&
@@ -5229,9 +5365,11 @@ static int ext4_do_update_inode(handle_t *handle,
 				cpu_to_le32(new_encode_dev(inode->i_rdev));
 			raw_inode->i_block[2] = 0;
 		}
-	} else
+	} else if (!ext4_has_inline_data(inode)) {
+		/* inline data is written straight to the raw inode */
 		for (block = 0; block < EXT4_N_BLOCKS; block++)
 			raw_inode->i_block[block] = ei->i_data[block];
+	}
 
 	raw_inode->i_disk_version = cpu_to_le32(inode->i_version);
 	if (ei->i_extra_isize) {
@@ -5389,6 +5527,16 @@ int ext4_setattr(struct dentry *dentry, struct iattr *attr)
 		ext4_journal_stop(handle);
 	}
 
+	if (S_ISREG(inode->i_mode) &&
+	    attr->ia_valid & ATTR_SIZE &&
+	    attr->ia_size > inode->i_size &&
+	    ext4_has_inline_data(inode)) {
+		/* Extending truncates move inline data out to a block */
+		error = ext4_convert_inline_data(inode);
+		if (error)
+			goto err_out;
+	}
+
 	if (attr->ia_valid & ATTR_SIZE) {
 		if (!(ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS))) {
 			struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
@@ -5723,9 +5871,11 @@ int ext4_mark_inode_dirty(handle_t *handle, struct inode *inode)
 	might_sleep();
 	trace_ext4_mark_inode_dirty(inode, _RET_IP_);
 	err = ext4_reserve_inode_write(handle, inode, &iloc);
+	/* expanding could push system.data out of the inode body */
 	if (ext4_handle_valid(handle) &&
 	    EXT4_I(inode)->i_extra_isize < sbi->s_want_extra_isize &&
-	    !ext4_test_inode_state(inode, EXT4_STATE_NO_EXPAND)) {
+	    !ext4_test_inode_state(inode, EXT4_STATE_NO_EXPAND) &&
+	    !ext4_has_inline_data(inode)) {
 		/*
 		 * We need extra buffer credits since we may write into EA block
 		 * with this same handle. If journal_extend fails, then it will
@@ -5755,6 +5905,8 @@ int ext4_mark_inode_dirty(handle_t *handle, struct inode *inode)
 	}
 	if (!err)
 		err = ext4_mark_iloc_dirty(handle, inode, &iloc);
+	if (!err)
+		ext4_fc_track_inode(handle, inode);
 	return err;
 }
 
@@ -5888,6 +6040,10 @@ int ext4_page_mkwrite(struct vm_area_struct *vma, struct vm_fault *vmf)
 	struct inode *inode = file->f_path.dentry->d_inode;
 	struct address_space *mapping = inode->i_mapping;
 
+	/* Shared writable mappings need the data in a block */
+	if (ext4_has_inline_data(inode) && ext4_convert_inline_data(inode))
+		return VM_FAULT_SIGBUS;
+
 	/*
 	 * Get i_alloc_sem to stop truncates messing with the inode. We cannot
 	 * get i_mutex because we are already holding mmap_sem.
@@ -106,6 +106,7 @@ long ext4_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 			err = PTR_ERR(handle);
 			goto flags_out;
 		}
+		ext4_fc_mark_ineligible(handle, inode->i_sb);
 		if (IS_SYNC(inode))
 			ext4_handle_sync(handle);
 		err = ext4_reserve_inode_write(handle, inode, &iloc);
@@ -167,6 +168,7 @@ flags_out:
 			err = PTR_ERR(handle);
 			goto setversion_out;
 		}
+		ext4_fc_mark_ineligible(handle, inode->i_sb);
 		err = ext4_reserve_inode_write(handle, inode, &iloc);
 		if (err == 0) {
 			inode->i_ctime = ext4_current_time(inode);
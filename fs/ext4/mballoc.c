@@ -24,6 +24,8 @@
 #include "mballoc.h"
 #include <linux/debugfs.h>
 #include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include <trace/events/ext4.h>
 
 /*
@@ -2465,6 +2467,10 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 
 	spin_lock_init(&sbi->s_md_lock);
 	spin_lock_init(&sbi->s_bal_lock);
+	spin_lock_init(&sbi->s_discard_lock);
+	sbi->s_discard_root = RB_ROOT;
+	sbi->s_discard_interval_ms = MB_DEFAULT_DISCARD_INTERVAL_MS;
+	sbi->s_discard_rate_kb = MB_DEFAULT_DISCARD_RATE_KB;
 
 	sbi->s_mb_max_to_scan = MB_DEFAULT_MAX_TO_SCAN;
 	sbi->s_mb_min_to_scan = MB_DEFAULT_MIN_TO_SCAN;
@@ -2519,6 +2525,97 @@ static void ext4_mb_cleanup_pa(struct ext4_group_info *grp)
 
 }
 
+/*
+ * Queue a freed extent for the idle discard thread, merging it with the
+ * extents it overlaps or touches.
+ */
+static void ext4_mb_queue_discard(struct super_block *sb,
+				  struct ext4_free_data *entry)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct rb_node **n = &sbi->s_discard_root.rb_node;
+	struct rb_node *parent = NULL, *node;
+	struct ext4_free_data *fd;
+	ext4_grpblk_t end;
+	bool was_empty;
+
+	spin_lock(&sbi->s_discard_lock);
+	was_empty = !sbi->s_discard_pending;
+	if (sbi->s_discard_extents >= MB_MAX_DISCARD_EXTENTS) {
+		sbi->s_discard_dropped += entry->count;
+		spin_unlock(&sbi->s_discard_lock);
+		kmem_cache_free(ext4_free_ext_cachep, entry);
+		return;
+	}
+
+	while (*n) {
+		parent = *n;
+		fd = rb_entry(parent, struct ext4_free_data, node);
+		if (entry->group < fd->group ||
+		    (entry->group == fd->group &&
+		     entry->start_blk < fd->start_blk))
+			n = &(*n)->rb_left;
+		else
+			n = &(*n)->rb_right;
+	}
+	rb_link_node(&entry->node, parent, n);
+	rb_insert_color(&entry->node, &sbi->s_discard_root);
+	sbi->s_discard_extents++;
+	sbi->s_discard_pending += entry->count;
+
+	while ((node = rb_prev(&entry->node))) {
+		fd = rb_entry(node, struct ext4_free_data, node);
+		if (fd->group != entry->group ||
+		    fd->start_blk + fd->count < entry->start_blk)
+			break;
+		end = max(fd->start_blk + fd->count,
+			  entry->start_blk + entry->count);
+		sbi->s_discard_pending -= fd->count + entry->count;
+		entry->count = end - fd->start_blk;
+		entry->start_blk = fd->start_blk;
+		sbi->s_discard_pending += entry->count;
+		rb_erase(node, &sbi->s_discard_root);
+		sbi->s_discard_extents--;
+		kmem_cache_free(ext4_free_ext_cachep, fd);
+	}
+
+	while ((node = rb_next(&entry->node))) {
+		fd = rb_entry(node, struct ext4_free_data, node);
+		if (fd->group != entry->group ||
+		    entry->start_blk + entry->count < fd->start_blk)
+			break;
+		end = max(fd->start_blk + fd->count,
+			  entry->start_blk + entry->count);
+		sbi->s_discard_pending -= fd->count + entry->count;
+		entry->count = end - entry->start_blk;
+		sbi->s_discard_pending += entry->count;
+		rb_erase(node, &sbi->s_discard_root);
+		sbi->s_discard_extents--;
+		kmem_cache_free(ext4_free_ext_cachep, fd);
+	}
+
+	/* else it is counting an idle interval already */
+	if (sbi->s_discard_tsk && was_empty)
+		wake_up_process(sbi->s_discard_tsk);
+	spin_unlock(&sbi->s_discard_lock);
+}
+
+static void ext4_mb_drop_discards(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct rb_node *node;
+
+	spin_lock(&sbi->s_discard_lock);
+	while ((node = rb_first(&sbi->s_discard_root))) {
+		rb_erase(node, &sbi->s_discard_root);
+		kmem_cache_free(ext4_free_ext_cachep,
+				rb_entry(node, struct ext4_free_data, node));
+	}
+	sbi->s_discard_extents = 0;
+	sbi->s_discard_pending = 0;
+	spin_unlock(&sbi->s_discard_lock);
+}
+
 int ext4_mb_release(struct super_block *sb)
 {
 	ext4_group_t ngroups = ext4_get_groups_count(sb);
@@ -2531,6 +2628,8 @@ int ext4_mb_release(struct super_block *sb)
 	if (sbi->s_proc)
 		remove_proc_entry("mb_groups", sbi->s_proc);
 
+	ext4_mb_drop_discards(sb);
+
 	if (sbi->s_group_info) {
 		for (i = 0; i < ngroups; i++) {
 			grinfo = ext4_get_group_info(sb, i);
@@ -2637,7 +2736,10 @@ static void release_blocks_on_commit(journal_t *journal, transaction_t *txn)
 			page_cache_release(e4b.bd_bitmap_page);
 		}
 		ext4_unlock_group(sb, entry->group);
-		kmem_cache_free(ext4_free_ext_cachep, entry);
+		if (!test_opt(sb, DISCARD) && test_opt2(sb, IDLE_DISCARD))
+			ext4_mb_queue_discard(sb, entry);
+		else
+			kmem_cache_free(ext4_free_ext_cachep, entry);
 		ext4_mb_unload_buddy(&e4b);
 	}
 
@@ -2829,6 +2931,122 @@ out_err:
 	return err;
 }
 
+/*
+ * Mark blocks [block, block + len) in use in the bitmaps, for fast commit
+ * replay to put back blocks whose allocation did not make it to the log.
+ * Blocks in use already are left alone.
+ */
+int ext4_mb_mark_bb(handle_t *handle, struct super_block *sb,
+		    ext4_fsblk_t block, ext4_lblk_t len)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct buffer_head *bitmap_bh = NULL;
+	struct buffer_head *gdp_bh;
+	struct ext4_group_desc *gdp;
+	struct ext4_free_extent ex;
+	struct ext4_buddy e4b;
+	ext4_group_t group;
+	ext4_grpblk_t off;
+	int count, i, j, marked, err = 0;
+
+	if (!ext4_data_block_valid(sbi, block, len)) {
+		ext4_error(sb, "Marking blocks %llu-%llu which overlap "
+			   "fs metadata", block, block + len);
+		return -EIO;
+	}
+
+	while (len && !err) {
+		ext4_get_group_no_and_offset(sb, block, &group, &off);
+		count = min_t(ext4_lblk_t, len,
+			      EXT4_BLOCKS_PER_GROUP(sb) - off);
+
+		err = -EIO;
+		bitmap_bh = ext4_read_block_bitmap(sb, group);
+		if (!bitmap_bh)
+			break;
+		err = ext4_journal_get_write_access(handle, bitmap_bh);
+		if (err)
+			break;
+		err = -EIO;
+		gdp = ext4_get_group_desc(sb, group, &gdp_bh);
+		if (!gdp)
+			break;
+		err = ext4_journal_get_write_access(handle, gdp_bh);
+		if (err)
+			break;
+		err = ext4_mb_load_buddy(sb, group, &e4b);
+		if (err)
+			break;
+
+		marked = 0;
+		ext4_lock_group(sb, group);
+		for (i = off; i < off + count && !err; i = j) {
+			if (mb_test_bit(i, bitmap_bh->b_data)) {
+				j = i + 1;
+				continue;
+			}
+			for (j = i; j < off + count; j++) {
+				if (mb_test_bit(j, bitmap_bh->b_data))
+					break;
+				/* free on disk, so it must be in the buddy */
+				if (mb_test_bit(j, EXT4_MB_BITMAP(&e4b))) {
+					err = -EIO;
+					break;
+				}
+			}
+			if (err)
+				break;
+			mb_set_bits(bitmap_bh->b_data, i, j - i);
+			ex.fe_logical = 0;
+			ex.fe_group = group;
+			ex.fe_start = i;
+			ex.fe_len = j - i;
+			mb_mark_used(&e4b, &ex);
+			marked += j - i;
+		}
+		if (marked) {
+			if (gdp->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT)) {
+				gdp->bg_flags &=
+					cpu_to_le16(~EXT4_BG_BLOCK_UNINIT);
+				ext4_free_blks_set(sb, gdp,
+					ext4_free_blocks_after_init(sb,
+							group, gdp));
+			}
+			ext4_free_blks_set(sb, gdp,
+				ext4_free_blks_count(sb, gdp) - marked);
+			gdp->bg_checksum = ext4_group_desc_csum(sbi, group,
+								gdp);
+		}
+		ext4_unlock_group(sb, group);
+		ext4_mb_unload_buddy(&e4b);
+
+		if (err) {
+			ext4_error(sb, "Block bitmap and buddy of group %u "
+				   "disagree at %llu", group,
+				   ext4_group_first_block_no(sb, group) + j);
+			break;
+		}
+		if (marked) {
+			percpu_counter_sub(&sbi->s_freeblocks_counter, marked);
+			if (sbi->s_log_groups_per_flex)
+				atomic_sub(marked, &sbi->s_flex_groups[
+					ext4_flex_group(sbi, group)].free_blocks);
+			err = ext4_handle_dirty_metadata(handle, NULL,
+							 bitmap_bh);
+			if (!err)
+				err = ext4_handle_dirty_metadata(handle, NULL,
+								 gdp_bh);
+		}
+		brelse(bitmap_bh);
+		bitmap_bh = NULL;
+		block += count;
+		len -= count;
+	}
+	brelse(bitmap_bh);
+	ext4_mark_super_dirty(sb);
+	return err;
+}
+
 /*
  * here we normalize request for locality group
  * Group request are normalized to s_strip size if we set the same via mount
@@ -4956,3 +5174,204 @@ int ext4_trim_fs(struct super_block *sb, struct fstrim_range *range)
 
 	return ret;
 }
+
+/*
+ * Discard the free blocks of [start, start + len) in @group, the part of
+ * a queued extent that was not allocated again meanwhile
+ */
+static ext4_grpblk_t ext4_mb_discard_range(struct super_block *sb,
+					   ext4_group_t group,
+					   ext4_grpblk_t start,
+					   ext4_grpblk_t len)
+{
+	ext4_grpblk_t next, max = start + len, count = 0;
+	struct hd_struct *part = sb->s_bdev->bd_part;
+	unsigned long reads = part_stat_read(part, ios[READ]);
+	struct ext4_buddy e4b;
+	int err;
+
+	/* the bitmaps read to load the buddy are not someone else's I/O */
+	err = ext4_mb_load_buddy(sb, group, &e4b);
+	EXT4_SB(sb)->s_discard_reads += part_stat_read(part, ios[READ]) - reads;
+	if (err)
+		return 0;
+
+	ext4_lock_group(sb, group);
+	while (start < max) {
+		start = mb_find_next_zero_bit(e4b.bd_bitmap, max, start);
+		if (start >= max)
+			break;
+		next = mb_find_next_bit(e4b.bd_bitmap, max, start);
+		ext4_trim_extent(sb, start, next - start, group, &e4b);
+		count += next - start;
+		start = next + 1;
+	}
+	ext4_unlock_group(sb, group);
+	ext4_mb_unload_buddy(&e4b);
+
+	return count;
+}
+
+/*
+ * What the others did on our partition: reads and written sectors,
+ * without the discards and the bitmap reads of this thread.  The other
+ * partitions of the disk do their own discarding, so they are only
+ * watched through what they have in flight.
+ */
+static unsigned long ext4_mb_disk_io(struct ext4_sb_info *sbi,
+				     struct hd_struct *part)
+{
+	return part_stat_read(part, ios[READ]) - sbi->s_discard_reads +
+	       part_stat_read(part, sectors[WRITE]) - sbi->s_discard_sectors;
+}
+
+static inline int ext4_mb_disk_busy(struct hd_struct *part)
+{
+	return part_in_flight(&part_to_disk(part)->part0);
+}
+
+/*
+ * Discard queued extents, lowest first, until the budget of one interval
+ * is spent or someone else uses the disk.
+ */
+static void ext4_mb_discard_idle(struct super_block *sb,
+				 struct hd_struct *part,
+				 unsigned long *last_io)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int kb_per_block = sb->s_blocksize >> 10;
+	unsigned long budget, chunk = MB_DISCARD_CHUNK_KB / kb_per_block;
+	struct ext4_free_data *entry;
+	struct rb_node *node;
+
+	budget = (unsigned long long)sbi->s_discard_rate_kb *
+		 sbi->s_discard_interval_ms / 1000 / kb_per_block;
+	if (!sbi->s_discard_rate_kb)
+		budget = ULONG_MAX;
+
+	while (budget && !kthread_should_stop()) {
+		ext4_group_t group;
+		ext4_grpblk_t start, len, done;
+
+		spin_lock(&sbi->s_discard_lock);
+		node = rb_first(&sbi->s_discard_root);
+		if (!node) {
+			spin_unlock(&sbi->s_discard_lock);
+			break;
+		}
+		entry = rb_entry(node, struct ext4_free_data, node);
+		group = entry->group;
+		start = entry->start_blk;
+		len = min3((unsigned long)entry->count, budget, chunk);
+		entry->start_blk += len;
+		entry->count -= len;
+		sbi->s_discard_pending -= len;
+		if (!entry->count) {
+			rb_erase(node, &sbi->s_discard_root);
+			sbi->s_discard_extents--;
+			kmem_cache_free(ext4_free_ext_cachep, entry);
+		}
+		spin_unlock(&sbi->s_discard_lock);
+
+		done = ext4_mb_discard_range(sb, group, start, len);
+		sbi->s_discard_done += done;
+		sbi->s_discard_sectors += done << (sb->s_blocksize_bits - 9);
+		budget -= len;
+
+		if (ext4_mb_disk_io(sbi, part) != *last_io ||
+		    ext4_mb_disk_busy(part))
+			break;
+	}
+}
+
+static int ext4_mb_discard_thread(void *data)
+{
+	struct super_block *sb = data;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct hd_struct *part = sb->s_bdev->bd_part;
+	unsigned long io, last_io = ext4_mb_disk_io(sbi, part);
+
+	set_freezable();
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop()) {
+			__set_current_state(TASK_RUNNING);
+			break;
+		}
+		if (sbi->s_discard_pending)
+			schedule_timeout(msecs_to_jiffies(
+				max(sbi->s_discard_interval_ms, 1U)));
+		else
+			schedule();
+		try_to_freeze();
+
+		/* only once the disk was idle for a whole interval */
+		io = ext4_mb_disk_io(sbi, part);
+		if (io != last_io || ext4_mb_disk_busy(part) ||
+		    sb->s_frozen != SB_UNFROZEN) {
+			last_io = io;
+			continue;
+		}
+		ext4_mb_discard_idle(sb, part, &last_io);
+		last_io = ext4_mb_disk_io(sbi, part);
+	}
+
+	return 0;
+}
+
+/**
+ * ext4_mb_start_idle_discard() -- start discarding freed blocks when idle
+ * @sb:			superblock for filesystem
+ *
+ * Extents freed by the committed transactions are queued from then on
+ * and discarded by a thread of this filesystem once its partition has
+ * been idle for s_discard_interval_ms and the disk has nothing in flight,
+ * so that the device can reclaim them without the latency of the inline
+ * discard option.
+ */
+void ext4_mb_start_idle_discard(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct task_struct *tsk;
+
+	if (sbi->s_discard_tsk)
+		return;
+
+	if (!blk_queue_discard(bdev_get_queue(sb->s_bdev))) {
+		ext4_msg(sb, KERN_WARNING, "idle_discard: the device does "
+			 "not support discard, disabled");
+		clear_opt2(sb, IDLE_DISCARD);
+		return;
+	}
+
+	tsk = kthread_run(ext4_mb_discard_thread, sb, "ext4discard-%s",
+			  sb->s_id);
+	if (IS_ERR(tsk)) {
+		ext4_msg(sb, KERN_ERR, "idle_discard: failed to start "
+			 "thread (%ld)", PTR_ERR(tsk));
+		return;
+	}
+
+	spin_lock(&sbi->s_discard_lock);
+	sbi->s_discard_tsk = tsk;
+	spin_unlock(&sbi->s_discard_lock);
+}
+
+/*
+ * Extents still queued stay so until the thread is started again or the
+ * filesystem is unmounted.
+ */
+void ext4_mb_stop_idle_discard(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct task_struct *tsk;
+
+	spin_lock(&sbi->s_discard_lock);
+	tsk = sbi->s_discard_tsk;
+	sbi->s_discard_tsk = NULL;
+	spin_unlock(&sbi->s_discard_lock);
+
+	if (tsk)
+		kthread_stop(tsk);
+}
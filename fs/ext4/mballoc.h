@@ -94,6 +94,17 @@ extern u8 mb_enable_debug;
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * with idle_discard, freed extents are discarded once the disk has been
+ * idle for this long, at most at the given rate, in chunks of at most
+ * MB_DISCARD_CHUNK_KB; past MB_MAX_DISCARD_EXTENTS waiting extents, new
+ * ones are left for FITRIM
+ */
+#define MB_DEFAULT_DISCARD_INTERVAL_MS	1000
+#define MB_DEFAULT_DISCARD_RATE_KB	16384	/* per second */
+#define MB_DISCARD_CHUNK_KB		8192
+#define MB_MAX_DISCARD_EXTENTS		8192
+
 
 struct ext4_free_data {
 	/* this links the free block information from group_info */
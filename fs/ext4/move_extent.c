@@ -764,6 +764,8 @@ out:
 
 	ext4_ext_invalidate_cache(orig_inode);
 	ext4_ext_invalidate_cache(donor_inode);
+	ext4_es_remove_extent(orig_inode, from, count);
+	ext4_es_remove_extent(donor_inode, from, count);
 
 	double_up_write_data_sem(orig_inode, donor_inode);
 
@@ -818,6 +820,7 @@ move_extent_per_page(struct file *o_filp, struct inode *donor_inode,
 		*err = PTR_ERR(handle);
 		return 0;
 	}
+	ext4_fc_mark_ineligible(handle, orig_inode->i_sb);
 
 	if (segment_eq(get_fs(), KERNEL_DS))
 		w_flags |= AOP_FLAG_UNINTERRUPTIBLE;
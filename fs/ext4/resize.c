@@ -798,6 +798,7 @@ int ext4_group_add(struct super_block *sb, struct ext4_new_group_data *input)
 		err = PTR_ERR(handle);
 		goto exit_put;
 	}
+	ext4_fc_mark_ineligible(handle, sb);
 
 	mutex_lock(&sbi->s_resize_lock);
 	if (input->group != sbi->s_groups_count) {
@@ -1037,6 +1038,7 @@ int ext4_group_extend(struct super_block *sb, struct ext4_super_block *es,
 		ext4_warning(sb, "error %d on journal start", err);
 		goto exit_put;
 	}
+	ext4_fc_mark_ineligible(handle, sb);
 
 	mutex_lock(&EXT4_SB(sb)->s_resize_lock);
 	if (o_blocks_count != ext4_blocks_count(es)) {
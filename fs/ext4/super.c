@@ -45,6 +45,7 @@
 #include <linux/freezer.h>
 
 #include "ext4.h"
+#include "ext4_extents.h"
 #include "ext4_jbd2.h"
 #include "xattr.h"
 #include "acl.h"
@@ -756,6 +757,7 @@ static void ext4_put_super(struct super_block *sb)
 	int i, err;
 
 	ext4_unregister_li_request(sb);
+	ext4_mb_stop_idle_discard(sb);
 	dquot_disable(sb, -1, DQUOT_USAGE_ENABLED | DQUOT_LIMITS_ENABLED);
 
 	flush_workqueue(sbi->dio_unwritten_wq);
@@ -773,6 +775,7 @@ static void ext4_put_super(struct super_block *sb)
 	}
 
 	del_timer(&sbi->s_err_report);
+	ext4_es_unregister_shrinker(sb);
 	ext4_release_system_zone(sb);
 	ext4_mb_release(sb);
 	ext4_ext_release(sb);
@@ -799,6 +802,7 @@ static void ext4_put_super(struct super_block *sb)
 	percpu_counter_destroy(&sbi->s_freeinodes_counter);
 	percpu_counter_destroy(&sbi->s_dirs_counter);
 	percpu_counter_destroy(&sbi->s_dirtyblocks_counter);
+	percpu_counter_destroy(&sbi->s_es_cnt);
 	brelse(sbi->s_sbh);
 #ifdef CONFIG_QUOTA
 	for (i = 0; i < MAXQUOTAS; i++)
@@ -854,6 +858,10 @@ static struct inode *ext4_alloc_inode(struct super_block *sb)
 	ei->vfs_inode.i_version = 1;
 	ei->vfs_inode.i_data.writeback_index = 0;
 	memset(&ei->i_cached_extent, 0, sizeof(struct ext4_ext_cache));
+	ext4_es_init_tree(&ei->i_es_tree);
+	rwlock_init(&ei->i_es_lock);
+	INIT_LIST_HEAD(&ei->i_es_lru);
+	ext4_fc_init_inode(&ei->vfs_inode);
 	INIT_LIST_HEAD(&ei->i_prealloc_list);
 	spin_lock_init(&ei->i_prealloc_lock);
 	ei->i_reserved_data_blocks = 0;
@@ -940,6 +948,9 @@ void ext4_clear_inode(struct inode *inode)
 	end_writeback(inode);
 	dquot_drop(inode);
 	ext4_discard_preallocations(inode);
+	ext4_es_remove_extent(inode, 0, EXT_MAX_BLOCKS);
+	ext4_es_lru_del(inode);
+	ext4_fc_del(inode);
 	if (EXT4_I(inode)->jinode) {
 		jbd2_journal_release_jbd_inode(EXT4_JOURNAL(inode),
 					       EXT4_I(inode)->jinode);
@@ -1103,6 +1114,12 @@ static int ext4_show_options(struct seq_file *seq, struct vfsmount *vfs)
 	if (test_opt(sb, DISCARD) && !(def_mount_opts & EXT4_DEFM_DISCARD))
 		seq_puts(seq, ",discard");
 
+	if (test_opt2(sb, IDLE_DISCARD))
+		seq_puts(seq, ",idle_discard");
+
+	if (test_opt2(sb, JOURNAL_FAST_COMMIT))
+		seq_puts(seq, ",fast_commit");
+
 	if (test_opt(sb, NOLOAD))
 		seq_puts(seq, ",norecovery");
 
@@ -1293,6 +1310,7 @@ enum {
 	Opt_inode_readahead_blks, Opt_journal_ioprio,
 	Opt_dioread_nolock, Opt_dioread_lock,
 	Opt_discard, Opt_nodiscard, Opt_init_itable, Opt_noinit_itable,
+	Opt_idle_discard, Opt_noidle_discard, Opt_fast_commit,
 };
 
 static const match_table_t tokens = {
@@ -1368,6 +1386,9 @@ static const match_table_t tokens = {
 	{Opt_init_itable, "init_itable=%u"},
 	{Opt_init_itable, "init_itable"},
 	{Opt_noinit_itable, "noinit_itable"},
+	{Opt_idle_discard, "idle_discard"},
+	{Opt_noidle_discard, "noidle_discard"},
+	{Opt_fast_commit, "fast_commit"},
 	{Opt_err, NULL},
 };
 
@@ -1858,6 +1879,15 @@ set_qf_format:
 		case Opt_noinit_itable:
 			clear_opt(sb, INIT_INODE_TABLE);
 			break;
+		case Opt_idle_discard:
+			set_opt2(sb, IDLE_DISCARD);
+			break;
+		case Opt_noidle_discard:
+			clear_opt2(sb, IDLE_DISCARD);
+			break;
+		case Opt_fast_commit:
+			set_opt2(sb, JOURNAL_FAST_COMMIT);
+			break;
 		default:
 			ext4_msg(sb, KERN_ERR,
 			       "Unrecognized mount option \"%s\" "
@@ -2115,6 +2145,26 @@ static int ext4_check_descriptors(struct super_block *sb,
 	return 1;
 }
 
+/*
+ * Replay the fast commits a crash left in the journal, then set up the fast
+ * commit area, or give it back to the log, as the fast_commit option says.
+ */
+static void ext4_setup_fast_commit(struct super_block *sb)
+{
+	int err;
+
+	err = ext4_fc_replay(sb);
+	if (err)
+		ext4_error(sb, "fast commit replay failed (%d)", err);
+	if (sb->s_flags & MS_RDONLY)
+		return;
+	err = ext4_fc_init(sb);
+	if (err) {
+		ext4_msg(sb, KERN_WARNING, "fast commits disabled (%d)", err);
+		clear_opt2(sb, JOURNAL_FAST_COMMIT);
+	}
+}
+
 /* ext4_orphan_cleanup() walks a singly-linked list of inodes (starting at
  * the superblock) which were deleted from all directories, but held open by
  * a process at the time of a crash.  We walk the list and try to delete these
@@ -2462,6 +2512,70 @@ static ssize_t extent_cache_misses_show(struct ext4_attr *a,
 	return snprintf(buf, PAGE_SIZE, "%lu\n", sbi->extent_cache_misses);
 }
 
+static ssize_t es_cache_hits_show(struct ext4_attr *a,
+				  struct ext4_sb_info *sbi, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%lu\n", sbi->s_es_hits);
+}
+
+static ssize_t es_cache_misses_show(struct ext4_attr *a,
+				    struct ext4_sb_info *sbi, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%lu\n", sbi->s_es_misses);
+}
+
+static ssize_t es_cached_extents_show(struct ext4_attr *a,
+				      struct ext4_sb_info *sbi, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%lld\n",
+			(long long) percpu_counter_sum(&sbi->s_es_cnt));
+}
+
+static ssize_t fc_commits_show(struct ext4_attr *a,
+			       struct ext4_sb_info *sbi, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%lu\n", sbi->s_fc_commits);
+}
+
+static ssize_t fc_fallbacks_show(struct ext4_attr *a,
+				 struct ext4_sb_info *sbi, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%lu\n", sbi->s_fc_fallbacks);
+}
+
+static ssize_t fc_blocks_show(struct ext4_attr *a,
+			      struct ext4_sb_info *sbi, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%lu\n", sbi->s_fc_blocks);
+}
+
+static ssize_t idle_discard_pending_kb_show(struct ext4_attr *a,
+					    struct ext4_sb_info *sbi, char *buf)
+{
+	struct super_block *sb = sbi->s_buddy_cache->i_sb;
+
+	return snprintf(buf, PAGE_SIZE, "%lu\n",
+			sbi->s_discard_pending << (sb->s_blocksize_bits - 10));
+}
+
+static ssize_t idle_discard_done_kb_show(struct ext4_attr *a,
+					 struct ext4_sb_info *sbi, char *buf)
+{
+	struct super_block *sb = sbi->s_buddy_cache->i_sb;
+
+	return snprintf(buf, PAGE_SIZE, "%lu\n",
+			sbi->s_discard_done << (sb->s_blocksize_bits - 10));
+}
+
+static ssize_t idle_discard_dropped_kb_show(struct ext4_attr *a,
+					    struct ext4_sb_info *sbi, char *buf)
+{
+	struct super_block *sb = sbi->s_buddy_cache->i_sb;
+
+	return snprintf(buf, PAGE_SIZE, "%lu\n",
+			sbi->s_discard_dropped << (sb->s_blocksize_bits - 10));
+}
+
 static ssize_t inode_readahead_blks_store(struct ext4_attr *a,
 					  struct ext4_sb_info *sbi,
 					  const char *buf, size_t count)
@@ -2521,6 +2635,12 @@ EXT4_RO_ATTR(session_write_kbytes);
 EXT4_RO_ATTR(lifetime_write_kbytes);
 EXT4_RO_ATTR(extent_cache_hits);
 EXT4_RO_ATTR(extent_cache_misses);
+EXT4_RO_ATTR(es_cache_hits);
+EXT4_RO_ATTR(es_cache_misses);
+EXT4_RO_ATTR(es_cached_extents);
+EXT4_RO_ATTR(fc_commits);
+EXT4_RO_ATTR(fc_fallbacks);
+EXT4_RO_ATTR(fc_blocks);
 EXT4_ATTR_OFFSET(inode_readahead_blks, 0644, sbi_ui_show,
 		 inode_readahead_blks_store, s_inode_readahead_blks);
 EXT4_RW_ATTR_SBI_UI(inode_goal, s_inode_goal);
@@ -2531,6 +2651,11 @@ EXT4_RW_ATTR_SBI_UI(mb_order2_req, s_mb_order2_reqs);
 EXT4_RW_ATTR_SBI_UI(mb_stream_req, s_mb_stream_request);
 EXT4_RW_ATTR_SBI_UI(mb_group_prealloc, s_mb_group_prealloc);
 EXT4_RW_ATTR_SBI_UI(max_writeback_mb_bump, s_max_writeback_mb_bump);
+EXT4_RW_ATTR_SBI_UI(idle_discard_interval_ms, s_discard_interval_ms);
+EXT4_RW_ATTR_SBI_UI(idle_discard_rate_kb, s_discard_rate_kb);
+EXT4_RO_ATTR(idle_discard_pending_kb);
+EXT4_RO_ATTR(idle_discard_done_kb);
+EXT4_RO_ATTR(idle_discard_dropped_kb);
 
 static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(delayed_allocation_blocks),
@@ -2538,6 +2663,12 @@ static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(lifetime_write_kbytes),
 	ATTR_LIST(extent_cache_hits),
 	ATTR_LIST(extent_cache_misses),
+	ATTR_LIST(es_cache_hits),
+	ATTR_LIST(es_cache_misses),
+	ATTR_LIST(es_cached_extents),
+	ATTR_LIST(fc_commits),
+	ATTR_LIST(fc_fallbacks),
+	ATTR_LIST(fc_blocks),
 	ATTR_LIST(inode_readahead_blks),
 	ATTR_LIST(inode_goal),
 	ATTR_LIST(mb_stats),
@@ -2547,6 +2678,11 @@ static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(mb_stream_req),
 	ATTR_LIST(mb_group_prealloc),
 	ATTR_LIST(max_writeback_mb_bump),
+	ATTR_LIST(idle_discard_interval_ms),
+	ATTR_LIST(idle_discard_rate_kb),
+	ATTR_LIST(idle_discard_pending_kb),
+	ATTR_LIST(idle_discard_done_kb),
+	ATTR_LIST(idle_discard_dropped_kb),
 	NULL,
 };
 
@@ -3463,10 +3599,18 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	if (!err) {
 		err = percpu_counter_init(&sbi->s_dirtyblocks_counter, 0);
 	}
+	if (!err) {
+		err = percpu_counter_init(&sbi->s_es_cnt, 0);
+	}
 	if (err) {
 		ext4_msg(sb, KERN_ERR, "insufficient memory");
-		goto failed_mount3;
+		goto failed_mount3a;
 	}
+	ext4_es_register_shrinker(sb);
+
+	INIT_LIST_HEAD(&sbi->s_fc_q);
+	spin_lock_init(&sbi->s_fc_lock);
+	init_waitqueue_head(&sbi->s_fc_wait);
 
 	sbi->s_stripe = ext4_get_stripe_size(sbi);
 	sbi->s_max_writeback_mb_bump = 128;
@@ -3516,6 +3660,11 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 		       "suppressed and not mounted read-only");
 		goto failed_mount_wq;
 	} else {
+		if (test_opt2(sb, JOURNAL_FAST_COMMIT)) {
+			ext4_msg(sb, KERN_ERR, "can't mount with fast_commit, "
+				 "fs has no journal");
+			goto failed_mount_wq;
+		}
 		clear_opt(sb, DATA_FLAGS);
 		sbi->s_journal = NULL;
 		needs_recovery = 0;
@@ -3570,6 +3719,13 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	default:
 		break;
 	}
+
+	if (test_opt2(sb, JOURNAL_FAST_COMMIT) &&
+	    test_opt(sb, DATA_FLAGS) == EXT4_MOUNT_JOURNAL_DATA) {
+		ext4_msg(sb, KERN_ERR, "can't mount with fast_commit "
+			 "and data=journal");
+		goto failed_mount_wq;
+	}
 	set_task_ioprio(sbi->s_journal->j_task, journal_ioprio);
 
 	/*
@@ -3695,6 +3851,9 @@ no_journal:
 		goto failed_mount4;
 	};
 
+	if (sbi->s_journal)
+		ext4_setup_fast_commit(sb);
+
 	EXT4_SB(sb)->s_mount_state |= EXT4_ORPHAN_FS;
 	ext4_orphan_cleanup(sb, es);
 	EXT4_SB(sb)->s_mount_state &= ~EXT4_ORPHAN_FS;
@@ -3719,6 +3878,9 @@ no_journal:
 	if (es->s_error_count)
 		mod_timer(&sbi->s_err_report, jiffies + 300*HZ); /* 5 minutes */
 
+	if (!(sb->s_flags & MS_RDONLY) && test_opt2(sb, IDLE_DISCARD))
+		ext4_mb_start_idle_discard(sb);
+
 	kfree(orig_data);
 	return 0;
 
@@ -3739,6 +3901,8 @@ failed_mount_wq:
 		sbi->s_journal = NULL;
 	}
 failed_mount3:
+	ext4_es_unregister_shrinker(sb);
+failed_mount3a:
 	del_timer(&sbi->s_err_report);
 	if (sbi->s_flex_groups) {
 		if (is_vmalloc_addr(sbi->s_flex_groups))
@@ -3750,6 +3914,7 @@ failed_mount3:
 	percpu_counter_destroy(&sbi->s_freeinodes_counter);
 	percpu_counter_destroy(&sbi->s_dirs_counter);
 	percpu_counter_destroy(&sbi->s_dirtyblocks_counter);
+	percpu_counter_destroy(&sbi->s_es_cnt);
 	if (sbi->s_mmp_tsk)
 		kthread_stop(sbi->s_mmp_tsk);
 failed_mount2:
@@ -4323,6 +4488,13 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 	if (sbi->s_mount_flags & EXT4_MF_FS_ABORTED)
 		ext4_abort(sb, "Abort forced by user");
 
+	if ((sbi->s_mount_opt2 ^ old_opts.s_mount_opt2) &
+	    EXT4_MOUNT2_JOURNAL_FAST_COMMIT) {
+		ext4_msg(sb, KERN_WARNING, "can't change fast_commit "
+			 "on remount");
+		sbi->s_mount_opt2 ^= EXT4_MOUNT2_JOURNAL_FAST_COMMIT;
+	}
+
 	sb->s_flags = (sb->s_flags & ~MS_POSIXACL) |
 		(test_opt(sb, POSIX_ACL) ? MS_POSIXACL : 0);
 
@@ -4436,6 +4608,15 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 		ext4_register_li_request(sb, first_not_zeroed);
 	}
 
+	if ((sb->s_flags & MS_RDONLY) || !test_opt2(sb, IDLE_DISCARD))
+		ext4_mb_stop_idle_discard(sb);
+	else
+		ext4_mb_start_idle_discard(sb);
+
+	if (sbi->s_journal && (old_sb_flags & MS_RDONLY) &&
+	    !(sb->s_flags & MS_RDONLY))
+		ext4_setup_fast_commit(sb);
+
 	ext4_setup_system_zone(sb);
 	if (sbi->s_journal == NULL)
 		ext4_commit_super(sb, 1);
@@ -4947,9 +5128,13 @@ static int __init ext4_init_fs(void)
 		init_waitqueue_head(&ext4__ioend_wq[i]);
 	}
 
-	err = ext4_init_pageio();
+	err = ext4_init_es();
 	if (err)
 		return err;
+
+	err = ext4_init_pageio();
+	if (err)
+		goto out8;
 	err = ext4_init_system_zone();
 	if (err)
 		goto out7;
@@ -5001,6 +5186,8 @@ out6:
 	ext4_exit_system_zone();
 out7:
 	ext4_exit_pageio();
+out8:
+	ext4_exit_es();
 	return err;
 }
 
@@ -5018,6 +5205,7 @@ static void __exit ext4_exit_fs(void)
 	kset_unregister(ext4_kset);
 	ext4_exit_system_zone();
 	ext4_exit_pageio();
+	ext4_exit_es();
 }
 
 MODULE_AUTHOR("Remy Card, Stephen Tweedie, Andrew Morton, Andreas Dilger, Theodore Ts'o and others");
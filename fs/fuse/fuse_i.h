@@ -22,10 +22,17 @@
 #include <linux/rbtree.h>
 #include <linux/poll.h>
 #include <linux/workqueue.h>
+#include <linux/idr.h>
 
-/** Max number of pages that can be used in a single read request */
+/** Magic of fuse and fuseblk superblocks */
+#define FUSE_SUPER_MAGIC 0x65735546
+
+/** Default max number of pages that can be used in a single read request */
 #define FUSE_MAX_PAGES_PER_REQ 32
 
+/** Upper limit of the max_pages the filesystem can ask for in INIT */
+#define FUSE_MAX_MAX_PAGES 256
+
 /** Bias for fi->writectr, meaning new writepages must not be sent */
 #define FUSE_NOWRITE INT_MIN
 
@@ -108,6 +115,15 @@ struct fuse_inode {
 struct fuse_conn;
 
 /** FUSE specific file data */
+/** Lower file of a passthrough open */
+struct fuse_passthrough {
+	/** The daemon's open file, NULL if not passing through */
+	struct file *filp;
+
+	/** Credentials of the daemon, to access it with */
+	const struct cred *cred;
+};
+
 struct fuse_file {
 	/** Fuse connection for this file */
 	struct fuse_conn *fc;
@@ -138,6 +154,9 @@ struct fuse_file {
 
 	/** Wait queue head for poll */
 	wait_queue_head_t poll_wait;
+
+	/** Lower file for FOPEN_PASSTHROUGH */
+	struct fuse_passthrough passthrough;
 };
 
 /** One input argument of a request */
@@ -287,8 +306,14 @@ struct fuse_req {
 		struct fuse_lk_in lk_in;
 	} misc;
 
-	/** page vector */
-	struct page *pages[FUSE_MAX_PAGES_PER_REQ];
+	/** page vector, inline_pages unless more than that were asked for */
+	struct page **pages;
+
+	/** size of the page vector */
+	unsigned max_pages;
+
+	/** inline page vector */
+	struct page *inline_pages[FUSE_MAX_PAGES_PER_REQ];
 
 	/** number of pages in vector */
 	unsigned num_pages;
@@ -310,6 +335,9 @@ struct fuse_req {
 
 	/** Request is stolen from fuse_file->reserved_req */
 	struct file *stolen_file;
+
+	/** Lower file from an OPEN or CREATE reply, for the opener */
+	struct fuse_passthrough passthrough;
 };
 
 /**
@@ -344,6 +372,9 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
+	/** Maximum number of pages that can be used in a single request */
+	unsigned max_pages;
+
 	/** Readers of the connection are waiting on this */
 	wait_queue_head_t waitq;
 
@@ -362,6 +393,10 @@ struct fuse_conn {
 	/** rbtree of fuse_files waiting for poll events indexed by ph */
 	struct rb_root polled_files;
 
+	/** Lower files registered for FOPEN_PASSTHROUGH and not yet
+	    claimed by an OPEN or CREATE reply, by passthrough_fh */
+	struct idr passthrough_idr;
+
 	/** Maximum number of outstanding background requests */
 	unsigned max_background;
 
@@ -475,6 +510,13 @@ struct fuse_conn {
 	/** Don't apply umask to creation modes */
 	unsigned dont_mask:1;
 
+	/** Files may be opened with FOPEN_PASSTHROUGH.  Only set in INIT */
+	unsigned passthrough:1;
+
+	/** Buffered writes go to the page cache and are written back
+	    later, the kernel owns i_size.  Only set in INIT */
+	unsigned writeback_cache:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -582,6 +624,11 @@ struct fuse_file *fuse_file_get(struct fuse_file *ff);
 void fuse_file_free(struct fuse_file *ff);
 void fuse_finish_open(struct inode *inode, struct file *file);
 
+/**
+ * OPEN or CREATE flags to send with the writeback cache
+ */
+int fuse_writeback_open_flags(int flags);
+
 void fuse_sync_release(struct fuse_file *ff, int flags);
 
 /**
@@ -647,7 +694,7 @@ void fuse_ctl_cleanup(void);
  */
 struct fuse_req *fuse_request_alloc(void);
 
-struct fuse_req *fuse_request_alloc_nofs(void);
+struct fuse_req *fuse_request_alloc_nofs(unsigned npages);
 
 /**
  * Free a request
@@ -659,6 +706,11 @@ void fuse_request_free(struct fuse_req *req);
  */
 struct fuse_req *fuse_get_req(struct fuse_conn *fc);
 
+/**
+ * Get a request with room for npages pages, may fail with -ENOMEM
+ */
+struct fuse_req *fuse_get_req_pages(struct fuse_conn *fc, unsigned npages);
+
 /**
  * Gets a requests for a file operation, always succeeds
  */
@@ -766,4 +818,20 @@ int fuse_dev_release(struct inode *inode, struct file *file);
 
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
+/**
+ * Passthrough of read, write and mmap to a lower file
+ */
+int fuse_passthrough_register(struct fuse_conn *fc, struct file *dev,
+			      unsigned int fd);
+int fuse_passthrough_unregister(struct fuse_conn *fc, u32 id);
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req);
+void fuse_passthrough_destroy(struct fuse_conn *fc);
+void fuse_passthrough_open(struct fuse_file *ff, int flags);
+void fuse_passthrough_release(struct fuse_passthrough *passthrough);
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos);
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
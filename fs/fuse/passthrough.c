@@ -0,0 +1,338 @@
+/*
+  FUSE: Filesystem in Userspace
+  Passthrough of read, write and mmap to a lower file
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * The daemon registers one of its own open files with the
+ * FUSE_DEV_IOC_PASSTHROUGH_OPEN ioctl on /dev/fuse, and answers OPEN or
+ * CREATE of a regular file with FOPEN_PASSTHROUGH and the passthrough_fh
+ * the ioctl returned.  Read, write and mmap of the fuse file then go
+ * straight to that lower file, without a round trip through the daemon
+ * nor a copy through the fuse device.
+ *
+ * The lower file is accessed with the credentials /dev/fuse was opened
+ * with, and only a daemon with CAP_SYS_ADMIN may register one: whoever
+ * ends up writing the reply to /dev/fuse lends neither a file nor
+ * credentials.  Other operations, attributes included, still go to the
+ * daemon.
+ */
+
+#include "fuse_i.h"
+
+#include <linux/cred.h>
+#include <linux/file.h>
+#include <linux/fsnotify.h>
+#include <linux/pagemap.h>
+#include <linux/ratelimit.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+static bool fuse_passthrough_valid(struct file *filp)
+{
+	struct inode *inode = filp->f_path.dentry->d_inode;
+
+	if (!S_ISREG(inode->i_mode) || !filp->f_op || !filp->f_op->aio_read)
+		return false;
+
+	/* No stacking on fuse, which could pass back to itself */
+	return inode->i_sb->s_magic != FUSE_SUPER_MAGIC;
+}
+
+/*
+ * FUSE_DEV_IOC_PASSTHROUGH_OPEN on dev: take the lower file fd of the
+ * daemon, and return the id an OPEN or CREATE reply claims it with.
+ */
+int fuse_passthrough_register(struct fuse_conn *fc, struct file *dev,
+			      unsigned int fd)
+{
+	struct fuse_passthrough *passthrough;
+	struct file *filp;
+	int id, err;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+	if (!fc->passthrough)
+		return -EINVAL;
+
+	filp = fget(fd);
+	if (!filp)
+		return -EBADF;
+	err = -EINVAL;
+	if (!fuse_passthrough_valid(filp))
+		goto out_fput;
+
+	err = -ENOMEM;
+	passthrough = kmalloc(sizeof(*passthrough), GFP_KERNEL);
+	if (!passthrough)
+		goto out_fput;
+	passthrough->filp = filp;
+	passthrough->cred = get_cred(dev->f_cred);
+
+	do {
+		err = -ENOMEM;
+		if (!idr_pre_get(&fc->passthrough_idr, GFP_KERNEL))
+			break;
+		spin_lock(&fc->lock);
+		err = idr_get_new_above(&fc->passthrough_idr, passthrough, 1,
+					&id);
+		spin_unlock(&fc->lock);
+	} while (err == -EAGAIN);
+	if (err) {
+		fuse_passthrough_release(passthrough);
+		kfree(passthrough);
+		return err;
+	}
+	return id;
+
+ out_fput:
+	fput(filp);
+	return err;
+}
+
+/* Take the lower file registered as id out of the connection, or NULL */
+static struct fuse_passthrough *fuse_passthrough_claim(struct fuse_conn *fc,
+						       u32 id)
+{
+	struct fuse_passthrough *passthrough = NULL;
+
+	if (!id || id > INT_MAX)
+		return NULL;
+
+	spin_lock(&fc->lock);
+	passthrough = idr_find(&fc->passthrough_idr, id);
+	if (passthrough)
+		idr_remove(&fc->passthrough_idr, id);
+	spin_unlock(&fc->lock);
+
+	return passthrough;
+}
+
+/*
+ * FUSE_DEV_IOC_PASSTHROUGH_CLOSE: drop a lower file no reply is going to
+ * claim, such as one registered for an OPEN the daemon then failed, or
+ * whose opener was interrupted before the reply.
+ */
+int fuse_passthrough_unregister(struct fuse_conn *fc, u32 id)
+{
+	struct fuse_passthrough *passthrough;
+
+	passthrough = fuse_passthrough_claim(fc, id);
+	if (!passthrough)
+		return -ENOENT;
+
+	fuse_passthrough_release(passthrough);
+	kfree(passthrough);
+	return 0;
+}
+
+/*
+ * Called on the reply to OPEN or CREATE: the lower file it names moves
+ * to the request, to wait there for the opener, who checks it against
+ * the open mode.  Anything unusable falls back to a normal open.  A
+ * lower file named without FOPEN_PASSTHROUGH is claimed and dropped all
+ * the same.  Error replies carry no passthrough_fh, the daemon closes
+ * the id itself.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_passthrough *passthrough;
+	struct fuse_open_out *outarg;
+	bool wanted;
+
+	if (req->in.h.opcode != FUSE_OPEN && req->in.h.opcode != FUSE_CREATE)
+		return;
+	if (req->out.h.error)
+		return;
+
+	outarg = req->out.args[req->out.numargs - 1].value;
+	wanted = outarg->open_flags & FOPEN_PASSTHROUGH;
+	outarg->open_flags &= ~FOPEN_PASSTHROUGH;
+
+	passthrough = fuse_passthrough_claim(fc, outarg->passthrough_fh);
+	if (!passthrough) {
+		if (wanted)
+			printk_ratelimited(KERN_WARNING "fuse: no lower file "
+					   "registered as %u\n",
+					   outarg->passthrough_fh);
+		return;
+	}
+
+	req->passthrough = *passthrough;
+	kfree(passthrough);
+	if (wanted)
+		outarg->open_flags |= FOPEN_PASSTHROUGH;
+	else
+		fuse_passthrough_release(&req->passthrough);
+}
+
+static int fuse_passthrough_free(int id, void *p, void *data)
+{
+	fuse_passthrough_release(p);
+	kfree(p);
+	return 0;
+}
+
+/* The connection goes away: drop the lower files no reply claimed */
+void fuse_passthrough_destroy(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->passthrough_idr, fuse_passthrough_free, NULL);
+	idr_remove_all(&fc->passthrough_idr);
+	idr_destroy(&fc->passthrough_idr);
+}
+
+void fuse_passthrough_release(struct fuse_passthrough *passthrough)
+{
+	if (!passthrough->filp)
+		return;
+
+	fput(passthrough->filp);
+	put_cred(passthrough->cred);
+	passthrough->filp = NULL;
+	passthrough->cred = NULL;
+}
+
+/*
+ * The opener took the lower file from the request: keep it if it can do
+ * what the fuse file was opened for.
+ */
+void fuse_passthrough_open(struct fuse_file *ff, int flags)
+{
+	struct file *filp = ff->passthrough.filp;
+	int accmode = flags & O_ACCMODE;
+
+	if (!filp) {
+		ff->open_flags &= ~FOPEN_PASSTHROUGH;
+		return;
+	}
+
+	if ((accmode != O_WRONLY && !(filp->f_mode & FMODE_READ)) ||
+	    (accmode != O_RDONLY && (!(filp->f_mode & FMODE_WRITE) ||
+				     !filp->f_op->aio_write))) {
+		fuse_passthrough_release(&ff->passthrough);
+		ff->open_flags &= ~FOPEN_PASSTHROUGH;
+		return;
+	}
+
+	/* The lower file has its own cache, fuse has none to bypass */
+	ff->open_flags &= ~FOPEN_DIRECT_IO;
+}
+
+/* A synchronous read or write of the lower file, like do_sync_read() */
+static ssize_t fuse_passthrough_rw(struct fuse_passthrough *passthrough,
+				   int rw, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t *ppos)
+{
+	struct file *filp = passthrough->filp;
+	size_t len = iov_length(iov, nr_segs);
+	const struct cred *old_cred;
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	init_sync_kiocb(&kiocb, filp);
+	kiocb.ki_pos = *ppos;
+	kiocb.ki_left = len;
+	kiocb.ki_nbytes = len;
+
+	old_cred = override_creds(passthrough->cred);
+	/* The checks vfs_read() and vfs_write() make, on the lower file */
+	ret = rw_verify_area(rw, filp, &kiocb.ki_pos, len);
+	if (ret >= 0) {
+		if (rw == READ)
+			ret = filp->f_op->aio_read(&kiocb, iov, nr_segs,
+						   kiocb.ki_pos);
+		else
+			ret = filp->f_op->aio_write(&kiocb, iov, nr_segs,
+						    kiocb.ki_pos);
+		if (ret == -EIOCBQUEUED)
+			ret = wait_on_sync_kiocb(&kiocb);
+	}
+	revert_creds(old_cred);
+
+	if (ret > 0) {
+		*ppos = kiocb.ki_pos;
+		if (rw == READ)
+			fsnotify_access(filp);
+		else
+			fsnotify_modify(filp);
+	}
+	return ret;
+}
+
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos)
+{
+	struct fuse_file *ff = iocb->ki_filp->private_data;
+	ssize_t ret;
+
+	ret = fuse_passthrough_rw(&ff->passthrough, READ, iov, nr_segs, &pos);
+	if (ret > 0)
+		iocb->ki_pos = pos;
+	return ret;
+}
+
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct inode *inode = file->f_mapping->host;
+	struct inode *lower = ff->passthrough.filp->f_mapping->host;
+	loff_t start;
+	ssize_t ret;
+
+	mutex_lock(&inode->i_mutex);
+	if (file->f_flags & O_APPEND)
+		pos = i_size_read(lower);
+	start = pos;
+
+	ret = fuse_passthrough_rw(&ff->passthrough, WRITE, iov, nr_segs, &pos);
+	if (ret > 0) {
+		iocb->ki_pos = pos;
+		fuse_write_update_size(inode, pos);
+		/* pages cached by other, non passthrough, opens are stale */
+		if (inode->i_mapping->nrpages)
+			invalidate_inode_pages2_range(inode->i_mapping,
+					start >> PAGE_CACHE_SHIFT,
+					(pos - 1) >> PAGE_CACHE_SHIFT);
+	}
+	fuse_invalidate_attr(inode);
+	mutex_unlock(&inode->i_mutex);
+
+	return ret;
+}
+
+/*
+ * Map the lower file instead, so that page faults go straight to it: the
+ * vma takes a reference on the lower file and drops the one on the fuse
+ * file that mmap_region() gave it.
+ */
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *filp = ff->passthrough.filp;
+	const struct cred *old_cred;
+	int ret;
+
+	if (!filp->f_op->mmap)
+		return -ENODEV;
+
+	get_file(filp);
+	vma->vm_file = filp;
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = filp->f_op->mmap(filp, vma);
+	revert_creds(old_cred);
+	if (ret) {
+		/* mmap_region() puts the file it passed in on error */
+		vma->vm_file = file;
+		fput(filp);
+		return ret;
+	}
+
+	fput(file);
+	file_accessed(file);
+	return 0;
+}
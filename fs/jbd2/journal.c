@@ -75,6 +75,14 @@ EXPORT_SYMBOL(jbd2_journal_update_format);
 EXPORT_SYMBOL(jbd2_journal_check_used_features);
 EXPORT_SYMBOL(jbd2_journal_check_available_features);
 EXPORT_SYMBOL(jbd2_journal_set_features);
+EXPORT_SYMBOL(jbd2_fc_init);
+EXPORT_SYMBOL(jbd2_fc_release);
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+EXPORT_SYMBOL(jbd2_fc_read_buf);
+EXPORT_SYMBOL(jbd2_fc_replay_tid);
+EXPORT_SYMBOL(jbd2_fc_replay_done);
 EXPORT_SYMBOL(jbd2_journal_load);
 EXPORT_SYMBOL(jbd2_journal_destroy);
 EXPORT_SYMBOL(jbd2_journal_abort);
@@ -744,6 +752,264 @@ struct journal_head *jbd2_journal_get_descriptor_buffer(journal_t *journal)
 	return jbd2_journal_add_journal_head(bh);
 }
 
+/*
+ * Fast commits.
+ *
+ * A client that can describe the changes of the running transaction more
+ * compactly than the buffers it dirtied may write that description to the
+ * fast commit area at the end of the journal instead of committing the
+ * transaction.  Fast commits are only valid on top of the last transaction
+ * in the log: the area is reused as soon as the running transaction is
+ * committed normally, and recovery hands the ID of the transaction they
+ * belong to back to the client, which replays them itself.
+ */
+
+/* Make the superblock changes below durable before the area is used */
+static void jbd2_fc_write_superblock(journal_t *journal)
+{
+	struct buffer_head *bh = journal->j_sb_buffer;
+
+	mark_buffer_dirty(bh);
+	sync_dirty_buffer(bh);
+}
+
+/**
+ * int jbd2_fc_init() - Set aside a fast commit area in a journal.
+ * @journal: Journal to act on.
+ * @num_blks: Number of blocks to take from the end of the log.
+ *
+ * The log is flushed first.  Nothing is done if the journal already has a
+ * fast commit area.
+ */
+int jbd2_fc_init(journal_t *journal, unsigned int num_blks)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	int err;
+
+	if (jbd2_has_fast_commit(journal))
+		return 0;
+	if (!jbd2_journal_check_available_features(journal, 0, 0,
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return -EINVAL;
+	if (journal->j_first + JBD2_MIN_JOURNAL_BLOCKS + num_blks >
+	    journal->j_last)
+		return -ENOSPC;
+
+	err = jbd2_journal_flush(journal);
+	if (err)
+		return err;
+
+	write_lock(&journal->j_state_lock);
+	journal->j_last -= num_blks;
+	journal->j_head = journal->j_tail = journal->j_first;
+	journal->j_free = journal->j_last - journal->j_first;
+	journal->j_fc_first = journal->j_last;
+	journal->j_fc_last = journal->j_last + num_blks;
+	journal->j_fc_off = 0;
+	sb->s_num_fc_blks = cpu_to_be32(num_blks);
+	sb->s_fc_flags = 0;
+	sb->s_feature_incompat |=
+		cpu_to_be32(JBD2_FEATURE_INCOMPAT_FAST_COMMIT);
+	write_unlock(&journal->j_state_lock);
+
+	jbd2_fc_write_superblock(journal);
+	return 0;
+}
+
+/**
+ * int jbd2_fc_release() - Give the fast commit area back to the log.
+ * @journal: Journal to act on.
+ */
+int jbd2_fc_release(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	int err;
+
+	if (!jbd2_has_fast_commit(journal))
+		return 0;
+
+	err = jbd2_journal_flush(journal);
+	if (err)
+		return err;
+
+	write_lock(&journal->j_state_lock);
+	journal->j_last = journal->j_fc_last;
+	journal->j_head = journal->j_tail = journal->j_first;
+	journal->j_free = journal->j_last - journal->j_first;
+	journal->j_fc_first = journal->j_fc_last;
+	journal->j_fc_off = 0;
+	sb->s_num_fc_blks = 0;
+	sb->s_fc_flags = 0;
+	sb->s_feature_incompat &=
+		~cpu_to_be32(JBD2_FEATURE_INCOMPAT_FAST_COMMIT);
+	write_unlock(&journal->j_state_lock);
+
+	jbd2_fc_write_superblock(journal);
+	return 0;
+}
+
+/**
+ * int jbd2_fc_begin_commit() - Start a fast commit.
+ * @journal: Journal to act on.
+ * @tid: Transaction the caller needs on disk.
+ *
+ * Returns 0 if @tid is the running transaction: it then won't start
+ * committing before jbd2_fc_end_commit() is called.  Returns -EALREADY if
+ * @tid is committing or committed already, so the caller only has to wait
+ * for it, and -EAGAIN after waiting for another commit to finish.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	DEFINE_WAIT(wait);
+
+	if (!jbd2_has_fast_commit(journal))
+		return -EINVAL;
+	if (is_journal_aborted(journal))
+		return -EROFS;
+
+	write_lock(&journal->j_state_lock);
+	if (!journal->j_running_transaction ||
+	    journal->j_running_transaction->t_tid != tid) {
+		write_unlock(&journal->j_state_lock);
+		return -EALREADY;
+	}
+	if (journal->j_flags & (JBD2_FAST_COMMIT_ONGOING |
+				JBD2_FULL_COMMIT_ONGOING)) {
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		finish_wait(&journal->j_fc_wait, &wait);
+		return -EAGAIN;
+	}
+	journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+
+	/*
+	 * A flushed log has s_start == 0 on disk, and recovery would not
+	 * look at the fast commit area at all.
+	 */
+	if (journal->j_flags & JBD2_FLUSHED)
+		jbd2_journal_update_superblock(journal, 1);
+	return 0;
+}
+
+/**
+ * void jbd2_fc_end_commit() - Finish a fast commit.
+ * @journal: Journal to act on.
+ */
+void jbd2_fc_end_commit(journal_t *journal)
+{
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+}
+
+/**
+ * int jbd2_fc_get_buf() - Get the next block of the fast commit area.
+ * @journal: Journal to act on.
+ * @bh_out: Zeroed buffer for the block, to be written by the caller.
+ *
+ * Returns -ENOSPC once the area is full.
+ */
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out)
+{
+	struct buffer_head *bh;
+	unsigned long long blocknr;
+	int err;
+
+	J_ASSERT(journal->j_flags & JBD2_FAST_COMMIT_ONGOING);
+
+	if (journal->j_fc_first + journal->j_fc_off >= journal->j_fc_last)
+		return -ENOSPC;
+	err = jbd2_journal_bmap(journal,
+				journal->j_fc_first + journal->j_fc_off,
+				&blocknr);
+	if (err)
+		return err;
+
+	bh = __getblk(journal->j_dev, blocknr, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+	lock_buffer(bh);
+	memset(bh->b_data, 0, journal->j_blocksize);
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+
+	journal->j_fc_off++;
+	*bh_out = bh;
+	return 0;
+}
+
+/**
+ * int jbd2_fc_read_buf() - Read a block of the fast commit area.
+ * @journal: Journal to act on.
+ * @off: Block to read, counting from the start of the area.
+ * @bh_out: The buffer read.
+ */
+int jbd2_fc_read_buf(journal_t *journal, unsigned long off,
+		     struct buffer_head **bh_out)
+{
+	struct buffer_head *bh;
+	unsigned long long blocknr;
+	int err;
+
+	if (journal->j_fc_first + off >= journal->j_fc_last)
+		return -EINVAL;
+	err = jbd2_journal_bmap(journal, journal->j_fc_first + off, &blocknr);
+	if (err)
+		return err;
+
+	bh = __getblk(journal->j_dev, blocknr, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+	if (!buffer_uptodate(bh)) {
+		ll_rw_block(READ, 1, &bh);
+		wait_on_buffer(bh);
+		if (!buffer_uptodate(bh)) {
+			brelse(bh);
+			return -EIO;
+		}
+	}
+	*bh_out = bh;
+	return 0;
+}
+
+/**
+ * int jbd2_fc_replay_tid() - Are there fast commits to replay?
+ * @journal: Journal to act on.
+ * @tid: Returns the transaction they belong to.
+ *
+ * Only fast commits of @tid written before the crash are valid.
+ */
+int jbd2_fc_replay_tid(journal_t *journal, tid_t *tid)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+
+	if (!jbd2_has_fast_commit(journal) ||
+	    !(sb->s_fc_flags & cpu_to_be32(JBD2_FC_REPLAY_PENDING)))
+		return 0;
+	*tid = be32_to_cpu(sb->s_fc_replay_tid);
+	return 1;
+}
+
+/**
+ * void jbd2_fc_replay_done() - The client has replayed the fast commits.
+ * @journal: Journal to act on.
+ *
+ * The replayed changes must be committed before this is called.
+ */
+void jbd2_fc_replay_done(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+
+	if (!(sb->s_fc_flags & cpu_to_be32(JBD2_FC_REPLAY_PENDING)))
+		return;
+	sb->s_fc_flags &= ~cpu_to_be32(JBD2_FC_REPLAY_PENDING);
+	jbd2_fc_write_superblock(journal);
+}
+
 struct jbd2_stats_proc_session {
 	journal_t *journal;
 	struct transaction_stats_s *stats;
@@ -894,6 +1160,7 @@ static journal_t * journal_init_common (void)
 	init_waitqueue_head(&journal->j_wait_checkpoint);
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
+	init_waitqueue_head(&journal->j_fc_wait);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1085,13 +1352,21 @@ static void journal_fail_superblock (journal_t *journal)
  * subsequent use.
  */
 
+/* Blocks at the end of the journal set aside for fast commits */
+static unsigned long journal_fc_blocks(journal_t *journal)
+{
+	if (!jbd2_has_fast_commit(journal))
+		return 0;
+	return be32_to_cpu(journal->j_superblock->s_num_fc_blks);
+}
+
 static int journal_reset(journal_t *journal)
 {
 	journal_superblock_t *sb = journal->j_superblock;
 	unsigned long long first, last;
 
 	first = be32_to_cpu(sb->s_first);
-	last = be32_to_cpu(sb->s_maxlen);
+	last = be32_to_cpu(sb->s_maxlen) - journal_fc_blocks(journal);
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1102,6 +1377,10 @@ static int journal_reset(journal_t *journal)
 	journal->j_first = first;
 	journal->j_last = last;
 
+	journal->j_fc_first = last;
+	journal->j_fc_last = be32_to_cpu(sb->s_maxlen);
+	journal->j_fc_off = 0;
+
 	journal->j_head = first;
 	journal->j_tail = first;
 	journal->j_free = last - first;
@@ -1259,6 +1538,16 @@ static int journal_get_superblock(journal_t *journal)
 		goto out;
 	}
 
+	if (jbd2_has_fast_commit(journal) &&
+	    (sb->s_num_fc_blks == 0 ||
+	     be32_to_cpu(sb->s_first) + JBD2_MIN_JOURNAL_BLOCKS +
+	     be32_to_cpu(sb->s_num_fc_blks) > journal->j_maxlen)) {
+		printk(KERN_WARNING
+			"JBD2: Invalid fast commit area of journal: %u\n",
+			be32_to_cpu(sb->s_num_fc_blks));
+		goto out;
+	}
+
 	return 0;
 
 out:
@@ -1285,7 +1574,7 @@ static int load_superblock(journal_t *journal)
 	journal->j_tail_sequence = be32_to_cpu(sb->s_sequence);
 	journal->j_tail = be32_to_cpu(sb->s_start);
 	journal->j_first = be32_to_cpu(sb->s_first);
-	journal->j_last = be32_to_cpu(sb->s_maxlen);
+	journal->j_last = be32_to_cpu(sb->s_maxlen) - journal_fc_blocks(journal);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
 	return 0;
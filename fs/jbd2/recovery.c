@@ -257,6 +257,16 @@ int jbd2_journal_recover(journal_t *journal)
 	jbd_debug(1, "JBD: Replayed %d and revoked %d/%d blocks\n",
 		  info.nr_replays, info.nr_revoke_hits, info.nr_revokes);
 
+	/* Fast commits of the transaction that did not make it to the log
+	 * are still valid; the client replays them once the filesystem is
+	 * up.  Keep the ID in the superblock until it has done so, it gets
+	 * written out when the log is reset. */
+	if (!err && jbd2_has_fast_commit(journal) &&
+	    !(sb->s_fc_flags & cpu_to_be32(JBD2_FC_REPLAY_PENDING))) {
+		sb->s_fc_replay_tid = cpu_to_be32(info.end_transaction);
+		sb->s_fc_flags |= cpu_to_be32(JBD2_FC_REPLAY_PENDING);
+	}
+
 	/* Restart the log at the next transaction ID, thus invalidating
 	 * any existing commit records in the log. */
 	journal->j_transaction_sequence = ++info.end_transaction;
@@ -307,6 +317,8 @@ int jbd2_journal_skip_recovery(journal_t *journal)
 	}
 
 	journal->j_tail = 0;
+	journal->j_superblock->s_fc_flags &=
+		~cpu_to_be32(JBD2_FC_REPLAY_PENDING);
 	return err;
 }
 
@@ -47,11 +47,14 @@
 #include <linux/string.h>
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
+#include <linux/blkdev.h>
+#include <linux/buffer_head.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs_fs_i.h"
 #include "squashfs.h"
+#include "page_actor.h"
 
 /*
  * Locate cache slot in range [offset, index] for specified inode.  If
@@ -371,18 +374,177 @@ static int read_blocklist(struct inode *inode, int index, u64 *block)
 }
 
 
-static int squashfs_readpage(struct file *file, struct page *page)
+/*
+ * Copy the datablock in buffer (or zeroes, if buffer is NULL) into the
+ * pages of the block, starting at offset bytes into it.  As the datablock
+ * likely covers many PAGE_CACHE_SIZE pages (default block size is 128 KiB)
+ * explicitly grab the pages from the page cache, except for the page that
+ * we've been called to fill.
+ */
+static void squashfs_copy_cache(struct page *page,
+	struct squashfs_cache_entry *buffer, int bytes, int offset)
 {
 	struct inode *inode = page->mapping->host;
 	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
-	int bytes, i, offset = 0, sparse = 0;
-	struct squashfs_cache_entry *buffer = NULL;
 	void *pageaddr;
+	int i, mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
+	int start_index = page->index & ~mask, end_index = start_index | mask;
+
+	for (i = start_index; i <= end_index && bytes > 0; i++,
+			bytes -= PAGE_CACHE_SIZE, offset += PAGE_CACHE_SIZE) {
+		struct page *push_page;
+		int avail = buffer ? min_t(int, bytes, PAGE_CACHE_SIZE) : 0;
+
+		TRACE("bytes %d, i %d, available_bytes %d\n", bytes, i, avail);
+
+		push_page = (i == page->index) ? page :
+			grab_cache_page_nowait(page->mapping, i);
+
+		if (!push_page)
+			continue;
+
+		if (PageUptodate(push_page))
+			goto skip_page;
+
+		pageaddr = kmap_atomic(push_page, KM_USER0);
+		squashfs_copy_data(pageaddr, buffer, offset, avail);
+		memset(pageaddr + avail, 0, PAGE_CACHE_SIZE - avail);
+		kunmap_atomic(pageaddr, KM_USER0);
+		flush_dcache_page(push_page);
+		SetPageUptodate(push_page);
+skip_page:
+		unlock_page(push_page);
+		if (i != page->index)
+			page_cache_release(push_page);
+	}
+}
+
+
+/* Read a datablock through the read_page cache, and copy it into the pages */
+static int squashfs_read_cache(struct page *page, u64 block, int bsize)
+{
+	struct squashfs_cache_entry *buffer = squashfs_get_datablock(
+		page->mapping->host->i_sb, block, bsize);
+	int res = buffer->error;
+
+	if (res)
+		ERROR("Unable to read page, block %llx, size %x\n", block,
+			bsize);
+	else
+		squashfs_copy_cache(page, buffer, buffer->length, 0);
+
+	squashfs_cache_put(buffer);
+	return res;
+}
+
 
+/*
+ * Read a datablock straight into the page cache: when all the pages it
+ * covers can be grabbed and none is already uptodate, decompress into them
+ * directly, without going through the read_page cache and its copy.  As
+ * a side effect readers of different blocks are then only serialised by
+ * the decompressors.  Otherwise fall back to squashfs_read_cache().
+ */
+static int squashfs_readpage_block(struct page *target_page, u64 block,
+	int bsize)
+{
+	struct inode *inode = target_page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int file_end = (i_size_read(inode) - 1) >> PAGE_CACHE_SHIFT;
 	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
-	int index = page->index >> (msblk->block_log - PAGE_CACHE_SHIFT);
-	int start_index = page->index & ~mask;
+	int start_index = target_page->index & ~mask;
 	int end_index = start_index | mask;
+	int i, n, pages, res = -ENOMEM;
+	struct squashfs_page_actor *actor;
+	struct page **page;
+	void *pageaddr;
+
+	if (end_index > file_end)
+		end_index = file_end;
+	pages = end_index - start_index + 1;
+
+	page = kmalloc(pages * sizeof(*page), GFP_KERNEL);
+	if (page == NULL)
+		return res;
+
+	/* Grab the other pages of the block, as squashfs_copy_cache() does */
+	for (n = 0, i = start_index; i <= end_index; n++, i++) {
+		page[n] = (i == target_page->index) ? target_page :
+			grab_cache_page_nowait(target_page->mapping, i);
+
+		if (page[n] == NULL)
+			goto fallback;
+
+		if (PageUptodate(page[n])) {
+			n++;
+			goto fallback;
+		}
+	}
+
+	actor = squashfs_page_actor_init_special(page, pages, 0);
+	if (actor == NULL)
+		goto mark_errored;
+
+	res = squashfs_read_data(inode->i_sb, block, bsize, NULL, actor);
+	kfree(actor);
+	if (res < 0)
+		goto mark_errored;
+
+	/* The last page of the file may only be partly filled */
+	for (i = res >> PAGE_CACHE_SHIFT; i < pages; i++) {
+		int offset = i == res >> PAGE_CACHE_SHIFT ?
+			res & (PAGE_CACHE_SIZE - 1) : 0;
+
+		pageaddr = kmap_atomic(page[i], KM_USER0);
+		memset(pageaddr + offset, 0, PAGE_CACHE_SIZE - offset);
+		kunmap_atomic(pageaddr, KM_USER0);
+	}
+
+	for (i = 0; i < pages; i++) {
+		flush_dcache_page(page[i]);
+		SetPageUptodate(page[i]);
+		unlock_page(page[i]);
+		if (page[i] != target_page)
+			page_cache_release(page[i]);
+	}
+
+	kfree(page);
+	return 0;
+
+mark_errored:
+	ERROR("Unable to read page, block %llx, size %x\n", block, bsize);
+	for (i = 0; i < pages; i++) {
+		if (page[i] == target_page)
+			continue;
+		flush_dcache_page(page[i]);
+		SetPageError(page[i]);
+		unlock_page(page[i]);
+		page_cache_release(page[i]);
+	}
+	kfree(page);
+	return res < 0 ? res : -EIO;
+
+fallback:
+	for (i = 0; i < n; i++) {
+		if (page[i] == NULL || page[i] == target_page)
+			continue;
+		unlock_page(page[i]);
+		page_cache_release(page[i]);
+	}
+	kfree(page);
+	return squashfs_read_cache(target_page, block, bsize);
+}
+
+
+static int squashfs_readpage(struct file *file, struct page *page)
+{
+	struct inode *inode = page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int bytes, res = 0;
+	struct squashfs_cache_entry *buffer;
+	void *pageaddr;
+
+	int index = page->index >> (msblk->block_log - PAGE_CACHE_SHIFT);
 	int file_end = i_size_read(inode) >> msblk->block_log;
 
 	TRACE("Entered squashfs_readpage, page index %lx, start block %llx\n",
@@ -407,21 +569,9 @@ static int squashfs_readpage(struct file *file, struct page *page)
 			bytes = index == file_end ?
 				(i_size_read(inode) & (msblk->block_size - 1)) :
 				 msblk->block_size;
-			sparse = 1;
-		} else {
-			/*
-			 * Read and decompress datablock.
-			 */
-			buffer = squashfs_get_datablock(inode->i_sb,
-								block, bsize);
-			if (buffer->error) {
-				ERROR("Unable to read page, block %llx, size %x"
-					"\n", block, bsize);
-				squashfs_cache_put(buffer);
-				goto error_out;
-			}
-			bytes = buffer->length;
-		}
+			squashfs_copy_cache(page, NULL, bytes, 0);
+		} else
+			res = squashfs_readpage_block(page, block, bsize);
 	} else {
 		/*
 		 * Datablock is stored inside a fragment (tail-end packed
@@ -431,53 +581,20 @@ static int squashfs_readpage(struct file *file, struct page *page)
 				squashfs_i(inode)->fragment_block,
 				squashfs_i(inode)->fragment_size);
 
-		if (buffer->error) {
+		res = buffer->error;
+		if (res)
 			ERROR("Unable to read page, block %llx, size %x\n",
 				squashfs_i(inode)->fragment_block,
 				squashfs_i(inode)->fragment_size);
-			squashfs_cache_put(buffer);
-			goto error_out;
-		}
-		bytes = i_size_read(inode) & (msblk->block_size - 1);
-		offset = squashfs_i(inode)->fragment_offset;
-	}
-
-	/*
-	 * Loop copying datablock into pages.  As the datablock likely covers
-	 * many PAGE_CACHE_SIZE pages (default block size is 128 KiB) explicitly
-	 * grab the pages from the page cache, except for the page that we've
-	 * been called to fill.
-	 */
-	for (i = start_index; i <= end_index && bytes > 0; i++,
-			bytes -= PAGE_CACHE_SIZE, offset += PAGE_CACHE_SIZE) {
-		struct page *push_page;
-		int avail = sparse ? 0 : min_t(int, bytes, PAGE_CACHE_SIZE);
-
-		TRACE("bytes %d, i %d, available_bytes %d\n", bytes, i, avail);
-
-		push_page = (i == page->index) ? page :
-			grab_cache_page_nowait(page->mapping, i);
-
-		if (!push_page)
-			continue;
-
-		if (PageUptodate(push_page))
-			goto skip_page;
-
-		pageaddr = kmap_atomic(push_page, KM_USER0);
-		squashfs_copy_data(pageaddr, buffer, offset, avail);
-		memset(pageaddr + avail, 0, PAGE_CACHE_SIZE - avail);
-		kunmap_atomic(pageaddr, KM_USER0);
-		flush_dcache_page(push_page);
-		SetPageUptodate(push_page);
-skip_page:
-		unlock_page(push_page);
-		if (i != page->index)
-			page_cache_release(push_page);
+		else
+			squashfs_copy_cache(page, buffer,
+				i_size_read(inode) & (msblk->block_size - 1),
+				squashfs_i(inode)->fragment_offset);
+		squashfs_cache_put(buffer);
 	}
 
-	if (!sparse)
-		squashfs_cache_put(buffer);
+	if (res)
+		goto error_out;
 
 	return 0;
 
@@ -496,6 +613,64 @@ out:
 }
 
 
+static int squashfs_readpages_filler(void *data, struct page *page)
+{
+	return squashfs_readpage(data, page);
+}
+
+
+/*
+ * Readahead.  Start reading all the compressed datablocks covering the
+ * pages at once, so that the device works on the later ones while the
+ * earlier ones are decompressed, then fill the pages a block at a time:
+ * squashfs_readpage() fills every page of the block it is called for, and
+ * the remaining pages of the list that are then found in the page cache
+ * are simply dropped by read_cache_pages().
+ */
+static int squashfs_readpages(struct file *file, struct address_space *mapping,
+	struct list_head *pages, unsigned nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct super_block *sb = inode->i_sb;
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_CACHE_SHIFT;
+	int file_end = i_size_read(inode) >> msblk->block_log;
+	pgoff_t first = ULONG_MAX, last = 0;
+	struct blk_plug plug;
+	struct page *page;
+	int index, bsize;
+	u64 block, cur, end;
+
+	list_for_each_entry(page, pages, lru) {
+		first = min(first, page->index);
+		last = max(last, page->index);
+	}
+
+	/* The tail-end fragment, if any, is read through the cache */
+	if (squashfs_i(inode)->fragment_block != SQUASHFS_INVALID_BLK)
+		file_end--;
+
+	blk_start_plug(&plug);
+	for (index = first >> shift; index <= (int) (last >> shift) &&
+			index <= file_end; index++) {
+		block = 0;
+		bsize = read_blocklist(inode, index, &block);
+		if (bsize <= 0)
+			continue;
+
+		end = block + SQUASHFS_COMPRESSED_SIZE_BLOCK(bsize);
+		for (cur = block >> msblk->devblksize_log2;
+				cur << msblk->devblksize_log2 < end; cur++)
+			sb_breadahead(sb, cur);
+	}
+	blk_finish_plug(&plug);
+
+	return read_cache_pages(mapping, pages, squashfs_readpages_filler,
+		file);
+}
+
+
 const struct address_space_operations squashfs_aops = {
-	.readpage = squashfs_readpage
+	.readpage = squashfs_readpage,
+	.readpages = squashfs_readpages
 };
@@ -48,7 +48,7 @@ static int yaffs_checkpt_erase(struct yaffs_dev *dev)
 				bi->block_state = YAFFS_BLOCK_STATE_EMPTY;
 				dev->n_erased_blocks++;
 				dev->n_free_chunks +=
-				    dev->param.chunks_per_block;
+				    dev->chunks_per_summary;
 			} else {
 				dev->param.bad_block_fn(dev, i);
 				bi->block_state = YAFFS_BLOCK_STATE_DEAD;
@@ -387,7 +387,7 @@ int yaffs_checkpt_close(struct yaffs_dev *dev)
 	}
 
 	dev->n_free_chunks -=
-	    dev->blocks_in_checkpt * dev->param.chunks_per_block;
+	    dev->blocks_in_checkpt * dev->chunks_per_summary;
 	dev->n_erased_blocks -= dev->blocks_in_checkpt;
 
 	yaffs_trace(YAFFS_TRACE_CHECKPOINT,"checkpoint byte count %d",
@@ -29,6 +29,7 @@
 
 #include "yaffs_nand.h"
 #include "yaffs_packedtags2.h"
+#include "yaffs_summary.h"
 
 #include "yaffs_nameval.h"
 #include "yaffs_allocator.h"
@@ -388,7 +389,7 @@ int yaffs_check_alloc_available(struct yaffs_dev *dev, int n_chunks)
 	checkpt_blocks = yaffs_calc_checkpt_blocks_required(dev);
 
 	reserved_chunks =
-	    ((reserved_blocks + checkpt_blocks) * dev->param.chunks_per_block);
+	    ((reserved_blocks + checkpt_blocks) * dev->chunks_per_summary);
 
 	return (dev->n_free_chunks > (reserved_chunks + n_chunks));
 }
@@ -450,6 +451,7 @@ static int yaffs_alloc_chunk(struct yaffs_dev *dev, int use_reserver,
 		/* Get next block to allocate off */
 		dev->alloc_block = yaffs_find_alloc_block(dev);
 		dev->alloc_page = 0;
+		yaffs_summary_clear(dev);
 	}
 
 	if (!use_reserver && !yaffs_check_alloc_available(dev, 1)) {
@@ -474,8 +476,11 @@ static int yaffs_alloc_chunk(struct yaffs_dev *dev, int use_reserver,
 
 		dev->n_free_chunks--;
 
-		/* If the block is full set the state to full */
-		if (dev->alloc_page >= dev->param.chunks_per_block) {
+		/* If the block is full set the state to full.  The chunks
+		 * left for the block summary, if any, are written by
+		 * yaffs_summary_add() and not allocated.
+		 */
+		if (dev->alloc_page >= dev->chunks_per_summary) {
 			bi->block_state = YAFFS_BLOCK_STATE_FULL;
 			dev->alloc_block = -1;
 		}
@@ -495,10 +500,10 @@ static int yaffs_get_erased_chunks(struct yaffs_dev *dev)
 {
 	int n;
 
-	n = dev->n_erased_blocks * dev->param.chunks_per_block;
+	n = dev->n_erased_blocks * dev->chunks_per_summary;
 
 	if (dev->alloc_block > 0)
-		n += (dev->param.chunks_per_block - dev->alloc_page);
+		n += (dev->chunks_per_summary - dev->alloc_page);
 
 	return n;
 
@@ -609,6 +614,8 @@ static int yaffs_write_new_chunk(struct yaffs_dev *dev,
 
 	if (!write_ok)
 		chunk = -1;
+	else
+		yaffs_summary_add(dev, tags, chunk);
 
 	if (attempts > 1) {
 		yaffs_trace(YAFFS_TRACE_ERROR,
@@ -2430,7 +2437,7 @@ void yaffs_block_became_dirty(struct yaffs_dev *dev, int block_no)
 			"Erased block %d", block_no);
 	} else {
 		/* We lost a block of free space */
-		dev->n_free_chunks -= dev->param.chunks_per_block;
+		dev->n_free_chunks -= dev->chunks_per_summary;
 		yaffs_retire_block(dev, block_no);
 		yaffs_trace(YAFFS_TRACE_ERROR | YAFFS_TRACE_BAD_BLOCKS,
 			"**>> Block %d retired", block_no);
@@ -2912,7 +2919,7 @@ static int yaffs_check_gc(struct yaffs_dev *dev, int background)
 		min_erased =
 		    dev->param.n_reserved_blocks + checkpt_block_adjust + 1;
 		erased_chunks =
-		    dev->n_erased_blocks * dev->param.chunks_per_block;
+		    dev->n_erased_blocks * dev->chunks_per_summary;
 
 		/* If we need a block soon then do aggressive gc. */
 		if (dev->n_erased_blocks < min_erased)
@@ -2981,7 +2988,7 @@ static int yaffs_check_gc(struct yaffs_dev *dev, int background)
  */
 int yaffs_bg_gc(struct yaffs_dev *dev, unsigned urgency)
 {
-	int erased_chunks = dev->n_erased_blocks * dev->param.chunks_per_block;
+	int erased_chunks = dev->n_erased_blocks * dev->chunks_per_summary;
 
 	yaffs_trace(YAFFS_TRACE_BACKGROUND, "Background gc %u", urgency);
 
@@ -4980,6 +4987,9 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 			init_failed = 1;
 	}
 
+	if (!init_failed && !yaffs_summary_init(dev))
+		init_failed = 1;
+
 	if (dev->param.is_yaffs2)
 		dev->param.use_header_file_size = 1;
 
@@ -5089,6 +5099,7 @@ void yaffs_deinitialise(struct yaffs_dev *dev)
 		}
 
 		kfree(dev->gc_cleanup_list);
+		yaffs_summary_deinit(dev);
 
 		for (i = 0; i < YAFFS_N_TEMP_BUFFERS; i++)
 			kfree(dev->temp_buffer[i].buffer);
@@ -5115,7 +5126,7 @@ int yaffs_count_free_chunks(struct yaffs_dev *dev)
 		case YAFFS_BLOCK_STATE_COLLECTING:
 		case YAFFS_BLOCK_STATE_FULL:
 			n_free +=
-			    (dev->param.chunks_per_block - blk->pages_in_use +
+			    (dev->chunks_per_summary - blk->pages_in_use +
 			     blk->soft_del_pages);
 			break;
 		default:
@@ -83,6 +83,9 @@
 #define YAFFS_OBJECTID_CHECKPOINT_DATA	0x20
 #define YAFFS_SEQUENCE_CHECKPOINT_DATA  0x21
 
+/* Pseudo object id for the chunks holding a block summary */
+#define YAFFS_OBJECTID_SUMMARY		0x30
+
 #define YAFFS_MAX_SHORT_OP_CACHES	20
 
 #define YAFFS_N_TEMP_BUFFERS		6
@@ -574,6 +577,8 @@ struct yaffs_param {
 	int auto_unicode;
 #endif
 	int always_check_erased;	/* Force chunk erased check always on */
+
+	int disable_summary;	/* yaffs2 only: Set to disable block summaries */
 };
 
 struct yaffs_dev {
@@ -632,6 +637,11 @@ struct yaffs_dev {
 
 	int checkpoint_blocks_required;	/* Number of blocks needed to store current checkpoint set */
 
+	/* Block summaries */
+	int chunks_per_summary;	/* Data chunks per block, the summary takes the rest */
+	struct yaffs_summary_tags *sum_tags;	/* Tags of the block being written */
+	struct yaffs_summary_tags *sum_scan_tags;	/* Summary of the block being scanned */
+
 	/* Block Info */
 	struct yaffs_block_info *block_info;
 	u8 *chunk_bits;		/* bitmap of chunks in use */
@@ -734,6 +744,8 @@ struct yaffs_dev {
 	u32 n_unmarked_deletions;
 	u32 refresh_count;
 	u32 cache_hits;
+	u32 tags_used;
+	u32 summary_used;
 
 };
 
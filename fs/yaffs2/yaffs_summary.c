@@ -0,0 +1,310 @@
+/*
+ * YAFFS: Yet Another Flash File System. A NAND-flash specific file system.
+ *
+ * Copyright (C) 2002-2010 Aleph One Ltd.
+ *   for Toby Churchill Ltd and Brightstar Engineering
+ *
+ * Created by Charles Manning <charles@aleph1.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/* Block summaries for faster scanning.
+ *
+ * The tags of the chunks of a block are collected as the block is written.
+ * Once the last data chunk of the block is written, the collected tags are
+ * written into the chunks left at the end of the block, so that a scan can
+ * read one summary instead of the tags of every chunk in the block.
+ *
+ * The summary chunks are never in use nor free: they are written with the
+ * summary object id, which scanning without summaries ignores, and are
+ * reclaimed with the rest of the block, which only ever frees
+ * chunks_per_summary chunks.  A summary that does not check out is ignored
+ * and the block is scanned chunk by chunk.
+ */
+
+#include "yaffs_summary.h"
+#include "yaffs_packedtags2.h"
+#include "yaffs_nand.h"
+#include "yaffs_getblockinfo.h"
+#include "yaffs_trace.h"
+
+#define YAFFS_SUMMARY_VERSION	1
+
+/* The tags of one chunk, packed as for inband tags less the sequence number */
+struct yaffs_summary_tags {
+	unsigned obj_id;
+	unsigned chunk_id;
+	unsigned n_bytes;
+};
+
+/* Each summary chunk starts with this header */
+struct yaffs_summary_header {
+	unsigned version;	/* Must match YAFFS_SUMMARY_VERSION */
+	unsigned block;		/* Must be this block */
+	unsigned seq;		/* Must be this block's sequence number */
+	unsigned sum;		/* Checksum of the summary tags */
+};
+
+static int yaffs_summary_bytes(struct yaffs_dev *dev)
+{
+	return dev->chunks_per_summary * sizeof(struct yaffs_summary_tags);
+}
+
+int yaffs_summary_init(struct yaffs_dev *dev)
+{
+	int sum_bytes_per_chunk;
+	int chunks_used;
+
+	dev->chunks_per_summary = dev->param.chunks_per_block;
+	dev->sum_tags = NULL;
+	dev->sum_scan_tags = NULL;
+
+	if (!dev->param.is_yaffs2 || dev->param.disable_summary)
+		return YAFFS_OK;
+
+	/* Work out how many chunks at the end of the block the summary
+	 * takes, leaving the rest for data.
+	 */
+	sum_bytes_per_chunk = dev->data_bytes_per_chunk -
+	    sizeof(struct yaffs_summary_header);
+	chunks_used = (dev->param.chunks_per_block *
+		       sizeof(struct yaffs_summary_tags) +
+		       sum_bytes_per_chunk - 1) / sum_bytes_per_chunk;
+
+	/* Not worth it on blocks too small to hold their own summary */
+	if (chunks_used * 2 > dev->param.chunks_per_block)
+		return YAFFS_OK;
+
+	dev->sum_tags = kmalloc(dev->param.chunks_per_block *
+				sizeof(struct yaffs_summary_tags), GFP_NOFS);
+	dev->sum_scan_tags = kmalloc(dev->param.chunks_per_block *
+				     sizeof(struct yaffs_summary_tags),
+				     GFP_NOFS);
+	if (!dev->sum_tags || !dev->sum_scan_tags) {
+		yaffs_summary_deinit(dev);
+		return YAFFS_FAIL;
+	}
+
+	dev->chunks_per_summary = dev->param.chunks_per_block - chunks_used;
+	yaffs_summary_clear(dev);
+
+	yaffs_trace(YAFFS_TRACE_MOUNT,
+		"block summary uses %d chunks of %d", chunks_used,
+		dev->param.chunks_per_block);
+
+	return YAFFS_OK;
+}
+
+void yaffs_summary_deinit(struct yaffs_dev *dev)
+{
+	kfree(dev->sum_tags);
+	kfree(dev->sum_scan_tags);
+	dev->sum_tags = NULL;
+	dev->sum_scan_tags = NULL;
+	dev->chunks_per_summary = dev->param.chunks_per_block;
+}
+
+/* An object id of zero marks a chunk the summary knows nothing about */
+void yaffs_summary_clear(struct yaffs_dev *dev)
+{
+	if (dev->sum_tags)
+		memset(dev->sum_tags, 0, yaffs_summary_bytes(dev));
+}
+
+static unsigned yaffs_summary_sum(struct yaffs_dev *dev,
+				  struct yaffs_summary_tags *sum_tags)
+{
+	u8 *sum_buffer = (u8 *) sum_tags;
+	int n_bytes = yaffs_summary_bytes(dev);
+	unsigned sum = 0;
+	int i;
+
+	for (i = 0; i < n_bytes; i++) {
+		sum = (sum << 1) | (sum >> 31);
+		sum += sum_buffer[i];
+	}
+
+	return sum;
+}
+
+static int yaffs_summary_write(struct yaffs_dev *dev, int blk)
+{
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+	struct yaffs_summary_header hdr;
+	struct yaffs_ext_tags tags;
+	u8 *sum_buffer = (u8 *) dev->sum_tags;
+	int sum_bytes_per_chunk = dev->data_bytes_per_chunk - sizeof(hdr);
+	int n_bytes = yaffs_summary_bytes(dev);
+	int chunk_in_nand;
+	int this_tx;
+	int result = YAFFS_OK;
+	u8 *buffer;
+
+	/* The summary goes under the block's own sequence number */
+	if (bi->seq_number != dev->seq_number)
+		return YAFFS_FAIL;
+
+	hdr.version = YAFFS_SUMMARY_VERSION;
+	hdr.block = blk;
+	hdr.seq = bi->seq_number;
+	hdr.sum = yaffs_summary_sum(dev, dev->sum_tags);
+
+	memset(&tags, 0, sizeof(tags));
+	tags.obj_id = YAFFS_OBJECTID_SUMMARY;
+	tags.chunk_id = 1;
+
+	chunk_in_nand = blk * dev->param.chunks_per_block +
+	    dev->chunks_per_summary;
+
+	buffer = yaffs_get_temp_buffer(dev, __LINE__);
+
+	while (result == YAFFS_OK && n_bytes > 0) {
+		this_tx = min(n_bytes, sum_bytes_per_chunk);
+		memset(buffer, 0xff, dev->data_bytes_per_chunk);
+		memcpy(buffer, &hdr, sizeof(hdr));
+		memcpy(buffer + sizeof(hdr), sum_buffer, this_tx);
+		tags.n_bytes = this_tx + sizeof(hdr);
+
+		result = yaffs_wr_chunk_tags_nand(dev, chunk_in_nand, buffer,
+						  &tags);
+
+		n_bytes -= this_tx;
+		sum_buffer += this_tx;
+		chunk_in_nand++;
+		tags.chunk_id++;
+	}
+
+	yaffs_release_temp_buffer(dev, buffer, __LINE__);
+
+	if (result != YAFFS_OK)
+		yaffs_trace(YAFFS_TRACE_ERROR,
+			"failed to write summary of block %d", blk);
+
+	return result;
+}
+
+/*
+ * Record the tags of a chunk just written.  Writing the last data chunk
+ * of a block writes out the block's summary: the allocator has already
+ * marked it full.
+ */
+void yaffs_summary_add(struct yaffs_dev *dev, struct yaffs_ext_tags *tags,
+		       int chunk_in_nand)
+{
+	struct yaffs_packed_tags2_tags_only tags_only;
+	struct yaffs_summary_tags *sum_tags;
+	int blk = chunk_in_nand / dev->param.chunks_per_block;
+	int chunk_in_block = chunk_in_nand % dev->param.chunks_per_block;
+
+	if (!dev->sum_tags || chunk_in_block >= dev->chunks_per_summary)
+		return;
+
+	yaffs_pack_tags2_tags_only(&tags_only, tags);
+	sum_tags = &dev->sum_tags[chunk_in_block];
+	sum_tags->obj_id = tags_only.obj_id;
+	sum_tags->chunk_id = tags_only.chunk_id;
+	sum_tags->n_bytes = tags_only.n_bytes;
+
+	if (chunk_in_block == dev->chunks_per_summary - 1) {
+		yaffs_summary_write(dev, blk);
+		yaffs_summary_clear(dev);
+	}
+}
+
+/*
+ * Read the summary of a block into dev->sum_scan_tags, leaving the tags
+ * collected for the allocation block alone.  Returns YAFFS_FAIL if the
+ * block has none, or one that does not check out.
+ */
+int yaffs_summary_read(struct yaffs_dev *dev, int blk)
+{
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+	struct yaffs_summary_header hdr;
+	struct yaffs_ext_tags tags;
+	u8 *sum_buffer = (u8 *) dev->sum_scan_tags;
+	int sum_bytes_per_chunk = dev->data_bytes_per_chunk - sizeof(hdr);
+	int n_bytes = yaffs_summary_bytes(dev);
+	int chunk_id = 1;
+	int chunk_in_nand;
+	int this_tx;
+	int result = YAFFS_OK;
+	u8 *buffer;
+
+	if (!dev->sum_scan_tags)
+		return YAFFS_FAIL;
+
+	chunk_in_nand = blk * dev->param.chunks_per_block +
+	    dev->chunks_per_summary;
+
+	buffer = yaffs_get_temp_buffer(dev, __LINE__);
+
+	while (result == YAFFS_OK && n_bytes > 0) {
+		this_tx = min(n_bytes, sum_bytes_per_chunk);
+
+		yaffs_rd_chunk_tags_nand(dev, chunk_in_nand, buffer, &tags);
+		memcpy(&hdr, buffer, sizeof(hdr));
+
+		if (!tags.chunk_used ||
+		    tags.ecc_result > YAFFS_ECC_RESULT_FIXED ||
+		    tags.obj_id != YAFFS_OBJECTID_SUMMARY ||
+		    tags.chunk_id != chunk_id ||
+		    tags.n_bytes != this_tx + sizeof(hdr) ||
+		    tags.seq_number != bi->seq_number ||
+		    hdr.version != YAFFS_SUMMARY_VERSION ||
+		    hdr.block != blk || hdr.seq != bi->seq_number) {
+			result = YAFFS_FAIL;
+			break;
+		}
+
+		memcpy(sum_buffer, buffer + sizeof(hdr), this_tx);
+
+		n_bytes -= this_tx;
+		sum_buffer += this_tx;
+		chunk_in_nand++;
+		chunk_id++;
+	}
+
+	yaffs_release_temp_buffer(dev, buffer, __LINE__);
+
+	if (result == YAFFS_OK && hdr.sum != yaffs_summary_sum(dev, dev->sum_scan_tags))
+		result = YAFFS_FAIL;
+
+	if (result != YAFFS_OK)
+		yaffs_trace(YAFFS_TRACE_SCAN,
+			"no usable summary in block %d", blk);
+
+	return result;
+}
+
+/*
+ * Get the tags of a data chunk of block blk from its summary, as read by
+ * yaffs_summary_read().  Returns YAFFS_FAIL if the summary has nothing
+ * for the chunk, whose tags then need reading.
+ */
+int yaffs_summary_fetch(struct yaffs_dev *dev, struct yaffs_ext_tags *tags,
+			int blk, int chunk_in_block)
+{
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+	struct yaffs_packed_tags2_tags_only tags_only;
+	struct yaffs_summary_tags *sum_tags;
+
+	if (chunk_in_block < 0 || chunk_in_block >= dev->chunks_per_summary)
+		return YAFFS_FAIL;
+
+	sum_tags = &dev->sum_scan_tags[chunk_in_block];
+	if (!sum_tags->obj_id)
+		return YAFFS_FAIL;
+
+	tags_only.obj_id = sum_tags->obj_id;
+	tags_only.chunk_id = sum_tags->chunk_id;
+	tags_only.n_bytes = sum_tags->n_bytes;
+	tags_only.seq_number = bi->seq_number;
+
+	yaffs_unpack_tags2_tags_only(tags, &tags_only);
+	tags->ecc_result = YAFFS_ECC_RESULT_NO_ERROR;
+
+	return YAFFS_OK;
+}
@@ -1764,6 +1764,7 @@ struct yaffs_options {
 	int lazy_loading_overridden;
 	int empty_lost_and_found;
 	int empty_lost_and_found_overridden;
+	int disable_summary;
 };
 
 #define MAX_OPT_LEN 30
@@ -1820,6 +1821,8 @@ static int yaffs_parse_options(struct yaffs_options *options,
 		} else if (!strcmp(cur_opt, "no-checkpoint")) {
 			options->skip_checkpoint_read = 1;
 			options->skip_checkpoint_write = 1;
+		} else if (!strcmp(cur_opt, "no-summary")) {
+			options->disable_summary = 1;
 		} else {
 			printk(KERN_INFO "yaffs: Bad mount option \"%s\"\n",
 			       cur_opt);
@@ -2296,6 +2299,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 
 	param->skip_checkpt_rd = options.skip_checkpoint_read;
 	param->skip_checkpt_wr = options.skip_checkpoint_write;
+	param->disable_summary = options.disable_summary;
 
 	mutex_lock(&yaffs_context_lock);
 	/* Get a mount id */
@@ -2442,6 +2446,8 @@ static char *yaffs_dump_dev_part0(char *buf, struct yaffs_dev *dev)
 			param->n_reserved_blocks);
 	buf += sprintf(buf, "always_check_erased... %d\n",
 			param->always_check_erased);
+	buf += sprintf(buf, "disable_summary....... %d\n",
+			param->disable_summary);
 
 	return buf;
 }
@@ -2486,6 +2492,8 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	    sprintf(buf, "n_tags_ecc_unfixed.... %u\n",
 		    dev->n_tags_ecc_unfixed);
 	buf += sprintf(buf, "cache_hits............ %u\n", dev->cache_hits);
+	buf += sprintf(buf, "tags_used............. %u\n", dev->tags_used);
+	buf += sprintf(buf, "summary_used.......... %u\n", dev->summary_used);
 	buf +=
 	    sprintf(buf, "n_deleted_files....... %u\n", dev->n_deleted_files);
 	buf +=
@@ -20,6 +20,7 @@
 #include "yaffs_getblockinfo.h"
 #include "yaffs_verify.h"
 #include "yaffs_attribs.h"
+#include "yaffs_summary.h"
 
 /*
  * Checkpoints are really no benefit on very small partitions.
@@ -983,6 +984,7 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	int found_chunks;
 	int equiv_id;
 	int alloc_failed = 0;
+	int summary_available;
 
 	struct yaffs_block_index *block_index = NULL;
 	int alt_block_index = 0;
@@ -1010,6 +1012,8 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	}
 
 	dev->blocks_in_checkpt = 0;
+	dev->tags_used = 0;
+	dev->summary_used = 0;
 
 	chunk_data = yaffs_get_temp_buffer(dev, __LINE__);
 
@@ -1044,7 +1048,7 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 		} else if (state == YAFFS_BLOCK_STATE_EMPTY) {
 			yaffs_trace(YAFFS_TRACE_SCAN_DEBUG, "Block empty ");
 			dev->n_erased_blocks++;
-			dev->n_free_chunks += dev->param.chunks_per_block;
+			dev->n_free_chunks += dev->chunks_per_summary;
 		} else if (state == YAFFS_BLOCK_STATE_NEEDS_SCANNING) {
 
 			/* Determine the highest sequence number */
@@ -1102,10 +1106,19 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 		deleted = 0;
 
+		/* With a summary only the data chunks need looking at.  The
+		 * summary chunks are neither in use nor free, as when
+		 * scanning without it.
+		 */
+		summary_available = yaffs_summary_read(dev, blk) == YAFFS_OK;
+		if (summary_available)
+			c = dev->chunks_per_summary - 1;
+		else
+			c = dev->param.chunks_per_block - 1;
+
 		/* For each chunk in each block that needs scanning.... */
 		found_chunks = 0;
-		for (c = dev->param.chunks_per_block - 1;
-		     !alloc_failed && c >= 0 &&
+		for (; !alloc_failed && c >= 0 &&
 		     (state == YAFFS_BLOCK_STATE_NEEDS_SCANNING ||
 		      state == YAFFS_BLOCK_STATE_ALLOCATING); c--) {
 			/* Scan backwards...
@@ -1114,8 +1127,14 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 			chunk = blk * dev->param.chunks_per_block + c;
 
-			result = yaffs_rd_chunk_tags_nand(dev, chunk, NULL,
-							  &tags);
+			if (summary_available &&
+			    yaffs_summary_fetch(dev, &tags, blk, c) == YAFFS_OK) {
+				dev->summary_used++;
+			} else {
+				result = yaffs_rd_chunk_tags_nand(dev, chunk,
+								  NULL, &tags);
+				dev->tags_used++;
+			}
 
 			/* Let's have a good look at this chunk... */
 
@@ -1131,6 +1150,8 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 				if (found_chunks) {
 					/* This is a chunk that was skipped due to failing the erased check */
+				} else if (c >= dev->chunks_per_summary) {
+					/* A summary chunk not written yet, the block was not full */
 				} else if (c == 0) {
 					/* We're looking at the first chunk in the block so the block is unused */
 					state = YAFFS_BLOCK_STATE_EMPTY;
@@ -1155,6 +1176,12 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 							dev->
 							    alloc_block_finder =
 							    blk;
+							/* The tags of the chunks
+							 * written before are not
+							 * known, the summary gets
+							 * none for them.
+							 */
+							yaffs_summary_clear(dev);
 						} else {
 							/* This is a partially written block that is not
 							 * the current allocation block.
@@ -1167,16 +1194,20 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 					}
 				}
 
-				dev->n_free_chunks++;
+				/* The summary chunks are never free */
+				if (c < dev->chunks_per_summary)
+					dev->n_free_chunks++;
 
 			} else if (tags.ecc_result == YAFFS_ECC_RESULT_UNFIXED) {
 				yaffs_trace(YAFFS_TRACE_SCAN,
 					" Unfixed ECC in chunk(%d:%d), chunk ignored",
 					blk, c);
 
-				dev->n_free_chunks++;
+				if (c < dev->chunks_per_summary)
+					dev->n_free_chunks++;
 
 			} else if (tags.obj_id > YAFFS_MAX_OBJECT_ID ||
+				   tags.obj_id == YAFFS_OBJECTID_SUMMARY ||
 				   tags.chunk_id > YAFFS_MAX_CHUNK_ID ||
 				   (tags.chunk_id > 0
 				    && tags.n_bytes > dev->data_bytes_per_chunk)
@@ -1186,7 +1217,8 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 					blk, c, tags.obj_id,
 					tags.chunk_id, tags.n_bytes);
 
-				dev->n_free_chunks++;
+				if (c < dev->chunks_per_summary)
+					dev->n_free_chunks++;
 
 			} else if (tags.chunk_id > 0) {
 				/* chunk_id > 0 so it is a data chunk... */
@@ -139,6 +139,59 @@ extern void put_online_cpus(void);
 #define unregister_hotcpu_notifier(nb)	unregister_cpu_notifier(nb)
 int cpu_down(unsigned int cpu);
 
+enum cpu_park_stat_item {
+	CPU_PARK_STAT_PARK,
+	CPU_PARK_STAT_UNPARK,
+	CPU_PARK_STAT_DOWN,
+	CPU_PARK_STAT_UP,
+	NR_CPU_PARK_STATS
+};
+
+struct cpu_park_stat {
+	unsigned long count;
+	u64 total_ns;
+	u64 max_ns;
+};
+
+#ifdef CONFIG_CPU_PARKING
+extern int cpu_park(unsigned int cpu);
+extern int cpu_unpark(unsigned int cpu);
+extern void cpu_park_get_stat(int item, struct cpu_park_stat *stat);
+#endif
+
+/*
+ * Helpers for the dynamic hotplug governors, which take idle cores out of
+ * use either by unplugging them or, much faster, by parking them.  A
+ * parked cpu is online but gets no tasks, so it counts as not usable.
+ */
+static inline bool cpu_usable(unsigned int cpu)
+{
+	return cpu_online(cpu) && !cpu_parked(cpu);
+}
+
+static inline unsigned int num_usable_cpus(void)
+{
+	return num_online_cpus() - num_parked_cpus();
+}
+
+static inline int cpu_core_down(unsigned int cpu, bool park)
+{
+#ifdef CONFIG_CPU_PARKING
+	if (park)
+		return cpu_park(cpu);
+#endif
+	return cpu_down(cpu);
+}
+
+static inline int cpu_core_up(unsigned int cpu)
+{
+#ifdef CONFIG_CPU_PARKING
+	if (cpu_parked(cpu))
+		return cpu_unpark(cpu);
+#endif
+	return cpu_up(cpu);
+}
+
 #ifdef CONFIG_ARCH_CPU_PROBE_RELEASE
 extern void cpu_hotplug_driver_lock(void);
 extern void cpu_hotplug_driver_unlock(void);
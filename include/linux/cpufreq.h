@@ -206,6 +206,54 @@ extern int __cpufreq_driver_getavg(struct cpufreq_policy *policy,
 int cpufreq_register_governor(struct cpufreq_governor *governor);
 void cpufreq_unregister_governor(struct cpufreq_governor *governor);
 
+/*
+ * Governors that want to ramp up ahead of load register here to be told
+ * about touch input.  The chain is called from the input event path with
+ * interrupts disabled, once per input frame.
+ */
+#ifdef CONFIG_CPU_FREQ_INPUT_BOOST
+int cpufreq_register_input_notifier(struct notifier_block *nb);
+int cpufreq_unregister_input_notifier(struct notifier_block *nb);
+#else
+static inline int cpufreq_register_input_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
+static inline int cpufreq_unregister_input_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
+#endif
+
+/*
+ * Shared sampling for governors that evaluate the load periodically.
+ * Samplers run from deferrable timers on a slot aligned to a multiple of
+ * their period, the same on every cpu, so one wakeup serves them all.
+ * A due sampler runs on whichever cpu of its mask comes by busy first;
+ * cpus that are idle are not woken for it, unless the sampler asked for
+ * that with cpufreq_sampler_wakeup() from the idle path.  ->sample runs
+ * in process context and may sleep; it may update period_us.
+ */
+struct cpufreq_sampler {
+	const char	*name;
+	unsigned int	period_us;
+	void		(*sample)(struct cpufreq_sampler *s, unsigned int cpu);
+
+	/* private to cpufreq_sampling.c */
+	struct list_head list;
+	cpumask_t	cpus;
+	cpumask_t	wake;
+	unsigned long	next;
+	unsigned long	samples;
+	unsigned long	idle_skips;
+	unsigned long	wakeups;
+};
+
+int cpufreq_sampler_start(struct cpufreq_sampler *s,
+			  const struct cpumask *cpus, unsigned long delay);
+void cpufreq_sampler_stop(struct cpufreq_sampler *s);
+void cpufreq_sampler_wakeup(struct cpufreq_sampler *s);
+
 
 /*********************************************************************
  *                      CPUFREQ DRIVER INTERFACE                     *
@@ -380,6 +428,9 @@ extern struct cpufreq_governor cpufreq_gov_adaptive;
 #elif defined(CONFIG_CPU_FREQ_DEFAULT_GOV_PEGASUSQ)
 extern struct cpufreq_governor cpufreq_gov_pegasusq;
 #define CPUFREQ_DEFAULT_GOVERNOR	(&cpufreq_gov_pegasusq)
+#elif defined(CONFIG_CPU_FREQ_DEFAULT_GOV_SCHEDUTIL)
+extern struct cpufreq_governor cpufreq_gov_schedutil;
+#define CPUFREQ_DEFAULT_GOVERNOR	(&cpufreq_gov_schedutil)
 #endif
 
 
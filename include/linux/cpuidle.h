@@ -40,6 +40,8 @@ struct cpuidle_state {
 
 	unsigned long long	usage;
 	unsigned long long	time; /* in US */
+	unsigned long long	above; /* woke before target_residency */
+	unsigned long long	below; /* a deeper state would have fit */
 
 	int (*enter)	(struct cpuidle_device *dev,
 			 struct cpuidle_state *state);
@@ -183,6 +185,27 @@ static inline void cpuidle_unregister_governor(struct cpuidle_governor *gov) { }
 
 #endif
 
+/*
+ * Wakeup source tracking for the predict governor: while a cpu is idle
+ * its slot is armed, and the first device interrupt handled afterwards
+ * records its number there.
+ */
+#define CPUIDLE_WAKEUP_NONE	(-2)
+#define CPUIDLE_WAKEUP_ARMED	(-1)
+
+#ifdef CONFIG_CPU_IDLE_GOV_PREDICT
+DECLARE_PER_CPU(int, cpuidle_wakeup_irq);
+
+static inline void cpuidle_note_wakeup_irq(unsigned int irq)
+{
+	if (unlikely(__this_cpu_read(cpuidle_wakeup_irq) ==
+		     CPUIDLE_WAKEUP_ARMED))
+		__this_cpu_write(cpuidle_wakeup_irq, irq);
+}
+#else
+static inline void cpuidle_note_wakeup_irq(unsigned int irq) { }
+#endif
+
 #ifdef CONFIG_ARCH_HAS_CPU_RELAX
 #define CPUIDLE_DRIVER_STATE_START	1
 #else
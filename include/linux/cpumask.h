@@ -43,6 +43,8 @@ extern int nr_cpu_ids;
  *     cpu_present_mask - has bit 'cpu' set iff cpu is populated
  *     cpu_online_mask  - has bit 'cpu' set iff cpu available to scheduler
  *     cpu_active_mask  - has bit 'cpu' set iff cpu available to migration
+ *     cpu_parked_mask  - has bit 'cpu' set iff online cpu kept idle by
+ *                        core parking (CONFIG_CPU_PARKING)
  *
  *  If !CONFIG_HOTPLUG_CPU, present == possible, and active == online.
  *
@@ -79,6 +81,7 @@ extern const struct cpumask *const cpu_possible_mask;
 extern const struct cpumask *const cpu_online_mask;
 extern const struct cpumask *const cpu_present_mask;
 extern const struct cpumask *const cpu_active_mask;
+extern const struct cpumask *const cpu_parked_mask;
 
 #if NR_CPUS > 1
 #define num_online_cpus()	cpumask_weight(cpu_online_mask)
@@ -100,6 +103,14 @@ extern const struct cpumask *const cpu_active_mask;
 #define cpu_active(cpu)		((cpu) == 0)
 #endif
 
+#if NR_CPUS > 1 && defined(CONFIG_CPU_PARKING)
+#define num_parked_cpus()	cpumask_weight(cpu_parked_mask)
+#define cpu_parked(cpu)		cpumask_test_cpu((cpu), cpu_parked_mask)
+#else
+#define num_parked_cpus()	0U
+#define cpu_parked(cpu)		((void)(cpu), 0)
+#endif
+
 /* verify cpu argument to cpumask_* operators */
 static inline unsigned int cpumask_check(unsigned int cpu)
 {
@@ -0,0 +1,35 @@
+#ifndef _LINUX_FILE_PREFETCH_H
+#define _LINUX_FILE_PREFETCH_H
+
+/*
+ * Page cache access trace recording and replay.
+ *
+ * While a recording window is open, every range that readahead has to
+ * fetch from disk is logged as (path, page offset, nr pages).  The trace
+ * is read back through /proc/file_prefetch/trace, stored by userspace and
+ * written to /proc/file_prefetch/replay on a later boot, where it is
+ * replayed as large, sorted, asynchronous readahead batches.
+ */
+
+#include <linux/fs.h>
+
+#ifdef CONFIG_FILE_PREFETCH
+extern int file_prefetch_recording;
+
+extern void __file_prefetch_record(struct file *filp, pgoff_t start,
+				   unsigned long nr_pages);
+
+static inline void file_prefetch_record(struct file *filp, pgoff_t start,
+					unsigned long nr_pages)
+{
+	if (unlikely(file_prefetch_recording) && filp)
+		__file_prefetch_record(filp, start, nr_pages);
+}
+#else
+static inline void file_prefetch_record(struct file *filp, pgoff_t start,
+					unsigned long nr_pages)
+{
+}
+#endif
+
+#endif /* _LINUX_FILE_PREFETCH_H */
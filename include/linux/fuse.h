@@ -47,12 +47,19 @@
  *  - FUSE_IOCTL_UNRESTRICTED shall now return with array of 'struct
  *    fuse_ioctl_iovec' instead of ambiguous 'struct iovec'
  *  - add FUSE_IOCTL_32BIT flag
+ *
+ * Not tied to a protocol version, negotiated with the INIT flag:
+ *  - add FUSE_PASSTHROUGH, FOPEN_PASSTHROUGH, passthrough_fh in
+ *    fuse_open_out and FUSE_DEV_IOC_PASSTHROUGH_OPEN
+ *  - add FUSE_WRITEBACK_CACHE
+ *  - add FUSE_MAX_PAGES, extend fuse_init_out with max_pages
  */
 
 #ifndef _LINUX_FUSE_H
 #define _LINUX_FUSE_H
 
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /*
  * Version negotiation:
@@ -145,16 +152,22 @@ struct fuse_file_lock {
  * FOPEN_DIRECT_IO: bypass page cache for this open file
  * FOPEN_KEEP_CACHE: don't invalidate the data cache on open
  * FOPEN_NONSEEKABLE: the file is not seekable
+ * FOPEN_PASSTHROUGH: read, write and mmap go to the lower file registered
+ *		      as passthrough_fh instead, needs FUSE_PASSTHROUGH
  */
 #define FOPEN_DIRECT_IO		(1 << 0)
 #define FOPEN_KEEP_CACHE	(1 << 1)
 #define FOPEN_NONSEEKABLE	(1 << 2)
+#define FOPEN_PASSTHROUGH	(1 << 7)
 
 /**
  * INIT request/reply flags
  *
  * FUSE_EXPORT_SUPPORT: filesystem handles lookups of "." and ".."
  * FUSE_DONT_MASK: don't apply umask to file mode on create operations
+ * FUSE_WRITEBACK_CACHE: use writeback cache for buffered writes
+ * FUSE_MAX_PAGES: init_out.max_pages contains the max number of req pages
+ * FUSE_PASSTHROUGH: regular files may be opened with FOPEN_PASSTHROUGH
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -163,6 +176,9 @@ struct fuse_file_lock {
 #define FUSE_EXPORT_SUPPORT	(1 << 4)
 #define FUSE_BIG_WRITES		(1 << 5)
 #define FUSE_DONT_MASK		(1 << 6)
+#define FUSE_WRITEBACK_CACHE	(1 << 16)
+#define FUSE_MAX_PAGES		(1 << 22)
+#define FUSE_PASSTHROUGH	(1 << 31)
 
 /**
  * CUSE INIT request/reply flags
@@ -380,7 +396,7 @@ struct fuse_create_in {
 struct fuse_open_out {
 	__u64	fh;
 	__u32	open_flags;
-	__u32	padding;
+	__u32	passthrough_fh;
 };
 
 struct fuse_release_in {
@@ -483,6 +499,10 @@ struct fuse_init_out {
 	__u16   max_background;
 	__u16   congestion_threshold;
 	__u32	max_write;
+	__u32	time_gran;
+	__u16	max_pages;
+	__u16	padding;
+	__u32	unused[8];
 };
 
 #define CUSE_INIT_INFO_MAX 4096
@@ -624,4 +644,24 @@ struct fuse_notify_retrieve_in {
 	__u64	dummy4;
 };
 
+/**
+ * Lower file for FOPEN_PASSTHROUGH
+ *
+ * FUSE_DEV_IOC_PASSTHROUGH_OPEN on /dev/fuse registers the daemon's open
+ * file fd, and returns the passthrough_fh to answer one OPEN or CREATE
+ * with.  Needs CAP_SYS_ADMIN.  A reply without error claims it, with or
+ * without FOPEN_PASSTHROUGH.  An id no such reply is going to claim, as
+ * when replying with an error or when writing the reply fails with
+ * ENOENT, is dropped with FUSE_DEV_IOC_PASSTHROUGH_CLOSE.
+ */
+struct fuse_passthrough_out {
+	__u32	fd;
+	__u32	padding;
+};
+
+#define FUSE_DEV_IOC_MAGIC		229
+#define FUSE_DEV_IOC_PASSTHROUGH_OPEN	_IOW(FUSE_DEV_IOC_MAGIC, 1, \
+					     struct fuse_passthrough_out)
+#define FUSE_DEV_IOC_PASSTHROUGH_CLOSE	_IOW(FUSE_DEV_IOC_MAGIC, 2, __u32)
+
 #endif /* _LINUX_FUSE_H */
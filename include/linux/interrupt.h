@@ -234,6 +234,7 @@ extern cpumask_var_t irq_default_affinity;
 extern int irq_set_affinity(unsigned int irq, const struct cpumask *cpumask);
 extern int irq_can_set_affinity(unsigned int irq);
 extern int irq_select_affinity(unsigned int irq);
+extern void irq_update_parked(const struct cpumask *mask);
 
 extern int irq_set_affinity_hint(unsigned int irq, const struct cpumask *m);
 
@@ -279,6 +280,8 @@ static inline int irq_can_set_affinity(unsigned int irq)
 
 static inline int irq_select_affinity(unsigned int irq)  { return 0; }
 
+static inline void irq_update_parked(const struct cpumask *mask) { }
+
 static inline int irq_set_affinity_hint(unsigned int irq,
 					const struct cpumask *m)
 {
@@ -241,7 +241,12 @@ typedef struct journal_superblock_s
 	__be32	s_max_trans_data;	/* Limit of data blocks per trans. */
 
 /* 0x0050 */
-	__u32	s_padding[44];
+	__be32	s_num_fc_blks;		/* Blocks of the fast commit area */
+	__be32	s_fc_replay_tid;	/* Fast commits left to replay */
+	__be32	s_fc_flags;		/* Fast commit state */
+
+/* 0x005C */
+	__u32	s_padding[41];
 
 /* 0x0100 */
 	__u8	s_users[16*48];		/* ids of all fs'es sharing the log */
@@ -263,13 +268,26 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_REVOKE		0x00000001
 #define JBD2_FEATURE_INCOMPAT_64BIT		0x00000002
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
+/*
+ * Not upstream's fast commit bit (0x20): the area and the superblock fields
+ * here are laid out differently, so a journal using them must not look
+ * like one upstream tools or kernels know how to handle.
+ */
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x80000000
 
 /* Features known to this kernel version: */
 #define JBD2_KNOWN_COMPAT_FEATURES	JBD2_FEATURE_COMPAT_CHECKSUM
 #define JBD2_KNOWN_ROCOMPAT_FEATURES	0
 #define JBD2_KNOWN_INCOMPAT_FEATURES	(JBD2_FEATURE_INCOMPAT_REVOKE | \
 					JBD2_FEATURE_INCOMPAT_64BIT | \
-					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)
+					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
+
+/*
+ * s_fc_flags: recovery found the log to end before s_fc_replay_tid, so
+ * the client has fast commits of that transaction to replay.
+ */
+#define JBD2_FC_REPLAY_PENDING		0x00000001
 
 #ifdef __KERNEL__
 
@@ -766,6 +784,12 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_proc_entry: procfs entry for the jbd statistics directory
  * @j_stats: Overall statistics
  * @j_private: An opaque pointer to fs-private information.
+ * @j_fc_first: First block of the fast commit area
+ * @j_fc_last: One beyond the last block of the fast commit area
+ * @j_fc_off: Fast commit blocks used by the running transaction
+ * @j_fc_wait: Wait queue for fast and full commits to wait for each other
+ * @j_fc_cleanup_callback: Called once a full commit made the fast commits of
+ *  a transaction unnecessary
  */
 
 struct journal_s
@@ -1002,6 +1026,20 @@ struct journal_s
 	 * superblock pointer here
 	 */
 	void *j_private;
+
+	/*
+	 * Fast commit area: the last blocks of the journal, kept out of the
+	 * log [j_state_lock].  j_fc_off is only touched by whoever holds
+	 * JBD2_FAST_COMMIT_ONGOING or JBD2_FULL_COMMIT_ONGOING.
+	 */
+	unsigned long		j_fc_first;
+	unsigned long		j_fc_last;
+	unsigned long		j_fc_off;
+
+	wait_queue_head_t	j_fc_wait;
+
+	/* Called at the end of every full commit */
+	void			(*j_fc_cleanup_callback)(journal_t *, tid_t);
 };
 
 /*
@@ -1016,6 +1054,10 @@ struct journal_s
 #define JBD2_ABORT_ON_SYNCDATA_ERR	0x040	/* Abort the journal on file
 						 * data write error in ordered
 						 * mode */
+#define JBD2_FAST_COMMIT_ONGOING	0x080	/* A fast commit is being
+						 * written */
+#define JBD2_FULL_COMMIT_ONGOING	0x100	/* A transaction is being
+						 * committed */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1147,6 +1189,24 @@ extern int	   jbd2_journal_wipe       (journal_t *, int);
 extern int	   jbd2_journal_skip_recovery	(journal_t *);
 extern void	   jbd2_journal_update_superblock	(journal_t *, int);
 extern void	   __jbd2_journal_abort_hard	(journal_t *);
+
+/* Fast commits */
+extern int	   jbd2_fc_init(journal_t *, unsigned int);
+extern int	   jbd2_fc_release(journal_t *);
+extern int	   jbd2_fc_begin_commit(journal_t *, tid_t);
+extern void	   jbd2_fc_end_commit(journal_t *);
+extern int	   jbd2_fc_get_buf(journal_t *, struct buffer_head **);
+extern int	   jbd2_fc_read_buf(journal_t *, unsigned long,
+				    struct buffer_head **);
+extern int	   jbd2_fc_replay_tid(journal_t *, tid_t *);
+extern void	   jbd2_fc_replay_done(journal_t *);
+
+static inline int jbd2_has_fast_commit(journal_t *journal)
+{
+	return JBD2_HAS_INCOMPAT_FEATURE(journal,
+					 JBD2_FEATURE_INCOMPAT_FAST_COMMIT);
+}
+
 extern void	   jbd2_journal_abort      (journal_t *, int);
 extern int	   jbd2_journal_errno      (journal_t *);
 extern void	   jbd2_journal_ack_err    (journal_t *);
@@ -956,6 +956,49 @@ int generic_error_remove_page(struct address_space *mapping, struct page *page);
 
 int invalidate_inode_page(struct page *page);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, unsigned int flags,
+			unsigned long vm_access);
+
+/*
+ * Changes to the vma tree, or to the fields of a linked vma that the fault
+ * path depends on, must be bracketed by these (under mmap_sem for writing)
+ * so that speculative faults racing with them back off.
+ */
+static inline void mm_vma_change_begin(struct mm_struct *mm)
+{
+	write_seqcount_begin(&mm->mmap_seq);
+}
+
+static inline void mm_vma_change_end(struct mm_struct *mm)
+{
+	write_seqcount_end(&mm->mmap_seq);
+}
+
+/*
+ * Wait until no speculative fault can still be looking at a vma or page
+ * table which has been unlinked, before freeing it.
+ */
+static inline void mm_spf_sync(struct mm_struct *mm)
+{
+	write_lock(&mm->spf_lock);
+	write_unlock(&mm->spf_lock);
+}
+#else
+static inline void mm_vma_change_begin(struct mm_struct *mm)
+{
+}
+
+static inline void mm_vma_change_end(struct mm_struct *mm)
+{
+}
+
+static inline void mm_spf_sync(struct mm_struct *mm)
+{
+}
+#endif
+
 #ifdef CONFIG_MMU
 extern int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 			unsigned long address, unsigned int flags);
@@ -142,6 +142,27 @@ extern unsigned long nr_iowait(void);
 extern unsigned long nr_iowait_cpu(int cpu);
 extern unsigned long this_cpu_load(void);
 
+struct nr_running_avg {
+	u64 integral;
+	u64 stamp;
+};
+extern unsigned int sched_get_nr_running_avg(int cpu,
+					     struct nr_running_avg *avg);
+
+#ifdef CONFIG_CPU_FREQ
+/*
+ * Hook called by the scheduler whenever the utilization of a cpu may
+ * have changed; @util / @max is its recent runnable fraction.
+ */
+struct update_util_data {
+	void (*func)(struct update_util_data *data, u64 time,
+		     unsigned long util, unsigned long max);
+};
+
+extern void cpufreq_set_update_util_data(int cpu,
+					 struct update_util_data *data);
+#endif
+
 
 extern void calc_global_load(unsigned long ticks);
 extern void prepare_calc_load(void);
@@ -1167,6 +1188,17 @@ struct sched_statistics {
 };
 #endif
 
+struct sched_avg {
+	/*
+	 * Geometrically decayed runnable time and total time, in units of
+	 * 1024ns, see __update_entity_runnable_avg().
+	 */
+	u32			runnable_avg_sum;
+	u32			runnable_avg_period;
+	u64			last_runnable_update;
+	unsigned long		load_avg_contrib;
+};
+
 struct sched_entity {
 	struct load_weight	load;		/* for load-balancing */
 	struct rb_node		run_node;
@@ -1191,6 +1223,10 @@ struct sched_entity {
 	/* rq "owned" by this entity/group: */
 	struct cfs_rq		*my_q;
 #endif
+
+#ifdef CONFIG_SMP
+	struct sched_avg	avg;
+#endif
 };
 
 struct sched_rt_entity {
@@ -1958,6 +1994,11 @@ extern void sched_exec(void);
 #define sched_exec()   {}
 #endif
 
+#ifdef CONFIG_CPU_PARKING
+extern void sched_park_cpu(int cpu);
+extern void sched_unpark_cpu(int cpu);
+#endif
+
 extern void sched_clock_idle_sleep_event(void);
 extern void sched_clock_idle_wakeup_event(u64 delta_ns);
 
@@ -2015,6 +2056,10 @@ int sched_rt_handler(struct ctl_table *table, int write,
 		void __user *buffer, size_t *lenp,
 		loff_t *ppos);
 
+#ifdef CONFIG_CFS_BANDWIDTH
+extern unsigned int sysctl_sched_cfs_bandwidth_slice;
+#endif
+
 #ifdef CONFIG_SCHED_AUTOGROUP
 extern unsigned int sysctl_sched_autogroup_enabled;
 
@@ -16,6 +16,8 @@
 #include <linux/mutex.h>
 #include <linux/gfp.h>
 #include <linux/suspend.h>
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
 
 #ifdef CONFIG_SMP
 /* Serializes the updates to cpu_online_mask, cpu_present_mask */
@@ -155,6 +157,39 @@ static int cpu_notify(unsigned long val, void *v)
 	return __cpu_notify(val, v, -1, NULL);
 }
 
+#ifdef CONFIG_CPU_PARKING
+static DECLARE_BITMAP(cpu_parked_bits, CONFIG_NR_CPUS) __read_mostly;
+const struct cpumask *const cpu_parked_mask = to_cpumask(cpu_parked_bits);
+EXPORT_SYMBOL(cpu_parked_mask);
+
+static struct cpu_park_stat cpu_park_stats[NR_CPU_PARK_STATS];
+static DEFINE_SPINLOCK(cpu_park_stats_lock);
+
+static void cpu_park_account(int item, ktime_t start)
+{
+	struct cpu_park_stat *stat = &cpu_park_stats[item];
+	u64 delta = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	spin_lock(&cpu_park_stats_lock);
+	stat->count++;
+	stat->total_ns += delta;
+	if (delta > stat->max_ns)
+		stat->max_ns = delta;
+	spin_unlock(&cpu_park_stats_lock);
+}
+
+void cpu_park_get_stat(int item, struct cpu_park_stat *stat)
+{
+	spin_lock(&cpu_park_stats_lock);
+	*stat = cpu_park_stats[item];
+	spin_unlock(&cpu_park_stats_lock);
+}
+#else
+static inline void cpu_park_account(int item, ktime_t start)
+{
+}
+#endif /* CONFIG_CPU_PARKING */
+
 #ifdef CONFIG_HOTPLUG_CPU
 
 static void cpu_notify_nofail(unsigned long val, void *v)
@@ -270,8 +305,99 @@ out_release:
 	return err;
 }
 
+#ifdef CONFIG_CPU_PARKING
+/**
+ * cpu_park - stop using an online cpu without unplugging it
+ * @cpu: cpu to park
+ *
+ * The scheduler stops placing tasks on a parked cpu and stops pulling
+ * work to it, the tasks queued there that may run elsewhere are moved
+ * off and its interrupts are routed to the other cpus.  The cpu is then
+ * left idle, where cpuidle puts it in the deepest state it allows.
+ * Per-cpu kthreads and pinned timers still run there when they have to.
+ *
+ * Unlike cpu_down() nothing is torn down, no notifiers are called and
+ * only the parked cpu itself is preempted, by its stopper thread, rather
+ * than the whole system by stop_machine().
+ */
+int cpu_park(unsigned int cpu)
+{
+	ktime_t start = ktime_get();
+	int err = 0;
+
+	cpu_maps_update_begin();
+
+	if (cpu_hotplug_disabled) {
+		err = -EBUSY;
+		goto out;
+	}
+	if (!cpu_online(cpu)) {
+		err = -EINVAL;
+		goto out;
+	}
+	if (cpu_parked(cpu))
+		goto out;
+	if (num_usable_cpus() == 1) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	/*
+	 * Wakeups racing with this may still queue a task here; the scan
+	 * in sched_park_cpu() or, failing that, load balancing from the
+	 * other cpus moves it.
+	 */
+	cpumask_set_cpu(cpu, to_cpumask(cpu_parked_bits));
+	smp_mb();
+
+	sched_park_cpu(cpu);
+	irq_update_parked(cpumask_of(cpu));
+
+out:
+	cpu_maps_update_done();
+	if (!err)
+		cpu_park_account(CPU_PARK_STAT_PARK, start);
+	return err;
+}
+EXPORT_SYMBOL(cpu_park);
+
+/**
+ * cpu_unpark - put a parked cpu back into use
+ * @cpu: cpu to unpark
+ *
+ * Interrupts whose affinity includes the cpu are pointed at it again;
+ * it picks up tasks through the usual load balancing, which is kicked
+ * right away.
+ */
+int cpu_unpark(unsigned int cpu)
+{
+	ktime_t start = ktime_get();
+	int err = 0;
+
+	cpu_maps_update_begin();
+
+	if (!cpu_parked(cpu)) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	cpumask_clear_cpu(cpu, to_cpumask(cpu_parked_bits));
+	smp_mb();
+	sched_unpark_cpu(cpu);
+	irq_update_parked(cpumask_of(cpu));
+
+out:
+	cpu_maps_update_done();
+	if (!err)
+		cpu_park_account(CPU_PARK_STAT_UNPARK, start);
+	return err;
+}
+EXPORT_SYMBOL(cpu_unpark);
+#endif /* CONFIG_CPU_PARKING */
+
 int __ref cpu_down(unsigned int cpu)
 {
+	ktime_t start = ktime_get();
 	int err;
 
 	cpu_maps_update_begin();
@@ -285,6 +411,8 @@ int __ref cpu_down(unsigned int cpu)
 
 out:
 	cpu_maps_update_done();
+	if (!err)
+		cpu_park_account(CPU_PARK_STAT_DOWN, start);
 	return err;
 }
 EXPORT_SYMBOL(cpu_down);
@@ -328,6 +456,7 @@ out_notify:
 
 int __cpuinit cpu_up(unsigned int cpu)
 {
+	ktime_t start;
 	int err = 0;
 
 #ifdef	CONFIG_MEMORY_HOTPLUG
@@ -367,6 +496,7 @@ int __cpuinit cpu_up(unsigned int cpu)
 	}
 #endif
 
+	start = ktime_get();
 	cpu_maps_update_begin();
 
 	if (cpu_hotplug_disabled) {
@@ -378,6 +508,8 @@ int __cpuinit cpu_up(unsigned int cpu)
 
 out:
 	cpu_maps_update_done();
+	if (!err)
+		cpu_park_account(CPU_PARK_STAT_UP, start);
 	return err;
 }
 
@@ -640,10 +772,15 @@ void set_cpu_present(unsigned int cpu, bool present)
 
 void set_cpu_online(unsigned int cpu, bool online)
 {
-	if (online)
+	if (online) {
 		cpumask_set_cpu(cpu, to_cpumask(cpu_online_bits));
-	else
+	} else {
 		cpumask_clear_cpu(cpu, to_cpumask(cpu_online_bits));
+#ifdef CONFIG_CPU_PARKING
+		/* unplugging a parked cpu unparks it */
+		cpumask_clear_cpu(cpu, to_cpumask(cpu_parked_bits));
+#endif
+	}
 }
 
 void set_cpu_active(unsigned int cpu, bool active)
@@ -335,6 +335,8 @@ static int dup_mmap(struct mm_struct *mm, struct mm_struct *oldmm)
 	struct mempolicy *pol;
 
 	down_write(&oldmm->mmap_sem);
+	/* Faults in oldmm must not race with copy_page_range() */
+	mm_vma_change_begin(oldmm);
 	flush_cache_dup_mm(oldmm);
 	/*
 	 * Not linked in yet - no deadlock potential:
@@ -445,6 +447,7 @@ static int dup_mmap(struct mm_struct *mm, struct mm_struct *oldmm)
 out:
 	up_write(&mm->mmap_sem);
 	flush_tlb_mm(oldmm);
+	mm_vma_change_end(oldmm);
 	up_write(&oldmm->mmap_sem);
 	return retval;
 fail_nomem_anon_vma_fork:
@@ -514,6 +517,10 @@ static struct mm_struct * mm_init(struct mm_struct * mm, struct task_struct *p)
 	mm->nr_ptes = 0;
 	memset(&mm->rss_stat, 0, sizeof(mm->rss_stat));
 	spin_lock_init(&mm->page_table_lock);
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	seqcount_init(&mm->mmap_seq);
+	rwlock_init(&mm->spf_lock);
+#endif
 	mm->free_area_cache = TASK_UNMAPPED_BASE;
 	mm->cached_hole_size = ~0UL;
 	mm_init_aio(mm);
@@ -192,6 +192,53 @@ int irq_set_affinity(unsigned int irq, const struct cpumask *mask)
 	return ret;
 }
 
+#ifdef CONFIG_CPU_PARKING
+/**
+ *	irq_update_parked - steer interrupts around the parked cpus
+ *	@mask:		cpus that have just been parked or unparked
+ *
+ *	Retargets every requested interrupt whose affinity includes cpus
+ *	in @mask to its affinity less the parked cpus, or to any unparked
+ *	online cpu if nothing is left.  The affinity itself, as set by the
+ *	user, is not changed and serves as the saved mask: once its cpus
+ *	are unparked, the interrupt is pointed at all of them again.
+ */
+void irq_update_parked(const struct cpumask *mask)
+{
+	struct irq_desc *desc;
+	cpumask_var_t target;
+	unsigned long flags;
+	unsigned int irq;
+
+	if (!alloc_cpumask_var(&target, GFP_KERNEL))
+		return;
+
+	for_each_irq_desc(irq, desc) {
+		struct irq_data *data = irq_desc_get_irq_data(desc);
+		struct irq_chip *chip = irq_data_get_irq_chip(data);
+
+		raw_spin_lock_irqsave(&desc->lock, flags);
+		if (!desc->action || !irqd_can_balance(data) ||
+		    !chip || !chip->irq_set_affinity ||
+		    !irq_can_move_pcntxt(data) ||
+		    !cpumask_intersects(data->affinity, mask))
+			goto next;
+
+		cpumask_andnot(target, data->affinity, cpu_parked_mask);
+		cpumask_and(target, target, cpu_online_mask);
+		if (cpumask_empty(target))
+			cpumask_andnot(target, cpu_online_mask,
+				       cpu_parked_mask);
+		if (!cpumask_empty(target))
+			chip->irq_set_affinity(data, target, false);
+next:
+		raw_spin_unlock_irqrestore(&desc->lock, flags);
+	}
+
+	free_cpumask_var(target);
+}
+#endif
+
 int irq_set_affinity_hint(unsigned int irq, const struct cpumask *m)
 {
 	unsigned long flags;
@@ -57,6 +57,12 @@ SCHED_FEAT(HRTICK, 0)
 SCHED_FEAT(DOUBLE_TICK, 0)
 SCHED_FEAT(LB_BIAS, 1)
 
+/*
+ * Balance and place wakeups on the decayed per-entity runnable load
+ * rather than on the instantaneous queued weight.
+ */
+SCHED_FEAT(RUNNABLE_AVG_LOAD, 1)
+
 /*
  * Spin-wait on mutex acquisition when the mutex owner is running on
  * another cpu -- assumes that when the owner is running, it will soon
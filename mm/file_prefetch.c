@@ -0,0 +1,696 @@
+/*
+ * mm/file_prefetch.c - record and replay page cache access traces.
+ *
+ * Cold boot and first application launch spend most of their time in
+ * small synchronous reads triggered by page faults on mmapped files.  This
+ * facility records which file ranges had to be read from disk during a
+ * window, lets userspace save that trace, and replays it on later boots as
+ * large sorted readahead batches issued from a kernel thread, so that the
+ * data is already in the page cache by the time it is faulted in.
+ *
+ * Interface (/proc/file_prefetch/):
+ *
+ *   control  write "start [seconds]", "stop" or "clear"
+ *   trace    recorded trace, one "<start> <nr_pages> <path>" line per range
+ *   replay   write a previously saved trace; replay starts on close
+ *   stats    recording and replay statistics and timings
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/hash.h>
+#include <linux/sort.h>
+#include <linux/ctype.h>
+#include <linux/kthread.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/file_prefetch.h>
+#include <asm/uaccess.h>
+
+#define PREFETCH_MAX_RECORDS	32768
+#define PREFETCH_MAX_FILES	4096
+#define PREFETCH_HASH_BITS	8
+#define PREFETCH_MAX_REPLAY	(4 << 20)	/* max size of a replayed trace */
+#define PREFETCH_MERGE_GAP	16		/* pages; smaller holes are read */
+#define PREFETCH_BATCH_PAGES	512		/* 2MB with 4KB pages */
+
+struct prefetch_file {
+	struct hlist_node	hash;
+	struct super_block	*sb;
+	unsigned long		ino;
+	unsigned int		idx;		/* index in prefetch_files */
+	unsigned int		last;		/* index of last record */
+	char			*path;
+};
+
+struct prefetch_record {
+	unsigned int		file;
+	pgoff_t			start;
+	unsigned long		nr;
+};
+
+int file_prefetch_recording __read_mostly;
+
+static DEFINE_MUTEX(prefetch_mutex);
+static struct hlist_head prefetch_hash[1 << PREFETCH_HASH_BITS];
+static struct prefetch_file **prefetch_files;
+static unsigned int prefetch_nr_files;
+static struct prefetch_record *prefetch_records;
+static unsigned int prefetch_nr_records;
+
+static void prefetch_stop_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(prefetch_stop_work, prefetch_stop_fn);
+
+static struct {
+	ktime_t		start;
+	ktime_t		stop;
+	unsigned long	events;		/* readahead misses seen */
+	unsigned long	pages;		/* pages covered by those misses */
+	unsigned long	dropped;	/* misses lost to a full trace */
+} rec_stats;
+
+static struct {
+	int		running;
+	ktime_t		start;
+	ktime_t		stop;
+	unsigned int	files;
+	unsigned int	failed;		/* files that could not be opened */
+	unsigned int	ranges;		/* ranges in the trace */
+	unsigned int	batches;	/* readahead batches after merging */
+	unsigned long	pages;		/* pages requested */
+} replay_stats;
+
+static struct task_struct *prefetch_replay_task;
+
+/*
+ * Recording.
+ */
+
+static struct prefetch_file *prefetch_lookup_file(struct file *filp)
+{
+	struct inode *inode = filp->f_mapping->host;
+	struct hlist_head *head;
+	struct hlist_node *node;
+	struct prefetch_file *pf;
+	char *buf, *p;
+
+	head = &prefetch_hash[hash_long((unsigned long)inode->i_sb ^
+					inode->i_ino, PREFETCH_HASH_BITS)];
+	hlist_for_each_entry(pf, node, head, hash)
+		if (pf->sb == inode->i_sb && pf->ino == inode->i_ino)
+			return pf;
+
+	if (prefetch_nr_files >= PREFETCH_MAX_FILES)
+		return NULL;
+
+	buf = kmalloc(PATH_MAX, GFP_NOFS);
+	if (!buf)
+		return NULL;
+	pf = NULL;
+	p = d_path(&filp->f_path, buf, PATH_MAX);
+	if (IS_ERR(p))
+		goto out_free;
+
+	pf = kmalloc(sizeof(*pf), GFP_NOFS);
+	if (!pf)
+		goto out_free;
+	pf->path = kstrdup(p, GFP_NOFS);
+	if (!pf->path) {
+		kfree(pf);
+		pf = NULL;
+		goto out_free;
+	}
+	pf->sb = inode->i_sb;
+	pf->ino = inode->i_ino;
+	pf->idx = prefetch_nr_files;
+	pf->last = UINT_MAX;
+	hlist_add_head(&pf->hash, head);
+	prefetch_files[prefetch_nr_files++] = pf;
+out_free:
+	kfree(buf);
+	return pf;
+}
+
+/*
+ * Called by readahead for every range of @filp it is about to read from
+ * disk.  Ranges that extend the previous range of the same file are merged
+ * in place, so sequential access costs one record.
+ */
+void __file_prefetch_record(struct file *filp, pgoff_t start,
+			    unsigned long nr_pages)
+{
+	struct prefetch_file *pf;
+	struct prefetch_record *rec;
+	unsigned int idx;
+
+	if (!S_ISREG(filp->f_mapping->host->i_mode))
+		return;
+	if (current == prefetch_replay_task)
+		return;
+
+	mutex_lock(&prefetch_mutex);
+	if (!file_prefetch_recording)
+		goto out;
+
+	rec_stats.events++;
+	rec_stats.pages += nr_pages;
+
+	pf = prefetch_lookup_file(filp);
+	if (!pf) {
+		rec_stats.dropped++;
+		goto out;
+	}
+
+	if (pf->last != UINT_MAX) {
+		rec = &prefetch_records[pf->last];
+		if (start >= rec->start && start <= rec->start + rec->nr) {
+			if (start + nr_pages > rec->start + rec->nr)
+				rec->nr = start + nr_pages - rec->start;
+			goto out;
+		}
+	}
+
+	if (prefetch_nr_records >= PREFETCH_MAX_RECORDS) {
+		rec_stats.dropped++;
+		goto out;
+	}
+
+	idx = prefetch_nr_records++;
+	rec = &prefetch_records[idx];
+	rec->file = pf->idx;
+	rec->start = start;
+	rec->nr = nr_pages;
+	pf->last = idx;
+out:
+	mutex_unlock(&prefetch_mutex);
+}
+
+static void prefetch_free_trace(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < prefetch_nr_files; i++) {
+		kfree(prefetch_files[i]->path);
+		kfree(prefetch_files[i]);
+	}
+	for (i = 0; i < ARRAY_SIZE(prefetch_hash); i++)
+		INIT_HLIST_HEAD(&prefetch_hash[i]);
+	prefetch_nr_files = 0;
+	prefetch_nr_records = 0;
+}
+
+static int prefetch_start(unsigned int seconds)
+{
+	if (file_prefetch_recording)
+		return -EBUSY;
+
+	if (!prefetch_records) {
+		prefetch_records = vmalloc(PREFETCH_MAX_RECORDS *
+					   sizeof(*prefetch_records));
+		prefetch_files = vmalloc(PREFETCH_MAX_FILES *
+					 sizeof(*prefetch_files));
+		if (!prefetch_records || !prefetch_files) {
+			vfree(prefetch_records);
+			vfree(prefetch_files);
+			prefetch_records = NULL;
+			prefetch_files = NULL;
+			return -ENOMEM;
+		}
+	}
+
+	prefetch_free_trace();
+	memset(&rec_stats, 0, sizeof(rec_stats));
+	rec_stats.start = ktime_get();
+	file_prefetch_recording = 1;
+
+	if (seconds)
+		schedule_delayed_work(&prefetch_stop_work, seconds * HZ);
+	return 0;
+}
+
+static void prefetch_stop(void)
+{
+	if (!file_prefetch_recording)
+		return;
+	file_prefetch_recording = 0;
+	rec_stats.stop = ktime_get();
+}
+
+static void prefetch_stop_fn(struct work_struct *work)
+{
+	mutex_lock(&prefetch_mutex);
+	prefetch_stop();
+	mutex_unlock(&prefetch_mutex);
+	pr_info("file_prefetch: recorded %u ranges in %u files\n",
+		prefetch_nr_records, prefetch_nr_files);
+}
+
+static ssize_t prefetch_control_write(struct file *file,
+				      const char __user *ubuf,
+				      size_t count, loff_t *ppos)
+{
+	char buf[32], *cmd;
+	unsigned int seconds = 0;
+	int ret = 0;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+	cmd = strstrip(buf);
+
+	cancel_delayed_work_sync(&prefetch_stop_work);
+
+	mutex_lock(&prefetch_mutex);
+	if (!strncmp(cmd, "start", 5)) {
+		if (cmd[5] && sscanf(cmd + 5, "%u", &seconds) != 1)
+			ret = -EINVAL;
+		else
+			ret = prefetch_start(seconds);
+	} else if (!strcmp(cmd, "stop")) {
+		prefetch_stop();
+	} else if (!strcmp(cmd, "clear")) {
+		prefetch_stop();
+		prefetch_free_trace();
+	} else {
+		ret = -EINVAL;
+	}
+	mutex_unlock(&prefetch_mutex);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations prefetch_control_fops = {
+	.write		= prefetch_control_write,
+	.llseek		= noop_llseek,
+};
+
+static void *prefetch_trace_start(struct seq_file *m, loff_t *pos)
+{
+	mutex_lock(&prefetch_mutex);
+	if (*pos >= prefetch_nr_records)
+		return NULL;
+	return &prefetch_records[*pos];
+}
+
+static void *prefetch_trace_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	(*pos)++;
+	if (*pos >= prefetch_nr_records)
+		return NULL;
+	return &prefetch_records[*pos];
+}
+
+static void prefetch_trace_stop(struct seq_file *m, void *v)
+{
+	mutex_unlock(&prefetch_mutex);
+}
+
+static int prefetch_trace_show(struct seq_file *m, void *v)
+{
+	struct prefetch_record *rec = v;
+
+	seq_printf(m, "%lu %lu ", (unsigned long)rec->start, rec->nr);
+	seq_escape(m, prefetch_files[rec->file]->path, " \t\n\\");
+	seq_putc(m, '\n');
+	return 0;
+}
+
+static const struct seq_operations prefetch_trace_op = {
+	.start	= prefetch_trace_start,
+	.next	= prefetch_trace_next,
+	.stop	= prefetch_trace_stop,
+	.show	= prefetch_trace_show,
+};
+
+static int prefetch_trace_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &prefetch_trace_op);
+}
+
+static const struct file_operations prefetch_trace_fops = {
+	.open		= prefetch_trace_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
+/*
+ * Replay.
+ */
+
+struct prefetch_replay_file {
+	struct hlist_node	hash;
+	const char		*path;
+};
+
+struct prefetch_replay {
+	char				*data;
+	size_t				len;
+	size_t				size;
+	struct prefetch_replay_file	*files;
+	unsigned int			nr_files;
+	struct prefetch_record		*ranges;
+	unsigned int			nr_ranges;
+	struct hlist_head		hash[1 << PREFETCH_HASH_BITS];
+};
+
+static void prefetch_replay_free(struct prefetch_replay *pr)
+{
+	vfree(pr->ranges);
+	vfree(pr->files);
+	vfree(pr->data);
+	kfree(pr);
+}
+
+/* Undo the octal escapes seq_escape() put into the trace. */
+static void prefetch_unescape(char *s)
+{
+	char *d = s;
+
+	while (*s) {
+		if (s[0] == '\\' && s[1] >= '0' && s[1] <= '3' &&
+		    s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+			*d++ = ((s[1] - '0') << 6) | ((s[2] - '0') << 3) |
+				(s[3] - '0');
+			s += 4;
+		} else {
+			*d++ = *s++;
+		}
+	}
+	*d = '\0';
+}
+
+static int prefetch_replay_file_index(struct prefetch_replay *pr,
+				      const char *path)
+{
+	unsigned int len = strlen(path);
+	struct prefetch_replay_file *rf;
+	struct hlist_head *head;
+	struct hlist_node *node;
+
+	head = &pr->hash[hash_long(full_name_hash((const unsigned char *)path,
+						  len),
+				   PREFETCH_HASH_BITS)];
+	hlist_for_each_entry(rf, node, head, hash)
+		if (!strcmp(rf->path, path))
+			return rf - pr->files;
+
+	if (pr->nr_files >= PREFETCH_MAX_FILES)
+		return -ENOSPC;
+	rf = &pr->files[pr->nr_files];
+	rf->path = path;
+	hlist_add_head(&rf->hash, head);
+	return pr->nr_files++;
+}
+
+static int prefetch_range_cmp(const void *a, const void *b)
+{
+	const struct prefetch_record *ra = a, *rb = b;
+
+	if (ra->file != rb->file)
+		return ra->file < rb->file ? -1 : 1;
+	if (ra->start != rb->start)
+		return ra->start < rb->start ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Parse the trace, sort the ranges by file (in first access order) and
+ * offset, and merge ranges that overlap or are separated by small holes
+ * so that the device sees few large reads instead of many small ones.
+ */
+static int prefetch_replay_parse(struct prefetch_replay *pr)
+{
+	struct prefetch_record *rec, *prev;
+	char *cur = pr->data, *line;
+	unsigned long start, nr;
+	unsigned int i, lines = 1;
+	int file, n;
+
+	for (i = 0; i < pr->len; i++)
+		if (pr->data[i] == '\n')
+			lines++;
+
+	pr->ranges = vmalloc(lines * sizeof(*pr->ranges));
+	pr->files = vmalloc(PREFETCH_MAX_FILES * sizeof(*pr->files));
+	if (!pr->ranges || !pr->files)
+		return -ENOMEM;
+	for (i = 0; i < ARRAY_SIZE(pr->hash); i++)
+		INIT_HLIST_HEAD(&pr->hash[i]);
+
+	while ((line = strsep(&cur, "\n")) != NULL) {
+		if (sscanf(line, "%lu %lu %n", &start, &nr, &n) != 2 ||
+		    !nr || !line[n])
+			continue;
+		prefetch_unescape(line + n);
+		file = prefetch_replay_file_index(pr, line + n);
+		if (file < 0)
+			continue;
+		rec = &pr->ranges[pr->nr_ranges++];
+		rec->file = file;
+		rec->start = start;
+		rec->nr = nr;
+	}
+	replay_stats.ranges = pr->nr_ranges;
+	if (!pr->nr_ranges)
+		return -EINVAL;
+
+	sort(pr->ranges, pr->nr_ranges, sizeof(*pr->ranges),
+	     prefetch_range_cmp, NULL);
+
+	prev = pr->ranges;
+	for (i = 1; i < pr->nr_ranges; i++) {
+		rec = &pr->ranges[i];
+		if (rec->file == prev->file &&
+		    rec->start <= prev->start + prev->nr + PREFETCH_MERGE_GAP) {
+			if (rec->start + rec->nr > prev->start + prev->nr)
+				prev->nr = rec->start + rec->nr - prev->start;
+			continue;
+		}
+		*++prev = *rec;
+	}
+	pr->nr_ranges = prev - pr->ranges + 1;
+	return 0;
+}
+
+static int prefetch_replay_thread(void *data)
+{
+	struct prefetch_replay *pr = data;
+	struct file *filp = NULL;
+	unsigned int i, file = UINT_MAX;
+	s64 ms;
+
+	for (i = 0; i < pr->nr_ranges; i++) {
+		struct prefetch_record *rec = &pr->ranges[i];
+		pgoff_t start = rec->start;
+		unsigned long left = rec->nr;
+
+		if (rec->file != file) {
+			if (filp && !IS_ERR(filp))
+				filp_close(filp, NULL);
+			file = rec->file;
+			filp = filp_open(pr->files[file].path,
+					 O_RDONLY | O_LARGEFILE, 0);
+			if (IS_ERR(filp))
+				replay_stats.failed++;
+			else
+				replay_stats.files++;
+		}
+		if (IS_ERR(filp))
+			continue;
+
+		while (left) {
+			unsigned long chunk = min_t(unsigned long, left,
+						    PREFETCH_BATCH_PAGES);
+
+			force_page_cache_readahead(filp->f_mapping, filp,
+						   start, chunk);
+			replay_stats.batches++;
+			replay_stats.pages += chunk;
+			start += chunk;
+			left -= chunk;
+		}
+	}
+	if (filp && !IS_ERR(filp))
+		filp_close(filp, NULL);
+
+	mutex_lock(&prefetch_mutex);
+	replay_stats.stop = ktime_get();
+	replay_stats.running = 0;
+	prefetch_replay_task = NULL;
+	mutex_unlock(&prefetch_mutex);
+
+	ms = ktime_to_ms(ktime_sub(replay_stats.stop, replay_stats.start));
+	pr_info("file_prefetch: replayed %lu pages from %u files in %lld ms "
+		"(%u files missing)\n", replay_stats.pages, replay_stats.files,
+		ms, replay_stats.failed);
+
+	prefetch_replay_free(pr);
+	return 0;
+}
+
+static int prefetch_replay_open(struct inode *inode, struct file *file)
+{
+	struct prefetch_replay *pr;
+
+	if ((file->f_flags & O_ACCMODE) != O_WRONLY)
+		return -EINVAL;
+	if (replay_stats.running)
+		return -EBUSY;
+
+	pr = kzalloc(sizeof(*pr), GFP_KERNEL);
+	if (!pr)
+		return -ENOMEM;
+	file->private_data = pr;
+	return 0;
+}
+
+static ssize_t prefetch_replay_write(struct file *file,
+				     const char __user *ubuf,
+				     size_t count, loff_t *ppos)
+{
+	struct prefetch_replay *pr = file->private_data;
+
+	if (pr->len + count > PREFETCH_MAX_REPLAY)
+		return -EFBIG;
+
+	if (pr->len + count >= pr->size) {
+		size_t size = max_t(size_t, pr->size * 2, 64 << 10);
+		char *data;
+
+		while (size <= pr->len + count)
+			size *= 2;
+		data = vmalloc(size);
+		if (!data)
+			return -ENOMEM;
+		if (pr->data) {
+			memcpy(data, pr->data, pr->len);
+			vfree(pr->data);
+		}
+		pr->data = data;
+		pr->size = size;
+	}
+
+	if (copy_from_user(pr->data + pr->len, ubuf, count))
+		return -EFAULT;
+	pr->len += count;
+	return count;
+}
+
+static int prefetch_replay_release(struct inode *inode, struct file *file)
+{
+	struct prefetch_replay *pr = file->private_data;
+	struct task_struct *task;
+	int ret;
+
+	if (!pr->len) {
+		prefetch_replay_free(pr);
+		return 0;
+	}
+	pr->data[pr->len] = '\0';
+
+	mutex_lock(&prefetch_mutex);
+	if (replay_stats.running) {
+		mutex_unlock(&prefetch_mutex);
+		prefetch_replay_free(pr);
+		return -EBUSY;
+	}
+	memset(&replay_stats, 0, sizeof(replay_stats));
+	replay_stats.running = 1;
+	replay_stats.start = ktime_get();
+	mutex_unlock(&prefetch_mutex);
+
+	ret = prefetch_replay_parse(pr);
+	if (!ret) {
+		task = kthread_create(prefetch_replay_thread, pr, "kprefetchd");
+		if (IS_ERR(task)) {
+			ret = PTR_ERR(task);
+		} else {
+			prefetch_replay_task = task;
+			wake_up_process(task);
+			return 0;
+		}
+	}
+
+	mutex_lock(&prefetch_mutex);
+	replay_stats.running = 0;
+	mutex_unlock(&prefetch_mutex);
+	prefetch_replay_free(pr);
+	return ret;
+}
+
+static const struct file_operations prefetch_replay_fops = {
+	.open		= prefetch_replay_open,
+	.write		= prefetch_replay_write,
+	.release	= prefetch_replay_release,
+	.llseek		= noop_llseek,
+};
+
+static int prefetch_stats_show(struct seq_file *m, void *v)
+{
+	ktime_t stop;
+
+	mutex_lock(&prefetch_mutex);
+	stop = file_prefetch_recording ? ktime_get() : rec_stats.stop;
+	seq_printf(m, "recording      %d\n", file_prefetch_recording);
+	seq_printf(m, "record_ms      %lld\n",
+		   ktime_to_ms(ktime_sub(stop, rec_stats.start)));
+	seq_printf(m, "record_misses  %lu\n", rec_stats.events);
+	seq_printf(m, "record_pages   %lu\n", rec_stats.pages);
+	seq_printf(m, "record_files   %u\n", prefetch_nr_files);
+	seq_printf(m, "record_ranges  %u\n", prefetch_nr_records);
+	seq_printf(m, "record_dropped %lu\n", rec_stats.dropped);
+
+	stop = replay_stats.running ? ktime_get() : replay_stats.stop;
+	seq_printf(m, "replaying      %d\n", replay_stats.running);
+	seq_printf(m, "replay_ms      %lld\n",
+		   ktime_to_ms(ktime_sub(stop, replay_stats.start)));
+	seq_printf(m, "replay_files   %u\n", replay_stats.files);
+	seq_printf(m, "replay_missing %u\n", replay_stats.failed);
+	seq_printf(m, "replay_ranges  %u\n", replay_stats.ranges);
+	seq_printf(m, "replay_batches %u\n", replay_stats.batches);
+	seq_printf(m, "replay_pages   %lu\n", replay_stats.pages);
+	mutex_unlock(&prefetch_mutex);
+	return 0;
+}
+
+static int prefetch_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, prefetch_stats_show, NULL);
+}
+
+static const struct file_operations prefetch_stats_fops = {
+	.open		= prefetch_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init file_prefetch_init(void)
+{
+	struct proc_dir_entry *dir;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(prefetch_hash); i++)
+		INIT_HLIST_HEAD(&prefetch_hash[i]);
+
+	dir = proc_mkdir("file_prefetch", NULL);
+	if (!dir)
+		return -ENOMEM;
+	proc_create("control", S_IWUSR, dir, &prefetch_control_fops);
+	proc_create("trace", S_IRUSR, dir, &prefetch_trace_fops);
+	proc_create("replay", S_IWUSR, dir, &prefetch_replay_fops);
+	proc_create("stats", S_IRUGO, dir, &prefetch_stats_fops);
+	return 0;
+}
+module_init(file_prefetch_init);
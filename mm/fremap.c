@@ -213,7 +213,9 @@ SYSCALL_DEFINE5(remap_file_pages, unsigned long, start, unsigned long, size,
 		}
 		mutex_lock(&mapping->i_mmap_mutex);
 		flush_dcache_mmap_lock(mapping);
+		mm_vma_change_begin(mm);
 		vma->vm_flags |= VM_NONLINEAR;
+		mm_vma_change_end(mm);
 		vma_prio_tree_remove(vma, &mapping->i_mmap);
 		vma_nonlinear_insert(vma, &mapping->i_mmap_nonlinear);
 		flush_dcache_mmap_unlock(mapping);
@@ -225,8 +227,17 @@ SYSCALL_DEFINE5(remap_file_pages, unsigned long, start, unsigned long, size,
 		 * drop PG_Mlocked flag for over-mapped range
 		 */
 		vm_flags_t saved_flags = vma->vm_flags;
+
+		if (!has_write_lock) {
+			up_read(&mm->mmap_sem);
+			down_write(&mm->mmap_sem);
+			has_write_lock = 1;
+			goto retry;
+		}
 		munlock_vma_pages_range(vma, start, start + size);
+		mm_vma_change_begin(mm);
 		vma->vm_flags = saved_flags;
+		mm_vma_change_end(mm);
 	}
 
 	mmu_notifier_invalidate_range_start(mm, start, start + size);
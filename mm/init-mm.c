@@ -20,6 +20,10 @@ struct mm_struct init_mm = {
 	.mm_count	= ATOMIC_INIT(1),
 	.mmap_sem	= __RWSEM_INITIALIZER(init_mm.mmap_sem),
 	.page_table_lock =  __SPIN_LOCK_UNLOCKED(init_mm.page_table_lock),
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	.mmap_seq	= SEQCNT_ZERO,
+	.spf_lock	= __RW_LOCK_UNLOCKED(init_mm.spf_lock),
+#endif
 	.mmlist		= LIST_HEAD_INIT(init_mm.mmlist),
 	INIT_MM_CONTEXT(init_mm)
 };
@@ -189,6 +189,31 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* The number of pages ksmd has scanned */
+static unsigned long ksm_pages_scanned;
+
+/* The number of pages ksmd has merged, each saving one page */
+static unsigned long ksm_pages_merged;
+
+/* CPU time ksmd has spent scanning, in nanoseconds */
+static u64 ksm_scan_time_ns;
+
+/*
+ * The scan rate advisor: when enabled, ksmd adapts pages_to_scan to
+ * whether its batches merge pages, and stretches its sleep so that it
+ * never uses more than advisor_max_cpu percent of one CPU.  The tunables
+ * are written under ksm_thread_mutex, which ksmd holds while tuning.
+ */
+#define KSM_ADVISOR_NONE	0
+#define KSM_ADVISOR_SCAN_RATE	1
+static unsigned int ksm_advisor = KSM_ADVISOR_NONE;
+static unsigned int ksm_advisor_max_cpu = 10;
+static unsigned int ksm_advisor_min_pages = 100;
+static unsigned int ksm_advisor_max_pages = 4000;
+
+/* Sleep chosen by the advisor, never less than ksm_thread_sleep_millisecs */
+static unsigned int ksm_advisor_sleep_millisecs;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -1188,6 +1213,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			 * The page was successfully merged:
 			 * add its rmap_item to the stable tree.
 			 */
+			ksm_pages_merged++;
 			lock_page(kpage);
 			stable_tree_append(rmap_item, page_stable_node(kpage));
 			unlock_page(kpage);
@@ -1227,6 +1253,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			if (stable_node) {
 				stable_tree_append(tree_rmap_item, stable_node);
 				stable_tree_append(rmap_item, stable_node);
+				ksm_pages_merged++;
 			}
 			unlock_page(kpage);
 
@@ -1417,12 +1444,47 @@ static void ksm_do_scan(unsigned int scan_npages)
 		rmap_item = scan_get_next_rmap_item(&page);
 		if (!rmap_item)
 			return;
+		ksm_pages_scanned++;
 		if (!PageKsm(page) || !in_stable_tree(rmap_item))
 			cmp_and_merge_page(page, rmap_item);
 		put_page(page);
 	}
 }
 
+/**
+ * ksm_advisor_tune - adapt the scan rate after a batch
+ * @scanned: pages scanned by the batch
+ * @merged: pages merged by the batch
+ * @cpu_ns: CPU time the batch took
+ *
+ * Batches that merge pages double pages_to_scan, unproductive ones shrink
+ * it by a quarter, within advisor_min_pages_to_scan..max_pages_to_scan.
+ * The sleep is then chosen so that a batch of this cost stays within
+ * advisor_max_cpu percent of one CPU.  Called with ksm_thread_mutex held.
+ */
+static void ksm_advisor_tune(unsigned long scanned, unsigned long merged,
+			     u64 cpu_ns)
+{
+	unsigned int pages;
+	u64 sleep_ms;
+
+	if (!scanned)
+		return;
+
+	pages = clamp(ksm_thread_pages_to_scan, ksm_advisor_min_pages,
+		      ksm_advisor_max_pages);
+	if (merged)
+		pages = min(pages, ksm_advisor_max_pages / 2) * 2;
+	else
+		pages -= pages / 4;
+	ksm_thread_pages_to_scan = max(pages, ksm_advisor_min_pages);
+
+	sleep_ms = cpu_ns * (100 - ksm_advisor_max_cpu);
+	do_div(sleep_ms, ksm_advisor_max_cpu * NSEC_PER_MSEC);
+	ksm_advisor_sleep_millisecs = max_t(u64, sleep_ms,
+					    ksm_thread_sleep_millisecs);
+}
+
 static int ksmd_should_run(void)
 {
 	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
@@ -1430,20 +1492,40 @@ static int ksmd_should_run(void)
 
 static int ksm_scan_thread(void *nothing)
 {
+	unsigned long scanned, merged;
+	unsigned int sleep_ms;
+	u64 runtime;
+
 	set_freezable();
 	set_user_nice(current, 5);
 
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
+		if (ksmd_should_run()) {
+			scanned = ksm_pages_scanned;
+			merged = ksm_pages_merged;
+			runtime = task_sched_runtime(current);
+
 			ksm_do_scan(ksm_thread_pages_to_scan);
+
+			runtime = task_sched_runtime(current) - runtime;
+			ksm_scan_time_ns += runtime;
+			if (ksm_advisor == KSM_ADVISOR_SCAN_RATE)
+				ksm_advisor_tune(ksm_pages_scanned - scanned,
+						 ksm_pages_merged - merged,
+						 runtime);
+		}
+		if (ksm_advisor == KSM_ADVISOR_SCAN_RATE)
+			sleep_ms = ksm_advisor_sleep_millisecs;
+		else
+			sleep_ms = ksm_thread_sleep_millisecs;
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
 
 		if (ksmd_should_run()) {
 			schedule_timeout_interruptible(
-				msecs_to_jiffies(ksm_thread_sleep_millisecs));
+				msecs_to_jiffies(sleep_ms));
 		} else {
 			wait_event_freezable(ksm_thread_wait,
 				ksmd_should_run() || kthread_should_stop());
@@ -1452,6 +1534,23 @@ static int ksm_scan_thread(void *nothing)
 	return 0;
 }
 
+/*
+ * Move @mm, already known to ksmd, just ahead of the scanning cursor, so
+ * that an area newly advised mergeable is scanned in the next batches
+ * instead of waiting for the rest of the current pass.  An mm entering
+ * ksm is left where __ksm_enter() put it, to settle down first.
+ */
+static void ksm_prioritize_mm(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+
+	spin_lock(&ksm_mmlist_lock);
+	mm_slot = get_mm_slot(mm);
+	if (mm_slot && mm_slot != ksm_scan.mm_slot)
+		list_move(&mm_slot->mm_list, &ksm_scan.mm_slot->mm_list);
+	spin_unlock(&ksm_mmlist_lock);
+}
+
 int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		unsigned long end, int advice, unsigned long *vm_flags)
 {
@@ -1473,7 +1572,8 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 			err = __ksm_enter(mm);
 			if (err)
 				return err;
-		}
+		} else
+			ksm_prioritize_mm(mm);
 
 		*vm_flags |= VM_MERGEABLE;
 		break;
@@ -1966,6 +2066,151 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_scanned_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_scanned);
+}
+KSM_ATTR_RO(pages_scanned);
+
+static ssize_t pages_merged_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_merged);
+}
+KSM_ATTR_RO(pages_merged);
+
+static ssize_t scan_time_ms_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	u64 ms = ksm_scan_time_ns;
+
+	do_div(ms, NSEC_PER_MSEC);
+	return sprintf(buf, "%llu\n", (unsigned long long)ms);
+}
+KSM_ATTR_RO(scan_time_ms);
+
+static ssize_t cpu_ns_per_merge_show(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
+{
+	u64 ns = ksm_scan_time_ns;
+
+	if (!ksm_pages_merged)
+		return sprintf(buf, "0\n");
+	do_div(ns, ksm_pages_merged);
+	return sprintf(buf, "%llu\n", (unsigned long long)ns);
+}
+KSM_ATTR_RO(cpu_ns_per_merge);
+
+static ssize_t advisor_mode_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_advisor);
+}
+
+static ssize_t advisor_mode_store(struct kobject *kobj,
+				  struct kobj_attribute *attr,
+				  const char *buf, size_t count)
+{
+	unsigned long mode;
+	int err;
+
+	err = strict_strtoul(buf, 10, &mode);
+	if (err || mode > KSM_ADVISOR_SCAN_RATE)
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	ksm_advisor = mode;
+	ksm_advisor_sleep_millisecs = ksm_thread_sleep_millisecs;
+	mutex_unlock(&ksm_thread_mutex);
+
+	return count;
+}
+KSM_ATTR(advisor_mode);
+
+static ssize_t advisor_max_cpu_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_advisor_max_cpu);
+}
+
+static ssize_t advisor_max_cpu_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	unsigned long percent;
+	int err;
+
+	err = strict_strtoul(buf, 10, &percent);
+	if (err || !percent || percent > 100)
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	ksm_advisor_max_cpu = percent;
+	mutex_unlock(&ksm_thread_mutex);
+
+	return count;
+}
+KSM_ATTR(advisor_max_cpu);
+
+static ssize_t advisor_min_pages_to_scan_show(struct kobject *kobj,
+					      struct kobj_attribute *attr,
+					      char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_advisor_min_pages);
+}
+
+static ssize_t advisor_min_pages_to_scan_store(struct kobject *kobj,
+					       struct kobj_attribute *attr,
+					       const char *buf, size_t count)
+{
+	unsigned long nr_pages;
+	int err;
+
+	err = strict_strtoul(buf, 10, &nr_pages);
+	if (err || !nr_pages)
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	if (nr_pages > ksm_advisor_max_pages)
+		count = -EINVAL;
+	else
+		ksm_advisor_min_pages = nr_pages;
+	mutex_unlock(&ksm_thread_mutex);
+
+	return count;
+}
+KSM_ATTR(advisor_min_pages_to_scan);
+
+static ssize_t advisor_max_pages_to_scan_show(struct kobject *kobj,
+					      struct kobj_attribute *attr,
+					      char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_advisor_max_pages);
+}
+
+static ssize_t advisor_max_pages_to_scan_store(struct kobject *kobj,
+					       struct kobj_attribute *attr,
+					       const char *buf, size_t count)
+{
+	unsigned long nr_pages;
+	int err;
+
+	err = strict_strtoul(buf, 10, &nr_pages);
+	if (err || nr_pages > UINT_MAX)
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	if (nr_pages < ksm_advisor_min_pages)
+		count = -EINVAL;
+	else
+		ksm_advisor_max_pages = nr_pages;
+	mutex_unlock(&ksm_thread_mutex);
+
+	return count;
+}
+KSM_ATTR(advisor_max_pages_to_scan);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -1975,6 +2220,14 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&pages_scanned_attr.attr,
+	&pages_merged_attr.attr,
+	&scan_time_ms_attr.attr,
+	&cpu_ns_per_merge_attr.attr,
+	&advisor_mode_attr.attr,
+	&advisor_max_cpu_attr.attr,
+	&advisor_min_pages_to_scan_attr.attr,
+	&advisor_max_pages_to_scan_attr.attr,
 	NULL,
 };
 
@@ -111,7 +111,9 @@ success:
 	/*
 	 * vm_flags is protected by the mmap_sem held in write mode.
 	 */
+	mm_vma_change_begin(mm);
 	vma->vm_flags = new_flags;
+	mm_vma_change_end(mm);
 
 out:
 	if (error == -ENOMEM)
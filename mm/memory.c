@@ -57,6 +57,7 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/file.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -424,6 +425,7 @@ static void free_pte_range(struct mmu_gather *tlb, pmd_t *pmd,
 {
 	pgtable_t token = pmd_pgtable(*pmd);
 	pmd_clear(pmd);
+	mm_spf_sync(tlb->mm);
 	pte_free_tlb(tlb, token, addr);
 	tlb->mm->nr_ptes--;
 }
@@ -3502,6 +3504,288 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative page faults.
+ *
+ * A fault on an anonymous or page cache backed area can usually be handled
+ * without mmap_sem: the vma is looked up and copied under mm->spf_lock,
+ * which keeps unlinked vmas and page tables from being freed under us, and
+ * the result is only committed if mm->mmap_seq is unchanged when checked
+ * under the pte lock.  Anything unusual backs off with VM_FAULT_RETRY and
+ * the caller retries the fault the normal way, with mmap_sem held.
+ */
+
+#define SPF_MAX_DEPTH	64	/* an rbtree this deep is being rebalanced */
+
+/*
+ * Look up the vma containing @addr.  Unlike find_vma() this does not
+ * update mm->mmap_cache, which would let a stale vma leak into the locked
+ * paths.  The tree may be changing under us: the walk is bounded, and the
+ * caller validates the result against mm->mmap_seq.
+ */
+static struct vm_area_struct *spf_find_vma(struct mm_struct *mm,
+					   unsigned long addr)
+{
+	struct rb_node *rb_node = ACCESS_ONCE(mm->mm_rb.rb_node);
+	int depth = 0;
+
+	while (rb_node && depth++ < SPF_MAX_DEPTH) {
+		struct vm_area_struct *vma;
+
+		vma = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (vma->vm_end > addr) {
+			if (vma->vm_start <= addr)
+				return vma;
+			rb_node = ACCESS_ONCE(rb_node->rb_left);
+		} else {
+			rb_node = ACCESS_ONCE(rb_node->rb_right);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Map and lock the pte for @address without allocating page tables.
+ * Called under mm->spf_lock, which keeps the page table page alive even
+ * if it is being freed; the pmd is read once so that a concurrent
+ * pmd_clear() cannot make us lock the wrong page.
+ */
+static pte_t *spf_pte_map_lock(struct mm_struct *mm, unsigned long address,
+			       spinlock_t **ptlp)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, pmdval;
+	pte_t *pte;
+
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		return NULL;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		return NULL;
+	pmd = pmd_offset(pud, address);
+	pmdval = *pmd;
+	barrier();
+	if (pmd_none(pmdval) || unlikely(pmd_bad(pmdval)) ||
+	    pmd_trans_huge(pmdval))
+		return NULL;
+
+	*ptlp = pte_lockptr(mm, &pmdval);
+	pte = pte_offset_map(&pmdval, address);
+	spin_lock(*ptlp);
+	if (unlikely(pmd_val(*pmd) != pmd_val(pmdval))) {
+		pte_unmap_unlock(pte, *ptlp);
+		return NULL;
+	}
+	return pte;
+}
+
+/**
+ * handle_speculative_fault - try to handle a fault without mmap_sem
+ * @mm:		faulting mm, current->mm
+ * @address:	page aligned faulting address
+ * @flags:	FAULT_FLAG_WRITE for write faults
+ * @vm_access:	the vma must have at least one of these VM_ flags
+ *
+ * Returns VM_FAULT_RETRY if the fault must be retried with mmap_sem held,
+ * otherwise the fault has been handled.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags, unsigned long vm_access)
+{
+	struct vm_area_struct *vma, vmc;
+	struct file *file = NULL;
+	struct page *page = NULL;
+	struct vm_fault vmf;
+	spinlock_t *ptl;
+	pte_t *pte, entry;
+	unsigned int seq;
+	int write = flags & FAULT_FLAG_WRITE;
+	int ret = 0;
+
+	count_vm_event(SPF_ATTEMPT);
+
+	seq = ACCESS_ONCE(mm->mmap_seq.sequence);
+	smp_rmb();
+	if (seq & 1)
+		goto abort;
+
+	read_lock(&mm->spf_lock);
+	vma = spf_find_vma(mm, address);
+	if (!vma) {
+		read_unlock(&mm->spf_lock);
+		goto abort;
+	}
+	vmc = *vma;
+	if (read_seqcount_retry(&mm->mmap_seq, seq) ||
+	    !(vmc.vm_flags & vm_access) ||
+	    (vmc.vm_flags & (VM_GROWSDOWN | VM_GROWSUP | VM_HUGETLB |
+			     VM_NONLINEAR | VM_PFNMAP | VM_MIXEDMAP |
+			     VM_INSERTPAGE))) {
+		read_unlock(&mm->spf_lock);
+		goto abort;
+	}
+	if (vmc.vm_ops || vmc.vm_file) {
+		/*
+		 * Only read faults on ordinary page cache backed areas:
+		 * write faults may need ->page_mkwrite or a COW anon_vma.
+		 */
+		if (write || !vmc.vm_file || !vmc.vm_ops ||
+		    vmc.vm_ops->fault != filemap_fault) {
+			read_unlock(&mm->spf_lock);
+			goto abort;
+		}
+		file = vmc.vm_file;
+		get_file(file);
+	} else if (write && !vmc.anon_vma) {
+		read_unlock(&mm->spf_lock);
+		goto abort;
+	}
+
+	pte = spf_pte_map_lock(mm, address, &ptl);
+	if (!pte) {
+		read_unlock(&mm->spf_lock);
+		goto abort;
+	}
+	if (read_seqcount_retry(&mm->mmap_seq, seq))
+		goto unlock_abort;
+
+	entry = *pte;
+	if (pte_present(entry)) {
+		/* Only the young/dirty bits need updating, as handle_pte_fault */
+		if (write && !pte_write(entry))
+			goto unlock_abort;
+		if (write)
+			entry = pte_mkdirty(entry);
+		entry = pte_mkyoung(entry);
+		if (ptep_set_access_flags(&vmc, address, pte, entry, write))
+			update_mmu_cache(&vmc, address, pte);
+		else if (write)
+			flush_tlb_fix_spurious_fault(&vmc, address);
+		goto unlock;
+	}
+	if (!pte_none(entry))
+		goto unlock_abort;
+
+	if (!file && !write) {
+		/* Use the zero-page for reads, as do_anonymous_page */
+		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
+					      vmc.vm_page_prot));
+		set_pte_at(mm, address, pte, entry);
+		update_mmu_cache(&vmc, address, pte);
+		goto unlock;
+	}
+
+	/* We need a page: drop the locks while we allocate or read it. */
+	pte_unmap_unlock(pte, ptl);
+	read_unlock(&mm->spf_lock);
+
+	if (!file) {
+		page = alloc_page(GFP_HIGHUSER_MOVABLE);
+		if (!page)
+			goto abort;
+		clear_user_highpage(page, address);
+		__SetPageUptodate(page);
+		if (mem_cgroup_newpage_charge(page, mm, GFP_KERNEL)) {
+			page_cache_release(page);
+			page = NULL;
+			goto abort;
+		}
+	} else {
+		vmf.virtual_address = (void __user *)address;
+		vmf.pgoff = linear_page_index(&vmc, address);
+		vmf.flags = flags;
+		vmf.page = NULL;
+
+		ret = filemap_fault(&vmc, &vmf);
+		if (unlikely(ret & (VM_FAULT_ERROR | VM_FAULT_NOPAGE |
+				    VM_FAULT_RETRY)))
+			goto abort;
+		page = vmf.page;
+		if (unlikely(!(ret & VM_FAULT_LOCKED)))
+			lock_page(page);
+		if (unlikely(PageHWPoison(page)))
+			goto abort;
+		ret &= VM_FAULT_MAJOR;
+	}
+
+	read_lock(&mm->spf_lock);
+	pte = spf_pte_map_lock(mm, address, &ptl);
+	if (!pte) {
+		read_unlock(&mm->spf_lock);
+		goto abort;
+	}
+	if (read_seqcount_retry(&mm->mmap_seq, seq))
+		goto unlock_abort;
+	if (!pte_none(*pte)) {
+		/* Another thread got there first; nothing left to do. */
+		pte_unmap_unlock(pte, ptl);
+		read_unlock(&mm->spf_lock);
+		if (file)
+			unlock_page(page);
+		else
+			mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+		goto put_file;
+	}
+
+	if (!file) {
+		entry = mk_pte(page, vmc.vm_page_prot);
+		if (vmc.vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+		inc_mm_counter_fast(mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, &vmc, address);
+	} else {
+		flush_icache_page(&vmc, page);
+		entry = mk_pte(page, vmc.vm_page_prot);
+		inc_mm_counter_fast(mm, MM_FILEPAGES);
+		page_add_file_rmap(page);
+	}
+	set_pte_at(mm, address, pte, entry);
+	update_mmu_cache(&vmc, address, pte);
+	pte_unmap_unlock(pte, ptl);
+	read_unlock(&mm->spf_lock);
+
+	/* The page table now holds the reference we had on the page. */
+	if (file) {
+		unlock_page(page);
+		fput(file);
+	}
+	goto done;
+
+unlock:
+	pte_unmap_unlock(pte, ptl);
+	read_unlock(&mm->spf_lock);
+put_file:
+	if (file)
+		fput(file);
+done:
+	count_vm_event(PGFAULT);
+	mem_cgroup_count_vm_event(mm, PGFAULT);
+	check_sync_rss_stat(current);
+	return ret;
+
+unlock_abort:
+	pte_unmap_unlock(pte, ptl);
+	read_unlock(&mm->spf_lock);
+abort:
+	count_vm_event(SPF_ABORT);
+	if (page) {
+		if (file) {
+			unlock_page(page);
+		} else {
+			mem_cgroup_uncharge_page(page);
+		}
+		page_cache_release(page);
+	}
+	if (file)
+		fput(file);
+	return VM_FAULT_RETRY;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -240,7 +240,9 @@ long mlock_vma_pages_range(struct vm_area_struct *vma,
 	make_pages_present(start, end);
 
 no_mlock:
+	mm_vma_change_begin(vma->vm_mm);
 	vma->vm_flags &= ~VM_LOCKED;	/* and don't come back! */
+	mm_vma_change_end(vma->vm_mm);
 	return nr_pages;		/* error or pages NOT mlocked */
 }
 
@@ -268,7 +270,9 @@ void munlock_vma_pages_range(struct vm_area_struct *vma,
 	unsigned long addr;
 
 	lru_add_drain();
+	mm_vma_change_begin(vma->vm_mm);
 	vma->vm_flags &= ~VM_LOCKED;
+	mm_vma_change_end(vma->vm_mm);
 
 	for (addr = start; addr < end; addr += PAGE_SIZE) {
 		struct page *page;
@@ -354,9 +358,11 @@ success:
 	 * set VM_LOCKED, __mlock_vma_pages_range will bring it back.
 	 */
 
-	if (lock)
+	if (lock) {
+		mm_vma_change_begin(mm);
 		vma->vm_flags = newflags;
-	else
+		mm_vma_change_end(mm);
+	} else
 		munlock_vma_pages_range(vma, start, end);
 
 out:
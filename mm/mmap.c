@@ -236,6 +236,7 @@ static struct vm_area_struct *remove_vma(struct vm_area_struct *vma)
 	struct vm_area_struct *next = vma->vm_next;
 
 	might_sleep();
+	mm_spf_sync(vma->vm_mm);
 	if (vma->vm_ops && vma->vm_ops->close)
 		vma->vm_ops->close(vma);
 	if (vma->vm_file) {
@@ -448,7 +449,9 @@ static void vma_link(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (mapping)
 		mutex_lock(&mapping->i_mmap_mutex);
 
+	mm_vma_change_begin(mm);
 	__vma_link(mm, vma, prev, rb_link, rb_parent);
+	mm_vma_change_end(mm);
 	__vma_link_file(vma);
 
 	if (mapping)
@@ -587,6 +590,7 @@ again:			remove_next = 1 + (end > next->vm_end);
 			vma_prio_tree_remove(next, root);
 	}
 
+	mm_vma_change_begin(mm);
 	vma->vm_start = start;
 	vma->vm_end = end;
 	vma->vm_pgoff = pgoff;
@@ -618,6 +622,7 @@ again:			remove_next = 1 + (end > next->vm_end);
 		 */
 		__insert_vm_struct(mm, insert);
 	}
+	mm_vma_change_end(mm);
 
 	if (anon_vma)
 		anon_vma_unlock(anon_vma);
@@ -625,6 +630,7 @@ again:			remove_next = 1 + (end > next->vm_end);
 		mutex_unlock(&mapping->i_mmap_mutex);
 
 	if (remove_next) {
+		mm_spf_sync(mm);
 		if (file) {
 			fput(file);
 			if (next->vm_flags & VM_EXECUTABLE)
@@ -1910,6 +1916,7 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 	struct vm_area_struct *tail_vma = NULL;
 	unsigned long addr;
 
+	mm_vma_change_begin(mm);
 	insertion_point = (prev ? &prev->vm_next : &mm->mmap);
 	vma->vm_prev = NULL;
 	do {
@@ -1928,6 +1935,7 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 		addr = vma ?  vma->vm_start : mm->mmap_base;
 	mm->unmap_area(mm, addr);
 	mm->mmap_cache = NULL;		/* Kill the cache. */
+	mm_vma_change_end(mm);
 }
 
 /*